@@ -830,9 +830,68 @@ config.NSFS_BUF_POOL_MEM_LIMIT_XL = config.NSFS_WANTED_BUFFERS_NUMBER * config.N
 // XL buffers not used in the last interval will be released back to the system (0 means disable)
 config.NSFS_BUF_POOL_XL_RELEASE_UNUSED_INTERVAL = 0;
 
+// carve the direct IO buffers of the pools from a native slab of mmap regions instead of posix_memalign,
+// released buffers return to the slab right away instead of waiting for the GC to free them.
+config.NSFS_DIO_SLAB_ENABLED = false;
+// bytes mapped by the slab, allocations beyond it fall back to posix_memalign (0 means unlimited)
+config.NSFS_DIO_SLAB_MAX_BYTES = config.NSFS_BUF_POOL_MEM_LIMIT_XS + config.NSFS_BUF_POOL_MEM_LIMIT_S +
+    config.NSFS_BUF_POOL_MEM_LIMIT_M + config.NSFS_BUF_POOL_MEM_LIMIT_L;
+// free buffers each native thread keeps per size class before returning them to the shared lists
+config.NSFS_DIO_SLAB_THREAD_CACHE = 8;
+// back slab regions with hugepages (reserved if available, otherwise transparent hugepages)
+config.NSFS_DIO_SLAB_HUGEPAGES = false;
+
+// initial size of the per-thread buffer used to read xattr values with a single syscall (grows up to 64KB)
+config.NSFS_XATTR_BUF_SIZE = 4 * 1024;
+// return stat xattr from native as one packed buffer that is decoded only when stat.xattr is accessed
+config.NSFS_XATTR_PACKED = false;
+// return native stat results as a Float64Array with accessors instead of objects with all the fields,
+// which avoids creating Dates and BigInts per stat when they are not read
+config.NSFS_STAT_COMPACT = false;
+
+// run native fs calls on a dedicated thread pool instead of the libuv default pool (UV_THREADPOOL_SIZE),
+// with separate threads for metadata calls (stat/open/readdir/...) and for data calls (read/write/copy/fsync)
+// so that bulk data calls do not delay metadata calls. 0 threads means to use the libuv pool for that lane.
+// blocking file lock waits (flock/fcntl lock) have their own lane, so waiters that may block for long
+// do not hold the threads of the other lanes, and unlocks run on the meta lane so they never wait behind waiters.
+config.NSFS_FS_POOL_META_THREADS = 0;
+config.NSFS_FS_POOL_DATA_THREADS = 0;
+config.NSFS_FS_POOL_LOCK_THREADS = 0;
+
+// keep the fs op latency histograms and error counters in native code and collect them periodically,
+// instead of calling back to JS with the stats of every single fs op.
+config.NSFS_FS_NATIVE_STATS = false;
+
+// delete directory trees (bucket deletion, multipart cleanup) with the native rmtree
+// which walks the tree with a bounded number of native threads instead of a readdir and unlink per entry from JS.
+config.NSFS_NATIVE_RMTREE = false;
+config.NSFS_RMTREE_CONCURRENCY = 8;
+
+// group commit of the NSFS_TRIGGER_FSYNC directory fsyncs - concurrent fsync calls of the same directory
+// are coalesced into one fsync that starts after all of them were issued, and resolves them all.
+// the first caller waits up to NSFS_FSYNC_GROUP_WINDOW_US (or for NSFS_FSYNC_GROUP_MAX_BATCH callers) before the sync.
+// with NSFS_FSYNC_GROUP_SYNCFS the directory and file fsyncs are coalesced per filesystem with a single syncfs (linux only).
+config.NSFS_FSYNC_GROUP_ENABLED = false;
+config.NSFS_FSYNC_GROUP_WINDOW_US = 0;
+config.NSFS_FSYNC_GROUP_MAX_BATCH = 64;
+config.NSFS_FSYNC_GROUP_SYNCFS = false;
+
+// commit non versioned PUT uploads (posix only) by writing to an O_TMPFILE and publishing it with a single native call
+// that sets the xattrs, fsyncs, links it to the object path (or renames over an existing one) and fsyncs the dir.
+// an unpublished O_TMPFILE has no name, so a crash during the upload leaves no temp files behind.
+config.NSFS_UPLOAD_PUBLISH_TMPFILE = false;
+
+// preallocate the Content-Length of uploads on open (fallocate keeping the file size)
+// to get contiguous extents, and fail with ENOSPC before writing any data instead of leaving half written files.
+config.NSFS_UPLOAD_PREALLOCATE = false;
+config.NSFS_UPLOAD_PREALLOCATE_MIN_SIZE = 1024 * 1024;
+
 config.NSFS_BUF_WARMUP_SPARSE_FILE_READS = true;
 
-config.NSFS_DEFAULT_IOV_MAX = 1024; // see IOV_MAX in https://man7.org/linux/man-pages/man0/limits.h.0p.html
+// max buffers that FileWriter passes to one native writev call, 0 for no limit.
+// the native writev splits the buffers by the platform IOV_MAX (see https://man7.org/linux/man-pages/man0/limits.h.0p.html)
+// and resumes partial writes, so this is only needed to limit the size of a single write op.
+config.NSFS_DEFAULT_IOV_MAX = 0;
 
 // the temporary path for uploads and other internal files
 config.NSFS_TEMP_DIR_NAME = '.noobaa-nsfs';
@@ -843,6 +902,74 @@ config.NSFS_DIR_CACHE_MAX_DIR_SIZE = 64 * 1024 * 1024;
 config.NSFS_DIR_CACHE_MIN_DIR_SIZE = 64;
 config.NSFS_DIR_CACHE_MAX_TOTAL_SIZE = 4 * config.NSFS_DIR_CACHE_MAX_DIR_SIZE;
 
+// NSFS_LIST_VERSIONS_NATIVE makes ListObjectVersions read the latest and .versions entries of a directory level,
+// stat the null versions and sort them by key and version time in one native call (fs.readdir_versions),
+// and page through versioned dirs that are too large for the dir cache in the listing order
+// (NSFS_LIST_VERSIONS_NATIVE_PAGE_SIZE entries per call) instead of streaming them unordered.
+config.NSFS_LIST_VERSIONS_NATIVE = false;
+config.NSFS_LIST_VERSIONS_NATIVE_PAGE_SIZE = 1000;
+
+// NSFS_DIR_FD_CACHE_SIZE is the max number of open directory fds (bucket roots) kept by the native fs module
+// in order to resolve object paths relative to them instead of walking the full path on every op.
+// 0 disables the cache. NSFS_DIR_FD_CACHE_VALIDATE_MS is the interval to revalidate a cached dir by its inode.
+config.NSFS_DIR_FD_CACHE_SIZE = 0;
+config.NSFS_DIR_FD_CACHE_VALIDATE_MS = 1000;
+
+// NSFS_OBJECT_CACHE_SIZE is the max number of small objects whose data, stat and xattrs are kept in memory
+// by the native fs module to serve hot GETs in one native call. 0 disables the cache.
+// entries are validated on every GET by the inode size, mtime and ctime, and the total memory is limited by NSFS_OBJECT_CACHE_MAX_BYTES.
+config.NSFS_OBJECT_CACHE_SIZE = 0;
+config.NSFS_OBJECT_CACHE_MAX_BYTES = 256 * 1024 * 1024;
+config.NSFS_OBJECT_CACHE_MAX_OBJECT_SIZE = 256 * 1024;
+
+// NSFS_FD_CACHE_SIZE is the max number of read-only object fds kept open by the native fs module
+// so that repeated ranged GETs of the same object skip the open. 0 disables the cache.
+// fds that no request uses for NSFS_FD_CACHE_IDLE_TTL_MS are closed, and NSFS_FD_CACHE_VALIDATE_MS is the interval
+// to revalidate a cached fd by the inode and mtime of its path (0 validates on every open).
+config.NSFS_FD_CACHE_SIZE = 0;
+config.NSFS_FD_CACHE_IDLE_TTL_MS = 10000;
+config.NSFS_FD_CACHE_VALIDATE_MS = 0;
+
+// NSFS_CONFIG_CACHE_SIZE is the max number of account and bucket config files (see config_fs.js) whose raw content
+// is kept by the native fs module, so repeated reads are served synchronously from memory. 0 disables the cache.
+// files on local filesystems are watched with inotify and dropped when changed, while files on remote filesystems
+// (NFS, GPFS, ...) or with NSFS_CONFIG_CACHE_WATCH=false are revalidated by stat every NSFS_CONFIG_CACHE_VALIDATE_MS.
+config.NSFS_CONFIG_CACHE_SIZE = 0;
+config.NSFS_CONFIG_CACHE_MAX_BYTES = 64 * 1024 * 1024;
+config.NSFS_CONFIG_CACHE_MAX_FILE_SIZE = 1024 * 1024;
+config.NSFS_CONFIG_CACHE_VALIDATE_MS = 1000;
+config.NSFS_CONFIG_CACHE_WATCH = true;
+
+// NSFS_BUCKET_INDEX_ENABLED keeps a native B+tree index of the objects of unversioned buckets (key, size, mtime and user xattrs)
+// in the bucket temp dir, updated by our own put, copy, delete, tagging and object lock ops.
+// when the index is complete, ListObjects (NSFS_BUCKET_INDEX_LIST) is served from it without readdir and stat.
+// the index is rebuilt by a native scan of the bucket on a thread of its own when it is incomplete (new, or after a failed update),
+// at most every NSFS_BUCKET_INDEX_REBUILD_INTERVAL_MS per process and by one process of the bucket at a time,
+// and lists are served from the filesystem until it completes. the keys that any process changes during the scan
+// are kept in the index and read again from the filesystem at its end, so a rebuild completes also on a busy bucket.
+// changes made directly on the filesystem are not in the index, so a complete index is not served after NSFS_BUCKET_INDEX_MAX_AGE_MS
+// since the scan of its last rebuild, and is rebuilt then (0 to trust a complete index forever).
+// the index file is kept and rebuilt with the credentials of the process, and lists skip the objects in directories
+// that the requesting account cannot access, like the filesystem list. the index does not follow symlinked directories.
+// NSFS_BUCKET_INDEX_SYNC makes every index update durable (fdatasync) before the op returns.
+config.NSFS_BUCKET_INDEX_ENABLED = false;
+config.NSFS_BUCKET_INDEX_LIST = true;
+config.NSFS_BUCKET_INDEX_SYNC = true;
+config.NSFS_BUCKET_INDEX_FILE_NAME = 'bucket.index';
+config.NSFS_BUCKET_INDEX_AUTO_REBUILD = true;
+config.NSFS_BUCKET_INDEX_REBUILD_INTERVAL_MS = 10 * 60 * 1000;
+config.NSFS_BUCKET_INDEX_MAX_AGE_MS = 24 * 60 * 60 * 1000;
+
+// NSFS_COPY_FILE_RANGE_ENABLED makes server side copies that cannot use a hard link (versioned buckets, link errors)
+// and multipart part copies use the native copy_file/copy_range, which clone or copy the data inside the kernel.
+// NSFS_COPY_FILE_REFLINK is 'auto' | 'always' | 'never' - whether to try a reflink clone (FICLONE) first,
+// where 'always' fails the native copy (and falls back to streaming) if the filesystem cannot clone.
+config.NSFS_COPY_FILE_RANGE_ENABLED = false;
+config.NSFS_COPY_FILE_REFLINK = 'auto';
+// NSFS_COMPLETE_MULTIPART_NATIVE assembles the parts on complete multipart upload with a single native call
+// (verify etags, link the in-place prefix, copy_file_range the rest, composite md5) instead of a JS loop per part.
+config.NSFS_COMPLETE_MULTIPART_NATIVE = false;
+
 config.NSFS_OPEN_READ_MODE = 'r'; // use 'rd' for direct io
 
 config.BASE_MODE_FILE = 0o666;
@@ -1043,12 +1170,40 @@ config.NSFS_GLACIER_RESERVED_BUCKET_TAGS = {};
 
 config.NSFS_LOGGER_LOCK_CHECK_INTERVAL = process.env.NODE_ENV === 'test' ? 10 : 1000;
 
+// NSFS_LOGGER_NATIVE_WRITER makes the endpoint bucket and notification loggers append through a native
+// ring buffer which is flushed in batches by a native thread, instead of a synchronous write per record.
+// append() still resolves only after its record was written (and synced with NSFS_LOGGER_NATIVE_FSYNC).
+config.NSFS_LOGGER_NATIVE_WRITER = false;
+config.NSFS_LOGGER_NATIVE_BUFFER_SIZE = 16 * 1024 * 1024;
+config.NSFS_LOGGER_NATIVE_FLUSH_SIZE = 256 * 1024;
+config.NSFS_LOGGER_NATIVE_FLUSH_INTERVAL_MS = 5;
+config.NSFS_LOGGER_NATIVE_FSYNC = true; // one fdatasync per batch, like the O_SYNC writes of the JS logger
+config.NSFS_LOGGER_NATIVE_ROTATE_SIZE = 0; // rotate the active log by size (0 to disable)
+config.NSFS_LOGGER_NATIVE_ROTATE_AGE_MS = 0; // rotate the active log by age (0 to disable)
+
 // anonymous account name
 config.ANONYMOUS_ACCOUNT_NAME = 'anonymous';
 
 config.NSFS_UPLOAD_STREAM_MEM_THRESHOLD = 8 * 1024 * 1024;
 config.NSFS_DOWNLOAD_STREAM_MEM_THRESHOLD = 8 * 1024 * 1024;
 
+// NSFS_SENDFILE_ENABLED will send GET data from the file to plain http sockets with sendfile(2)
+// instead of reading it into buffers, and NSFS_SENDFILE_CHUNK_SIZE is the max bytes per native call.
+// a full socket is polled in the event loop until it is writable, and the wait is rechecked for aborts
+// and closed sockets every NSFS_SENDFILE_WRITABLE_TIMEOUT_MS.
+config.NSFS_SENDFILE_ENABLED = false;
+config.NSFS_SENDFILE_CHUNK_SIZE = 64 * 1024 * 1024;
+config.NSFS_SENDFILE_WRITABLE_TIMEOUT_MS = 1000;
+
+// page cache hints for reads - NSFS_READAHEAD_SIZE > 0 makes GETs prefetch that many bytes ahead of the reader with readahead(2).
+// NSFS_SCAN_DROP_BEHIND makes one pass scans (lifecycle candidates) drop the pages they read every NSFS_DROP_BEHIND_SIZE bytes
+// so that they do not evict hot objects from the page cache.
+// NSFS_GET_DROP_BEHIND_MIN_SIZE > 0 does the same for GETs that read at least that many bytes (0 disables).
+config.NSFS_READAHEAD_SIZE = 0;
+config.NSFS_SCAN_DROP_BEHIND = false;
+config.NSFS_GET_DROP_BEHIND_MIN_SIZE = 0;
+config.NSFS_DROP_BEHIND_SIZE = 8 * 1024 * 1024;
+
 // we want to change our handling related to EACCESS error
 config.NSFS_LIST_IGNORE_ENTRY_ON_EACCES = true;
 // we will for now handle the same way also EINVAL error - for gpfs stat issues on list (.snapshots)
@@ -1147,6 +1302,11 @@ config.NC_LIFECYCLE_GPFS_ALLOW_SCAN_ON_REMOTE = true;
 config.NC_GPFS_BIN_DIR = '/usr/lpp/mmfs/bin/';
 config.NC_LIFECYCLE_GPFS_MMAPPLY_ILM_POLICY_CONCURRENCY = 1;
 
+// find the expiration candidates with the native tree walker, which applies the rule filter while walking
+// the bucket path on NC_LIFECYCLE_WALK_CONCURRENCY threads, instead of listing the bucket objects in batches.
+config.NC_LIFECYCLE_NATIVE_WALK = false;
+config.NC_LIFECYCLE_WALK_CONCURRENCY = 8;
+
 ////////// GPFS //////////
 config.GPFS_DOWN_DELAY = 1000;
 
@@ -1172,6 +1332,19 @@ config.BLOCK_STORE_CACHE_SIZE = 256 * 1024 * 1024;
 config.BLOCK_STORE_FS_CACHED_DF_MAX_TIME = 30 * 1000; // 30 seconds
 config.BLOCK_STORE_FS_CACHED_DF_MIN_TIME = 1 * 1000; // 1 seconds
 config.BLOCK_STORE_FS_CACHED_DF_MIN_SPACE = 1 * 1024 * 1024 * 1024; // 1 GB
+config.BLOCK_STORE_FS_PREALLOCATE = false; // fallocate blocks before writing - ENOSPC fails the write before any data is written
+
+// BLOCK_STORE_FS_LOG_ENABLED writes new blocks to a native log-structured store under <root_path>/blocks_log
+// (large segment files + index) instead of a file per block. blocks that were already written as files
+// are still read and deleted from blocks_tree, so existing nodes can enable it without a migration.
+config.BLOCK_STORE_FS_LOG_ENABLED = false;
+config.BLOCK_STORE_FS_LOG_SEGMENT_SIZE = 256 * 1024 * 1024;
+config.BLOCK_STORE_FS_LOG_DIRECT_IO = false;
+config.BLOCK_STORE_FS_LOG_SYNC = true; // fdatasync the segment and the index log before a write returns
+config.BLOCK_STORE_FS_LOG_MAINTENANCE_INTERVAL = 60 * 1000; // 1 minute
+config.BLOCK_STORE_FS_LOG_CHECKPOINT_WAL_SIZE = 64 * 1024 * 1024; // checkpoint the index when its WAL grows above this
+config.BLOCK_STORE_FS_LOG_COMPACT_GARBAGE_RATIO = 0.5; // compact segments with at least this ratio of deleted data
+config.BLOCK_STORE_FS_LOG_COMPACT_MAX_SEGMENTS = 4; // segments to compact per maintenance round
 
 config.BLOCK_STORE_FS_TMFS_ENABLED = false;
 config.BLOCK_STORE_FS_MAPPING_INFO_ENABLED = false;
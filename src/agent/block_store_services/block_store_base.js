@@ -172,16 +172,23 @@ class BlockStoreBase {
 
     async verify_blocks(req) {
         const { verify_blocks } = req.rpc_params;
-        await P.map_with_concurrency(10, verify_blocks, block_md => this.verify_block(block_md));
+        // read in small batches to bound the memory of the blocks that are verified at once
+        for (const batch of _.chunk(verify_blocks, 10)) {
+            const blocks = await this._read_blocks(batch);
+            await Promise.all(batch.map((block_md, i) => this.verify_block(block_md, blocks[i])));
+        }
     }
 
     /**
      * @param {nb.BlockMD} block_md
+     * @param {{ block_md: nb.BlockMD, data: Buffer } | Error} [block_from_batch] the block if it was already read by _read_blocks
      */
-    async verify_block(block_md) {
+    async verify_block(block_md, block_from_batch) {
         try {
+            if (block_from_batch instanceof Error) throw block_from_batch;
+            if (block_from_batch?.data) this._update_read_stats(block_from_batch.data.length);
             const [block_from_store, block_from_cache] = await Promise.all([
-                this._read_block_md(block_md),
+                block_from_batch || this._read_block_md(block_md),
                 this.block_cache.peek_cache(block_md)
             ]);
             if (block_from_store) {
@@ -480,6 +487,17 @@ class BlockStoreBase {
         throw new Error('BlockStoreBase._read_block() is ABSTRACT');
     }
 
+    /**
+     * Reads a batch of blocks, and returns the error of each block that failed instead of throwing.
+     * Block stores can override it to read the whole batch with fewer calls.
+     * 
+     * @param {nb.BlockMD[]} block_mds
+     * @returns {Promise<Array<{ block_md: nb.BlockMD, data: Buffer } | Error>>}
+     */
+    async _read_blocks(block_mds) {
+        return P.map_with_concurrency(10, block_mds, block_md => this._read_block(block_md).catch(err => err));
+    }
+
     /**
      * Abstract method - override me.
      * 
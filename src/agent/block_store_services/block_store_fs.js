@@ -34,6 +34,13 @@ class BlockStoreFs extends BlockStoreBase {
         this.old_blocks_path = path.join(this.root_path, 'blocks');
         this.config_path = path.join(this.root_path, 'config');
         this.usage_path = path.join(this.root_path, 'usage');
+        this.block_log_path = path.join(this.root_path, 'blocks_log');
+
+        // native log-structured store for new blocks, see config.BLOCK_STORE_FS_LOG_ENABLED
+        /** @type {nb.BlockLog} */
+        this.block_log = null;
+        this.block_log_maintenance_running = false;
+        this.block_log_maintenance_interval = null;
 
         // stores the cached df data for the root path
         this.cached_df_data = null;
@@ -76,7 +83,64 @@ class BlockStoreFs extends BlockStoreBase {
                             this._usage = null;
                         });
                 }
+            })
+            .then(() => config.BLOCK_STORE_FS_LOG_ENABLED && this._open_block_log());
+    }
+
+    async _open_block_log() {
+        const block_log = new (nb_native().BlockLog)({
+            root_path: this.block_log_path,
+            segment_size: config.BLOCK_STORE_FS_LOG_SEGMENT_SIZE,
+            direct_io: config.BLOCK_STORE_FS_LOG_DIRECT_IO,
+            sync: config.BLOCK_STORE_FS_LOG_SYNC,
+        });
+        await block_log.open();
+        this.block_log = block_log;
+        dbg.log0('opened block log', this.block_log_path, block_log.stats());
+        this.block_log_maintenance_interval = setInterval(() => this._block_log_maintenance(),
+            config.BLOCK_STORE_FS_LOG_MAINTENANCE_INTERVAL);
+        this.block_log_maintenance_interval.unref();
+    }
+
+    async close_block_log() {
+        clearInterval(this.block_log_maintenance_interval);
+        this.block_log_maintenance_interval = null;
+        const block_log = this.block_log;
+        if (!block_log) return;
+        this.block_log = null;
+        await block_log.close();
+        dbg.log0('closed block log', this.block_log_path);
+    }
+
+    /**
+     * checkpoints the block log index when its WAL grew too much,
+     * and compacts segments that are mostly garbage from deleted or overwritten blocks.
+     */
+    async _block_log_maintenance() {
+        if (this.block_log_maintenance_running || !this.block_log) return;
+        this.block_log_maintenance_running = true;
+        try {
+            if (this.block_log.stats().wal_bytes >= config.BLOCK_STORE_FS_LOG_CHECKPOINT_WAL_SIZE) {
+                await this.block_log.checkpoint();
+            }
+            const res = await this.block_log.compact({
+                min_garbage_ratio: config.BLOCK_STORE_FS_LOG_COMPACT_GARBAGE_RATIO,
+                max_segments: config.BLOCK_STORE_FS_LOG_COMPACT_MAX_SEGMENTS,
             });
+            if (res.segments) dbg.log0('compacted block log', res);
+        } catch (err) {
+            dbg.error('block log maintenance failed', err);
+        } finally {
+            this.block_log_maintenance_running = false;
+        }
+    }
+
+    /**
+     * blocks that were written as files before the block log was enabled
+     * still need to be looked up in blocks_tree until they are all deleted.
+     */
+    _has_file_blocks() {
+        return !this._usage || this._usage.count > 0;
     }
 
     async get_storage_info() {
@@ -130,6 +194,16 @@ class BlockStoreFs extends BlockStoreBase {
      * @returns {Promise<{ block_md: nb.BlockMD, data: Buffer }>}
      */
     async _read_block(block_md) {
+        if (this.block_log) {
+            try {
+                const { md, data } = await this.block_log.read(block_md.id);
+                return { block_md: try_parse_block_md(md) || block_md, data };
+            } catch (err) {
+                if (err.code !== 'ENOENT') throw err;
+                if (!this._has_file_blocks()) this._test_root_path_exists(err);
+            }
+        }
+
         const fs_context = this.fs_context;
         const block_path = this._get_block_data_path(block_md.id);
 
@@ -207,6 +281,28 @@ class BlockStoreFs extends BlockStoreBase {
         }
     }
 
+    /**
+     * reads the batch with a single native call, and retries the blocks that failed
+     * with _read_block, which handles the xattr fallback and missing root path.
+     * @param {nb.BlockMD[]} block_mds
+     * @returns {Promise<Array<{ block_md: nb.BlockMD, data: Buffer } | Error>>}
+     */
+    async _read_blocks(block_mds) {
+        if (this.block_log || config.BLOCK_STORE_FS_TMFS_ENABLED) return super._read_blocks(block_mds);
+        const blocks = block_mds.map(block_md => ({
+            path: this._get_block_data_path(block_md.id),
+            meta_path: this._get_block_meta_path(block_md.id),
+        }));
+        const res = await nb_native().fs.read_blocks(this.fs_context, blocks, {
+            xattr_key: this.xattr_enabled ? config.BLOCK_STORE_FS_XATTR_BLOCK_MD : undefined,
+        });
+        return P.map_with_concurrency(10, block_mds, async (block_md, i) => {
+            const { data, md, code } = res[i];
+            if (!code) return { block_md: try_parse_block_md(md) || block_md, data };
+            return this._read_block(block_md).catch(err => err);
+        });
+    }
+
     /**
      * @param {nb.BlockMD} block_md
      * @param {Buffer} data
@@ -214,6 +310,8 @@ class BlockStoreFs extends BlockStoreBase {
      * @returns {Promise<void>}
      */
     async _write_block(block_md, data, options) {
+        if (this.block_log) return this._write_block_log(block_md, data, options);
+
         const fs_context = this.fs_context;
         const block_path = this._get_block_data_path(block_md.id);
         const is_test_block = Boolean(options?.ignore_usage);
@@ -263,10 +361,11 @@ class BlockStoreFs extends BlockStoreBase {
                     xattr: { [config.BLOCK_STORE_FS_XATTR_BLOCK_MD]: block_md_data },
                     xattr_try,
                     xattr_need_fsync,
+                    preallocate: config.BLOCK_STORE_FS_PREALLOCATE,
                 });
             } else {
                 await Promise.all([
-                    nb_native().fs.writeFile(fs_context, block_path, data),
+                    nb_native().fs.writeFile(fs_context, block_path, data, { preallocate: config.BLOCK_STORE_FS_PREALLOCATE }),
                     nb_native().fs.writeFile(fs_context, meta_path, Buffer.from(block_md_data, 'utf8')),
                 ]);
 
@@ -281,6 +380,11 @@ class BlockStoreFs extends BlockStoreBase {
 
                 return this._write_block(block_md, data, options);
             }
+            if (err.code === 'ENOSPC') {
+                // the cached df data is stale, refresh it on the next _check_write_space
+                this.cached_df_data = undefined;
+                throw new RpcError('NO_BLOCK_STORE_SPACE', 'no space left to write block ' + block_md.id);
+            }
 
             this._test_root_path_exists(err);
         }
@@ -290,25 +394,70 @@ class BlockStoreFs extends BlockStoreBase {
         }
     }
 
+    /**
+     * the usage of the block log is taken from its index (see _get_usage),
+     * so here we only need to remove an older block file with the same id.
+     * @param {nb.BlockMD} block_md
+     * @param {Buffer} data
+     * @param {{ ignore_usage?: boolean }} [options]
+     * @returns {Promise<void>}
+     */
+    async _write_block_log(block_md, data, options) {
+        const block_md_to_store = _.pick(block_md, 'id', 'digest_type', 'digest_b64', 'mapping_info');
+        const block_md_data = JSON.stringify(block_md_to_store);
+        if (!options?.ignore_usage && this._has_file_blocks()) {
+            await this._delete_block(block_md.id);
+        }
+        try {
+            await this.block_log.write(block_md.id, block_md_data, data);
+        } catch (err) {
+            if (err.code === 'ENOSPC') {
+                this.cached_df_data = undefined;
+                throw new RpcError('NO_BLOCK_STORE_SPACE', 'no space left to write block ' + block_md.id);
+            }
+            this._test_root_path_exists(err);
+        }
+    }
+
     async _delete_blocks(block_ids) {
         const succeeded_block_ids = [];
         const failed_block_ids = [];
-        await P.map_with_concurrency(10, block_ids, async block_id => {
+        if (this.block_log) {
             try {
-                await this._delete_block(block_id);
-                succeeded_block_ids.push(block_id);
+                await this.block_log.remove(block_ids);
             } catch (err) {
-                // treat ENOENT as success - 
-                // this check is already performed inside _delete_block by calling ignore_not_found
-                // but just in case something changes we perform it once again here explicitly
-                if (err.code === 'ENOENT') {
-                    succeeded_block_ids.push(block_id);
-                } else {
-                    failed_block_ids.push(block_id);
-                }
-                dbg.warn(`delete block ${block_id} failed due to`, err);
+                dbg.warn('delete blocks from block log failed due to', err);
+                return { failed_block_ids: block_ids, succeeded_block_ids };
             }
-        });
+            if (!this._has_file_blocks()) return { failed_block_ids, succeeded_block_ids: block_ids };
+        }
+
+        // delete the whole batch with a single native call, missing blocks are not an error
+        let res;
+        try {
+            res = await nb_native().fs.delete_blocks(this.fs_context, block_ids.map(block_id => ({
+                path: this._get_block_data_path(block_id),
+                meta_path: this._get_block_meta_path(block_id),
+            })));
+        } catch (err) {
+            dbg.warn('delete blocks failed due to', err);
+            return { failed_block_ids: block_ids, succeeded_block_ids };
+        }
+        const usage = { size: 0, count: 0 };
+        for (let i = 0; i < block_ids.length; ++i) {
+            const { size, code, message } = res[i];
+            if (code) {
+                failed_block_ids.push(block_ids[i]);
+                dbg.warn(`delete block ${block_ids[i]} failed due to`, code, message);
+                continue;
+            }
+            succeeded_block_ids.push(block_ids[i]);
+            if (size >= 0) {
+                usage.size -= size;
+                usage.count -= 1;
+            }
+        }
+        if (usage.count) this._update_usage(usage);
         return { failed_block_ids, succeeded_block_ids };
     }
 
@@ -409,8 +558,11 @@ class BlockStoreFs extends BlockStoreBase {
         return evicting;
     }
 
-    _get_usage() {
-        return this._usage || this._count_usage();
+    async _get_usage() {
+        const usage = this._usage || await this._count_usage();
+        if (!this.block_log) return usage;
+        const stats = this.block_log.stats();
+        return { size: usage.size + stats.data_bytes, count: usage.count + stats.blocks };
     }
 
     async _count_usage() {
@@ -1204,6 +1204,12 @@ module.exports = {
         fs_workers_stats: {
             type: 'object',
             properties: {
+                fsync_group: {
+                    $ref: 'common_api#/definitions/fsync_group_stats_val'
+                },
+                log_writer: {
+                    $ref: 'common_api#/definitions/log_writer_stats_val'
+                },
                 stat: {
                     $ref: 'common_api#/definitions/op_stats_val'
                 },
@@ -1299,6 +1305,111 @@ module.exports = {
                 },
                 safeunlink: {
                     $ref: 'common_api#/definitions/op_stats_val'
+                },
+                completemultipart: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                copyfile: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                deleteblocks: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                dircacheadd: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                fcntlgetlock: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                fileadvise: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                fileallocate: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filecopyrange: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filefcntlgetlock: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filefcntllock: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                fileflock: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filepublish: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filereadahead: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filereadrdma: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filesendfile: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                filewriterdma: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                getpwname: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                getsupplementalgroupsbyuid: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                getsupplementalgroupsbyusername: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                linkfileat: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                readblocks: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                readcachedfile: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                readconfigfile: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                readdirversions: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                rmtree: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                seekdir: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                symlink: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                telldir: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                unlinkfileat: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                walkclose: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                walkopen: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                writeblocks: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                queue_meta: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                queue_data: {
+                    $ref: 'common_api#/definitions/op_stats_val'
+                },
+                queue_lock: {
+                    $ref: 'common_api#/definitions/op_stats_val'
                 }
             }
         },
@@ -1324,6 +1435,66 @@ module.exports = {
             },
         },
 
+        fsync_group_stats_val: {
+            type: 'object',
+            properties: {
+                min_time: {
+                    type: 'integer'
+                },
+                max_time: {
+                    type: 'integer'
+                },
+                sum_time: {
+                    type: 'integer'
+                },
+                count: {
+                    type: 'integer'
+                },
+                error_count: {
+                    type: 'integer'
+                },
+                requests: {
+                    type: 'integer'
+                },
+                max_batch: {
+                    type: 'integer'
+                },
+                window_wait_time: {
+                    type: 'integer'
+                },
+            },
+        },
+
+        log_writer_stats_val: {
+            type: 'object',
+            properties: {
+                min_time: {
+                    type: 'integer'
+                },
+                max_time: {
+                    type: 'integer'
+                },
+                sum_time: {
+                    type: 'integer'
+                },
+                count: {
+                    type: 'integer'
+                },
+                error_count: {
+                    type: 'integer'
+                },
+                flushed_bytes: {
+                    type: 'integer'
+                },
+                max_backlog_bytes: {
+                    type: 'integer'
+                },
+                full_errors: {
+                    type: 'integer'
+                },
+            },
+        },
+
         bucket_name: {
             wrapper: SensitiveString,
         },
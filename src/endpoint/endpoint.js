@@ -156,12 +156,14 @@ async function main(options = {}) {
             new PersistentLogger(config.PERSISTENT_BUCKET_LOG_DIR, config.PERSISTENT_BUCKET_LOG_NS + '_' + node_name, {
                 locking: 'SHARED',
                 poll_interval: config.NSFS_GLACIER_LOGS_POLL_INTERVAL,
+                native_writer: config.NSFS_LOGGER_NATIVE_WRITER,
             });
 
         notification_logger = config.NOTIFICATION_LOG_DIR && get_notification_logger(
             'SHARED', //shared locking for endpoitns
             undefined, //use default namespace based on hostname
-            config.NSFS_GLACIER_LOGS_POLL_INTERVAL);
+            config.NSFS_GLACIER_LOGS_POLL_INTERVAL,
+            config.NSFS_LOGGER_NATIVE_WRITER);
 
         process.on('warning', e => dbg.warn(e.stack));
 
@@ -30,6 +30,8 @@ const { throw_cli_error, get_service_status, NOOBAA_SERVICE_NAME,
 // TODO - we will filter during the scan except for get_candidates_by_expiration_rule on GPFS that does the filter on the file system
 
 const LIFECYCLE_CLUSTER_LOCK = 'lifecycle_cluster.lock';
+const HIDDEN_VERSIONS_PATH = '.versions';
+const XATTR_TAG = 'user.noobaa.tag.';
 const LIFECYLE_TIMESTAMP_FILE = 'lifecycle.timestamp';
 const config_fs_options = { silent_if_missing: true };
 const ILM_POLICIES_TMP_DIR = path.join(config.NC_LIFECYCLE_LOGS_DIR, 'lifecycle_ilm_policies');
@@ -97,6 +99,8 @@ class NCLifecycle {
         // used for GPFS optimization - maps bucket names to their mount points
         // example - { 'bucket1': '/gpfs/mount/point1', 'bucket2': '/gpfs/mount/point2' }
         this.bucket_to_mount_point_map = {};
+        // native tree walkers of the expiration rules that are in progress, by bucket name and rule id
+        this.expiration_walkers = new Map();
     }
 
     /**
@@ -122,6 +126,7 @@ class NCLifecycle {
                 dbg.error('run_lifecycle_under_lock failed with error', err, err.code, err.message);
                 throw err;
             } finally {
+                await this.close_expiration_walkers();
                 await record_current_time(this.fs_context, this.lifecycle_timestamp_file_path);
                 await this.write_lifecycle_log_file();
                 dbg.log0('run_lifecycle_under_lock done lifecycle - released lock');
@@ -465,6 +470,8 @@ class NCLifecycle {
     async get_candidates_by_expiration_rule(lifecycle_rule, bucket_json, object_sdk) {
         if (this._should_use_gpfs_optimization()) {
             return this.get_candidates_by_expiration_rule_gpfs(lifecycle_rule, bucket_json);
+        } else if (config.NC_LIFECYCLE_NATIVE_WALK) {
+            return this.get_candidates_by_expiration_rule_walk(lifecycle_rule, bucket_json);
         } else {
             return this.get_candidates_by_expiration_rule_posix(lifecycle_rule, bucket_json, object_sdk);
         }
@@ -526,6 +533,83 @@ class NCLifecycle {
         return filtered_objects;
     }
 
+    /**
+     * close_expiration_walkers closes the tree walks that were left open by a run that failed or timed out
+     * @returns {Promise<Void>}
+     */
+    async close_expiration_walkers() {
+        const walkers = [...this.expiration_walkers.values()];
+        this.expiration_walkers.clear();
+        for (const walker of walkers) {
+            try {
+                await walker.close(this.fs_context);
+            } catch (err) {
+                dbg.warn('close_expiration_walkers: failed to close walker', err);
+            }
+        }
+    }
+
+    /**
+     * get_candidates_by_expiration_rule_walk returns the next batch of candidates from a native tree walk
+     * of the bucket path, which applies the rule filter (prefix, age, size and tags) natively.
+     * The candidates are checked again with the filter on deletion, so the walk only needs to narrow them down.
+     * @param {*} lifecycle_rule
+     * @param {Object} bucket_json
+     * @returns {Promise<Object[]>}
+     */
+    async get_candidates_by_expiration_rule_walk(lifecycle_rule, bucket_json) {
+        const rule_state = this._get_rule_state(bucket_json, lifecycle_rule).expire;
+        if (rule_state.is_finished) return [];
+        const expiration = this._get_expiration_time(lifecycle_rule.expiration);
+        if (expiration < 0) return [];
+        const walker_key = `${bucket_json.name}/${lifecycle_rule.id}`;
+        let walker = this.expiration_walkers.get(walker_key);
+        if (!walker) {
+            const filter = lifecycle_rule.filter || {};
+            // no object is smaller than 0 bytes, and a max_size of -1 would mean no limit to the walk
+            if (filter.object_size_less_than !== undefined && filter.object_size_less_than <= 0) {
+                rule_state.is_finished = true;
+                return [];
+            }
+            walker = await nb_native().fs.walk(this.fs_context, bucket_json.path, {
+                concurrency: config.NC_LIFECYCLE_WALK_CONCURRENCY,
+                batch_size: config.NC_LIFECYCLE_LIST_BATCH_SIZE,
+                prefix: filter.prefix,
+                exclude_dirs: [HIDDEN_VERSIONS_PATH, native_fs_utils.get_bucket_tmpdir_name(bucket_json._id)],
+                mtime_before_ms: Date.now() - (expiration * 24 * 60 * 60 * 1000),
+                // the rule sizes are exclusive and the walk sizes are inclusive
+                min_size: filter.object_size_greater_than === undefined ? undefined : filter.object_size_greater_than + 1,
+                max_size: filter.object_size_less_than === undefined ? undefined : filter.object_size_less_than - 1,
+                xattr_equals: filter.tags && Object.fromEntries(filter.tags.map(tag => [XATTR_TAG + tag.key, tag.value])),
+            });
+            this.expiration_walkers.set(walker_key, walker);
+        }
+        let entries;
+        try {
+            entries = await walker.read(this.fs_context);
+        } catch (err) {
+            this.expiration_walkers.delete(walker_key);
+            await walker.close(this.fs_context);
+            throw err;
+        }
+        if (!entries) {
+            const { error_count, errors } = walker.stats();
+            if (error_count) dbg.warn('get_candidates_by_expiration_rule_walk: walk errors', bucket_json.name, error_count, errors);
+            this.expiration_walkers.delete(walker_key);
+            await walker.close(this.fs_context);
+            rule_state.is_finished = true;
+            return [];
+        }
+        rule_state.is_finished = false;
+        const bucket_state = this.lifecycle_run_status.buckets_statuses[bucket_json.name].state;
+        bucket_state.num_processed_objects += entries.length;
+        return entries.map(({ key }) => {
+            // a directory object is kept in the directory's .folder file
+            if (path.basename(key) === config.NSFS_FOLDER_OBJECT_NAME) return { key: path.join(path.dirname(key), '/') };
+            return { key };
+        });
+    }
+
     /**
      * get_candidates_by_expiration_rule_gpfs does the following -
      * 1. gets the ilm candidates file path
@@ -1483,7 +1567,11 @@ class NCLifecycle {
         try {
             dbg.log2(`parse_candidates_from_gpfs_ilm_policy bucket_name=${bucket_json.name}, rule_id ${lifecycle_rule.id}, existing rule_state=${util.inspect(rule_state)}`);
             const parsed_candidates_array = [];
-            reader = new NewlineReader(this.non_gpfs_fs_context, rule_candidates_path, { lock: 'SHARED', read_file_offset: rule_state?.candidates_file_offset || 0 });
+            reader = new NewlineReader(this.non_gpfs_fs_context, rule_candidates_path, {
+                lock: 'SHARED',
+                read_file_offset: rule_state?.candidates_file_offset || 0,
+                drop_behind: config.NSFS_SCAN_DROP_BEHIND,
+            });
 
             const [count, is_finished] = await reader.forEachFilePathEntry(async entry => {
                 if (parsed_candidates_array.length >= config.NC_LIFECYCLE_LIST_BATCH_SIZE) return false;
@@ -0,0 +1,896 @@
+/* Copyright (C) 2016 NooBaa */
+#include "block_log.h"
+
+#include "../third_party/isa-l/include/crc.h"
+#include "../util/fsync_group.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+static const uint32_t RECORD_MAGIC = 0x4b4c424e; // "NBLK"
+static const uint32_t WAL_MAGIC = 0x4c57424e;    // "NBWL"
+static const uint32_t CKPT_MAGIC = 0x4b43424e;   // "NBCK"
+static const uint32_t CKPT_VERSION = 1;
+static const uint32_t WAL_PUT = 1;
+static const uint32_t WAL_DEL = 2;
+static const uint64_t DIRECT_IO_ALIGN = 4096;
+static const uint64_t RECORD_ALIGN = 8;
+
+/**
+ * RecordHeader starts every block record in a segment.
+ * header_crc covers the fields after it, the block id and the md, and data_crc covers the data.
+ * All the on-disk structs are in host byte order.
+ */
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t header_crc;
+    uint32_t id_len;
+    uint32_t md_len;
+    uint32_t data_len;
+    uint32_t data_crc;
+};
+
+/**
+ * WalRecord is an index change in the WAL, followed by the block id.
+ * The checkpoint body is a sequence of WAL_PUT records of the whole index.
+ */
+struct WalRecord
+{
+    uint32_t magic;
+    uint32_t crc;
+    uint32_t type;
+    uint32_t id_len;
+    uint32_t seg;
+    uint32_t md_len;
+    uint32_t data_len;
+    uint32_t data_crc;
+    uint64_t offset;
+    uint64_t rec_len;
+};
+
+struct CkptHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t wal_gen;
+    uint64_t next_seg;
+    uint64_t count;
+    uint32_t body_crc;
+    uint32_t header_crc;
+};
+
+static uint32_t
+crc32c(uint32_t crc, const void* buf, size_t len)
+{
+    return crc32_iscsi((unsigned char*)buf, len, crc);
+}
+
+static uint32_t
+record_header_crc(const RecordHeader& h, const char* id, const char* md)
+{
+    uint32_t crc = crc32c(0, &h.id_len, sizeof(h) - offsetof(RecordHeader, id_len));
+    crc = crc32c(crc, id, h.id_len);
+    return crc32c(crc, md, h.md_len);
+}
+
+static uint32_t
+wal_record_crc(const WalRecord& r, const char* id)
+{
+    uint32_t crc = crc32c(0, &r.type, sizeof(r) - offsetof(WalRecord, type));
+    return crc32c(crc, id, r.id_len);
+}
+
+static void
+encode_wal_record(std::string& out, uint32_t type, const std::string& id, const BlockLog::Entry& e)
+{
+    WalRecord r;
+    r.magic = WAL_MAGIC;
+    r.type = type;
+    r.id_len = id.size();
+    r.seg = e.seg;
+    r.md_len = e.md_len;
+    r.data_len = e.data_len;
+    r.data_crc = e.data_crc;
+    r.offset = e.offset;
+    r.rec_len = e.rec_len;
+    r.crc = wal_record_crc(r, id.data());
+    out.append((const char*)&r, sizeof(r));
+    out.append(id);
+}
+
+// decodes one record from buf at pos, returns false on a torn or corrupted record
+static bool
+decode_wal_record(const std::vector<char>& buf, size_t& pos, uint32_t& type, std::string& id, BlockLog::Entry& e)
+{
+    WalRecord r;
+    if (buf.size() - pos < sizeof(r)) return false;
+    memcpy(&r, buf.data() + pos, sizeof(r));
+    if (r.magic != WAL_MAGIC || buf.size() - pos - sizeof(r) < r.id_len) return false;
+    const char* id_ptr = buf.data() + pos + sizeof(r);
+    if (r.crc != wal_record_crc(r, id_ptr)) return false;
+    type = r.type;
+    id.assign(id_ptr, r.id_len);
+    e.seg = r.seg;
+    e.md_len = r.md_len;
+    e.data_len = r.data_len;
+    e.data_crc = r.data_crc;
+    e.offset = r.offset;
+    e.rec_len = r.rec_len;
+    pos += sizeof(r) + r.id_len;
+    return true;
+}
+
+// pwritev/preadv that continue after partial transfers, return 0 or errno
+static int
+pwritev_full(int fd, struct iovec* iov, int iovcnt, off_t offset)
+{
+    while (iovcnt > 0) {
+        ssize_t n = pwritev(fd, iov, iovcnt, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (n == 0) return EIO;
+        offset += n;
+        while (iovcnt > 0 && size_t(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int
+preadv_full(int fd, struct iovec* iov, int iovcnt, off_t offset)
+{
+    while (iovcnt > 0) {
+        ssize_t n = preadv(fd, iov, iovcnt, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        // the record is shorter than its index entry
+        if (n == 0) return EIO;
+        offset += n;
+        while (iovcnt > 0 && size_t(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int
+read_whole_file(const std::string& path, std::vector<char>& buf)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    struct stat st;
+    if (fstat(fd, &st)) {
+        int err = errno;
+        ::close(fd);
+        return err;
+    }
+    buf.resize(st.st_size);
+    struct iovec iov = { buf.data(), buf.size() };
+    int err = buf.empty() ? 0 : preadv_full(fd, &iov, 1, 0);
+    ::close(fd);
+    return err;
+}
+
+static int
+fsync_dir(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    int err = fsync(fd) ? errno : 0;
+    ::close(fd);
+    return err;
+}
+
+static int
+mkdir_if_missing(const std::string& path)
+{
+    if (mkdir(path.c_str(), 0755) && errno != EEXIST) return errno;
+    return 0;
+}
+
+// aligned buffer for O_DIRECT transfers
+struct AlignedBuf
+{
+    uint8_t* ptr = 0;
+    explicit AlignedBuf(size_t len)
+    {
+        if (posix_memalign((void**)&ptr, DIRECT_IO_ALIGN, len)) ptr = 0;
+    }
+    ~AlignedBuf() { free(ptr); }
+};
+
+BlockLog::Segment::~Segment()
+{
+    if (fd >= 0) ::close(fd);
+}
+
+BlockLog::Wal::~Wal()
+{
+    if (fd >= 0) ::close(fd);
+}
+
+BlockLog::BlockLog(const Config& config)
+    : _config(config)
+{
+    _config.segment_size = std::max<uint64_t>(_config.segment_size, 1024 * 1024);
+#ifndef O_DIRECT
+    _config.direct_io = false;
+#endif
+}
+
+BlockLog::~BlockLog()
+{
+    close();
+}
+
+std::string
+BlockLog::_segment_path(uint32_t seg) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%08x.seg", seg);
+    return _config.root_path + "/segments/" + name;
+}
+
+std::string
+BlockLog::_wal_path(uint64_t gen) const
+{
+    return _config.root_path + "/wal." + std::to_string(gen);
+}
+
+std::string
+BlockLog::_ckpt_path() const
+{
+    return _config.root_path + "/index.ckpt";
+}
+
+uint64_t
+BlockLog::_align(uint64_t n) const
+{
+    uint64_t a = _config.direct_io ? DIRECT_IO_ALIGN : RECORD_ALIGN;
+    return (n + a - 1) / a * a;
+}
+
+int
+BlockLog::open()
+{
+    std::lock_guard<std::mutex> maintenance_lock(_maintenance_mutex);
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_opened) return 0;
+    int err = mkdir_if_missing(_config.root_path);
+    if (!err) err = mkdir_if_missing(_config.root_path + "/segments");
+    if (err) return err;
+
+    uint64_t ckpt_gen = 1;
+    err = _load_checkpoint(ckpt_gen);
+    if (err) return err;
+
+    // replay the WAL generations that follow the checkpoint, and remove the older ones
+    std::vector<uint64_t> gens;
+    DIR* dir = opendir(_config.root_path.c_str());
+    if (!dir) return errno;
+    while (struct dirent* d = readdir(dir)) {
+        if (strncmp(d->d_name, "wal.", 4) == 0) gens.push_back(strtoull(d->d_name + 4, 0, 10));
+    }
+    closedir(dir);
+    std::sort(gens.begin(), gens.end());
+    uint64_t last_gen = ckpt_gen;
+    _first_wal_gen = ckpt_gen;
+    for (uint64_t gen : gens) {
+        if (gen < ckpt_gen) {
+            ::unlink(_wal_path(gen).c_str());
+            continue;
+        }
+        err = _replay_wal(gen);
+        if (err) return err;
+        last_gen = std::max(last_gen, gen + 1);
+    }
+
+    err = _open_segments();
+    if (!err) err = _open_wal(last_gen);
+    if (!err) err = _new_segment_locked();
+    if (err) return err;
+    _opened = true;
+    const std::string& root_path = _config.root_path;
+    size_t blocks = _index.size();
+    size_t segments = _segments.size();
+    uint64_t wal_records = _stats.recovered_wal_records;
+    LOG("BlockLog::open: " << DVAL(root_path) << DVAL(blocks) << DVAL(segments) << DVAL(ckpt_gen) << DVAL(wal_records));
+    return 0;
+}
+
+int
+BlockLog::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_opened) return 0;
+    }
+    int err = _wal && _wal->size ? checkpoint() : 0;
+    std::lock_guard<std::mutex> maintenance_lock(_maintenance_mutex);
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_active && _active->fd >= 0 && fdatasync(_active->fd) && !err) err = errno;
+    _index.clear();
+    _segments.clear();
+    _active.reset();
+    _wal.reset();
+    _opened = false;
+    return err;
+}
+
+int
+BlockLog::_load_checkpoint(uint64_t& wal_gen)
+{
+    std::vector<char> buf;
+    int err = read_whole_file(_ckpt_path(), buf);
+    if (err == ENOENT) return 0;
+    if (err) return err;
+    CkptHeader h;
+    if (buf.size() < sizeof(h)) return EIO;
+    memcpy(&h, buf.data(), sizeof(h));
+    if (h.magic != CKPT_MAGIC || h.version != CKPT_VERSION ||
+        h.header_crc != crc32c(0, &h, offsetof(CkptHeader, header_crc)) ||
+        h.body_crc != crc32c(0, buf.data() + sizeof(h), buf.size() - sizeof(h))) {
+        LOG("BlockLog::_load_checkpoint: corrupted checkpoint " << DVAL(_ckpt_path()));
+        return EIO;
+    }
+    size_t pos = sizeof(h);
+    _index.reserve(h.count);
+    for (uint64_t i = 0; i < h.count; ++i) {
+        uint32_t type;
+        std::string id;
+        Entry e;
+        if (!decode_wal_record(buf, pos, type, id, e) || type != WAL_PUT) return EIO;
+        _index[id] = e;
+    }
+    wal_gen = h.wal_gen;
+    _next_seg = std::max<uint64_t>(_next_seg, h.next_seg);
+    return 0;
+}
+
+int
+BlockLog::_replay_wal(uint64_t gen)
+{
+    std::vector<char> buf;
+    int err = read_whole_file(_wal_path(gen), buf);
+    if (err) return err;
+    size_t pos = 0;
+    uint32_t type;
+    std::string id;
+    Entry e;
+    while (decode_wal_record(buf, pos, type, id, e)) {
+        if (type == WAL_PUT) {
+            _index[id] = e;
+        } else {
+            _index.erase(id);
+        }
+        _stats.recovered_wal_records += 1;
+    }
+    // a torn tail is expected after a crash, the writes in it were never acknowledged
+    if (pos < buf.size()) {
+        LOG("BlockLog::_replay_wal: ignoring torn tail " << DVAL(_wal_path(gen)) << DVAL(pos) << DVAL(buf.size()));
+    }
+    return 0;
+}
+
+int
+BlockLog::_open_segments()
+{
+    std::string dir_path = _config.root_path + "/segments";
+    DIR* dir = opendir(dir_path.c_str());
+    if (!dir) return errno;
+    std::vector<uint32_t> ids;
+    while (struct dirent* d = readdir(dir)) {
+        size_t len = strlen(d->d_name);
+        if (len > 4 && strcmp(d->d_name + len - 4, ".seg") == 0) ids.push_back(strtoul(d->d_name, 0, 16));
+    }
+    closedir(dir);
+
+    // sealed segments are only read, and may have been written with records that are not 4K aligned,
+    // so they are never opened with O_DIRECT
+    int flags = O_RDWR | O_CLOEXEC;
+    for (uint32_t id : ids) {
+        auto seg = std::make_shared<Segment>();
+        seg->id = id;
+        seg->path = _segment_path(id);
+        seg->fd = ::open(seg->path.c_str(), flags);
+        if (seg->fd < 0) return errno;
+        struct stat st;
+        if (fstat(seg->fd, &st)) return errno;
+        _next_seg = std::max(_next_seg, id + 1);
+        // the active segment of the previous run may be empty
+        if (st.st_size == 0) {
+            ::unlink(seg->path.c_str());
+            continue;
+        }
+        seg->size = _align(st.st_size);
+        _segments[id] = seg;
+    }
+
+    // account the live records, and drop index entries whose segment is gone
+    _data_bytes = 0;
+    for (auto it = _index.begin(); it != _index.end();) {
+        auto seg_it = _segments.find(it->second.seg);
+        if (seg_it == _segments.end()) {
+            LOG("BlockLog::_open_segments: missing segment for block " << DVAL(it->first) << DVAL(it->second.seg));
+            it = _index.erase(it);
+            continue;
+        }
+        seg_it->second->live_bytes += it->second.rec_len;
+        _data_bytes += it->second.data_len;
+        ++it;
+    }
+    return 0;
+}
+
+int
+BlockLog::_open_wal(uint64_t gen)
+{
+    auto wal = std::make_shared<Wal>();
+    wal->gen = gen;
+    wal->path = _wal_path(gen);
+    wal->fd = ::open(wal->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (wal->fd < 0) return errno;
+    struct stat st;
+    if (fstat(wal->fd, &st)) return errno;
+    wal->size = st.st_size;
+    if (_config.sync) {
+        int err = fsync_dir(_config.root_path);
+        if (err) return err;
+    }
+    _wal = wal;
+    return 0;
+}
+
+int
+BlockLog::_new_segment_locked()
+{
+    int flags = O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC;
+    auto seg = std::make_shared<Segment>();
+#ifdef O_DIRECT
+    if (_config.direct_io) {
+        flags |= O_DIRECT;
+        seg->direct_io = true;
+    }
+#endif
+    seg->id = _next_seg++;
+    seg->path = _segment_path(seg->id);
+    seg->fd = ::open(seg->path.c_str(), flags, 0644);
+    if (seg->fd < 0) return errno;
+    if (_config.sync) {
+        int err = fsync_dir(_config.root_path + "/segments");
+        if (err) return err;
+    }
+    _segments[seg->id] = seg;
+    _active = seg;
+    return 0;
+}
+
+int
+BlockLog::_reserve(uint64_t rec_len, std::shared_ptr<Segment>& seg, uint64_t& offset)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_opened) return EBADF;
+    if (_active->size > 0 && _active->size + rec_len > _config.segment_size) {
+        int err = _new_segment_locked();
+        if (err) return err;
+    }
+    seg = _active;
+    offset = seg->size;
+    seg->size += rec_len;
+    seg->writers += 1;
+    return 0;
+}
+
+int
+BlockLog::_write_record(
+    Segment& seg,
+    uint64_t offset,
+    const std::string& id,
+    const std::string& md,
+    const uint8_t* data,
+    size_t len,
+    uint64_t rec_len)
+{
+    RecordHeader h;
+    h.magic = RECORD_MAGIC;
+    h.id_len = id.size();
+    h.md_len = md.size();
+    h.data_len = len;
+    h.data_crc = crc32c(0, data, len);
+    h.header_crc = record_header_crc(h, id.data(), md.data());
+    uint64_t used = sizeof(h) + id.size() + md.size() + len;
+
+    if (seg.direct_io) {
+        AlignedBuf buf(rec_len);
+        if (!buf.ptr) return ENOMEM;
+        uint8_t* p = buf.ptr;
+        memcpy(p, &h, sizeof(h));
+        memcpy(p += sizeof(h), id.data(), id.size());
+        memcpy(p += id.size(), md.data(), md.size());
+        memcpy(p += md.size(), data, len);
+        memset(buf.ptr + used, 0, rec_len - used);
+        struct iovec iov = { buf.ptr, rec_len };
+        return pwritev_full(seg.fd, &iov, 1, offset);
+    }
+
+    static const char zeros[RECORD_ALIGN] = { 0 };
+    struct iovec iov[5] = {
+        { &h, sizeof(h) },
+        { (void*)id.data(), id.size() },
+        { (void*)md.data(), md.size() },
+        { (void*)data, len },
+        { (void*)zeros, rec_len - used },
+    };
+    return pwritev_full(seg.fd, iov, 5, offset);
+}
+
+int
+BlockLog::_read_record(Segment& seg, const Entry& e, const std::string& id, std::string& md, std::vector<uint8_t>& data)
+{
+    RecordHeader h;
+    std::vector<char> head(id.size() + e.md_len);
+    data.resize(e.data_len);
+
+    if (seg.direct_io) {
+        AlignedBuf buf(e.rec_len);
+        if (!buf.ptr) return ENOMEM;
+        struct iovec iov = { buf.ptr, e.rec_len };
+        int err = preadv_full(seg.fd, &iov, 1, e.offset);
+        if (err) return err;
+        memcpy(&h, buf.ptr, sizeof(h));
+        memcpy(head.data(), buf.ptr + sizeof(h), head.size());
+        memcpy(data.data(), buf.ptr + sizeof(h) + head.size(), data.size());
+    } else {
+        struct iovec iov[3] = {
+            { &h, sizeof(h) },
+            { head.data(), head.size() },
+            { data.data(), data.size() },
+        };
+        int err = preadv_full(seg.fd, iov, 3, e.offset);
+        if (err) return err;
+    }
+
+    if (h.magic != RECORD_MAGIC || h.id_len != id.size() || h.md_len != e.md_len || h.data_len != e.data_len ||
+        memcmp(head.data(), id.data(), id.size()) != 0 ||
+        h.header_crc != record_header_crc(h, head.data(), head.data() + id.size()) ||
+        h.data_crc != e.data_crc || crc32c(0, data.data(), data.size()) != e.data_crc) {
+        LOG("BlockLog::_read_record: corrupted record " << DVAL(id) << DVAL(seg.path) << DVAL(e.offset));
+        return EIO;
+    }
+    md.assign(head.data() + id.size(), e.md_len);
+    return 0;
+}
+
+void
+BlockLog::_apply_put_locked(const std::string& id, const Entry& e)
+{
+    auto it = _index.find(id);
+    if (it != _index.end()) {
+        auto seg_it = _segments.find(it->second.seg);
+        if (seg_it != _segments.end()) seg_it->second->live_bytes -= it->second.rec_len;
+        _data_bytes -= it->second.data_len;
+        it->second = e;
+    } else {
+        _index.emplace(id, e);
+    }
+    auto seg_it = _segments.find(e.seg);
+    if (seg_it != _segments.end()) seg_it->second->live_bytes += e.rec_len;
+    _data_bytes += e.data_len;
+}
+
+bool
+BlockLog::_apply_del_locked(const std::string& id)
+{
+    auto it = _index.find(id);
+    if (it == _index.end()) return false;
+    auto seg_it = _segments.find(it->second.seg);
+    if (seg_it != _segments.end()) seg_it->second->live_bytes -= it->second.rec_len;
+    _data_bytes -= it->second.data_len;
+    _index.erase(it);
+    return true;
+}
+
+int
+BlockLog::_append_wal_locked(uint32_t type, const std::string& id, const Entry& e, std::shared_ptr<Wal>& wal)
+{
+    if (!_wal) return EBADF;
+    std::string rec;
+    encode_wal_record(rec, type, id, e);
+    struct iovec iov = { (void*)rec.data(), rec.size() };
+    // O_APPEND ignores the offset
+    int err = pwritev_full(_wal->fd, &iov, 1, 0);
+    if (err) return err;
+    _wal->size += rec.size();
+    wal = _wal;
+    return 0;
+}
+
+int
+BlockLog::_sync_wal(const std::shared_ptr<Wal>& wal)
+{
+    if (!_config.sync || !wal) return 0;
+    int fd = wal->fd;
+    auto do_sync = [fd]() { return fdatasync(fd) ? errno : 0; };
+    // concurrent writers share one fdatasync of the WAL
+    if (FsyncGroup::instance().enabled()) return FsyncGroup::instance().sync(wal->path, do_sync);
+    return do_sync();
+}
+
+int
+BlockLog::write(const std::string& id, const std::string& md, const uint8_t* data, size_t len)
+{
+    if (id.empty() || len > UINT32_MAX || md.size() > UINT32_MAX) return EINVAL;
+    uint64_t rec_len = _align(sizeof(RecordHeader) + id.size() + md.size() + len);
+    std::shared_ptr<Segment> seg;
+    Entry e;
+    int err = _reserve(rec_len, seg, e.offset);
+    if (err) return err;
+    e.seg = seg->id;
+    e.md_len = md.size();
+    e.data_len = len;
+    e.data_crc = crc32c(0, data, len);
+    e.rec_len = rec_len;
+
+    err = _write_record(*seg, e.offset, id, md, data, len, rec_len);
+    if (!err && _config.sync && fdatasync(seg->fd)) err = errno;
+
+    std::shared_ptr<Wal> wal;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        seg->writers -= 1;
+        // close() may have run since _reserve(), and then the block cannot be indexed
+        if (!err && !_opened) err = EBADF;
+        // a failed write leaves garbage in the segment, which is reclaimed by compaction
+        if (!err) err = _append_wal_locked(WAL_PUT, id, e, wal);
+        if (!err) _apply_put_locked(id, e);
+    }
+    if (err) return err;
+    return _sync_wal(wal);
+}
+
+int
+BlockLog::read(const std::string& id, std::string& md, std::vector<uint8_t>& data)
+{
+    std::shared_ptr<Segment> seg;
+    Entry e;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _index.find(id);
+        if (it == _index.end()) return ENOENT;
+        e = it->second;
+        auto seg_it = _segments.find(e.seg);
+        if (seg_it == _segments.end()) return EIO;
+        seg = seg_it->second;
+    }
+    // the segment keeps its fd open while referenced, even if compaction removed it meanwhile
+    return _read_record(*seg, e, id, md, data);
+}
+
+bool
+BlockLog::has(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _index.find(id) != _index.end();
+}
+
+int
+BlockLog::remove(const std::vector<std::string>& ids, std::vector<bool>& found)
+{
+    found.assign(ids.size(), false);
+    std::shared_ptr<Wal> wal;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_opened) return EBADF;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto it = _index.find(ids[i]);
+            if (it == _index.end()) continue;
+            int err = _append_wal_locked(WAL_DEL, ids[i], it->second, wal);
+            if (err) return err;
+            _apply_del_locked(ids[i]);
+            found[i] = true;
+        }
+    }
+    return _sync_wal(wal);
+}
+
+int
+BlockLog::checkpoint()
+{
+    std::lock_guard<std::mutex> maintenance_lock(_maintenance_mutex);
+    Index snapshot;
+    uint64_t next_seg;
+    uint64_t wal_gen;
+    std::shared_ptr<Wal> old_wal;
+    {
+        // the snapshot and the WAL rotation are atomic, so the new WAL has exactly the changes after the snapshot
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_opened) return EBADF;
+        snapshot = _index;
+        next_seg = _next_seg;
+        old_wal = _wal;
+        int err = _open_wal(old_wal->gen + 1);
+        if (err) return err;
+        wal_gen = _wal->gen;
+    }
+
+    std::string body;
+    body.reserve(snapshot.size() * (sizeof(WalRecord) + 24));
+    for (auto const& it : snapshot) encode_wal_record(body, WAL_PUT, it.first, it.second);
+    CkptHeader h;
+    h.magic = CKPT_MAGIC;
+    h.version = CKPT_VERSION;
+    h.wal_gen = wal_gen;
+    h.next_seg = next_seg;
+    h.count = snapshot.size();
+    h.body_crc = crc32c(0, body.data(), body.size());
+    h.header_crc = crc32c(0, &h, offsetof(CkptHeader, header_crc));
+
+    std::string tmp_path = _ckpt_path() + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return errno;
+    struct iovec iov[2] = { { &h, sizeof(h) }, { (void*)body.data(), body.size() } };
+    int err = pwritev_full(fd, iov, 2, 0);
+    if (!err && fsync(fd)) err = errno;
+    ::close(fd);
+    if (!err && rename(tmp_path.c_str(), _ckpt_path().c_str())) err = errno;
+    if (!err) err = fsync_dir(_config.root_path);
+    if (err) {
+        ::unlink(tmp_path.c_str());
+        return err;
+    }
+    // the checkpoint covers all the older generations
+    for (uint64_t gen = _first_wal_gen; gen < wal_gen; ++gen) ::unlink(_wal_path(gen).c_str());
+    _first_wal_gen = wal_gen;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.checkpoints += 1;
+    uint64_t blocks = h.count;
+    DBG1("BlockLog::checkpoint: " << DVAL(_config.root_path) << DVAL(blocks) << DVAL(wal_gen));
+    return 0;
+}
+
+int
+BlockLog::compact(double min_garbage_ratio, int max_segments, CompactResult& res)
+{
+    std::lock_guard<std::mutex> maintenance_lock(_maintenance_mutex);
+    std::vector<std::shared_ptr<Segment>> segs;
+    std::map<uint32_t, std::vector<std::pair<std::string, Entry>>> moves;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_opened) return EBADF;
+        for (auto const& it : _segments) {
+            auto& seg = it.second;
+            // writers that reserved space before the segment was sealed may still add entries to it
+            if (seg == _active || seg->writers > 0 || seg->size == 0) continue;
+            double ratio = double(seg->size - seg->live_bytes) / seg->size;
+            if (ratio >= min_garbage_ratio) segs.push_back(seg);
+        }
+        std::sort(segs.begin(), segs.end(), [](const std::shared_ptr<Segment>& a, const std::shared_ptr<Segment>& b) {
+            return a->live_bytes * b->size < b->live_bytes * a->size;
+        });
+        if (max_segments > 0 && int(segs.size()) > max_segments) segs.resize(max_segments);
+        if (segs.empty()) return 0;
+        for (auto const& seg : segs) moves[seg->id];
+        for (auto const& it : _index) {
+            auto m = moves.find(it.second.seg);
+            if (m != moves.end()) m->second.push_back(it);
+        }
+    }
+
+    for (auto const& seg : segs) {
+        // copy the live records to the active segment and make them durable before pointing the index to them
+        std::vector<std::pair<std::string, Entry>> moved;
+        std::vector<std::shared_ptr<Segment>> targets;
+        std::string md;
+        std::vector<uint8_t> data;
+        int err = 0;
+        for (auto const& it : moves[seg->id]) {
+            err = _read_record(*seg, it.second, it.first, md, data);
+            if (err) break;
+            Entry e = it.second;
+            // the source segment may have been written with another alignment than the active segment
+            e.rec_len = _align(sizeof(RecordHeader) + it.first.size() + md.size() + data.size());
+            std::shared_ptr<Segment> target;
+            err = _reserve(e.rec_len, target, e.offset);
+            if (err) break;
+            e.seg = target->id;
+            err = _write_record(*target, e.offset, it.first, md, data.data(), data.size(), e.rec_len);
+            if (!err && _config.sync && (targets.empty() || targets.back() != target)) targets.push_back(target);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                target->writers -= 1;
+            }
+            if (err) break;
+            moved.emplace_back(it.first, e);
+            res.bytes += e.rec_len;
+        }
+        for (auto const& target : targets) {
+            if (!err && fdatasync(target->fd)) err = errno;
+        }
+        if (err) return err;
+
+        std::shared_ptr<Wal> wal;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < moved.size(); ++i) {
+                auto const& old_entry = moves[seg->id][i].second;
+                auto it = _index.find(moved[i].first);
+                // the block was deleted or overwritten while moving it, so the copy is garbage
+                if (it == _index.end() || it->second.seg != old_entry.seg || it->second.offset != old_entry.offset) continue;
+                err = _append_wal_locked(WAL_PUT, moved[i].first, moved[i].second, wal);
+                if (err) return err;
+                _apply_put_locked(moved[i].first, moved[i].second);
+                res.blocks += 1;
+            }
+        }
+        err = _sync_wal(wal);
+        if (err) return err;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (seg->live_bytes != 0) {
+                LOG("BlockLog::compact: segment still has live records " << DVAL(seg->path) << DVAL(seg->live_bytes));
+                continue;
+            }
+            _segments.erase(seg->id);
+            res.reclaimed_bytes += seg->size;
+            res.segments += 1;
+            _stats.compacted_segments += 1;
+            _stats.compacted_blocks += moved.size();
+            _stats.compacted_bytes += seg->size;
+        }
+        // readers that still hold the segment keep reading from the unlinked file
+        if (::unlink(seg->path.c_str()) && errno != ENOENT) return errno;
+    }
+    return 0;
+}
+
+BlockLog::Stats
+BlockLog::stats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats s = _stats;
+    s.blocks = _index.size();
+    s.data_bytes = _data_bytes;
+    s.segments = _segments.size();
+    for (auto const& it : _segments) {
+        s.live_bytes += it.second->live_bytes;
+        s.total_bytes += it.second->size;
+    }
+    if (_wal) {
+        s.wal_bytes = _wal->size;
+        s.wal_gen = _wal->gen;
+    }
+    return s;
+}
+
+} // namespace noobaa
@@ -0,0 +1,170 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../util/common.h"
+
+namespace noobaa
+{
+
+/**
+ * BlockLog is a log-structured store for agent blocks.
+ *
+ * Instead of a file (and a meta file) per block, blocks are appended to large segment files,
+ * and an in-memory index maps block_id -> (segment, offset, len, crc).
+ * Index changes are appended to a write-ahead log (WAL), and a checkpoint periodically
+ * persists the whole index so that startup reads the checkpoint and replays only a short WAL.
+ *
+ * Layout of the root dir:
+ *   segments/<seg_id>.seg - records of [header, block_id, md, data] aligned to 8 bytes (or 4K with direct_io)
+ *   wal.<gen>             - index changes since the checkpoint of that generation
+ *   index.ckpt            - the index snapshot and the WAL generation that follows it
+ *
+ * Only the active segment is written, and only it is opened with O_DIRECT (when direct_io is set),
+ * so the segments of a previous run are readable whether or not they were written with direct_io.
+ *
+ * Deleted and overwritten blocks leave garbage in their segments, which compact() reclaims
+ * by moving the live blocks of mostly-garbage segments to the active segment and removing the old segment.
+ *
+ * Writers reserve space in the active segment under the lock and write the data outside of it,
+ * so concurrent writes only serialize on the index update.
+ * Methods return 0 or an errno, and are safe to call from multiple threads.
+ */
+class BlockLog
+{
+public:
+    struct Config
+    {
+        std::string root_path;
+        uint64_t segment_size = 256 * 1024 * 1024;
+        bool direct_io = false;
+        // fdatasync the segment and the WAL before a write or delete returns
+        bool sync = true;
+    };
+
+    struct Entry
+    {
+        uint32_t seg = 0;
+        uint32_t md_len = 0;
+        uint32_t data_len = 0;
+        uint32_t data_crc = 0;
+        uint64_t offset = 0;
+        uint64_t rec_len = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t blocks = 0;
+        uint64_t data_bytes = 0;
+        uint64_t live_bytes = 0;
+        uint64_t total_bytes = 0;
+        uint64_t segments = 0;
+        uint64_t wal_bytes = 0;
+        uint64_t wal_gen = 0;
+        uint64_t recovered_wal_records = 0;
+        uint64_t checkpoints = 0;
+        uint64_t compacted_segments = 0;
+        uint64_t compacted_blocks = 0;
+        uint64_t compacted_bytes = 0;
+    };
+
+    struct CompactResult
+    {
+        uint64_t segments = 0;
+        uint64_t blocks = 0;
+        uint64_t bytes = 0;
+        uint64_t reclaimed_bytes = 0;
+    };
+
+    explicit BlockLog(const Config& config);
+    ~BlockLog();
+
+    // loads the checkpoint, replays the WAL and opens a new active segment
+    int open();
+    int close();
+
+    int write(const std::string& id, const std::string& md, const uint8_t* data, size_t len);
+    // returns ENOENT when the block does not exist, and EIO when the record does not match its index entry
+    int read(const std::string& id, std::string& md, std::vector<uint8_t>& data);
+    // removes the blocks and sets found[i] to whether block ids[i] existed
+    int remove(const std::vector<std::string>& ids, std::vector<bool>& found);
+    bool has(const std::string& id);
+
+    // persist the index and start a new WAL generation
+    int checkpoint();
+    // compact up to max_segments sealed segments with a garbage ratio of at least min_garbage_ratio
+    int compact(double min_garbage_ratio, int max_segments, CompactResult& res);
+
+    Stats stats();
+    const Config& config() const { return _config; }
+
+private:
+    struct Segment
+    {
+        uint32_t id = 0;
+        int fd = -1;
+        std::string path;
+        // end of the reserved space, and the bytes of the records that are still indexed
+        uint64_t size = 0;
+        uint64_t live_bytes = 0;
+        // writers that reserved space and did not update the index yet
+        int writers = 0;
+        // opened with O_DIRECT, so its records are written and read with aligned buffers
+        bool direct_io = false;
+        ~Segment();
+    };
+
+    struct Wal
+    {
+        uint64_t gen = 0;
+        int fd = -1;
+        std::string path;
+        uint64_t size = 0;
+        ~Wal();
+    };
+
+    typedef std::unordered_map<std::string, Entry> Index;
+
+    std::string _segment_path(uint32_t seg) const;
+    std::string _wal_path(uint64_t gen) const;
+    std::string _ckpt_path() const;
+    uint64_t _align(uint64_t n) const;
+
+    int _load_checkpoint(uint64_t& wal_gen);
+    int _replay_wal(uint64_t gen);
+    int _open_segments();
+    int _open_wal(uint64_t gen);
+    int _new_segment_locked();
+
+    int _reserve(uint64_t rec_len, std::shared_ptr<Segment>& seg, uint64_t& offset);
+    int _write_record(Segment& seg, uint64_t offset, const std::string& id, const std::string& md, const uint8_t* data, size_t len, uint64_t rec_len);
+    int _read_record(Segment& seg, const Entry& e, const std::string& id, std::string& md, std::vector<uint8_t>& data);
+    void _apply_put_locked(const std::string& id, const Entry& e);
+    bool _apply_del_locked(const std::string& id);
+    int _append_wal_locked(uint32_t type, const std::string& id, const Entry& e, std::shared_ptr<Wal>& wal);
+    int _sync_wal(const std::shared_ptr<Wal>& wal);
+
+    Config _config;
+    std::mutex _mutex;
+    // only one checkpoint or compaction at a time
+    std::mutex _maintenance_mutex;
+    Index _index;
+    std::map<uint32_t, std::shared_ptr<Segment>> _segments;
+    std::shared_ptr<Segment> _active;
+    std::shared_ptr<Wal> _wal;
+    uint32_t _next_seg = 1;
+    // the oldest WAL generation that was not removed yet
+    uint64_t _first_wal_gen = 1;
+    uint64_t _data_bytes = 0;
+    bool _opened = false;
+    Stats _stats;
+};
+
+} // namespace noobaa
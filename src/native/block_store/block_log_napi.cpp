@@ -0,0 +1,371 @@
+/* Copyright (C) 2016 NooBaa */
+#include "../util/common.h"
+#include "../util/napi.h"
+#include "../util/worker.h"
+#include "block_log.h"
+
+#include <uv.h>
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+/**
+ * BlockLogNapi is a napi object wrapper for BlockLog.
+ * All the methods except stats() run on the libuv threadpool and return a promise.
+ */
+struct BlockLogNapi : public Napi::ObjectWrap<BlockLogNapi>
+{
+    static Napi::FunctionReference constructor;
+    std::shared_ptr<BlockLog> _log;
+
+    static Napi::Function Init(Napi::Env env);
+    BlockLogNapi(const Napi::CallbackInfo& info);
+    Napi::Value open(const Napi::CallbackInfo& info);
+    Napi::Value close(const Napi::CallbackInfo& info);
+    Napi::Value write(const Napi::CallbackInfo& info);
+    Napi::Value read(const Napi::CallbackInfo& info);
+    Napi::Value remove(const Napi::CallbackInfo& info);
+    Napi::Value checkpoint(const Napi::CallbackInfo& info);
+    Napi::Value compact(const Napi::CallbackInfo& info);
+    Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+Napi::FunctionReference BlockLogNapi::constructor;
+
+Napi::Function
+BlockLogNapi::Init(Napi::Env env)
+{
+    constructor = Napi::Persistent(DefineClass(env,
+        "BlockLog",
+        {
+            InstanceMethod<&BlockLogNapi::open>("open"),
+            InstanceMethod<&BlockLogNapi::close>("close"),
+            InstanceMethod<&BlockLogNapi::write>("write"),
+            InstanceMethod<&BlockLogNapi::read>("read"),
+            InstanceMethod<&BlockLogNapi::remove>("remove"),
+            InstanceMethod<&BlockLogNapi::checkpoint>("checkpoint"),
+            InstanceMethod<&BlockLogNapi::compact>("compact"),
+            InstanceMethod<&BlockLogNapi::stats>("stats"),
+        }));
+    constructor.SuppressDestruct();
+    return constructor.Value();
+}
+
+/**
+ * new BlockLog({ root_path, segment_size, direct_io, sync })
+ */
+BlockLogNapi::BlockLogNapi(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<BlockLogNapi>(info)
+{
+    auto env = info.Env();
+    if (!info[0].IsObject()) {
+        throw Napi::TypeError::New(env, "BlockLog: expected params object");
+    }
+    auto params = info[0].As<Napi::Object>();
+    BlockLog::Config config;
+    if (!params.Get("root_path").IsString()) {
+        throw Napi::TypeError::New(env, "BlockLog: expected params.root_path");
+    }
+    config.root_path = params.Get("root_path").As<Napi::String>().Utf8Value();
+    if (params.Get("segment_size").IsNumber()) {
+        config.segment_size = params.Get("segment_size").As<Napi::Number>().Int64Value();
+    }
+    if (params.Has("direct_io")) config.direct_io = params.Get("direct_io").ToBoolean();
+    if (params.Has("sync")) config.sync = params.Get("sync").ToBoolean();
+    _log = std::make_shared<BlockLog>(config);
+    DBG1("BlockLogNapi::ctor " << DVAL(config.root_path) << DVAL(config.segment_size) << DVAL(config.direct_io));
+}
+
+/**
+ * BlockLogWorker is the base worker of the BlockLog methods.
+ * It keeps the log alive for the worker lifetime, and rejects with an error code like the fs module.
+ */
+struct BlockLogWorker : public ObjectWrapWorker<BlockLogNapi>
+{
+    std::shared_ptr<BlockLog> _log;
+    std::string _desc;
+    int _errno;
+
+    BlockLogWorker(const Napi::CallbackInfo& info)
+        : ObjectWrapWorker<BlockLogNapi>(info)
+        , _log(_wrap->_log)
+        , _errno(0)
+    {
+    }
+    void Begin(std::string desc)
+    {
+        _desc = desc;
+        DBG1("BlockLogWorker::Begin: " << _desc);
+    }
+    void SetErrno(int err)
+    {
+        _errno = err;
+        SetError(XSTR() << _desc << ": " << strerror(err));
+    }
+    virtual void OnError(Napi::Error const& error) override
+    {
+        auto env = Env();
+        DBG1("BlockLogWorker::OnError: " << _desc << " " << DVAL(error.Message()));
+        auto obj = error.Value();
+        if (_errno) obj.Set("code", Napi::String::New(env, uv_err_name(uv_translate_sys_error(_errno))));
+        _promise.Reject(obj);
+    }
+};
+
+struct BlockLogOpen : public BlockLogWorker
+{
+    BlockLogOpen(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+    {
+        Begin(XSTR() << "BlockLog::open " << _log->config().root_path);
+    }
+    virtual void Execute() override
+    {
+        int err = _log->open();
+        if (err) SetErrno(err);
+    }
+};
+
+struct BlockLogClose : public BlockLogWorker
+{
+    BlockLogClose(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+    {
+        Begin(XSTR() << "BlockLog::close " << _log->config().root_path);
+    }
+    virtual void Execute() override
+    {
+        int err = _log->close();
+        if (err) SetErrno(err);
+    }
+};
+
+struct BlockLogWrite : public BlockLogWorker
+{
+    std::string _id;
+    std::string _md;
+    const uint8_t* _data;
+    size_t _len;
+    BlockLogWrite(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+        , _data(0)
+        , _len(0)
+    {
+        _id = info[0].As<Napi::String>().Utf8Value();
+        _md = info[1].As<Napi::String>().Utf8Value();
+        auto buf = info[2].As<Napi::Buffer<uint8_t>>();
+        _data = buf.Data();
+        _len = buf.Length();
+        Begin(XSTR() << "BlockLog::write " << _id);
+    }
+    virtual void Execute() override
+    {
+        int err = _log->write(_id, _md, _data, _len);
+        if (err) SetErrno(err);
+    }
+};
+
+struct BlockLogRead : public BlockLogWorker
+{
+    std::string _id;
+    std::string _md;
+    std::vector<uint8_t> _data;
+    BlockLogRead(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+    {
+        _id = info[0].As<Napi::String>().Utf8Value();
+        Begin(XSTR() << "BlockLog::read " << _id);
+    }
+    virtual void Execute() override
+    {
+        int err = _log->read(_id, _md, _data);
+        if (err) SetErrno(err);
+    }
+    virtual void OnOK() override
+    {
+        auto env = Env();
+        auto res = Napi::Object::New(env);
+        res["md"] = Napi::String::New(env, _md);
+        // hand the vector memory to the buffer instead of copying it
+        auto data = new std::vector<uint8_t>(std::move(_data));
+        res["data"] = Napi::Buffer<uint8_t>::New(
+            env, data->data(), data->size(), [](Napi::Env, uint8_t*, std::vector<uint8_t>* v) { delete v; }, data);
+        _promise.Resolve(res);
+    }
+};
+
+struct BlockLogRemove : public BlockLogWorker
+{
+    std::vector<std::string> _ids;
+    std::vector<bool> _found;
+    BlockLogRemove(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+    {
+        auto ids = info[0].As<Napi::Array>();
+        for (uint32_t i = 0; i < ids.Length(); ++i) {
+            _ids.push_back(ids.Get(i).As<Napi::String>().Utf8Value());
+        }
+        Begin(XSTR() << "BlockLog::remove " << DVAL(_ids.size()));
+    }
+    virtual void Execute() override
+    {
+        int err = _log->remove(_ids, _found);
+        if (err) SetErrno(err);
+    }
+    virtual void OnOK() override
+    {
+        auto env = Env();
+        auto res = Napi::Object::New(env);
+        auto removed = Napi::Array::New(env);
+        auto missing = Napi::Array::New(env);
+        int num_removed = 0;
+        int num_missing = 0;
+        for (size_t i = 0; i < _ids.size(); ++i) {
+            if (_found[i]) {
+                removed.Set(num_removed++, Napi::String::New(env, _ids[i]));
+            } else {
+                missing.Set(num_missing++, Napi::String::New(env, _ids[i]));
+            }
+        }
+        res["removed"] = removed;
+        res["missing"] = missing;
+        _promise.Resolve(res);
+    }
+};
+
+struct BlockLogCheckpoint : public BlockLogWorker
+{
+    BlockLogCheckpoint(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+    {
+        Begin(XSTR() << "BlockLog::checkpoint " << _log->config().root_path);
+    }
+    virtual void Execute() override
+    {
+        int err = _log->checkpoint();
+        if (err) SetErrno(err);
+    }
+};
+
+struct BlockLogCompact : public BlockLogWorker
+{
+    double _min_garbage_ratio;
+    int _max_segments;
+    BlockLog::CompactResult _res;
+    BlockLogCompact(const Napi::CallbackInfo& info)
+        : BlockLogWorker(info)
+        , _min_garbage_ratio(0.5)
+        , _max_segments(0)
+    {
+        if (info[0].IsObject()) {
+            auto params = info[0].As<Napi::Object>();
+            if (params.Get("min_garbage_ratio").IsNumber()) {
+                _min_garbage_ratio = params.Get("min_garbage_ratio").As<Napi::Number>().DoubleValue();
+            }
+            if (params.Get("max_segments").IsNumber()) {
+                _max_segments = params.Get("max_segments").As<Napi::Number>().Int32Value();
+            }
+        }
+        Begin(XSTR() << "BlockLog::compact " << DVAL(_min_garbage_ratio) << DVAL(_max_segments));
+    }
+    virtual void Execute() override
+    {
+        int err = _log->compact(_min_garbage_ratio, _max_segments, _res);
+        if (err) SetErrno(err);
+    }
+    virtual void OnOK() override
+    {
+        auto env = Env();
+        auto res = Napi::Object::New(env);
+        res["segments"] = Napi::Number::New(env, _res.segments);
+        res["blocks"] = Napi::Number::New(env, _res.blocks);
+        res["bytes"] = Napi::Number::New(env, _res.bytes);
+        res["reclaimed_bytes"] = Napi::Number::New(env, _res.reclaimed_bytes);
+        _promise.Resolve(res);
+    }
+};
+
+Napi::Value
+BlockLogNapi::open(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogOpen>(info);
+}
+
+Napi::Value
+BlockLogNapi::close(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogClose>(info);
+}
+
+/**
+ * write(block_id, md, data)
+ */
+Napi::Value
+BlockLogNapi::write(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogWrite>(info);
+}
+
+/**
+ * read(block_id) => { md, data } or reject with ENOENT
+ */
+Napi::Value
+BlockLogNapi::read(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogRead>(info);
+}
+
+/**
+ * remove(block_ids) => { removed, missing }
+ */
+Napi::Value
+BlockLogNapi::remove(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogRemove>(info);
+}
+
+Napi::Value
+BlockLogNapi::checkpoint(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogCheckpoint>(info);
+}
+
+/**
+ * compact({ min_garbage_ratio, max_segments }) => { segments, blocks, bytes, reclaimed_bytes }
+ */
+Napi::Value
+BlockLogNapi::compact(const Napi::CallbackInfo& info)
+{
+    return await_worker<BlockLogCompact>(info);
+}
+
+Napi::Value
+BlockLogNapi::stats(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+    BlockLog::Stats s = _log->stats();
+    auto res = Napi::Object::New(env);
+    res["blocks"] = Napi::Number::New(env, s.blocks);
+    res["data_bytes"] = Napi::Number::New(env, s.data_bytes);
+    res["live_bytes"] = Napi::Number::New(env, s.live_bytes);
+    res["total_bytes"] = Napi::Number::New(env, s.total_bytes);
+    res["segments"] = Napi::Number::New(env, s.segments);
+    res["wal_bytes"] = Napi::Number::New(env, s.wal_bytes);
+    res["wal_gen"] = Napi::Number::New(env, s.wal_gen);
+    res["recovered_wal_records"] = Napi::Number::New(env, s.recovered_wal_records);
+    res["checkpoints"] = Napi::Number::New(env, s.checkpoints);
+    res["compacted_segments"] = Napi::Number::New(env, s.compacted_segments);
+    res["compacted_blocks"] = Napi::Number::New(env, s.compacted_blocks);
+    res["compacted_bytes"] = Napi::Number::New(env, s.compacted_bytes);
+    return res;
+}
+
+void
+block_log_napi(Napi::Env env, Napi::Object exports)
+{
+    exports["BlockLog"] = BlockLogNapi::Init(env);
+}
+
+} // namespace noobaa
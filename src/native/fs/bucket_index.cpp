@@ -0,0 +1,2083 @@
+/* Copyright (C) 2016 NooBaa */
+#include "bucket_index.h"
+
+#include "../third_party/isa-l/include/crc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <functional>
+#include <queue>
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+    #define flistxattr(a, b, c) ::flistxattr(a, b, c, 0)
+    #define fgetxattr(a, b, c, d) ::fgetxattr(a, b, c, d, 0, 0)
+#else
+    #define ENOATTR ENODATA
+#endif
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+static const uint64_t META_MAGIC = 0x58444e4942424e4eULL; // "NNBBINDX"
+static const uint32_t META_VERSION = 4;
+static const uint16_t PAGE_LEAF = 1;
+static const uint16_t PAGE_BRANCH = 2;
+static const uint16_t PAGE_FREE = 3;
+static const uint16_t PAGE_KEYS = 4;
+static const uint64_t MAX_DEPTH = 32;
+// ids of nodes that were modified in a transaction and have no page yet
+static const uint64_t DIRTY = 1ULL << 63;
+// a node smaller than this is merged with a sibling when the merged node is not larger than MERGE_MAX
+static const size_t MERGE_MIN = BucketIndex::PAGE_SIZE / 4;
+static const size_t MERGE_MAX = BucketIndex::PAGE_SIZE * 3 / 4;
+// rebuild fills pages up to this size, to leave room for inserts
+static const size_t BUILD_FILL = BucketIndex::PAGE_SIZE * 7 / 8;
+// rebuild sorts the names of a directory in memory up to this size, and merges sorted runs of larger directories
+static const size_t SORT_RUN_BYTES = 64 * 1024 * 1024;
+static const size_t LEAF_FIXED_SIZE = 30;
+static const uint64_t MAP_GROW_MAX = 1ULL << 30;
+// the keys list of a rebuild is lost when it grows beyond this, and then the rebuild does not complete the index
+static const uint64_t MAX_KEYS_PAGES = 1024;
+
+/**
+ * MetaPage is stored at the start of pages 0 and 1, a transaction writes the page of (txn % 2).
+ * All the on-disk structs are in host byte order.
+ */
+struct MetaPage
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t txn;
+    uint64_t root;
+    uint64_t num_pages;
+    uint64_t depth;
+    uint64_t objects;
+    uint64_t bytes;
+    int64_t built_ns;
+    uint64_t free_root;
+    uint64_t free_count;
+    uint64_t rebuild_id;
+    uint64_t keys_root;
+    uint64_t keys_pages;
+    uint32_t keys_lost;
+    uint32_t complete;
+    uint32_t crc;
+};
+
+/**
+ * A tree page is a PageHeader, an array of count uint16 offsets of the entries in key order,
+ * and the entries - uint16 key_len, key, uint16 val_len, val.
+ * A leaf value is the encoded entry (see encode_leaf_val), and a branch value is the uint64 child page,
+ * where the key of a branch entry is a lower bound of the keys in its child (ignored for the first entry).
+ */
+struct PageHeader
+{
+    uint16_t type;
+    uint16_t count;
+    uint32_t reserved;
+    uint64_t txn;
+};
+
+/**
+ * The free list of a transaction is a chain of free list pages - a PageHeader, the uint64 next page of the chain
+ * (0 at the end), and count uint64 free page numbers. The pages of the chain are not in the list.
+ */
+static const size_t FREE_LIST_OFFSET = sizeof(PageHeader) + 8;
+static const size_t FREE_LIST_CAP = (BucketIndex::PAGE_SIZE - FREE_LIST_OFFSET) / 8;
+
+/**
+ * The keys list of a rebuild is a chain of keys pages - a PageHeader, the uint64 next page of the chain (0 at the end),
+ * and count keys as uint16 length and bytes. Transactions add their keys to the first page while they fit.
+ */
+static const size_t KEYS_OFFSET = sizeof(PageHeader) + 8;
+
+static uint32_t
+crc32c(uint32_t crc, const void* buf, size_t len)
+{
+    return crc32_iscsi((unsigned char*)buf, len, crc);
+}
+
+template <typename T>
+static T
+load_as(const uint8_t* p)
+{
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <typename T>
+static void
+append_as(std::string& s, T v)
+{
+    s.append((const char*)&v, sizeof(v));
+}
+
+// reads the keys of a keys page, returns false when the page is not valid
+static bool
+load_keys_page(const uint8_t* p, std::vector<std::string>& keys, uint64_t& next)
+{
+    PageHeader h;
+    memcpy(&h, p, sizeof(h));
+    if (h.type != PAGE_KEYS) return false;
+    next = load_as<uint64_t>(p + sizeof(h));
+    size_t pos = KEYS_OFFSET;
+    for (int i = 0; i < h.count; ++i) {
+        if (pos + 2 > BucketIndex::PAGE_SIZE) return false;
+        size_t len = load_as<uint16_t>(p + pos);
+        if (pos + 2 + len > BucketIndex::PAGE_SIZE) return false;
+        keys.emplace_back((const char*)p + pos + 2, len);
+        pos += 2 + len;
+    }
+    return true;
+}
+
+static int
+pwrite_full(int fd, const void* buf, size_t len, off_t offset)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int
+fsync_dir_of(const std::string& path)
+{
+    std::string dir = path.substr(0, path.rfind('/') + 1);
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    int err = fsync(fd) ? errno : 0;
+    ::close(fd);
+    return err;
+}
+
+/**
+ * PageView reads a page in place. Pages come from a file that other processes write,
+ * so every page is validated before its entries are used.
+ */
+class PageView
+{
+public:
+    explicit PageView(const uint8_t* p)
+        : _p(p)
+    {
+        memcpy(&_h, p, sizeof(_h));
+    }
+
+    bool valid() const
+    {
+        if (_h.type != PAGE_LEAF && _h.type != PAGE_BRANCH) return false;
+        if (sizeof(_h) + _h.count * 2 > BucketIndex::PAGE_SIZE) return false;
+        for (int i = 0; i < _h.count; ++i) {
+            size_t off = offset(i);
+            if (off + 2 > BucketIndex::PAGE_SIZE) return false;
+            size_t key_len = load_as<uint16_t>(_p + off);
+            if (off + 4 + key_len > BucketIndex::PAGE_SIZE) return false;
+            size_t val_len = load_as<uint16_t>(_p + off + 2 + key_len);
+            if (off + 4 + key_len + val_len > BucketIndex::PAGE_SIZE) return false;
+            if (_h.type == PAGE_BRANCH && val_len != 8) return false;
+        }
+        return _h.type == PAGE_LEAF || _h.count > 0;
+    }
+
+    bool leaf() const { return _h.type == PAGE_LEAF; }
+    int count() const { return _h.count; }
+
+    std::string_view key(int i) const
+    {
+        size_t off = offset(i);
+        return std::string_view((const char*)_p + off + 2, load_as<uint16_t>(_p + off));
+    }
+
+    std::string_view val(int i) const
+    {
+        size_t off = offset(i);
+        size_t key_len = load_as<uint16_t>(_p + off);
+        return std::string_view((const char*)_p + off + 4 + key_len, load_as<uint16_t>(_p + off + 2 + key_len));
+    }
+
+    uint64_t child(int i) const { return load_as<uint64_t>((const uint8_t*)val(i).data()); }
+
+    // the first entry with key >= k
+    int lower_bound(std::string_view k) const
+    {
+        int lo = 0, hi = count();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (key(mid) < k) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // the last entry with key <= k, or the first entry
+    int child_index(std::string_view k) const
+    {
+        int lo = 1, hi = count();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (key(mid) <= k) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo - 1;
+    }
+
+private:
+    size_t offset(int i) const { return load_as<uint16_t>(_p + sizeof(_h) + i * 2); }
+    const uint8_t* _p;
+    PageHeader _h;
+};
+
+static int
+branch_child_index(const std::vector<std::string>& keys, const std::string& key)
+{
+    int i = std::upper_bound(keys.begin() + 1, keys.end(), key) - keys.begin();
+    return i - 1;
+}
+
+static uint64_t
+node_child(const std::vector<std::string>& vals, int i)
+{
+    return load_as<uint64_t>((const uint8_t*)vals[i].data());
+}
+
+static std::string
+child_val(uint64_t id)
+{
+    std::string v;
+    append_as<uint64_t>(v, id);
+    return v;
+}
+
+static size_t
+entry_bytes(size_t key_len, size_t val_len)
+{
+    return 2 + 4 + key_len + val_len;
+}
+
+/**
+ * Leaf values are uint64 size, int64 mtime_ns, uint64 ino, uint32 flags, uint16 xattr count,
+ * and the xattr pairs as uint16 length and bytes of the name and the value.
+ */
+static std::string
+encode_leaf_val(const BucketIndex::Entry& e)
+{
+    std::string v;
+    bool overflow = false;
+    size_t size = LEAF_FIXED_SIZE;
+    for (auto const& [name, value] : e.xattr) {
+        if (name.size() > UINT16_MAX || value.size() > UINT16_MAX) overflow = true;
+        size += 4 + name.size() + value.size();
+    }
+    if (entry_bytes(e.key.size(), size) > BucketIndex::MAX_ENTRY_SIZE) overflow = true;
+    append_as<uint64_t>(v, e.size);
+    append_as<int64_t>(v, e.mtime_ns);
+    append_as<uint64_t>(v, e.ino);
+    append_as<uint32_t>(v, e.flags | (overflow ? BucketIndex::FLAG_XATTR_OVERFLOW : 0));
+    append_as<uint16_t>(v, overflow ? 0 : e.xattr.size());
+    if (!overflow) {
+        for (auto const& [name, value] : e.xattr) {
+            append_as<uint16_t>(v, name.size());
+            v.append(name);
+            append_as<uint16_t>(v, value.size());
+            v.append(value);
+        }
+    }
+    return v;
+}
+
+static uint64_t
+leaf_val_size(std::string_view v)
+{
+    return v.size() >= LEAF_FIXED_SIZE ? load_as<uint64_t>((const uint8_t*)v.data()) : 0;
+}
+
+static bool
+decode_leaf_val(std::string_view key, std::string_view v, BucketIndex::Entry& e)
+{
+    if (v.size() < LEAF_FIXED_SIZE) return false;
+    const uint8_t* p = (const uint8_t*)v.data();
+    e.key.assign(key);
+    e.size = load_as<uint64_t>(p);
+    e.mtime_ns = load_as<int64_t>(p + 8);
+    e.ino = load_as<uint64_t>(p + 16);
+    e.flags = load_as<uint32_t>(p + 24);
+    int count = load_as<uint16_t>(p + 28);
+    e.xattr.clear();
+    size_t pos = LEAF_FIXED_SIZE;
+    for (int i = 0; i < count; ++i) {
+        if (pos + 2 > v.size()) return false;
+        size_t name_len = load_as<uint16_t>(p + pos);
+        if (pos + 4 + name_len > v.size()) return false;
+        size_t value_len = load_as<uint16_t>(p + pos + 2 + name_len);
+        if (pos + 4 + name_len + value_len > v.size()) return false;
+        e.xattr.emplace_back(std::string(v.substr(pos + 2, name_len)), std::string(v.substr(pos + 4 + name_len, value_len)));
+        pos += 4 + name_len + value_len;
+    }
+    return true;
+}
+
+// the smallest string that is greater than every string that starts with prefix, empty when there is none
+static std::string
+prefix_successor(std::string prefix)
+{
+    while (!prefix.empty() && (uint8_t)prefix.back() == 0xff) prefix.pop_back();
+    if (!prefix.empty()) prefix.back() = char((uint8_t)prefix.back() + 1);
+    return prefix;
+}
+
+static bool
+valid_key(const std::string& key)
+{
+    return !key.empty() && key.size() <= BucketIndex::MAX_KEY_SIZE;
+}
+
+static bool
+starts_with_any(const std::string& name, const std::vector<std::string>& prefixes)
+{
+    for (auto const& p : prefixes) {
+        if (name.compare(0, p.size(), p) == 0) return true;
+    }
+    return false;
+}
+
+// reads the selected xattrs of fd, and the dir content xattr when dir_content is given
+static int
+read_scan_xattr(int fd, const BucketIndex::ScanParams& params, BucketIndex::Xattr& xattr, std::string* dir_content, bool* has_dir_content)
+{
+    if (params.xattr_keys.empty() && params.xattr_prefixes.empty() && !dir_content) return 0;
+    std::vector<char> names;
+    for (;;) {
+        ssize_t len = flistxattr(fd, nullptr, 0);
+        if (len < 0) return errno == ENOTSUP ? 0 : errno;
+        names.resize(len);
+        len = flistxattr(fd, names.data(), names.size());
+        if (len >= 0) {
+            names.resize(len);
+            break;
+        }
+        if (errno != ERANGE) return errno;
+    }
+    std::vector<char> value;
+    for (size_t pos = 0; pos < names.size(); pos += strlen(&names[pos]) + 1) {
+        std::string name(&names[pos]);
+        bool selected = std::find(params.xattr_keys.begin(), params.xattr_keys.end(), name) != params.xattr_keys.end() ||
+            starts_with_any(name, params.xattr_prefixes);
+        bool is_dir_content = dir_content && name == params.dir_content_xattr;
+        if (!selected && !is_dir_content) continue;
+        ssize_t len = fgetxattr(fd, name.c_str(), nullptr, 0);
+        if (len >= 0) {
+            value.resize(len);
+            len = fgetxattr(fd, name.c_str(), value.data(), value.size());
+        }
+        if (len < 0) {
+            if (errno == ENOATTR || errno == ERANGE) continue;
+            return errno;
+        }
+        std::string v(value.data(), len);
+        if (is_dir_content) {
+            *dir_content = v;
+            *has_dir_content = true;
+        }
+        if (selected) xattr.emplace_back(std::move(name), std::move(v));
+    }
+    return 0;
+}
+
+static int64_t
+stat_mtime_ns(const struct stat& st)
+{
+#ifdef __APPLE__
+    return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+static bool
+skip_name(const BucketIndex::ScanParams& params, const std::string& name)
+{
+    return starts_with_any(name, params.skip_prefixes) ||
+        std::find(params.skip_names.begin(), params.skip_names.end(), name) != params.skip_names.end();
+}
+
+// reads the object that fd is open to into e, a directory is an object only when it has the dir content xattr
+static int
+read_entry(const BucketIndex::ScanParams& params, int fd, bool is_dir, BucketIndex::Entry& e, bool& is_object)
+{
+    is_object = false;
+    struct stat st;
+    if (fstat(fd, &st)) return errno;
+    std::string dir_content;
+    bool has_dir_content = false;
+    int err = read_scan_xattr(fd, params, e.xattr, is_dir ? &dir_content : nullptr, &has_dir_content);
+    if (err || !(is_dir ? S_ISDIR(st.st_mode) : S_ISREG(st.st_mode))) return err;
+    e.mtime_ns = stat_mtime_ns(st);
+    e.ino = st.st_ino;
+    e.size = is_dir ? strtoull(dir_content.c_str(), nullptr, 10) : st.st_size;
+    is_object = !is_dir || has_dir_content;
+    return 0;
+}
+
+// reads the object of key into e like a scan would find it, keys that a scan skips are not objects
+static int
+read_key(const BucketIndex::ScanParams& params, const std::string& key, BucketIndex::Entry& e, bool& is_object)
+{
+    is_object = false;
+    bool is_dir = key.back() == '/';
+    std::string rel = is_dir ? key.substr(0, key.size() - 1) : key;
+    for (size_t pos = 0; pos <= rel.size();) {
+        size_t end = std::min(rel.find('/', pos), rel.size());
+        std::string name = rel.substr(pos, end - pos);
+        if (name.empty() || name == "." || name == ".." || skip_name(params, name)) return 0;
+        pos = end + 1;
+    }
+    std::string path = params.root + "/" + rel;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | (is_dir ? O_DIRECTORY | O_NOFOLLOW : O_NONBLOCK));
+    if (fd < 0) return errno == ENOENT || errno == ENOTDIR || errno == ELOOP ? 0 : errno;
+    e.key = key;
+    int err = read_entry(params, fd, is_dir, e, is_object);
+    ::close(fd);
+    return err;
+}
+
+size_t
+BucketIndex::Node::bytes() const
+{
+    size_t n = sizeof(PageHeader);
+    for (size_t i = 0; i < keys.size(); ++i) n += entry_bytes(keys[i].size(), vals[i].size());
+    return n;
+}
+
+void
+BucketIndex::Node::load(const uint8_t* page)
+{
+    PageView v(page);
+    leaf = v.leaf();
+    keys.resize(v.count());
+    vals.resize(v.count());
+    for (int i = 0; i < v.count(); ++i) {
+        keys[i].assign(v.key(i));
+        vals[i].assign(v.val(i));
+    }
+}
+
+void
+BucketIndex::Node::store(uint8_t* page, uint64_t txn) const
+{
+    memset(page, 0, PAGE_SIZE);
+    PageHeader h = {};
+    h.type = leaf ? PAGE_LEAF : PAGE_BRANCH;
+    h.count = keys.size();
+    h.txn = txn;
+    memcpy(page, &h, sizeof(h));
+    size_t off = sizeof(h) + keys.size() * 2;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint16_t o = off;
+        memcpy(page + sizeof(h) + i * 2, &o, 2);
+        uint16_t key_len = keys[i].size();
+        uint16_t val_len = vals[i].size();
+        memcpy(page + off, &key_len, 2);
+        memcpy(page + off + 2, keys[i].data(), key_len);
+        memcpy(page + off + 2 + key_len, &val_len, 2);
+        memcpy(page + off + 4 + key_len, vals[i].data(), val_len);
+        off += 4 + key_len + val_len;
+    }
+}
+
+/**
+ * Txn modifies the tree copy-on-write - a node is loaded from its page into a dirty node before it is modified,
+ * and its parent is updated to the dirty node id. commit() writes the dirty nodes to free pages bottom up
+ * and then switches the meta page.
+ */
+struct BucketIndex::Txn
+{
+    BucketIndex& idx;
+    Meta meta;
+    std::vector<std::unique_ptr<Node>> nodes;
+    // committed pages that this transaction replaced, free once it commits
+    std::vector<uint64_t> freed;
+    // the keys that this transaction changed, added to the keys list when a rebuild is running
+    std::vector<std::string> changed;
+    std::vector<uint8_t> buf;
+
+    Txn(BucketIndex& i, const Meta& m)
+        : idx(i)
+        , meta(m)
+        , buf(PAGE_SIZE)
+    {
+    }
+
+    Node* node(uint64_t id) { return nodes[id & ~DIRTY].get(); }
+
+    uint64_t new_node(bool leaf)
+    {
+        nodes.emplace_back(new Node());
+        nodes.back()->leaf = leaf;
+        return DIRTY | (nodes.size() - 1);
+    }
+
+    int check_page(uint64_t pgno)
+    {
+        if (pgno < 2 || pgno >= meta.num_pages || !PageView(idx._page(pgno)).valid()) return EIO;
+        return 0;
+    }
+
+    // returns the dirty node id of id, loading its page when it is not dirty yet
+    int touch(uint64_t id, uint64_t& out)
+    {
+        if (id & DIRTY) {
+            out = id;
+            return 0;
+        }
+        int err = check_page(id);
+        if (err) return err;
+        out = new_node(true);
+        node(out)->load(idx._page(id));
+        freed.push_back(id);
+        return 0;
+    }
+
+    int node_bytes(uint64_t id, size_t& bytes)
+    {
+        if (id & DIRTY) {
+            bytes = node(id)->bytes();
+            return 0;
+        }
+        int err = check_page(id);
+        if (err) return err;
+        Node n;
+        n.load(idx._page(id));
+        bytes = n.bytes();
+        return 0;
+    }
+
+    // finds the value of key in the dirty or committed tree without modifying it
+    int find(const std::string& key, std::string& val, bool& found)
+    {
+        found = false;
+        uint64_t id = meta.root;
+        for (uint64_t level = 0; id; ++level) {
+            if (level >= MAX_DEPTH) return EIO;
+            if (id & DIRTY) {
+                Node* n = node(id);
+                if (n->leaf) {
+                    auto it = std::lower_bound(n->keys.begin(), n->keys.end(), key);
+                    if (it != n->keys.end() && *it == key) {
+                        val = n->vals[it - n->keys.begin()];
+                        found = true;
+                    }
+                    return 0;
+                }
+                id = node_child(n->vals, branch_child_index(n->keys, key));
+            } else {
+                int err = check_page(id);
+                if (err) return err;
+                PageView v(idx._page(id));
+                if (v.leaf()) {
+                    int i = v.lower_bound(key);
+                    if (i < v.count() && v.key(i) == key) {
+                        val.assign(v.val(i));
+                        found = true;
+                    }
+                    return 0;
+                }
+                id = v.child(v.child_index(key));
+            }
+        }
+        return 0;
+    }
+
+    // makes the path from the root to the leaf of key dirty, path holds the (branch, child index) pairs
+    int descend(const std::string& key, std::vector<std::pair<uint64_t, int>>& path, uint64_t& leaf)
+    {
+        uint64_t id;
+        if (!meta.root) {
+            id = new_node(true);
+            meta.depth = 1;
+        } else {
+            int err = touch(meta.root, id);
+            if (err) return err;
+        }
+        meta.root = id;
+        while (!node(id)->leaf) {
+            if (path.size() >= MAX_DEPTH) return EIO;
+            Node* n = node(id);
+            int i = branch_child_index(n->keys, key);
+            uint64_t child;
+            int err = touch(node_child(n->vals, i), child);
+            if (err) return err;
+            n->vals[i] = child_val(child);
+            path.emplace_back(id, i);
+            id = child;
+        }
+        leaf = id;
+        return 0;
+    }
+
+    int put(const Entry& e)
+    {
+        std::vector<std::pair<uint64_t, int>> path;
+        uint64_t id;
+        int err = descend(e.key, path, id);
+        if (err) return err;
+        Node* n = node(id);
+        std::string val = encode_leaf_val(e);
+        auto it = std::lower_bound(n->keys.begin(), n->keys.end(), e.key);
+        size_t i = it - n->keys.begin();
+        if (it != n->keys.end() && *it == e.key) {
+            meta.bytes -= leaf_val_size(n->vals[i]);
+            n->vals[i] = val;
+        } else {
+            n->keys.insert(it, e.key);
+            n->vals.insert(n->vals.begin() + i, val);
+            meta.objects += 1;
+        }
+        meta.bytes += e.size;
+        return fix(path, id);
+    }
+
+    int del(const std::string& key)
+    {
+        std::string val;
+        bool found;
+        int err = find(key, val, found);
+        if (err || !found) return err;
+        std::vector<std::pair<uint64_t, int>> path;
+        uint64_t id;
+        err = descend(key, path, id);
+        if (err) return err;
+        Node* n = node(id);
+        auto it = std::lower_bound(n->keys.begin(), n->keys.end(), key);
+        size_t i = it - n->keys.begin();
+        meta.bytes -= leaf_val_size(n->vals[i]);
+        meta.objects -= 1;
+        n->keys.erase(it);
+        n->vals.erase(n->vals.begin() + i);
+        return fix(path, id);
+    }
+
+    // moves the upper half of node id to a new node and returns its id
+    uint64_t split(uint64_t id)
+    {
+        Node* n = node(id);
+        size_t total = n->bytes();
+        size_t half = sizeof(PageHeader);
+        size_t i = 0;
+        while (i + 1 < n->keys.size() && half < total / 2) {
+            half += entry_bytes(n->keys[i].size(), n->vals[i].size());
+            i += 1;
+        }
+        uint64_t right_id = new_node(n->leaf);
+        Node* right = node(right_id);
+        n = node(id);
+        right->keys.assign(n->keys.begin() + i, n->keys.end());
+        right->vals.assign(n->vals.begin() + i, n->vals.end());
+        n->keys.resize(i);
+        n->vals.resize(i);
+        return right_id;
+    }
+
+    // splits, removes or merges the nodes along the path after the leaf id was modified
+    int fix(std::vector<std::pair<uint64_t, int>>& path, uint64_t id)
+    {
+        while (!path.empty()) {
+            auto [parent_id, i] = path.back();
+            path.pop_back();
+            Node* n = node(id);
+            if (n->bytes() > PAGE_SIZE) {
+                uint64_t right_id = split(id);
+                Node* p = node(parent_id);
+                p->keys.insert(p->keys.begin() + i + 1, node(right_id)->keys[0]);
+                p->vals.insert(p->vals.begin() + i + 1, child_val(right_id));
+            } else if (n->keys.empty()) {
+                Node* p = node(parent_id);
+                p->keys.erase(p->keys.begin() + i);
+                p->vals.erase(p->vals.begin() + i);
+            } else if (n->bytes() < MERGE_MIN && node(parent_id)->keys.size() > 1) {
+                Node* p = node(parent_id);
+                int j = i + 1 < (int)p->keys.size() ? i + 1 : i - 1;
+                size_t sibling_bytes;
+                int err = node_bytes(node_child(p->vals, j), sibling_bytes);
+                if (err) return err;
+                if (n->bytes() + sibling_bytes - sizeof(PageHeader) <= MERGE_MAX) {
+                    uint64_t sibling;
+                    err = touch(node_child(p->vals, j), sibling);
+                    if (err) return err;
+                    p = node(parent_id);
+                    p->vals[j] = child_val(sibling);
+                    int l = std::min(i, j), r = std::max(i, j);
+                    Node* left = node(node_child(p->vals, l));
+                    Node* right = node(node_child(p->vals, r));
+                    // the first key of a branch is ignored, so it takes the lower bound from the parent
+                    if (!right->leaf) right->keys[0] = p->keys[r];
+                    left->keys.insert(left->keys.end(), right->keys.begin(), right->keys.end());
+                    left->vals.insert(left->vals.end(), right->vals.begin(), right->vals.end());
+                    p->keys.erase(p->keys.begin() + r);
+                    p->vals.erase(p->vals.begin() + r);
+                }
+            }
+            id = parent_id;
+        }
+        // id is the root
+        Node* root = node(id);
+        if (root->bytes() > PAGE_SIZE) {
+            uint64_t right_id = split(id);
+            uint64_t new_root = new_node(false);
+            Node* r = node(new_root);
+            r->keys.push_back(std::string());
+            r->vals.push_back(child_val(id));
+            r->keys.push_back(node(right_id)->keys[0]);
+            r->vals.push_back(child_val(right_id));
+            meta.root = new_root;
+            meta.depth += 1;
+        } else if (root->keys.empty()) {
+            meta.root = 0;
+            meta.depth = 0;
+        } else {
+            while (!node(id)->leaf && node(id)->keys.size() == 1) {
+                int err = touch(node_child(node(id)->vals, 0), id);
+                if (err) return err;
+                meta.root = id;
+                meta.depth -= 1;
+            }
+        }
+        return 0;
+    }
+
+    void alloc(uint64_t& pgno)
+    {
+        if (!idx._free.empty()) {
+            pgno = idx._free.back();
+            idx._free.pop_back();
+        } else {
+            pgno = meta.num_pages++;
+        }
+    }
+
+    int write(uint64_t id, uint64_t& pgno)
+    {
+        Node* n = node(id);
+        if (!n->leaf) {
+            for (size_t i = 0; i < n->vals.size(); ++i) {
+                uint64_t child = node_child(n->vals, i);
+                if (!(child & DIRTY)) continue;
+                uint64_t child_pgno;
+                int err = write(child, child_pgno);
+                if (err) return err;
+                n->vals[i] = child_val(child_pgno);
+            }
+        }
+        alloc(pgno);
+        n->store(buf.data(), meta.txn + 1);
+        idx._stats.written_pages += 1;
+        return pwrite_full(idx._fd, buf.data(), PAGE_SIZE, pgno * PAGE_SIZE);
+    }
+
+    // frees the keys list, which starts a new list for a new rebuild
+    int reset_keys()
+    {
+        std::vector<std::string> keys;
+        for (uint64_t pgno = meta.keys_root; pgno;) {
+            if (pgno < 2 || pgno >= meta.num_pages || freed.size() > meta.num_pages) return EIO;
+            freed.push_back(pgno);
+            keys.clear();
+            if (!load_keys_page(idx._page(pgno), keys, pgno)) return EIO;
+        }
+        meta.keys_root = 0;
+        meta.keys_pages = 0;
+        meta.keys_lost = false;
+        return 0;
+    }
+
+    /**
+     * write_keys adds the changed keys to the keys list of a running rebuild - it replaces the first page of the list
+     * with pages that hold its keys and the changed keys, so the list stays about full.
+     */
+    int write_keys()
+    {
+        if (!meta.rebuild_id || meta.keys_lost || changed.empty()) return 0;
+        std::vector<std::string> keys;
+        uint64_t next = meta.keys_root;
+        if (meta.keys_root) {
+            if (meta.keys_root < 2 || meta.keys_root >= meta.num_pages) return EIO;
+            if (!load_keys_page(idx._page(meta.keys_root), keys, next)) return EIO;
+            freed.push_back(meta.keys_root);
+            meta.keys_pages -= 1;
+        }
+        keys.insert(keys.end(), changed.begin(), changed.end());
+        // the pages are written from the last to the first, so each one points to the one after it
+        std::vector<std::pair<size_t, size_t>> pages;
+        size_t bytes = PAGE_SIZE;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (bytes + 2 + keys[i].size() > PAGE_SIZE) {
+                pages.emplace_back(i, i);
+                bytes = KEYS_OFFSET;
+            }
+            pages.back().second = i + 1;
+            bytes += 2 + keys[i].size();
+        }
+        if (meta.keys_pages + pages.size() > MAX_KEYS_PAGES) {
+            meta.keys_lost = true;
+            return 0;
+        }
+        for (size_t i = pages.size(); i-- > 0;) {
+            memset(buf.data(), 0, PAGE_SIZE);
+            PageHeader h = {};
+            h.type = PAGE_KEYS;
+            h.count = pages[i].second - pages[i].first;
+            h.txn = meta.txn + 1;
+            memcpy(buf.data(), &h, sizeof(h));
+            memcpy(buf.data() + sizeof(h), &next, 8);
+            size_t pos = KEYS_OFFSET;
+            for (size_t k = pages[i].first; k < pages[i].second; ++k) {
+                uint16_t len = keys[k].size();
+                memcpy(buf.data() + pos, &len, 2);
+                memcpy(buf.data() + pos + 2, keys[k].data(), len);
+                pos += 2 + len;
+            }
+            alloc(next);
+            idx._stats.written_pages += 1;
+            int err = pwrite_full(idx._fd, buf.data(), PAGE_SIZE, next * PAGE_SIZE);
+            if (err) return err;
+        }
+        meta.keys_root = next;
+        meta.keys_pages += pages.size();
+        return 0;
+    }
+
+    /**
+     * write_free_list writes the free list of this transaction - the pages that are still free, the pages it replaced
+     * and the pages of the current free list - to pages that are free now, or to new pages at the end of the file.
+     */
+    int write_free_list(std::vector<uint64_t>& list, std::vector<uint64_t>& list_pages)
+    {
+        size_t count = idx._free.size() + freed.size() + idx._free_list_pages.size();
+        // every page of the new list that is taken from the free pages also leaves the list
+        size_t num = 0;
+        while (num * FREE_LIST_CAP < count - std::min(num, idx._free.size())) num += 1;
+        list_pages.resize(num);
+        for (auto& pgno : list_pages) alloc(pgno);
+        list = idx._free;
+        list.insert(list.end(), freed.begin(), freed.end());
+        list.insert(list.end(), idx._free_list_pages.begin(), idx._free_list_pages.end());
+        // in descending order so that the lowest pages are used first
+        std::sort(list.begin(), list.end(), std::greater<uint64_t>());
+        for (size_t i = 0; i < num; ++i) {
+            size_t begin = std::min(i * FREE_LIST_CAP, list.size());
+            size_t n = std::min(FREE_LIST_CAP, list.size() - begin);
+            memset(buf.data(), 0, PAGE_SIZE);
+            PageHeader h = {};
+            h.type = PAGE_FREE;
+            h.count = n;
+            h.txn = meta.txn + 1;
+            memcpy(buf.data(), &h, sizeof(h));
+            uint64_t next = i + 1 < num ? list_pages[i + 1] : 0;
+            memcpy(buf.data() + sizeof(h), &next, 8);
+            if (n) memcpy(buf.data() + FREE_LIST_OFFSET, &list[begin], n * 8);
+            idx._stats.written_pages += 1;
+            int err = pwrite_full(idx._fd, buf.data(), PAGE_SIZE, list_pages[i] * PAGE_SIZE);
+            if (err) return err;
+        }
+        meta.free_root = num ? list_pages[0] : 0;
+        meta.free_count = list.size();
+        return 0;
+    }
+
+    int commit()
+    {
+        std::vector<uint64_t> list;
+        std::vector<uint64_t> list_pages;
+        int err = 0;
+        if (meta.root & DIRTY) err = write(meta.root, meta.root);
+        if (!err) err = write_keys();
+        if (!err) err = write_free_list(list, list_pages);
+        if (!err && idx._config.sync && fdatasync(idx._fd)) err = errno;
+        if (!err) {
+            meta.txn += 1;
+            err = idx._write_meta(idx._fd, meta);
+        }
+        if (!err) err = idx._map_file(meta.num_pages);
+        if (err) {
+            // the meta page may not be written, so the next transaction reads the free list from the file
+            idx._free_txn = UINT64_MAX;
+            return err;
+        }
+        idx._free = std::move(list);
+        idx._free_list_pages = std::move(list_pages);
+        idx._free_txn = meta.txn;
+        idx._stats.txns += 1;
+        return 0;
+    }
+};
+
+/**
+ * Builder writes sorted entries to a new index file bottom up - it fills a leaf, writes it,
+ * and adds its first key to the branch above, which is written the same way when it fills up.
+ */
+class BucketIndex::Builder
+{
+public:
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t skipped = 0;
+
+    explicit Builder(int fd)
+        : _fd(fd)
+        , _buf(PAGE_SIZE)
+    {
+    }
+
+    int add(const Entry& e)
+    {
+        if (!valid_key(e.key)) {
+            skipped += 1;
+            return 0;
+        }
+        if (count && e.key <= _last_key) return EINVAL;
+        _last_key = e.key;
+        count += 1;
+        bytes += e.size;
+        return add_to_level(0, e.key, encode_leaf_val(e));
+    }
+
+    int finish(Meta& meta)
+    {
+        meta.objects = count;
+        meta.bytes = bytes;
+        for (size_t level = 0; level < _levels.size(); ++level) {
+            bool top = level + 1 == _levels.size();
+            if (top && !_level_pages[level]) {
+                int err = write_node(_levels[level], meta.root);
+                if (err) return err;
+                meta.depth = level + 1;
+                break;
+            }
+            if (!_levels[level].keys.empty()) {
+                int err = flush(level);
+                if (err) return err;
+            }
+        }
+        meta.num_pages = _next;
+        return 0;
+    }
+
+private:
+    int add_to_level(size_t level, const std::string& key, const std::string& val)
+    {
+        if (level == _levels.size()) {
+            _levels.emplace_back();
+            _levels.back().leaf = level == 0;
+            _level_pages.push_back(0);
+        }
+        if (!_levels[level].keys.empty() && _levels[level].bytes() + entry_bytes(key.size(), val.size()) > BUILD_FILL) {
+            int err = flush(level);
+            if (err) return err;
+        }
+        _levels[level].keys.push_back(key);
+        _levels[level].vals.push_back(val);
+        return 0;
+    }
+
+    int flush(size_t level)
+    {
+        uint64_t pgno;
+        int err = write_node(_levels[level], pgno);
+        if (err) return err;
+        _level_pages[level] += 1;
+        std::string first = std::move(_levels[level].keys[0]);
+        _levels[level].keys.clear();
+        _levels[level].vals.clear();
+        return add_to_level(level + 1, first, child_val(pgno));
+    }
+
+    int write_node(const Node& n, uint64_t& pgno)
+    {
+        pgno = _next++;
+        n.store(_buf.data(), 0);
+        return pwrite_full(_fd, _buf.data(), PAGE_SIZE, pgno * PAGE_SIZE);
+    }
+
+    int _fd;
+    uint64_t _next = 2;
+    std::vector<uint8_t> _buf;
+    std::vector<Node> _levels;
+    std::vector<uint64_t> _level_pages;
+    std::string _last_key;
+};
+
+/**
+ * ReadLock locks the index for readers of this process and shared for other processes,
+ * and makes sure the file is the current file of the path and its committed pages are mapped.
+ */
+class BucketIndex::ReadLock
+{
+public:
+    explicit ReadLock(BucketIndex& idx)
+        : _idx(idx)
+    {
+    }
+    ~ReadLock() { unlock(); }
+
+    int lock()
+    {
+        for (;;) {
+            _idx._rw_mutex.lock_shared();
+            _shared = true;
+            if (_idx._fd < 0) return EBADF;
+            {
+                std::lock_guard<std::mutex> guard(_idx._file_lock_mutex);
+                if (_idx._file_readers == 0) {
+                    int err = _idx._lock_file(F_RDLCK);
+                    if (err) return err;
+                }
+                _idx._file_readers += 1;
+                _file = true;
+            }
+            int err = _idx._check_file();
+            if (err != ESTALE) return err;
+            unlock();
+            std::unique_lock<std::shared_mutex> w(_idx._rw_mutex);
+            err = _idx._reopen();
+            if (err) return err;
+        }
+    }
+
+    void unlock()
+    {
+        if (_file) {
+            std::lock_guard<std::mutex> guard(_idx._file_lock_mutex);
+            _idx._file_readers -= 1;
+            if (_idx._file_readers == 0) _idx._unlock_file();
+            _file = false;
+        }
+        if (_shared) {
+            _idx._rw_mutex.unlock_shared();
+            _shared = false;
+        }
+    }
+
+private:
+    BucketIndex& _idx;
+    bool _shared = false;
+    bool _file = false;
+};
+
+/**
+ * WriteLock locks the index exclusively for this process and for other processes.
+ */
+class BucketIndex::WriteLock
+{
+public:
+    explicit WriteLock(BucketIndex& idx)
+        : _idx(idx)
+    {
+    }
+    ~WriteLock() { unlock(); }
+
+    int lock()
+    {
+        _idx._rw_mutex.lock();
+        _locked = true;
+        for (;;) {
+            if (_idx._fd < 0) return EBADF;
+            int err = _idx._lock_file(F_WRLCK);
+            if (err) return err;
+            _file = true;
+            err = _idx._check_file();
+            if (err != ESTALE) return err;
+            _idx._unlock_file();
+            _file = false;
+            err = _idx._reopen();
+            if (err) return err;
+        }
+    }
+
+    void unlock()
+    {
+        if (_file) {
+            _idx._unlock_file();
+            _file = false;
+        }
+        if (_locked) {
+            _idx._rw_mutex.unlock();
+            _locked = false;
+        }
+    }
+
+private:
+    BucketIndex& _idx;
+    bool _locked = false;
+    bool _file = false;
+};
+
+BucketIndex::BucketIndex(const Config& config)
+    : _config(config)
+{
+}
+
+BucketIndex::~BucketIndex()
+{
+    close();
+}
+
+static int
+lock_fd(int fd, short type)
+{
+    struct flock fl = {};
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &fl)) {
+        if (errno != EINTR) return errno;
+    }
+    return 0;
+}
+
+int
+BucketIndex::_lock_file(short type)
+{
+    return lock_fd(_fd, type);
+}
+
+void
+BucketIndex::_unlock_file()
+{
+    struct flock fl = {};
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fcntl(_fd, F_SETLK, &fl);
+}
+
+int
+BucketIndex::_read_meta(Meta& meta) const
+{
+    if (_map_size < 2 * PAGE_SIZE) return EIO;
+    bool found = false;
+    for (int slot = 0; slot < 2; ++slot) {
+        MetaPage mp;
+        memcpy(&mp, _page(slot), sizeof(mp));
+        if (mp.magic != META_MAGIC || mp.version != META_VERSION || mp.page_size != PAGE_SIZE) continue;
+        if (mp.crc != crc32c(0, &mp, offsetof(MetaPage, crc))) continue;
+        if (mp.num_pages < 2 || mp.root >= mp.num_pages || mp.free_root >= mp.num_pages ||
+            mp.keys_root >= mp.num_pages || mp.depth > MAX_DEPTH) {
+            continue;
+        }
+        if (found && mp.txn <= meta.txn) continue;
+        meta.txn = mp.txn;
+        meta.root = mp.root;
+        meta.num_pages = mp.num_pages;
+        meta.depth = mp.depth;
+        meta.objects = mp.objects;
+        meta.bytes = mp.bytes;
+        meta.built_ns = mp.built_ns;
+        meta.free_root = mp.free_root;
+        meta.free_count = mp.free_count;
+        meta.rebuild_id = mp.rebuild_id;
+        meta.keys_root = mp.keys_root;
+        meta.keys_pages = mp.keys_pages;
+        meta.keys_lost = mp.keys_lost;
+        meta.complete = mp.complete;
+        found = true;
+    }
+    return found ? 0 : EIO;
+}
+
+int
+BucketIndex::_write_meta(int fd, const Meta& meta)
+{
+    MetaPage mp = {};
+    mp.magic = META_MAGIC;
+    mp.version = META_VERSION;
+    mp.page_size = PAGE_SIZE;
+    mp.txn = meta.txn;
+    mp.root = meta.root;
+    mp.num_pages = meta.num_pages;
+    mp.depth = meta.depth;
+    mp.objects = meta.objects;
+    mp.bytes = meta.bytes;
+    mp.built_ns = meta.built_ns;
+    mp.free_root = meta.free_root;
+    mp.free_count = meta.free_count;
+    mp.rebuild_id = meta.rebuild_id;
+    mp.keys_root = meta.keys_root;
+    mp.keys_pages = meta.keys_pages;
+    mp.keys_lost = meta.keys_lost;
+    mp.complete = meta.complete;
+    mp.crc = crc32c(0, &mp, offsetof(MetaPage, crc));
+    int err = pwrite_full(fd, &mp, sizeof(mp), (meta.txn % 2) * PAGE_SIZE);
+    if (!err && _config.sync && fdatasync(fd)) err = errno;
+    return err;
+}
+
+// returns ESTALE when the path was replaced or the committed pages are not mapped, which requires _reopen()
+int
+BucketIndex::_check_file()
+{
+    struct stat st;
+    if (stat(_config.path.c_str(), &st)) return errno;
+    if (st.st_ino != _ino) return ESTALE;
+    Meta meta;
+    int err = _read_meta(meta);
+    if (err) return err;
+    if (meta.num_pages * PAGE_SIZE > _map_size) {
+        if (fstat(_fd, &st)) return errno;
+        if (meta.num_pages * PAGE_SIZE > (uint64_t)st.st_size) return EIO;
+        return ESTALE;
+    }
+    return 0;
+}
+
+// reopens the path when it was replaced and maps the whole file, called with _rw_mutex locked exclusively
+int
+BucketIndex::_reopen()
+{
+    if (_fd < 0) return EBADF;
+    struct stat st;
+    if (stat(_config.path.c_str(), &st)) return errno;
+    if (st.st_ino != _ino) {
+        int fd = ::open(_config.path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) return errno;
+        if (fstat(fd, &st)) {
+            int err = errno;
+            ::close(fd);
+            return err;
+        }
+        _unmap();
+        ::close(_fd);
+        _fd = fd;
+        _ino = st.st_ino;
+        _free_txn = UINT64_MAX;
+    } else if (fstat(_fd, &st)) {
+        return errno;
+    }
+    return _map_file(std::max<uint64_t>(2, st.st_size / PAGE_SIZE));
+}
+
+int
+BucketIndex::_map_file(uint64_t num_pages)
+{
+    uint64_t need = num_pages * PAGE_SIZE;
+    if (need <= _map_size) return 0;
+    // map ahead of the file size to remap less often, the pages past the end are never accessed
+    uint64_t size = std::max(need, std::min(_map_size * 2, need + MAP_GROW_MAX));
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED) return errno;
+    _unmap();
+    _map = (uint8_t*)map;
+    _map_size = size;
+    return 0;
+}
+
+void
+BucketIndex::_unmap()
+{
+    if (_map) munmap(_map, _map_size);
+    _map = nullptr;
+    _map_size = 0;
+}
+
+int
+BucketIndex::open()
+{
+    std::unique_lock<std::shared_mutex> w(_rw_mutex);
+    if (_fd >= 0) return 0;
+    _fd = ::open(_config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, _config.mode);
+    if (_fd < 0) return errno;
+    int err = _lock_file(F_WRLCK);
+    struct stat st = {};
+    if (!err && fstat(_fd, &st)) err = errno;
+    if (!err && (uint64_t)st.st_size < 2 * PAGE_SIZE) {
+        // a new file - an empty incomplete index in meta page 0, and an invalid meta page 1
+        std::vector<uint8_t> zeros(2 * PAGE_SIZE);
+        err = pwrite_full(_fd, zeros.data(), zeros.size(), 0);
+        if (!err) err = _write_meta(_fd, Meta());
+        if (!err && fdatasync(_fd)) err = errno;
+    }
+    _ino = st.st_ino;
+    Meta meta;
+    if (!err) err = _map_file(2);
+    if (!err) err = _read_meta(meta);
+    if (!err) err = _map_file(meta.num_pages);
+    _unlock_file();
+    if (err) {
+        _unmap();
+        ::close(_fd);
+        _fd = -1;
+        return err;
+    }
+    DBG1("BucketIndex::open " << DVAL(_config.path) << DVAL(meta.txn) << DVAL(meta.objects) << DVAL(meta.complete));
+    return 0;
+}
+
+int
+BucketIndex::close()
+{
+    std::unique_lock<std::shared_mutex> w(_rw_mutex);
+    if (_fd < 0) return 0;
+    _unmap();
+    int err = ::close(_fd) ? errno : 0;
+    _fd = -1;
+    _free.clear();
+    _free_list_pages.clear();
+    _free_txn = UINT64_MAX;
+    return err;
+}
+
+// reads the free list of the committed txn from its chain of free list pages
+int
+BucketIndex::_load_free_pages(const Meta& meta)
+{
+    _free.clear();
+    _free_list_pages.clear();
+    _free_txn = UINT64_MAX;
+    for (uint64_t pgno = meta.free_root; pgno;) {
+        if (pgno < 2 || pgno >= meta.num_pages || _free_list_pages.size() >= meta.num_pages) return EIO;
+        const uint8_t* p = _page(pgno);
+        PageHeader h;
+        memcpy(&h, p, sizeof(h));
+        if (h.type != PAGE_FREE || h.count > FREE_LIST_CAP) return EIO;
+        _free_list_pages.push_back(pgno);
+        for (int i = 0; i < h.count; ++i) {
+            uint64_t free_pgno = load_as<uint64_t>(p + FREE_LIST_OFFSET + i * 8);
+            if (free_pgno < 2 || free_pgno >= meta.num_pages) return EIO;
+            _free.push_back(free_pgno);
+        }
+        pgno = load_as<uint64_t>(p + sizeof(h));
+    }
+    if (_free.size() != meta.free_count) return EIO;
+    _free_txn = meta.txn;
+    return 0;
+}
+
+int
+BucketIndex::_apply_locked(const std::vector<Op>& ops, const std::function<int(Txn&)>& update)
+{
+    Meta meta;
+    int err = _read_meta(meta);
+    if (err) return err;
+    // another process committed since our last transaction, so our free pages may be used
+    if (_free_txn != meta.txn) err = _load_free_pages(meta);
+    if (err) return err;
+    Txn txn(*this, meta);
+    for (auto const& op : ops) {
+        if (op.scan) {
+            Entry e;
+            bool is_object;
+            err = read_key(*op.scan, op.entry.key, e, is_object);
+            if (!err) err = is_object ? txn.put(e) : txn.del(op.entry.key);
+        } else {
+            err = op.del ? txn.del(op.entry.key) : txn.put(op.entry);
+        }
+        if (err) return err;
+        txn.changed.push_back(op.entry.key);
+    }
+    if (update) err = update(txn);
+    if (err) return err;
+    return txn.commit();
+}
+
+/**
+ * _group_apply queues the ops of the calling thread, and the first thread that finds no commit in progress
+ * commits the queued ops of all the threads in one transaction, so concurrent writers of this process
+ * share the file lock and the fdatasyncs of one transaction.
+ */
+int
+BucketIndex::_group_apply(const std::vector<Op>& ops)
+{
+    Commit c;
+    c.ops = &ops;
+    std::unique_lock<std::mutex> lock(_commit_mutex);
+    _commit_queue.push_back(&c);
+    while (!c.done) {
+        if (_committing) {
+            _commit_cond.wait(lock);
+            continue;
+        }
+        _committing = true;
+        std::vector<Commit*> batch;
+        batch.swap(_commit_queue);
+        lock.unlock();
+        _commit_batch(batch);
+        lock.lock();
+        for (auto* b : batch) b->done = true;
+        _committing = false;
+        _commit_cond.notify_all();
+    }
+    return c.err;
+}
+
+void
+BucketIndex::_commit_batch(const std::vector<Commit*>& batch)
+{
+    WriteLock lock(*this);
+    int err = lock.lock();
+    if (err) {
+        for (auto* b : batch) b->err = err;
+        return;
+    }
+    std::vector<Op> ops;
+    for (auto* b : batch) ops.insert(ops.end(), b->ops->begin(), b->ops->end());
+    err = _apply_locked(ops);
+    if (!err || batch.size() == 1) {
+        for (auto* b : batch) b->err = err;
+        return;
+    }
+    // one failed op should not fail the ops of the other writers, so commit every writer alone
+    for (auto* b : batch) {
+        b->err = _apply_locked(*b->ops);
+    }
+}
+
+int
+BucketIndex::apply(const std::vector<Entry>& puts, const std::vector<std::string>& deletes)
+{
+    std::vector<Op> ops(puts.size() + deletes.size());
+    for (size_t i = 0; i < puts.size(); ++i) {
+        if (!valid_key(puts[i].key)) return EINVAL;
+        ops[i].entry = puts[i];
+    }
+    for (size_t i = 0; i < deletes.size(); ++i) {
+        if (!valid_key(deletes[i])) return EINVAL;
+        ops[puts.size() + i].del = true;
+        ops[puts.size() + i].entry.key = deletes[i];
+    }
+    if (ops.empty()) return 0;
+    return _group_apply(ops);
+}
+
+int
+BucketIndex::refresh(const ScanParams& params, const std::vector<std::string>& keys)
+{
+    std::vector<Op> ops(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!valid_key(keys[i])) return EINVAL;
+        ops[i].entry.key = keys[i];
+        ops[i].scan = &params;
+    }
+    if (ops.empty()) return 0;
+    return _group_apply(ops);
+}
+
+int
+BucketIndex::invalidate()
+{
+    WriteLock lock(*this);
+    int err = lock.lock();
+    if (err) return err;
+    Meta meta;
+    err = _read_meta(meta);
+    if (err || (!meta.complete && (!meta.rebuild_id || meta.keys_lost))) return err;
+    return _apply_locked({}, [](Txn& txn) {
+        txn.meta.complete = false;
+        // the change is not in the keys list, so a rebuild that runs now does not complete the index
+        if (txn.meta.rebuild_id) txn.meta.keys_lost = true;
+        return 0;
+    });
+}
+
+// reads the keys list of a rebuild, sorted and without duplicates
+int
+BucketIndex::_read_keys(const Meta& meta, std::vector<std::string>& keys) const
+{
+    uint64_t pages = 0;
+    for (uint64_t pgno = meta.keys_root; pgno; ++pages) {
+        if (pgno < 2 || pgno >= meta.num_pages || pages >= meta.keys_pages) return EIO;
+        if (!load_keys_page(_page(pgno), keys, pgno)) return EIO;
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    for (auto const& key : keys) {
+        if (!valid_key(key)) return EIO;
+    }
+    return 0;
+}
+
+int
+BucketIndex::_leaf_for(uint64_t root, const std::string& key, uint64_t& leaf) const
+{
+    Meta meta;
+    int err = _read_meta(meta);
+    if (err) return err;
+    uint64_t pgno = root;
+    for (uint64_t level = 1;; ++level) {
+        if (pgno < 2 || pgno >= meta.num_pages || level > meta.depth) return EIO;
+        PageView v(_page(pgno));
+        if (!v.valid() || v.leaf() != (level == meta.depth)) return EIO;
+        if (v.leaf()) break;
+        pgno = v.child(v.child_index(key));
+    }
+    leaf = pgno;
+    return 0;
+}
+
+int
+BucketIndex::get(const std::string& key, Entry& entry)
+{
+    ReadLock lock(*this);
+    int err = lock.lock();
+    if (err) return err;
+    Meta meta;
+    err = _read_meta(meta);
+    if (err) return err;
+    if (!meta.root) return ENOENT;
+    uint64_t leaf;
+    err = _leaf_for(meta.root, key, leaf);
+    if (err) return err;
+    PageView v(_page(leaf));
+    int i = v.lower_bound(key);
+    if (i >= v.count() || v.key(i) != key) return ENOENT;
+    return decode_leaf_val(v.key(i), v.val(i), entry) ? 0 : EIO;
+}
+
+static bool
+match_xattr(const BucketIndex::Entry& e, const BucketIndex::Xattr& filter)
+{
+    if (e.flags & BucketIndex::FLAG_XATTR_OVERFLOW) return true;
+    for (auto const& f : filter) {
+        if (std::find(e.xattr.begin(), e.xattr.end(), f) == e.xattr.end()) return false;
+    }
+    return true;
+}
+
+int
+BucketIndex::_list_locked(const Meta& meta, const ListParams& params, ListResult& res) const
+{
+    res.complete = meta.complete;
+    res.built_ns = meta.built_ns;
+    if (!meta.root || params.limit <= 0) return 0;
+    const std::string& prefix = params.prefix;
+    const std::string& delimiter = params.delimiter;
+    // the path of (page, index) from the root to the current leaf entry
+    std::vector<std::pair<uint64_t, int>> stack;
+    auto check = [&](uint64_t pgno, uint64_t level) {
+        if (pgno < 2 || pgno >= meta.num_pages) return false;
+        PageView v(_page(pgno));
+        return v.valid() && v.leaf() == (level == meta.depth);
+    };
+    auto seek = [&](const std::string& key) {
+        stack.clear();
+        uint64_t pgno = meta.root;
+        for (uint64_t level = 1; level <= meta.depth; ++level) {
+            if (!check(pgno, level)) return EIO;
+            PageView v(_page(pgno));
+            if (v.leaf()) {
+                stack.emplace_back(pgno, v.lower_bound(key));
+                return 0;
+            }
+            int i = v.child_index(key);
+            stack.emplace_back(pgno, i);
+            pgno = v.child(i);
+        }
+        return EIO;
+    };
+    // moves to the first entry of the next leaf, returns ENOENT at the end of the tree
+    auto next_leaf = [&]() {
+        stack.pop_back();
+        while (!stack.empty()) {
+            auto& [pgno, i] = stack.back();
+            PageView v(_page(pgno));
+            if (i + 1 < v.count()) {
+                i += 1;
+                uint64_t child = v.child(i);
+                for (uint64_t level = stack.size() + 1; level <= meta.depth; ++level) {
+                    if (!check(child, level)) return EIO;
+                    stack.emplace_back(child, 0);
+                    PageView c(_page(child));
+                    if (c.leaf()) return 0;
+                    child = c.child(0);
+                }
+                return EIO;
+            }
+            stack.pop_back();
+        }
+        return ENOENT;
+    };
+
+    bool after_marker = params.start_after >= prefix;
+    int err = seek(after_marker ? params.start_after : prefix);
+    if (err) return err;
+    int64_t results = 0;
+    Entry e;
+    for (;;) {
+        auto& [pgno, i] = stack.back();
+        PageView v(_page(pgno));
+        if (i >= v.count()) {
+            err = next_leaf();
+            if (err == ENOENT) break;
+            if (err) return err;
+            continue;
+        }
+        std::string_view key = v.key(i);
+        if (key.substr(0, prefix.size()) != prefix) break;
+        if (after_marker && key <= params.start_after) {
+            i += 1;
+            continue;
+        }
+        res.scanned += 1;
+        size_t pos = delimiter.empty() ? std::string::npos : key.find(delimiter, prefix.size());
+        if (pos != std::string::npos) {
+            std::string common_prefix(key.substr(0, pos + delimiter.size()));
+            // a common prefix that contains the marker was already listed
+            if (!after_marker || common_prefix > params.start_after) {
+                if (results >= params.limit) {
+                    res.truncated = true;
+                    break;
+                }
+                res.common_prefixes.push_back(common_prefix);
+                res.next_marker = common_prefix;
+                results += 1;
+            }
+            std::string next = prefix_successor(common_prefix);
+            if (next.empty()) break;
+            err = seek(next);
+            if (err) return err;
+            continue;
+        }
+        std::string_view val = v.val(i);
+        i += 1;
+        uint64_t size = leaf_val_size(val);
+        if (size < params.min_size || size > params.max_size) continue;
+        if (params.modified_before_ns && load_as<int64_t>((const uint8_t*)val.data() + 8) >= params.modified_before_ns) continue;
+        if (!decode_leaf_val(key, val, e)) return EIO;
+        if (!match_xattr(e, params.xattr)) continue;
+        if (results >= params.limit) {
+            res.truncated = true;
+            break;
+        }
+        res.next_marker = e.key;
+        res.entries.push_back(std::move(e));
+        results += 1;
+    }
+    return 0;
+}
+
+int
+BucketIndex::list(const ListParams& params, ListResult& res)
+{
+    ReadLock lock(*this);
+    int err = lock.lock();
+    if (err) return err;
+    Meta meta;
+    err = _read_meta(meta);
+    if (err) return err;
+    return _list_locked(meta, params, res);
+}
+
+BucketIndex::Usage
+BucketIndex::usage()
+{
+    Usage u;
+    ReadLock lock(*this);
+    Meta meta;
+    if (lock.lock() || _read_meta(meta)) return u;
+    u.objects = meta.objects;
+    u.bytes = meta.bytes;
+    u.txn = meta.txn;
+    u.complete = meta.complete;
+    u.built_ns = meta.built_ns;
+    return u;
+}
+
+BucketIndex::Stats
+BucketIndex::stats()
+{
+    std::unique_lock<std::shared_mutex> w(_rw_mutex);
+    Stats s = _stats;
+    Meta meta;
+    if (_fd >= 0 && !_read_meta(meta)) {
+        s.pages = meta.num_pages;
+        s.depth = meta.depth;
+    }
+    s.free_pages = _free.size();
+    return s;
+}
+
+/**
+ * NameSorter sorts the names of a directory - in memory up to SORT_RUN_BYTES,
+ * and for larger directories it writes sorted runs to unlinked temp files and merges them.
+ */
+class NameSorter
+{
+public:
+    explicit NameSorter(const std::string& tmp_prefix)
+        : _tmp_prefix(tmp_prefix)
+    {
+    }
+
+    ~NameSorter()
+    {
+        for (auto& r : _runs) ::close(r.fd);
+    }
+
+    int add(std::string name)
+    {
+        _bytes += name.size() + sizeof(std::string);
+        _names.push_back(std::move(name));
+        return _bytes > SORT_RUN_BYTES ? spill() : 0;
+    }
+
+    int finish()
+    {
+        std::sort(_names.begin(), _names.end());
+        if (_runs.empty()) return 0;
+        if (!_names.empty()) {
+            int err = spill();
+            if (err) return err;
+        }
+        for (size_t i = 0; i < _runs.size(); ++i) {
+            bool has;
+            int err = read_run(_runs[i], has);
+            if (err) return err;
+            if (has) _heap.push(i);
+        }
+        return 0;
+    }
+
+    // returns the next name in order, or has=false at the end
+    int next(std::string& name, bool& has)
+    {
+        if (_runs.empty()) {
+            has = _pos < _names.size();
+            if (has) name = std::move(_names[_pos++]);
+            return 0;
+        }
+        has = !_heap.empty();
+        if (!has) return 0;
+        size_t i = _heap.top();
+        _heap.pop();
+        name = std::move(_runs[i].cur);
+        bool more;
+        int err = read_run(_runs[i], more);
+        if (err) return err;
+        if (more) _heap.push(i);
+        return 0;
+    }
+
+private:
+    struct Run
+    {
+        int fd = -1;
+        off_t off = 0;
+        std::string buf;
+        size_t pos = 0;
+        std::string cur;
+    };
+
+    struct RunGreater
+    {
+        const std::vector<Run>* runs;
+        bool operator()(size_t a, size_t b) const { return (*runs)[a].cur > (*runs)[b].cur; }
+    };
+
+    int spill()
+    {
+        std::sort(_names.begin(), _names.end());
+        std::string path = _tmp_prefix + ".sort.XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd < 0) return errno;
+        unlink(path.c_str());
+        Run r;
+        r.fd = fd;
+        _runs.push_back(std::move(r));
+        std::string out;
+        off_t off = 0;
+        for (size_t i = 0; i <= _names.size(); ++i) {
+            if (out.size() >= 1024 * 1024 || (i == _names.size() && !out.empty())) {
+                int err = pwrite_full(fd, out.data(), out.size(), off);
+                if (err) return err;
+                off += out.size();
+                out.clear();
+            }
+            if (i < _names.size()) {
+                append_as<uint32_t>(out, _names[i].size());
+                out.append(_names[i]);
+            }
+        }
+        _names.clear();
+        _bytes = 0;
+        return 0;
+    }
+
+    // reads n bytes of the run into the buffer, returns false at the end of the run
+    int fill(Run& r, size_t n, bool& ok)
+    {
+        while (r.buf.size() - r.pos < n) {
+            r.buf.erase(0, r.pos);
+            r.pos = 0;
+            size_t len = r.buf.size();
+            r.buf.resize(len + std::max<size_t>(n, 256 * 1024));
+            ssize_t nread = pread(r.fd, &r.buf[len], r.buf.size() - len, r.off);
+            if (nread < 0) {
+                r.buf.resize(len);
+                if (errno == EINTR) continue;
+                return errno;
+            }
+            r.buf.resize(len + nread);
+            r.off += nread;
+            if (nread == 0) {
+                ok = false;
+                return 0;
+            }
+        }
+        ok = true;
+        return 0;
+    }
+
+    int read_run(Run& r, bool& has)
+    {
+        int err = fill(r, 4, has);
+        if (err || !has) return err;
+        uint32_t len = load_as<uint32_t>((const uint8_t*)&r.buf[r.pos]);
+        err = fill(r, 4 + len, has);
+        if (err) return err;
+        if (!has) return EIO;
+        r.cur.assign(r.buf, r.pos + 4, len);
+        r.pos += 4 + len;
+        return 0;
+    }
+
+    std::string _tmp_prefix;
+    std::vector<std::string> _names;
+    size_t _bytes = 0;
+    size_t _pos = 0;
+    std::vector<Run> _runs;
+    std::priority_queue<size_t, std::vector<size_t>, RunGreater> _heap{ RunGreater{ &_runs } };
+};
+
+/**
+ * scan_dir emits the objects under the directory dirfd in key order. The names are sorted with a '/' suffix
+ * for directories, which orders every subtree right where its keys belong among the names of its directory.
+ * Symlinks to files are followed, but symlinks to directories are not, to avoid loops.
+ */
+static int
+scan_dir(
+    const BucketIndex::ScanParams& params,
+    const std::string& tmp_prefix,
+    int dirfd,
+    const std::string& dir_key,
+    bool is_dir_object,
+    const std::function<int(const BucketIndex::Entry&)>& emit,
+    uint64_t& skipped)
+{
+    int fd = dup(dirfd);
+    if (fd < 0) return errno;
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        int err = errno;
+        ::close(fd);
+        return err;
+    }
+    NameSorter sorter(tmp_prefix);
+    int err = 0;
+    for (;;) {
+        errno = 0;
+        struct dirent* d = readdir(dir);
+        if (!d) {
+            err = errno;
+            break;
+        }
+        std::string name(d->d_name);
+        if (name == "." || name == ".." || skip_name(params, name) || (is_dir_object && name == params.folder_object_name)) {
+            continue;
+        }
+        bool is_dir = d->d_type == DT_DIR;
+        if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) {
+            struct stat st;
+            if (fstatat(dirfd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW)) continue;
+            if (S_ISLNK(st.st_mode)) {
+                if (fstatat(dirfd, name.c_str(), &st, 0)) continue;
+                if (!S_ISREG(st.st_mode)) continue;
+            }
+            is_dir = S_ISDIR(st.st_mode);
+            if (!is_dir && !S_ISREG(st.st_mode)) continue;
+        } else if (d->d_type != DT_DIR && d->d_type != DT_REG) {
+            continue;
+        }
+        err = sorter.add(is_dir ? name + "/" : name);
+        if (err) break;
+    }
+    closedir(dir);
+    if (!err) err = sorter.finish();
+    std::string sort_name;
+    bool has = false;
+    while (!err) {
+        err = sorter.next(sort_name, has);
+        if (err || !has) break;
+        bool is_dir = sort_name.back() == '/';
+        std::string name = is_dir ? sort_name.substr(0, sort_name.size() - 1) : sort_name;
+        BucketIndex::Entry e;
+        e.key = dir_key + sort_name;
+        if (e.key.size() > BucketIndex::MAX_KEY_SIZE) {
+            skipped += 1;
+            continue;
+        }
+        int child = openat(dirfd, name.c_str(), O_RDONLY | O_CLOEXEC | (is_dir ? O_DIRECTORY | O_NOFOLLOW : O_NONBLOCK));
+        if (child < 0) {
+            // removed while scanning
+            if (errno == ENOENT) continue;
+            err = errno;
+            break;
+        }
+        bool is_object = false;
+        err = read_entry(params, child, is_dir, e, is_object);
+        if (!err && is_object) err = emit(e);
+        // opened with O_DIRECTORY, so it is a directory
+        if (!err && is_dir) err = scan_dir(params, tmp_prefix, child, e.key, is_object, emit, skipped);
+        ::close(child);
+    }
+    return err;
+}
+
+int
+BucketIndex::_scan(const ScanParams& params, Builder& builder)
+{
+    int fd = ::open(params.root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    int err = scan_dir(params, _config.path, fd, "", false, [&](const Entry& e) { return builder.add(e); }, builder.skipped);
+    ::close(fd);
+    return err;
+}
+
+int
+BucketIndex::rebuild(const ScanParams& params, uint64_t& count)
+{
+    std::unique_lock<std::mutex> rebuild_lock(_rebuild_mutex, std::try_to_lock);
+    if (!rebuild_lock.owns_lock()) return EBUSY;
+    // one rebuild at a time in all the processes, the fcntl lock is released when its fd is closed or the process exits
+    std::string lock_path = _config.path + ".rebuild.lock";
+    int lock_file = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, _config.mode);
+    if (lock_file < 0) return errno;
+    struct flock fl = {};
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    int err = 0;
+    if (fcntl(lock_file, F_SETLK, &fl)) err = errno == EAGAIN || errno == EACCES ? EBUSY : errno;
+    if (!err) err = _rebuild(params, count);
+    ::close(lock_file);
+    return err;
+}
+
+/**
+ * _rebuild marks a rebuild in the meta page, so from then on the writers of all the processes add the keys
+ * they change to the keys list in the index. Then it scans the bucket into a new file, and replaces the index
+ * with it, and reads the objects of the listed keys again, because the scan may have missed their changes.
+ * The new index is complete unless the scan skipped objects or the keys list was lost.
+ */
+int
+BucketIndex::_rebuild(const ScanParams& params, uint64_t& count)
+{
+    // the tmp file of a rebuild that crashed is truncated
+    std::string tmp_path = _config.path + ".rebuild";
+    // changes made before the scan started are in the new index, so this is the time it is up to date with
+    int64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t rebuild_id = start_ns;
+    {
+        WriteLock lock(*this);
+        int err = lock.lock();
+        if (!err) {
+            err = _apply_locked({}, [&](Txn& txn) {
+                txn.meta.rebuild_id = rebuild_id;
+                return txn.reset_keys();
+            });
+        }
+        if (err) return err;
+    }
+
+    int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, _config.mode);
+    int err = fd < 0 ? errno : 0;
+    Builder builder(fd);
+    Meta meta;
+    meta.built_ns = start_ns;
+    if (!err) err = _scan(params, builder);
+    if (!err) err = builder.finish(meta);
+    if (!err && fdatasync(fd)) err = errno;
+    DBG1("BucketIndex::rebuild scanned " << DVAL(_config.path) << DVAL(builder.count) << DVAL(builder.skipped) << DVAL(err));
+
+    WriteLock lock(*this);
+    int lock_err = lock.lock();
+    if (!err) err = lock_err;
+    Meta current;
+    if (!err) err = _read_meta(current);
+    std::vector<std::string> keys;
+    if (!err) err = _read_keys(current, keys);
+    bool complete = !builder.skipped && current.rebuild_id == rebuild_id && !current.keys_lost;
+    struct stat st;
+    if (!err && fstat(fd, &st)) err = errno;
+    if (!err && ftruncate(fd, meta.num_pages * PAGE_SIZE)) err = errno;
+    if (!err) {
+        // the new file starts incomplete, and is completed by the transaction that reads the keys again
+        meta.txn = current.txn + 1;
+        meta.complete = false;
+        err = _write_meta(fd, meta);
+        if (!err && fdatasync(fd)) err = errno;
+    }
+    // lock the new file before it is visible, and then replace the current file, which releases its lock
+    if (!err) err = lock_fd(fd, F_WRLCK);
+    if (!err && rename(tmp_path.c_str(), _config.path.c_str())) err = errno;
+    if (err) {
+        if (fd >= 0) ::close(fd);
+        unlink(tmp_path.c_str());
+        // stop the writers from adding keys for this rebuild
+        if (!lock_err && current.rebuild_id == rebuild_id) {
+            _apply_locked({}, [](Txn& txn) {
+                txn.meta.rebuild_id = 0;
+                return txn.reset_keys();
+            });
+        }
+        return err;
+    }
+    fsync_dir_of(_config.path);
+    _unmap();
+    ::close(_fd);
+    _fd = fd;
+    _ino = st.st_ino;
+    _free_txn = UINT64_MAX;
+    err = _map_file(meta.num_pages);
+    std::vector<Op> ops(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ops[i].entry.key = keys[i];
+        ops[i].scan = &params;
+    }
+    if (!err) {
+        err = _apply_locked(ops, [&](Txn& txn) {
+            txn.meta.complete = complete;
+            return 0;
+        });
+    }
+    _stats.rebuilds += 1;
+    _stats.rebuild_entries += builder.count;
+    count = builder.count;
+    DBG1("BucketIndex::rebuild done " << DVAL(_config.path) << DVAL(count) << DVAL(keys.size()) << DVAL(complete) << DVAL(err));
+    return err;
+}
+
+} // namespace noobaa
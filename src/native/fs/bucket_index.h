@@ -0,0 +1,271 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "../util/common.h"
+
+namespace noobaa
+{
+
+/**
+ * BucketIndex is an embedded index of the objects of an NSFS bucket -
+ * a copy-on-write B+tree of key -> (size, mtime, ino, selected xattrs) in a single memory-mapped file.
+ *
+ * Every apply() is a transaction (concurrent calls of one process are committed together) - the modified pages are written to free pages (never over live pages),
+ * and then one of the two meta pages at the start of the file is switched to the new root.
+ * Open picks the valid meta page with the highest txn, so a crash leaves the last committed tree.
+ * Pages that a transaction replaced are reused by the next transactions - every transaction writes its list
+ * of free pages to the file, which the next writer reads when the last transaction was committed by another process.
+ *
+ * The file can be shared by the endpoint forks (and other hosts of a cluster filesystem) -
+ * readers lock the file shared and writers exclusive, so a reader always sees a committed tree,
+ * and a writer never reuses pages that a reader may still read. rebuild() replaces the file by rename,
+ * which the other processes detect by the inode of the path and reopen.
+ * fcntl locks do not exclude the threads of one process, so a process should open each path with one BucketIndex.
+ *
+ * Keys are ordered by bytes like S3 keys. The meta page also keeps the object count and total size
+ * of the bucket, a complete flag which is set by rebuild() and cleared by invalidate(),
+ * and the time of the last rebuild, so callers can bound how long a complete index is trusted.
+ * Methods return 0 or an errno, and are safe to call from multiple threads.
+ */
+class BucketIndex
+{
+public:
+    static const uint32_t PAGE_SIZE = 16384;
+    static const uint32_t MAX_KEY_SIZE = 1024;
+    // an entry with larger xattrs is indexed without them (FLAG_XATTR_OVERFLOW) so every page holds at least 4 entries
+    static const uint32_t MAX_ENTRY_SIZE = 4000;
+    static const uint32_t FLAG_XATTR_OVERFLOW = 1;
+
+    typedef std::vector<std::pair<std::string, std::string>> Xattr;
+
+    struct Config
+    {
+        std::string path;
+        // fdatasync the pages and the meta page before apply() returns
+        bool sync = true;
+        // the mode of a new index file (before the umask) - the index is opened with the credentials of the process,
+        // and holds the metadata of every account of the bucket, so no other user should read it
+        mode_t mode = 0600;
+    };
+
+    struct Entry
+    {
+        std::string key;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        uint64_t ino = 0;
+        uint32_t flags = 0;
+        Xattr xattr;
+    };
+
+    struct ListParams
+    {
+        std::string prefix;
+        std::string delimiter;
+        std::string start_after;
+        int64_t limit = 1000;
+        uint64_t min_size = 0;
+        uint64_t max_size = UINT64_MAX;
+        // entries modified at or after this time are filtered out, 0 for no filter
+        int64_t modified_before_ns = 0;
+        // entries without all these xattrs are filtered out, entries with FLAG_XATTR_OVERFLOW are always returned
+        Xattr xattr;
+    };
+
+    struct ListResult
+    {
+        std::vector<Entry> entries;
+        std::vector<std::string> common_prefixes;
+        bool truncated = false;
+        // the complete flag of the index that was listed
+        bool complete = false;
+        // the time (ns since epoch) that the scan of the last rebuild started, 0 if never rebuilt
+        int64_t built_ns = 0;
+        // the last key or common prefix that the list covered, to continue with start_after
+        std::string next_marker;
+        uint64_t scanned = 0;
+    };
+
+    struct Usage
+    {
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+        uint64_t txn = 0;
+        bool complete = false;
+        int64_t built_ns = 0;
+    };
+
+    /**
+     * ScanParams selects what rebuild() and refresh() index from the bucket directory.
+     * Names that start with one of skip_prefixes or equal one of skip_names are skipped at every level.
+     * A directory with the dir_content_xattr is indexed as the object "<dir>/" of that size, and its
+     * folder_object_name file is skipped. Only the xattrs in xattr_keys or with one of xattr_prefixes are kept.
+     */
+    struct ScanParams
+    {
+        std::string root;
+        std::vector<std::string> skip_prefixes;
+        std::vector<std::string> skip_names;
+        std::string dir_content_xattr;
+        std::string folder_object_name;
+        std::vector<std::string> xattr_keys;
+        std::vector<std::string> xattr_prefixes;
+    };
+
+    struct Stats
+    {
+        uint64_t pages = 0;
+        uint64_t free_pages = 0;
+        uint64_t depth = 0;
+        uint64_t txns = 0;
+        uint64_t written_pages = 0;
+        uint64_t rebuilds = 0;
+        uint64_t rebuild_entries = 0;
+    };
+
+    explicit BucketIndex(const Config& config);
+    ~BucketIndex();
+
+    // opens the index file, or creates an empty incomplete index
+    int open();
+    int close();
+
+    // one transaction that puts and then deletes, returns EINVAL for a key that is empty or too long
+    int apply(const std::vector<Entry>& puts, const std::vector<std::string>& deletes);
+    /**
+     * refresh sets the entries of keys to their objects as they are now in the params.root directory,
+     * and deletes the entries of keys that are not objects, in one transaction. The objects are read while
+     * the index is locked for write, so concurrent refreshes of a key never apply an older state over a newer one.
+     */
+    int refresh(const ScanParams& params, const std::vector<std::string>& keys);
+    // returns ENOENT when the key is not indexed
+    int get(const std::string& key, Entry& entry);
+    int list(const ListParams& params, ListResult& res);
+    Usage usage();
+    Stats stats();
+
+    /**
+     * rebuild scans the bucket directory (with the credentials of the calling thread, which should see every object)
+     * into a new index file and replaces the current index with it. The keys that the writers of all the processes
+     * change during the scan are read again from the bucket directory when it ends, so the new index is complete.
+     * Returns EBUSY when the index is already rebuilding. The scan of a large bucket can take hours,
+     * so the caller should run it on a thread of its own.
+     */
+    int rebuild(const ScanParams& params, uint64_t& count);
+    // clears the complete flag, used when the bucket changed without updating the index
+    int invalidate();
+
+    const Config& config() const { return _config; }
+
+private:
+    struct Meta
+    {
+        uint64_t txn = 0;
+        uint64_t root = 0;
+        uint64_t num_pages = 2;
+        uint64_t depth = 0;
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+        int64_t built_ns = 0;
+        uint64_t free_root = 0;
+        uint64_t free_count = 0;
+        // the running rebuild (0 for none), and its list of the keys that changed since it started
+        uint64_t rebuild_id = 0;
+        uint64_t keys_root = 0;
+        uint64_t keys_pages = 0;
+        // a change is missing from the keys list, so the running rebuild cannot complete the index
+        bool keys_lost = false;
+        bool complete = false;
+    };
+
+    struct Op
+    {
+        bool del = false;
+        Entry entry;
+        // refresh the entry of entry.key from the bucket directory
+        const ScanParams* scan = nullptr;
+    };
+
+    // Node is a page loaded for modification - the values of a leaf are encoded entries, and of a branch child page numbers
+    struct Node
+    {
+        bool leaf = true;
+        std::vector<std::string> keys;
+        std::vector<std::string> vals;
+        size_t bytes() const;
+        // load expects a valid page, store expects bytes() <= PAGE_SIZE
+        void load(const uint8_t* page);
+        void store(uint8_t* page, uint64_t txn) const;
+    };
+
+    // the ops of a writer thread that wait in the queue of _group_apply
+    struct Commit
+    {
+        const std::vector<Op>* ops = nullptr;
+        int err = 0;
+        bool done = false;
+    };
+
+    struct Txn;
+    class Builder;
+    class ReadLock;
+    class WriteLock;
+
+    const uint8_t* _page(uint64_t pgno) const { return _map + pgno * PAGE_SIZE; }
+    int _read_meta(Meta& meta) const;
+    int _write_meta(int fd, const Meta& meta);
+    int _lock_file(short type);
+    void _unlock_file();
+    int _check_file();
+    int _reopen();
+    int _map_file(uint64_t num_pages);
+    void _unmap();
+    int _leaf_for(uint64_t root, const std::string& key, uint64_t& leaf) const;
+    int _list_locked(const Meta& meta, const ListParams& params, ListResult& res) const;
+    int _load_free_pages(const Meta& meta);
+    // applies ops and then update in one transaction
+    int _apply_locked(const std::vector<Op>& ops, const std::function<int(Txn&)>& update = nullptr);
+    int _group_apply(const std::vector<Op>& ops);
+    void _commit_batch(const std::vector<Commit*>& batch);
+    int _read_keys(const Meta& meta, std::vector<std::string>& keys) const;
+    int _scan(const ScanParams& params, Builder& builder);
+    int _rebuild(const ScanParams& params, uint64_t& count);
+
+    Config _config;
+    /**
+     * _rw_mutex is the lock of the threads of this process - readers lock it shared and writers exclusive.
+     * Other processes are excluded with a fcntl lock on the whole file, which readers take shared
+     * (the first reader takes it and the last releases it, counted in _file_readers) and writers exclusive.
+     */
+    std::shared_mutex _rw_mutex;
+    std::mutex _file_lock_mutex;
+    int _file_readers = 0;
+    std::mutex _commit_mutex;
+    std::condition_variable _commit_cond;
+    std::vector<Commit*> _commit_queue;
+    bool _committing = false;
+    int _fd = -1;
+    ino_t _ino = 0;
+    uint8_t* _map = nullptr;
+    uint64_t _map_size = 0;
+    // the free list of txn _free_txn and the pages of its chain, only used by writers
+    std::vector<uint64_t> _free;
+    std::vector<uint64_t> _free_list_pages;
+    uint64_t _free_txn = UINT64_MAX;
+    // only one rebuild at a time in this process, and other processes are excluded by a lock file
+    std::mutex _rebuild_mutex;
+    Stats _stats;
+};
+
+} // namespace noobaa
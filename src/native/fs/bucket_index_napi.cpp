@@ -0,0 +1,518 @@
+/* Copyright (C) 2016 NooBaa */
+#include "../util/common.h"
+#include "../util/napi.h"
+#include "../util/worker.h"
+#include "bucket_index.h"
+
+#include <thread>
+#include <uv.h>
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+/**
+ * BucketIndexNapi is a napi object wrapper for BucketIndex.
+ * stats() is synchronous, rebuild() runs on its own thread, and the rest run on the libuv threadpool,
+ * and all of them but stats() return a promise.
+ */
+struct BucketIndexNapi : public Napi::ObjectWrap<BucketIndexNapi>
+{
+    static Napi::FunctionReference constructor;
+    std::shared_ptr<BucketIndex> _index;
+
+    static Napi::Function Init(Napi::Env env);
+    BucketIndexNapi(const Napi::CallbackInfo& info);
+    Napi::Value open(const Napi::CallbackInfo& info);
+    Napi::Value close(const Napi::CallbackInfo& info);
+    Napi::Value apply(const Napi::CallbackInfo& info);
+    Napi::Value refresh(const Napi::CallbackInfo& info);
+    Napi::Value get(const Napi::CallbackInfo& info);
+    Napi::Value list(const Napi::CallbackInfo& info);
+    Napi::Value usage(const Napi::CallbackInfo& info);
+    Napi::Value rebuild(const Napi::CallbackInfo& info);
+    Napi::Value invalidate(const Napi::CallbackInfo& info);
+    Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+Napi::FunctionReference BucketIndexNapi::constructor;
+
+Napi::Function
+BucketIndexNapi::Init(Napi::Env env)
+{
+    constructor = Napi::Persistent(DefineClass(env,
+        "BucketIndex",
+        {
+            InstanceMethod<&BucketIndexNapi::open>("open"),
+            InstanceMethod<&BucketIndexNapi::close>("close"),
+            InstanceMethod<&BucketIndexNapi::apply>("apply"),
+            InstanceMethod<&BucketIndexNapi::refresh>("refresh"),
+            InstanceMethod<&BucketIndexNapi::get>("get"),
+            InstanceMethod<&BucketIndexNapi::list>("list"),
+            InstanceMethod<&BucketIndexNapi::usage>("usage"),
+            InstanceMethod<&BucketIndexNapi::rebuild>("rebuild"),
+            InstanceMethod<&BucketIndexNapi::invalidate>("invalidate"),
+            InstanceMethod<&BucketIndexNapi::stats>("stats"),
+        }));
+    constructor.SuppressDestruct();
+    return constructor.Value();
+}
+
+/**
+ * new BucketIndex({ path, sync, mode })
+ */
+BucketIndexNapi::BucketIndexNapi(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<BucketIndexNapi>(info)
+{
+    auto env = info.Env();
+    if (!info[0].IsObject() || !info[0].As<Napi::Object>().Get("path").IsString()) {
+        throw Napi::TypeError::New(env, "BucketIndex: expected params.path");
+    }
+    auto params = info[0].As<Napi::Object>();
+    BucketIndex::Config config;
+    config.path = napi_get_str(params, "path");
+    if (params.Has("sync")) config.sync = params.Get("sync").ToBoolean();
+    if (params.Get("mode").IsNumber()) config.mode = params.Get("mode").As<Napi::Number>().Uint32Value();
+    _index = std::make_shared<BucketIndex>(config);
+    DBG1("BucketIndexNapi::ctor " << DVAL(config.path) << DVAL(config.sync) << DVAL(config.mode));
+}
+
+static std::vector<std::string>
+get_str_array(Napi::Value v)
+{
+    std::vector<std::string> res;
+    if (!v.IsArray()) return res;
+    auto arr = v.As<Napi::Array>();
+    for (uint32_t i = 0; i < arr.Length(); ++i) res.push_back(napi_get_str(arr.Get(i)));
+    return res;
+}
+
+static BucketIndex::Xattr
+get_xattr(Napi::Value v)
+{
+    BucketIndex::Xattr xattr;
+    if (!v.IsObject()) return xattr;
+    auto obj = v.As<Napi::Object>();
+    auto keys = obj.GetPropertyNames();
+    for (uint32_t i = 0; i < keys.Length(); ++i) {
+        auto key = napi_get_str(keys.Get(i));
+        auto val = obj.Get(key);
+        if (val.IsString()) xattr.emplace_back(key, napi_get_str(val));
+    }
+    return xattr;
+}
+
+static int64_t
+get_i64_or_bigint(Napi::Value v)
+{
+    bool lossless;
+    if (v.IsBigInt()) return v.As<Napi::BigInt>().Int64Value(&lossless);
+    if (v.IsNumber()) return napi_get_i64(v);
+    return 0;
+}
+
+static BucketIndex::ScanParams
+get_scan_params(const Napi::CallbackInfo& info, Napi::Value v, const char* method)
+{
+    if (!v.IsObject() || !v.As<Napi::Object>().Get("root").IsString()) {
+        throw Napi::TypeError::New(info.Env(), XSTR() << "BucketIndex." << method << ": expected params.root");
+    }
+    auto params = v.As<Napi::Object>();
+    BucketIndex::ScanParams scan;
+    scan.root = napi_get_str(params, "root");
+    scan.skip_prefixes = get_str_array(params.Get("skip_prefixes"));
+    scan.skip_names = get_str_array(params.Get("skip_names"));
+    scan.dir_content_xattr = napi_get_str_or(params, "dir_content_xattr", "");
+    scan.folder_object_name = napi_get_str_or(params, "folder_object_name", "");
+    scan.xattr_keys = get_str_array(params.Get("xattr_keys"));
+    scan.xattr_prefixes = get_str_array(params.Get("xattr_prefixes"));
+    return scan;
+}
+
+static Napi::Object
+entry_to_object(Napi::Env env, const BucketIndex::Entry& e)
+{
+    auto obj = Napi::Object::New(env);
+    obj["key"] = Napi::String::New(env, e.key);
+    obj["size"] = Napi::Number::New(env, e.size);
+    obj["mtime_ns"] = Napi::BigInt::New(env, e.mtime_ns);
+    obj["ino"] = Napi::Number::New(env, e.ino);
+    auto xattr = Napi::Object::New(env);
+    for (auto const& [name, value] : e.xattr) xattr[name] = Napi::String::New(env, value);
+    obj["xattr"] = xattr;
+    if (e.flags & BucketIndex::FLAG_XATTR_OVERFLOW) obj["xattr_overflow"] = Napi::Boolean::New(env, true);
+    return obj;
+}
+
+/**
+ * BucketIndexWorker is the base worker of the async BucketIndex methods.
+ * It keeps the index alive for the worker lifetime, and rejects with an error code like the fs module.
+ * Workers run with the credentials of the process and not of an account, because the index file
+ * and the scan of the bucket are shared by all the accounts of the bucket.
+ */
+struct BucketIndexWorker : public ObjectWrapWorker<BucketIndexNapi>
+{
+    std::shared_ptr<BucketIndex> _index;
+    std::string _desc;
+    int _errno;
+
+    BucketIndexWorker(const Napi::CallbackInfo& info)
+        : ObjectWrapWorker<BucketIndexNapi>(info)
+        , _index(_wrap->_index)
+        , _errno(0)
+    {
+    }
+    void Begin(std::string desc)
+    {
+        _desc = desc;
+        DBG1("BucketIndexWorker::Begin: " << _desc);
+    }
+    void SetErrno(int err)
+    {
+        _errno = err;
+        SetError(XSTR() << _desc << ": " << strerror(err));
+    }
+    virtual void OnError(Napi::Error const& error) override
+    {
+        auto env = Env();
+        DBG1("BucketIndexWorker::OnError: " << _desc << " " << DVAL(error.Message()));
+        auto obj = error.Value();
+        if (_errno) obj.Set("code", Napi::String::New(env, uv_err_name(uv_translate_sys_error(_errno))));
+        _promise.Reject(obj);
+    }
+};
+
+struct BucketIndexOpen : public BucketIndexWorker
+{
+    BucketIndexOpen(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+    {
+        Begin(XSTR() << "BucketIndex::open " << _index->config().path);
+    }
+    virtual void Execute() override
+    {
+        int err = _index->open();
+        if (err) SetErrno(err);
+    }
+};
+
+struct BucketIndexClose : public BucketIndexWorker
+{
+    BucketIndexClose(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+    {
+        Begin(XSTR() << "BucketIndex::close " << _index->config().path);
+    }
+    virtual void Execute() override
+    {
+        int err = _index->close();
+        if (err) SetErrno(err);
+    }
+};
+
+struct BucketIndexApply : public BucketIndexWorker
+{
+    std::vector<BucketIndex::Entry> _puts;
+    std::vector<std::string> _deletes;
+    BucketIndexApply(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+    {
+        if (info[0].IsArray()) {
+            auto puts = info[0].As<Napi::Array>();
+            for (uint32_t i = 0; i < puts.Length(); ++i) {
+                auto obj = puts.Get(i).As<Napi::Object>();
+                BucketIndex::Entry e;
+                e.key = napi_get_str(obj, "key");
+                e.size = napi_get_i64_or(obj, "size", 0);
+                e.mtime_ns = get_i64_or_bigint(obj.Get("mtime_ns"));
+                e.ino = napi_get_i64_or(obj, "ino", 0);
+                e.xattr = get_xattr(obj.Get("xattr"));
+                _puts.push_back(std::move(e));
+            }
+        }
+        _deletes = get_str_array(info[1]);
+        Begin(XSTR() << "BucketIndex::apply " << _index->config().path << DVAL(_puts.size()) << DVAL(_deletes.size()));
+    }
+    virtual void Execute() override
+    {
+        int err = _index->apply(_puts, _deletes);
+        if (err) SetErrno(err);
+    }
+};
+
+struct BucketIndexRefresh : public BucketIndexWorker
+{
+    BucketIndex::ScanParams _params;
+    std::vector<std::string> _keys;
+    BucketIndexRefresh(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+        , _params(get_scan_params(info, info[0], "refresh"))
+        , _keys(get_str_array(info[1]))
+    {
+        Begin(XSTR() << "BucketIndex::refresh " << _index->config().path << DVAL(_keys.size()));
+    }
+    virtual void Execute() override
+    {
+        int err = _index->refresh(_params, _keys);
+        if (err) SetErrno(err);
+    }
+};
+
+struct BucketIndexGet : public BucketIndexWorker
+{
+    std::string _key;
+    BucketIndex::Entry _entry;
+    BucketIndexGet(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+        , _key(napi_get_str(info[0]))
+    {
+        Begin(XSTR() << "BucketIndex::get " << _index->config().path << " " << _key);
+    }
+    virtual void Execute() override
+    {
+        int err = _index->get(_key, _entry);
+        if (err) SetErrno(err);
+    }
+    virtual void OnOK() override
+    {
+        _promise.Resolve(entry_to_object(Env(), _entry));
+    }
+};
+
+struct BucketIndexList : public BucketIndexWorker
+{
+    BucketIndex::ListParams _params;
+    BucketIndex::ListResult _res;
+    BucketIndexList(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+    {
+        if (info[0].IsObject()) {
+            auto params = info[0].As<Napi::Object>();
+            _params.prefix = napi_get_str_or(params, "prefix", "");
+            _params.delimiter = napi_get_str_or(params, "delimiter", "");
+            _params.start_after = napi_get_str_or(params, "start_after", "");
+            _params.limit = napi_get_i64_or(params, "limit", _params.limit);
+            _params.min_size = napi_get_i64_or(params, "min_size", 0);
+            if (params.Get("max_size").IsNumber()) _params.max_size = napi_get_i64(params, "max_size");
+            _params.modified_before_ns = get_i64_or_bigint(params.Get("modified_before_ns"));
+            _params.xattr = get_xattr(params.Get("xattr"));
+        }
+        Begin(XSTR() << "BucketIndex::list " << _index->config().path << DVAL(_params.prefix) << DVAL(_params.start_after));
+    }
+    virtual void Execute() override
+    {
+        int err = _index->list(_params, _res);
+        if (err) SetErrno(err);
+    }
+    virtual void OnOK() override
+    {
+        auto env = Env();
+        auto res = Napi::Object::New(env);
+        auto entries = Napi::Array::New(env, _res.entries.size());
+        for (uint32_t i = 0; i < _res.entries.size(); ++i) entries[i] = entry_to_object(env, _res.entries[i]);
+        auto common_prefixes = Napi::Array::New(env, _res.common_prefixes.size());
+        for (uint32_t i = 0; i < _res.common_prefixes.size(); ++i) common_prefixes[i] = Napi::String::New(env, _res.common_prefixes[i]);
+        res["entries"] = entries;
+        res["common_prefixes"] = common_prefixes;
+        res["is_truncated"] = Napi::Boolean::New(env, _res.truncated);
+        res["complete"] = Napi::Boolean::New(env, _res.complete);
+        res["built_time_ms"] = Napi::Number::New(env, _res.built_ns / 1000000);
+        res["next_marker"] = Napi::String::New(env, _res.next_marker);
+        res["scanned"] = Napi::Number::New(env, _res.scanned);
+        _promise.Resolve(res);
+    }
+};
+
+struct BucketIndexUsage : public BucketIndexWorker
+{
+    BucketIndex::Usage _usage;
+    BucketIndexUsage(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+    {
+        Begin(XSTR() << "BucketIndex::usage " << _index->config().path);
+    }
+    virtual void Execute() override
+    {
+        _usage = _index->usage();
+    }
+    virtual void OnOK() override
+    {
+        auto env = Env();
+        auto res = Napi::Object::New(env);
+        res["objects"] = Napi::Number::New(env, _usage.objects);
+        res["bytes"] = Napi::Number::New(env, _usage.bytes);
+        res["txn"] = Napi::Number::New(env, _usage.txn);
+        res["complete"] = Napi::Boolean::New(env, _usage.complete);
+        res["built_time_ms"] = Napi::Number::New(env, _usage.built_ns / 1000000);
+        _promise.Resolve(res);
+    }
+};
+
+/**
+ * BucketIndexRebuild runs a rebuild on a thread of its own and not on the libuv threadpool, which it would hold
+ * for the whole scan of the bucket (hours for a large bucket), and resolves the promise on the main thread.
+ */
+struct BucketIndexRebuild
+{
+    std::shared_ptr<BucketIndex> _index;
+    BucketIndex::ScanParams _params;
+    std::string _desc;
+    uint64_t _count = 0;
+    int _errno = 0;
+    Napi::Promise::Deferred _deferred;
+    Napi::ThreadSafeFunction _done;
+
+    BucketIndexRebuild(const Napi::CallbackInfo& info, std::shared_ptr<BucketIndex> index)
+        : _index(index)
+        , _params(get_scan_params(info, info[0], "rebuild"))
+        , _desc(XSTR() << "BucketIndex::rebuild " << index->config().path << DVAL(_params.root))
+        , _deferred(Napi::Promise::Deferred::New(info.Env()))
+    {
+        auto noop = Napi::Function::New(info.Env(), [](const Napi::CallbackInfo& info) {});
+        _done = Napi::ThreadSafeFunction::New(info.Env(), noop, "BucketIndexRebuild", 0, 1);
+    }
+
+    static void start(std::shared_ptr<BucketIndexRebuild> r)
+    {
+        DBG1("BucketIndexRebuild::start: " << r->_desc);
+        std::thread([r]() {
+            r->_errno = r->_index->rebuild(r->_params, r->_count);
+            r->_done.BlockingCall([r](Napi::Env env, Napi::Function) { r->finish(env); });
+            r->_done.Release();
+        }).detach();
+    }
+
+    void finish(Napi::Env env)
+    {
+        DBG1("BucketIndexRebuild::finish: " << _desc << DVAL(_count) << DVAL(_errno));
+        if (_errno) {
+            auto err = Napi::Error::New(env, XSTR() << _desc << ": " << strerror(_errno));
+            err.Set("code", Napi::String::New(env, uv_err_name(uv_translate_sys_error(_errno))));
+            _deferred.Reject(err.Value());
+        } else {
+            _deferred.Resolve(Napi::Number::New(env, _count));
+        }
+    }
+};
+
+struct BucketIndexInvalidate : public BucketIndexWorker
+{
+    BucketIndexInvalidate(const Napi::CallbackInfo& info)
+        : BucketIndexWorker(info)
+    {
+        Begin(XSTR() << "BucketIndex::invalidate " << _index->config().path);
+    }
+    virtual void Execute() override
+    {
+        int err = _index->invalidate();
+        if (err) SetErrno(err);
+    }
+};
+
+/**
+ * open() creates the index file when missing
+ */
+Napi::Value
+BucketIndexNapi::open(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexOpen>(info);
+}
+
+Napi::Value
+BucketIndexNapi::close(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexClose>(info);
+}
+
+/**
+ * apply(puts: [{ key, size, mtime_ns, ino, xattr }], deletes: [key]) in one transaction
+ */
+Napi::Value
+BucketIndexNapi::apply(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexApply>(info);
+}
+
+/**
+ * refresh({ root, ... same as rebuild }, keys: [key]) reads the objects of keys from the bucket directory
+ * in one transaction, and deletes the entries of keys that are not objects
+ */
+Napi::Value
+BucketIndexNapi::refresh(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexRefresh>(info);
+}
+
+/**
+ * get(key) => { key, size, mtime_ns, ino, xattr, xattr_overflow }, rejects with code ENOENT
+ */
+Napi::Value
+BucketIndexNapi::get(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexGet>(info);
+}
+
+/**
+ * list({ prefix, delimiter, start_after, limit, min_size, max_size, modified_before_ns, xattr })
+ *  => { entries, common_prefixes, is_truncated, complete, built_time_ms, next_marker, scanned }
+ */
+Napi::Value
+BucketIndexNapi::list(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexList>(info);
+}
+
+/**
+ * usage() => { objects, bytes, txn, complete, built_time_ms }
+ */
+Napi::Value
+BucketIndexNapi::usage(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexUsage>(info);
+}
+
+/**
+ * rebuild({ root, skip_prefixes, skip_names, dir_content_xattr, folder_object_name,
+ *           xattr_keys, xattr_prefixes }) => number of indexed objects, rejects with code EBUSY when already rebuilding
+ */
+Napi::Value
+BucketIndexNapi::rebuild(const Napi::CallbackInfo& info)
+{
+    auto r = std::make_shared<BucketIndexRebuild>(info, _index);
+    BucketIndexRebuild::start(r);
+    return r->_deferred.Promise();
+}
+
+Napi::Value
+BucketIndexNapi::invalidate(const Napi::CallbackInfo& info)
+{
+    return await_worker<BucketIndexInvalidate>(info);
+}
+
+/**
+ * stats() => counters of this process and the current file
+ */
+Napi::Value
+BucketIndexNapi::stats(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+    BucketIndex::Stats s = _index->stats();
+    auto res = Napi::Object::New(env);
+    res["pages"] = Napi::Number::New(env, s.pages);
+    res["free_pages"] = Napi::Number::New(env, s.free_pages);
+    res["depth"] = Napi::Number::New(env, s.depth);
+    res["txns"] = Napi::Number::New(env, s.txns);
+    res["written_pages"] = Napi::Number::New(env, s.written_pages);
+    res["rebuilds"] = Napi::Number::New(env, s.rebuilds);
+    res["rebuild_entries"] = Napi::Number::New(env, s.rebuild_entries);
+    return res;
+}
+
+void
+bucket_index_napi(Napi::Env env, Napi::Object exports)
+{
+    exports["BucketIndex"] = BucketIndexNapi::Init(env);
+}
+
+} // namespace noobaa
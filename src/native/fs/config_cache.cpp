@@ -0,0 +1,542 @@
+/* Copyright (C) 2016 NooBaa */
+#include "config_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef __linux__
+    #include <sys/inotify.h>
+    #include <sys/statfs.h>
+#endif
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+#ifdef __linux__
+static const uint32_t WATCH_MASK =
+    IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// filesystems that do not report the changes of other hosts (or of the userspace server) to inotify
+static const int64_t REMOTE_FS_MAGICS[] = {
+    0x6969, // NFS
+    0x47504653, // GPFS
+    0xFF534D42, // CIFS
+    0xFE534D42, // SMB2
+    0x65735546, // FUSE
+    0x00C36400, // CEPH
+    0x0BD00BD0, // LUSTRE
+    0x01021997, // 9P
+};
+#endif
+
+static int64_t
+now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static bool
+same_version(const struct stat& a, const struct stat& b)
+{
+#ifdef __APPLE__
+    const struct timespec &am = a.st_mtimespec, &bm = b.st_mtimespec, &ac = a.st_ctimespec, &bc = b.st_ctimespec;
+#else
+    const struct timespec &am = a.st_mtim, &bm = b.st_mtim, &ac = a.st_ctim, &bc = b.st_ctim;
+#endif
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+        am.tv_sec == bm.tv_sec && am.tv_nsec == bm.tv_nsec && ac.tv_sec == bc.tv_sec && ac.tv_nsec == bc.tv_nsec;
+}
+
+static std::string
+dir_of(const std::string& path)
+{
+    size_t pos = path.rfind('/');
+    if (pos == std::string::npos) return ".";
+    if (pos == 0) return "/";
+    return path.substr(0, pos);
+}
+
+static size_t
+cost_of(const ConfigFile& file)
+{
+    return sizeof(ConfigFile) + file.path.size() + file.data.size();
+}
+
+/**
+ * read the whole file into file.data and set stable when it did not change while reading
+ */
+static int
+read_whole_file(const std::string& path, ConfigFile& file, bool& stable)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    int err = 0;
+    if (fstat(fd, &file.stat)) {
+        err = errno;
+        ::close(fd);
+        return err;
+    }
+    file.data.resize(std::max<off_t>(file.stat.st_size, 0));
+    size_t pos = 0;
+    while (true) {
+        if (pos == file.data.size()) file.data.resize(pos + 4096);
+        ssize_t len = ::read(fd, file.data.data() + pos, file.data.size() - pos);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        if (len == 0) break;
+        pos += len;
+    }
+    file.data.resize(pos);
+    struct stat st;
+    if (!err && fstat(fd, &st)) err = errno;
+    ::close(fd);
+    stable = !err && int64_t(pos) == int64_t(file.stat.st_size) && same_version(st, file.stat);
+    return err;
+}
+
+ConfigCache::ConfigCache()
+{
+}
+
+ConfigCache::~ConfigCache()
+{
+    if (_watcher.joinable()) {
+        char c = 0;
+        while (::write(_wake_pipe[1], &c, 1) < 0 && errno == EINTR) {}
+        _watcher.join();
+    }
+    for (int fd : { _inotify_fd, _wake_pipe[0], _wake_pipe[1] }) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+void
+ConfigCache::configure(const Config& config)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _clear();
+    _config = config;
+    _config.max_file_size = std::max<int64_t>(0, _config.max_file_size);
+    _config.validate_ms = std::max<int64_t>(0, _config.validate_ms);
+    _enabled = _config.max_entries > 0 && _config.max_bytes > 0 && _config.max_file_size > 0;
+}
+
+std::shared_ptr<const ConfigFile>
+ConfigCache::get(const std::string& path, const User& user)
+{
+    if (_size == 0) return nullptr;
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry* e = _find(path, user);
+    if (!e || !_fresh(*e, now_ms())) return nullptr;
+    _touch(e);
+    _hits += 1;
+    return e->file;
+}
+
+int
+ConfigCache::read(const std::string& path, const User& user, std::shared_ptr<const ConfigFile>& file, bool& hit)
+{
+    hit = false;
+    int64_t now = now_ms();
+    std::shared_ptr<const ConfigFile> prev;
+    Config config;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        config = _config;
+        Entry* e = _find(path, user);
+        if (e) {
+            if (_fresh(*e, now)) {
+                _touch(e);
+                _hits += 1;
+                file = e->file;
+                hit = true;
+                return 0;
+            }
+            prev = e->file;
+        }
+    }
+
+    // a stale entry costs a stat when the file did not change
+    if (prev) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && same_version(st, prev->stat)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Entry* e = _find(path, user);
+            if (e && e->file == prev) {
+                e->validated_ms = now;
+                _touch(e);
+            }
+            _validations += 1;
+            _hits += 1;
+            file = prev;
+            hit = true;
+            return 0;
+        }
+    }
+
+    _misses += 1;
+    auto entry = std::make_unique<Entry>();
+    if (_enabled) {
+        _resolve(path, entry->names);
+        // the watches are added before reading, so any change after the read is reported
+        if (config.watch) entry->watched = _watch(entry->names, entry->wds);
+    }
+    uint64_t epoch = _epoch;
+    auto new_file = std::make_shared<ConfigFile>();
+    new_file->path = path;
+    bool stable = false;
+    int err = read_whole_file(path, *new_file, stable);
+    if (err || !stable || int64_t(new_file->data.size()) > config.max_file_size || !_enabled) {
+        if (!entry->wds.empty()) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _release_watches(entry->wds);
+        }
+        if (!err) file = new_file;
+        return err;
+    }
+    entry->file = new_file;
+    entry->user = user;
+    entry->validated_ms = now;
+    file = new_file;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _insert(std::move(entry), epoch);
+    return 0;
+}
+
+void
+ConfigCache::remove(const std::string& path)
+{
+    if (!_enabled) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _epoch += 1;
+    if (_size == 0) return;
+    std::vector<Entry*> entries;
+    auto it = _map.find(path);
+    if (it != _map.end()) {
+        for (auto& e : it->second) entries.push_back(e.get());
+    }
+    auto range = _names.equal_range(path);
+    for (auto i = range.first; i != range.second; ++i) entries.push_back(i->second);
+    _erase_all(entries);
+}
+
+ConfigCache::Stats
+ConfigCache::stats(bool reset)
+{
+    Stats s;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        s.entries = _size;
+        s.bytes = _bytes;
+        s.watched_entries = _watched;
+        s.watches = _watches.size();
+    }
+    s.hits = reset ? _hits.exchange(0) : _hits.load();
+    s.misses = reset ? _misses.exchange(0) : _misses.load();
+    s.validations = reset ? _validations.exchange(0) : _validations.load();
+    s.inserts = reset ? _inserts.exchange(0) : _inserts.load();
+    s.evictions = reset ? _evictions.exchange(0) : _evictions.load();
+    s.invalidations = reset ? _invalidations.exchange(0) : _invalidations.load();
+    s.watch_events = reset ? _watch_events.exchange(0) : _watch_events.load();
+    s.watch_errors = reset ? _watch_errors.exchange(0) : _watch_errors.load();
+    return s;
+}
+
+bool
+ConfigCache::_fresh(const Entry& e, int64_t now) const
+{
+    return e.watched || now - e.validated_ms < _config.validate_ms;
+}
+
+ConfigCache::Entry*
+ConfigCache::_find(const std::string& path, const User& user)
+{
+    auto it = _map.find(path);
+    if (it == _map.end()) return nullptr;
+    for (auto& e : it->second) {
+        if (e->user == user) return e.get();
+    }
+    return nullptr;
+}
+
+void
+ConfigCache::_touch(Entry* e)
+{
+    _lru.splice(_lru.begin(), _lru, e->lru_it);
+}
+
+void
+ConfigCache::_insert(std::unique_ptr<Entry> entry, uint64_t epoch)
+{
+    if (!_enabled) {
+        _release_watches(entry->wds);
+        return;
+    }
+    // a change since the read started may belong to this file, so it is validated by stat on the next read
+    if (_epoch != epoch) {
+        entry->watched = false;
+        entry->validated_ms = 0;
+        _release_watches(entry->wds);
+        entry->wds.clear();
+    }
+    Entry* prev = _find(entry->file->path, entry->user);
+    if (prev) _erase(prev);
+    Entry* e = entry.get();
+    _lru.push_front(e);
+    e->lru_it = _lru.begin();
+    for (auto const& name : e->names) _names.emplace(name, e);
+    _map[e->file->path].push_back(std::move(entry));
+    _size += 1;
+    _bytes += cost_of(*e->file);
+    if (e->watched) _watched += 1;
+    _inserts += 1;
+    _evict();
+}
+
+void
+ConfigCache::_erase(Entry* e)
+{
+    for (auto const& name : e->names) {
+        auto range = _names.equal_range(name);
+        for (auto i = range.first; i != range.second; ++i) {
+            if (i->second == e) {
+                _names.erase(i);
+                break;
+            }
+        }
+    }
+    _lru.erase(e->lru_it);
+    _release_watches(e->wds);
+    _size -= 1;
+    _bytes -= cost_of(*e->file);
+    if (e->watched) _watched -= 1;
+    auto it = _map.find(e->file->path);
+    auto& list = it->second;
+    for (auto i = list.begin(); i != list.end(); ++i) {
+        if (i->get() == e) {
+            list.erase(i);
+            break;
+        }
+    }
+    if (list.empty()) _map.erase(it);
+}
+
+void
+ConfigCache::_erase_all(std::vector<Entry*>& entries)
+{
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    for (Entry* e : entries) {
+        DBG1("ConfigCache: invalidated " << DVAL(e->file->path));
+        _erase(e);
+        _invalidations += 1;
+    }
+}
+
+void
+ConfigCache::_evict()
+{
+    while (!_lru.empty() && (_size > _config.max_entries || _bytes > _config.max_bytes)) {
+        _erase(_lru.back());
+        _evictions += 1;
+    }
+}
+
+void
+ConfigCache::_clear()
+{
+    while (!_lru.empty()) _erase(_lru.back());
+}
+
+/**
+ * _resolve sets the names whose changes invalidate the file - the path itself in its real directory,
+ * and the real path of its target when the path is a symlink (like the accounts_by_name index).
+ */
+void
+ConfigCache::_resolve(const std::string& path, std::vector<std::string>& names)
+{
+    char buf[PATH_MAX];
+    std::string name = path;
+    if (::realpath(dir_of(path).c_str(), buf)) {
+        std::string dir(buf);
+        name = (dir == "/" ? dir : dir + "/") + path.substr(path.rfind('/') + 1);
+    }
+    names.push_back(name);
+    if (::realpath(path.c_str(), buf) && name != buf) names.push_back(buf);
+}
+
+/**
+ * _watch adds inotify watches for the directories of the names, and returns false
+ * (without keeping any watch) if any of them cannot be watched or is on a remote filesystem.
+ */
+bool
+ConfigCache::_watch(const std::vector<std::string>& names, std::vector<int>& wds)
+{
+#ifdef __linux__
+    std::vector<std::string> dirs;
+    for (auto const& name : names) {
+        std::string dir = dir_of(name);
+        if (std::find(dirs.begin(), dirs.end(), dir) != dirs.end()) continue;
+        struct statfs sfs;
+        if (::statfs(dir.c_str(), &sfs)) return false;
+        for (int64_t magic : REMOTE_FS_MAGICS) {
+            if (int64_t(uint32_t(sfs.f_type)) == magic) return false;
+        }
+        dirs.push_back(dir);
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto const& dir : dirs) {
+        int wd = _add_watch(dir);
+        if (wd < 0) {
+            _release_watches(wds);
+            wds.clear();
+            return false;
+        }
+        wds.push_back(wd);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+int
+ConfigCache::_add_watch(const std::string& dir)
+{
+#ifdef __linux__
+    auto it = _dir_wds.find(dir);
+    if (it != _dir_wds.end()) {
+        _watches[it->second].refs += 1;
+        return it->second;
+    }
+    if (_inotify_fd < 0) {
+        _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify_fd < 0) {
+            DBG0("ConfigCache: inotify_init1 failed " << DVAL(strerror(errno)));
+            _watch_errors += 1;
+            return -1;
+        }
+        if (pipe2(_wake_pipe, O_CLOEXEC)) {
+            DBG0("ConfigCache: pipe2 failed " << DVAL(strerror(errno)));
+            ::close(_inotify_fd);
+            _inotify_fd = -1;
+            _watch_errors += 1;
+            return -1;
+        }
+        _watcher = std::thread(&ConfigCache::_watcher_main, this);
+    }
+    int wd = inotify_add_watch(_inotify_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        DBG1("ConfigCache: inotify_add_watch failed " << DVAL(dir) << DVAL(strerror(errno)));
+        _watch_errors += 1;
+        return -1;
+    }
+    // the same directory under another path (a bind mount) reports its events with the other path
+    auto w = _watches.find(wd);
+    if (w != _watches.end()) {
+        if (w->second.dir != dir) return -1;
+        w->second.refs += 1;
+        return wd;
+    }
+    _watches[wd] = Watch{ dir, 1 };
+    _dir_wds[dir] = wd;
+    return wd;
+#else
+    return -1;
+#endif
+}
+
+void
+ConfigCache::_release_watches(const std::vector<int>& wds)
+{
+#ifdef __linux__
+    for (int wd : wds) {
+        auto it = _watches.find(wd);
+        if (it == _watches.end()) continue;
+        if (--it->second.refs > 0) continue;
+        inotify_rm_watch(_inotify_fd, wd);
+        auto d = _dir_wds.find(it->second.dir);
+        if (d != _dir_wds.end() && d->second == wd) _dir_wds.erase(d);
+        _watches.erase(it);
+    }
+#endif
+}
+
+void
+ConfigCache::_watcher_main()
+{
+#ifdef __linux__
+    DBG1("ConfigCache: watcher started");
+    alignas(struct inotify_event) char buf[64 * 1024];
+    while (true) {
+        struct pollfd fds[2] = { { _inotify_fd, POLLIN, 0 }, { _wake_pipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            DBG0("ConfigCache: poll failed " << DVAL(strerror(errno)));
+            break;
+        }
+        if (fds[1].revents) break;
+        ssize_t len = ::read(_inotify_fd, buf, sizeof(buf));
+        if (len <= 0) continue;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (char* p = buf; p < buf + len;) {
+            auto ev = reinterpret_cast<struct inotify_event*>(p);
+            _handle_event(ev->wd, ev->mask, ev->len ? ev->name : nullptr);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    DBG1("ConfigCache: watcher stopped");
+#endif
+}
+
+void
+ConfigCache::_handle_event(int wd, uint32_t mask, const char* name)
+{
+#ifdef __linux__
+    _watch_events += 1;
+    _epoch += 1;
+    std::vector<Entry*> entries;
+    if (mask & IN_Q_OVERFLOW) {
+        DBG0("ConfigCache: inotify queue overflow, dropping all the watched entries");
+        for (Entry* e : _lru) {
+            if (e->watched) entries.push_back(e);
+        }
+        _erase_all(entries);
+        return;
+    }
+    auto it = _watches.find(wd);
+    if (it == _watches.end()) return;
+    if (!name || (mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT))) {
+        // the directory itself changed or is gone, and a new watch is needed for a directory at the same path
+        if (mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+            auto d = _dir_wds.find(it->second.dir);
+            if (d != _dir_wds.end() && d->second == wd) _dir_wds.erase(d);
+        }
+        for (Entry* e : _lru) {
+            if (std::find(e->wds.begin(), e->wds.end(), wd) != e->wds.end()) entries.push_back(e);
+        }
+    } else {
+        const std::string& dir = it->second.dir;
+        std::string key = (dir == "/" ? dir : dir + "/") + name;
+        auto range = _names.equal_range(key);
+        for (auto i = range.first; i != range.second; ++i) entries.push_back(i->second);
+    }
+    _erase_all(entries);
+#endif
+}
+
+} // namespace noobaa
@@ -0,0 +1,172 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../util/common.h"
+
+namespace noobaa
+{
+
+/**
+ * ConfigFile is the raw content of a config file as read by one user.
+ * It is shared by the cache and by the JS buffers that were handed out for it.
+ */
+struct ConfigFile
+{
+    std::string path;
+    struct stat stat;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * ConfigCache keeps the raw bytes of small config files (see sdk/config_fs.js) so that
+ * repeated reads of the same account and bucket configs can be served synchronously from JS.
+ *
+ * On linux the directories of the cached files (and of their symlink targets) are watched with inotify,
+ * and a watcher thread drops the entries of every file that was modified, replaced or removed,
+ * so a watched entry is served without any syscall until it changes.
+ * Remote filesystems (NFS, GPFS, CIFS, FUSE, ...) do not report the changes of other hosts to inotify,
+ * so files on them, and all files when watching is disabled or not supported, are validated by the
+ * inode size, mtime and ctime of the path when the last validation is older than validate_ms.
+ *
+ * Entries are kept per user (uid, gid and groups), because a hit does not check the file permissions.
+ * Our own fs ops that replace or remove a path call remove() so a writer reads its own writes immediately.
+ */
+class ConfigCache
+{
+public:
+    struct Config
+    {
+        int64_t max_entries = 0;
+        int64_t max_bytes = 0;
+        int64_t max_file_size = 1024 * 1024;
+        int64_t validate_ms = 1000;
+        bool watch = true;
+    };
+
+    struct User
+    {
+        uid_t uid;
+        gid_t gid;
+        std::vector<gid_t> groups;
+        bool operator==(const User& o) const { return uid == o.uid && gid == o.gid && groups == o.groups; }
+    };
+
+    struct Stats
+    {
+        int64_t entries = 0;
+        int64_t bytes = 0;
+        int64_t watched_entries = 0;
+        int64_t watches = 0;
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t validations = 0;
+        int64_t inserts = 0;
+        int64_t evictions = 0;
+        int64_t invalidations = 0;
+        int64_t watch_events = 0;
+        int64_t watch_errors = 0;
+    };
+
+    ConfigCache();
+    ~ConfigCache();
+
+    void configure(const Config& config);
+    bool enabled() const { return _enabled; }
+
+    /**
+     * get returns the cached file if it can be served without any syscall -
+     * a watched entry, or an unwatched entry that was validated in the last validate_ms.
+     * Called from the main thread, so it never blocks on the filesystem.
+     */
+    std::shared_ptr<const ConfigFile> get(const std::string& path, const User& user);
+
+    /**
+     * read returns the file through the cache, validating a stale entry by stat or reading the file on a miss.
+     * Called from a worker thread that runs with the user credentials. Returns 0 or an errno.
+     */
+    int read(const std::string& path, const User& user, std::shared_ptr<const ConfigFile>& file, bool& hit);
+
+    // remove the entries of path (or that resolved to path), used by ops that replace or unlink the path
+    void remove(const std::string& path);
+
+    Stats stats(bool reset);
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const ConfigFile> file;
+        User user;
+        bool watched = false;
+        int64_t validated_ms = 0;
+        // the watched names ("<dir>/<name>") that invalidate this entry, and their directories' watch descriptors
+        std::vector<std::string> names;
+        std::vector<int> wds;
+        std::list<Entry*>::iterator lru_it;
+    };
+
+    struct Watch
+    {
+        std::string dir;
+        int refs = 0;
+    };
+
+    // the methods with an underscore prefix are called with _mutex locked, except _resolve and _watch
+    bool _fresh(const Entry& e, int64_t now) const;
+    Entry* _find(const std::string& path, const User& user);
+    void _touch(Entry* e);
+    void _insert(std::unique_ptr<Entry> entry, uint64_t epoch);
+    void _erase(Entry* e);
+    void _erase_all(std::vector<Entry*>& entries);
+    void _evict();
+    void _clear();
+    void _resolve(const std::string& path, std::vector<std::string>& names);
+    bool _watch(const std::vector<std::string>& names, std::vector<int>& wds);
+    int _add_watch(const std::string& dir);
+    void _release_watches(const std::vector<int>& wds);
+    void _watcher_main();
+    void _handle_event(int wd, uint32_t mask, const char* name);
+
+    std::mutex _mutex;
+    Config _config;
+    std::atomic<bool> _enabled{ false };
+    // path -> entries of different users
+    std::unordered_map<std::string, std::vector<std::unique_ptr<Entry>>> _map;
+    // watched name -> entries to invalidate on its events
+    std::unordered_multimap<std::string, Entry*> _names;
+    std::list<Entry*> _lru; // most recently used first
+    std::atomic<int64_t> _size{ 0 };
+    int64_t _bytes = 0;
+    int64_t _watched = 0;
+
+    // inotify state, the watcher thread is started on the first watched insert
+    int _inotify_fd = -1;
+    int _wake_pipe[2] = { -1, -1 };
+    std::thread _watcher;
+    std::unordered_map<int, Watch> _watches;
+    std::unordered_map<std::string, int> _dir_wds;
+    // incremented on every watch event and remove(), so a read that raced with a change is validated again
+    std::atomic<uint64_t> _epoch{ 0 };
+
+    std::atomic<int64_t> _hits{ 0 };
+    std::atomic<int64_t> _misses{ 0 };
+    std::atomic<int64_t> _validations{ 0 };
+    std::atomic<int64_t> _inserts{ 0 };
+    std::atomic<int64_t> _evictions{ 0 };
+    std::atomic<int64_t> _invalidations{ 0 };
+    std::atomic<int64_t> _watch_events{ 0 };
+    std::atomic<int64_t> _watch_errors{ 0 };
+};
+
+} // namespace noobaa
@@ -1,9 +1,17 @@
 /* Copyright (C) 2016 NooBaa */
+#include "../third_party/isa-l_crypto/include/md5_mb.h"
 #include "../util/b64.h"
 #include "../util/buf.h"
 #include "../util/common.h"
+#include "../util/endian.h"
+#include "../util/fsync_group.h"
+#include "../util/latency_stats.h"
 #include "../util/napi.h"
 #include "../util/os.h"
+#include "../util/slab.h"
+#include "../util/worker_pool.h"
+#include "./config_cache.h"
+#include "./fs_ops.h"
 
 // Disable pedantic warning temporarily to include GPFS headers which have zero-length arrays
 #pragma GCC diagnostic push
@@ -13,13 +21,22 @@
 #include "./gpfs_rdma_experimental.h"
 #pragma GCC diagnostic pop
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <functional>
 #include <limits.h>
+#include <list>
 #include <map>
 #include <math.h>
+#include <memory>
+#include <mutex>
 #include <grp.h>
+#include <iomanip>
 #include <pwd.h>
 #include <stdlib.h>
 #include <sys/fcntl.h>
@@ -29,8 +46,10 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/xattr.h>
+#include <system_error>
 #include <thread>
 #include <typeinfo>
+#include <unordered_map>
 #include <unistd.h>
 #include <uv.h>
 #include <vector>
@@ -39,15 +58,12 @@
     #include <sys/mount.h>
     #include <sys/param.h>
 #else
+    #include <linux/fs.h>
+    #include <sys/ioctl.h>
+    #include <sys/sendfile.h>
     #include <sys/statfs.h>
 #endif
 
-#ifndef __APPLE__
-    #define ENOATTR ENODATA
-#endif
-
-#define ROUNDUP(X, Y) ((Y) * (((X) + (Y) - 1) / (Y)))
-
 // Should total to 256 (sizeof(buffer) 216 + sizeof(header) 16 + sizeof(payload) 24)
 #define GPFS_XATTR_BUFFER_SIZE 216
 #define GPFS_BACKEND "GPFS"
@@ -152,29 +168,11 @@
         }                                                         \
     } while (0)
 
-#ifdef __APPLE__
-    #define flistxattr(a, b, c) ::flistxattr(a, b, c, 0)
-    #define getxattr(a, b, c, d) ::getxattr(a, b, c, d, 0, 0)
-    #define fgetxattr(a, b, c, d) ::fgetxattr(a, b, c, d, 0, 0)
-    #define fsetxattr(a, b, c, d, e) ::fsetxattr(a, b, c, d, e, 0)
-    #define fremovexattr(a, b) ::fremovexattr(a, b, 0)
-#endif
-
-#ifdef __APPLE__
-typedef unsigned long long DirOffset;
-    #define DIR_OFFSET_FIELD d_seekoff
-#else
-typedef long DirOffset;
-    #define DIR_OFFSET_FIELD d_off
-#endif
-
 namespace noobaa
 {
 
 DBG_INIT(0);
 
-typedef std::map<std::string, std::string> XattrMap;
-
 const char* gpfs_dl_path = std::getenv("GPFS_DL_PATH");
 
 int gpfs_lib_file_exists = -1;
@@ -198,14 +196,26 @@ struct gpfs_ganesha_noobaa_arg
 };
 #define OPENHANDLE_REGISTER_NOOBAA 157
 
-static const int DIO_BUFFER_MEMALIGN = 4096;
-
 static void
 buffer_releaser(Napi::Env env, uint8_t* buf)
 {
     if (buf) free(buf);
 }
 
+static void
+dio_buffer_finalizer(Napi::Env env, uint8_t* buf, void* hint)
+{
+    Slab::instance().free(buf, uint64_t(uintptr_t(hint)));
+}
+
+// wraps a buffer from dio_alloc() as a JS buffer that frees it on GC (unless released explicitly before)
+static Napi::Buffer<uint8_t>
+dio_buffer_new(Napi::Env env, uint8_t* buf, size_t len, uint64_t ticket)
+{
+    if (!ticket) return Napi::Buffer<uint8_t>::New(env, buf, len, buffer_releaser);
+    return Napi::Buffer<uint8_t>::New(env, buf, len, dio_buffer_finalizer, reinterpret_cast<void*>(uintptr_t(ticket)));
+}
+
 static int
 parse_open_flags(std::string flags)
 {
@@ -279,14 +289,6 @@ const static std::vector<std::string> USER_XATTRS{
     "user.noobaa.restore.expiry",
 };
 
-struct Entry
-{
-    std::string name;
-    ino_t ino;
-    uint8_t type;
-    DirOffset off;
-};
-
 // Disable pedantic warning temporarily to use GPFS struct which have zero-length arrays
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
@@ -317,63 +319,195 @@ build_gpfs_get_ea_request(gpfsRequest_t* reqP, std::string key)
     memcpy(&reqP->payload.buffer[0], key.c_str(), nameLen);
 }
 
+/**
+ * FS workers are split to lanes of the fs worker pool (when configured by fs_pool_config),
+ * so that a burst of bulk data ops (read/write/copy/fsync) does not delay metadata ops,
+ * and blocking lock waits, which can take as long as the lock is held, do not hold the threads of either.
+ */
+enum FSLane {
+    FS_LANE_META,
+    FS_LANE_DATA,
+    FS_LANE_LOCK,
+};
+
+const static std::vector<std::string> FS_LANE_NAMES{ "meta", "data", "lock" };
+
 template <typename T>
 static Napi::Value
 api(const Napi::CallbackInfo& info)
 {
     auto w = new T(info);
     Napi::Promise promise = w->_deferred.Promise();
-    w->Queue();
+    if (!WorkerPool::instance().submit(w, w->_lane, info.Env())) {
+        w->Queue();
+    }
     return promise;
 }
 
+static std::atomic<bool> xattr_packed(false);
+
+/**
+ * Packed xattr - instead of creating a JS string for every key and value when most callers
+ * never look at the xattr (e.g listing), the map is copied to a single buffer as
+ * a sequence of [u32 key_len][key][u32 value_len][value] in native byte order,
+ * which is kept on a hidden property and decoded on the first access to res.xattr.
+ */
+static const char* XATTR_PACKED_PROP = "_xattr_packed";
+
+static void
+xattr_define_value(Napi::Object obj, Napi::Value xattr)
+{
+    obj.DefineProperty(Napi::PropertyDescriptor::Value("xattr", xattr, napi_default_jsproperty));
+    obj.Delete(XATTR_PACKED_PROP);
+}
+
+static Napi::Value
+xattr_packed_get(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    auto obj = info.This().As<Napi::Object>();
+    auto xattr = Napi::Object::New(env);
+    Napi::Value packed = obj.Get(XATTR_PACKED_PROP);
+    if (packed.IsBuffer()) {
+        auto buf = packed.As<Napi::Buffer<char>>();
+        const char* p = buf.Data();
+        const char* end = p + buf.Length();
+        while (p + 2 * sizeof(uint32_t) <= end) {
+            uint32_t key_len, value_len;
+            memcpy(&key_len, p, sizeof(key_len));
+            const char* key = p + sizeof(key_len);
+            memcpy(&value_len, key + key_len, sizeof(value_len));
+            const char* value = key + key_len + sizeof(value_len);
+            xattr.Set(Napi::String::New(env, key, key_len), Napi::String::New(env, value, value_len));
+            p = value + value_len;
+        }
+    }
+    xattr_define_value(obj, xattr);
+    return xattr;
+}
+
 static void
-set_stat_res(Napi::Object res, Napi::Env env, struct stat& stat_res, XattrMap& xattr_res)
+xattr_packed_set(const Napi::CallbackInfo& info)
+{
+    xattr_define_value(info.This().As<Napi::Object>(), info[0]);
+}
+
+static void
+set_xattr_packed(Napi::Object res, Napi::Env env, const XattrMap& xattr_res)
+{
+    size_t len = 0;
+    for (auto it = xattr_res.begin(); it != xattr_res.end(); ++it) {
+        len += 2 * sizeof(uint32_t) + it->first.size() + it->second.size();
+    }
+    auto buf = Napi::Buffer<char>::New(env, len);
+    char* p = buf.Data();
+    for (auto it = xattr_res.begin(); it != xattr_res.end(); ++it) {
+        uint32_t key_len = it->first.size();
+        uint32_t value_len = it->second.size();
+        memcpy(p, &key_len, sizeof(key_len));
+        p += sizeof(key_len);
+        memcpy(p, it->first.data(), key_len);
+        p += key_len;
+        memcpy(p, &value_len, sizeof(value_len));
+        p += sizeof(value_len);
+        memcpy(p, it->second.data(), value_len);
+        p += value_len;
+    }
+    res.DefineProperty(Napi::PropertyDescriptor::Value(XATTR_PACKED_PROP, buf, napi_configurable));
+    res.DefineProperty(Napi::PropertyDescriptor::Accessor<xattr_packed_get, xattr_packed_set>(
+        "xattr", napi_property_attributes(napi_enumerable | napi_configurable)));
+}
+
+/**
+ * Stat fields in the order of the compact stat layout (see new_stat_res),
+ * the names are exported as STAT_COMPACT_FIELDS for the JS accessors.
+ * The ns times are stored rounded like mtimeNsBigint, which makes them exact integers in a double.
+ */
+enum StatField {
+    STAT_DEV,
+    STAT_INO,
+    STAT_MODE,
+    STAT_NLINK,
+    STAT_UID,
+    STAT_GID,
+    STAT_RDEV,
+    STAT_SIZE,
+    STAT_BLKSIZE,
+    STAT_BLOCKS,
+    STAT_ATIME_MS,
+    STAT_CTIME_MS,
+    STAT_MTIME_MS,
+    STAT_BIRTHTIME_MS,
+    STAT_ATIME_NS,
+    STAT_CTIME_NS,
+    STAT_MTIME_NS,
+    STAT_FIELDS_COUNT,
+};
+
+const static std::vector<std::string> STAT_COMPACT_FIELDS{
+    "dev",
+    "ino",
+    "mode",
+    "nlink",
+    "uid",
+    "gid",
+    "rdev",
+    "size",
+    "blksize",
+    "blocks",
+    "atimeMs",
+    "ctimeMs",
+    "mtimeMs",
+    "birthtimeMs",
+    "atimeNs",
+    "ctimeNs",
+    "mtimeNs",
+};
+
+// when set, stat results are created with this class from a Float64Array of the stat fields
+static Napi::FunctionReference compact_stat_class;
+
+static void
+get_stat_fields(struct stat& stat_res, double* f)
 {
-    res["dev"] = Napi::Number::New(env, stat_res.st_dev);
-    res["ino"] = Napi::Number::New(env, stat_res.st_ino);
-    res["mode"] = Napi::Number::New(env, stat_res.st_mode);
-    res["nlink"] = Napi::Number::New(env, stat_res.st_nlink);
-    res["uid"] = Napi::Number::New(env, stat_res.st_uid);
-    res["gid"] = Napi::Number::New(env, stat_res.st_gid);
-    res["rdev"] = Napi::Number::New(env, stat_res.st_rdev);
-    res["size"] = Napi::Number::New(env, stat_res.st_size);
-    res["blksize"] = Napi::Number::New(env, stat_res.st_blksize);
-    res["blocks"] = Napi::Number::New(env, stat_res.st_blocks);
+    f[STAT_DEV] = stat_res.st_dev;
+    f[STAT_INO] = stat_res.st_ino;
+    f[STAT_MODE] = stat_res.st_mode;
+    f[STAT_NLINK] = stat_res.st_nlink;
+    f[STAT_UID] = stat_res.st_uid;
+    f[STAT_GID] = stat_res.st_gid;
+    f[STAT_RDEV] = stat_res.st_rdev;
+    f[STAT_SIZE] = stat_res.st_size;
+    f[STAT_BLKSIZE] = stat_res.st_blksize;
+    f[STAT_BLOCKS] = stat_res.st_blocks;
 
 // https://nodejs.org/dist/latest-v14.x/docs/api/fs.html#fs_stat_time_values
 #ifdef __APPLE__
-    double atimeMs = (double(1e3) * stat_res.st_atimespec.tv_sec) + (double(1e-6) * stat_res.st_atimespec.tv_nsec);
-    double ctimeMs = (double(1e3) * stat_res.st_ctimespec.tv_sec) + (double(1e-6) * stat_res.st_ctimespec.tv_nsec);
-    double mtimeMs = (double(1e3) * stat_res.st_mtimespec.tv_sec) + (double(1e-6) * stat_res.st_mtimespec.tv_nsec);
-    double birthtimeMs = (double(1e3) * stat_res.st_birthtimespec.tv_sec) + (double(1e-6) * stat_res.st_birthtimespec.tv_nsec);
-    double atimeNs = (double(1e9) * stat_res.st_atimespec.tv_sec) + stat_res.st_atimespec.tv_nsec;
-    double ctimeNs = (double(1e9) * stat_res.st_ctimespec.tv_sec) + stat_res.st_ctimespec.tv_nsec;
-    double mtimeNs = (double(1e9) * stat_res.st_mtimespec.tv_sec) + stat_res.st_mtimespec.tv_nsec;
+    f[STAT_ATIME_MS] = (double(1e3) * stat_res.st_atimespec.tv_sec) + (double(1e-6) * stat_res.st_atimespec.tv_nsec);
+    f[STAT_CTIME_MS] = (double(1e3) * stat_res.st_ctimespec.tv_sec) + (double(1e-6) * stat_res.st_ctimespec.tv_nsec);
+    f[STAT_MTIME_MS] = (double(1e3) * stat_res.st_mtimespec.tv_sec) + (double(1e-6) * stat_res.st_mtimespec.tv_nsec);
+    f[STAT_BIRTHTIME_MS] = (double(1e3) * stat_res.st_birthtimespec.tv_sec) + (double(1e-6) * stat_res.st_birthtimespec.tv_nsec);
+    f[STAT_ATIME_NS] = round((double(1e9) * stat_res.st_atimespec.tv_sec) + stat_res.st_atimespec.tv_nsec);
+    f[STAT_CTIME_NS] = round((double(1e9) * stat_res.st_ctimespec.tv_sec) + stat_res.st_ctimespec.tv_nsec);
+    f[STAT_MTIME_NS] = round((double(1e9) * stat_res.st_mtimespec.tv_sec) + stat_res.st_mtimespec.tv_nsec);
 #else
-    double atimeMs = (double(1e3) * stat_res.st_atim.tv_sec) + (double(1e-6) * stat_res.st_atim.tv_nsec);
-    double ctimeMs = (double(1e3) * stat_res.st_ctim.tv_sec) + (double(1e-6) * stat_res.st_ctim.tv_nsec);
-    double mtimeMs = (double(1e3) * stat_res.st_mtim.tv_sec) + (double(1e-6) * stat_res.st_mtim.tv_nsec);
-    double birthtimeMs = ctimeMs; // Posix doesn't have birthtime
-    double atimeNs = (double(1e9) * stat_res.st_atim.tv_sec) + stat_res.st_atim.tv_nsec;
-    double ctimeNs = (double(1e9) * stat_res.st_ctim.tv_sec) + stat_res.st_ctim.tv_nsec;
-    double mtimeNs = (double(1e9) * stat_res.st_mtim.tv_sec) + stat_res.st_mtim.tv_nsec;
+    f[STAT_ATIME_MS] = (double(1e3) * stat_res.st_atim.tv_sec) + (double(1e-6) * stat_res.st_atim.tv_nsec);
+    f[STAT_CTIME_MS] = (double(1e3) * stat_res.st_ctim.tv_sec) + (double(1e-6) * stat_res.st_ctim.tv_nsec);
+    f[STAT_MTIME_MS] = (double(1e3) * stat_res.st_mtim.tv_sec) + (double(1e-6) * stat_res.st_mtim.tv_nsec);
+    f[STAT_BIRTHTIME_MS] = f[STAT_CTIME_MS]; // Posix doesn't have birthtime
+    f[STAT_ATIME_NS] = round((double(1e9) * stat_res.st_atim.tv_sec) + stat_res.st_atim.tv_nsec);
+    f[STAT_CTIME_NS] = round((double(1e9) * stat_res.st_ctim.tv_sec) + stat_res.st_ctim.tv_nsec);
+    f[STAT_MTIME_NS] = round((double(1e9) * stat_res.st_mtim.tv_sec) + stat_res.st_mtim.tv_nsec);
 #endif
+}
 
-    res["atimeMs"] = Napi::Number::New(env, atimeMs);
-    res["ctimeMs"] = Napi::Number::New(env, ctimeMs);
-    res["mtimeMs"] = Napi::Number::New(env, mtimeMs);
-    res["birthtimeMs"] = Napi::Number::New(env, birthtimeMs);
-    res["atime"] = Napi::Date::New(env, uint64_t(round(atimeMs)));
-    res["mtime"] = Napi::Date::New(env, uint64_t(round(mtimeMs)));
-    res["ctime"] = Napi::Date::New(env, uint64_t(round(ctimeMs)));
-    res["birthtime"] = Napi::Date::New(env, uint64_t(round(birthtimeMs)));
-
-    // high resolution times
-    res["atimeNsBigint"] = Napi::BigInt::New(env, int64_t(round(atimeNs)));
-    res["ctimeNsBigint"] = Napi::BigInt::New(env, int64_t(round(ctimeNs)));
-    res["mtimeNsBigint"] = Napi::BigInt::New(env, int64_t(round(mtimeNs)));
-
+static void
+set_stat_xattr(Napi::Object res, Napi::Env env, XattrMap& xattr_res)
+{
+    if (xattr_packed) {
+        set_xattr_packed(res, env, xattr_res);
+        return;
+    }
     auto xattr = Napi::Object::New(env);
     res["xattr"] = xattr;
     for (auto it = xattr_res.begin(); it != xattr_res.end(); ++it) {
@@ -381,6 +515,60 @@ set_stat_res(Napi::Object res, Napi::Env env, struct stat& stat_res, XattrMap& x
     }
 }
 
+static void
+set_stat_res(Napi::Object res, Napi::Env env, struct stat& stat_res, XattrMap& xattr_res)
+{
+    double f[STAT_FIELDS_COUNT];
+    get_stat_fields(stat_res, f);
+
+    res["dev"] = Napi::Number::New(env, f[STAT_DEV]);
+    res["ino"] = Napi::Number::New(env, f[STAT_INO]);
+    res["mode"] = Napi::Number::New(env, f[STAT_MODE]);
+    res["nlink"] = Napi::Number::New(env, f[STAT_NLINK]);
+    res["uid"] = Napi::Number::New(env, f[STAT_UID]);
+    res["gid"] = Napi::Number::New(env, f[STAT_GID]);
+    res["rdev"] = Napi::Number::New(env, f[STAT_RDEV]);
+    res["size"] = Napi::Number::New(env, f[STAT_SIZE]);
+    res["blksize"] = Napi::Number::New(env, f[STAT_BLKSIZE]);
+    res["blocks"] = Napi::Number::New(env, f[STAT_BLOCKS]);
+
+    res["atimeMs"] = Napi::Number::New(env, f[STAT_ATIME_MS]);
+    res["ctimeMs"] = Napi::Number::New(env, f[STAT_CTIME_MS]);
+    res["mtimeMs"] = Napi::Number::New(env, f[STAT_MTIME_MS]);
+    res["birthtimeMs"] = Napi::Number::New(env, f[STAT_BIRTHTIME_MS]);
+    res["atime"] = Napi::Date::New(env, uint64_t(round(f[STAT_ATIME_MS])));
+    res["mtime"] = Napi::Date::New(env, uint64_t(round(f[STAT_MTIME_MS])));
+    res["ctime"] = Napi::Date::New(env, uint64_t(round(f[STAT_CTIME_MS])));
+    res["birthtime"] = Napi::Date::New(env, uint64_t(round(f[STAT_BIRTHTIME_MS])));
+
+    // high resolution times
+    res["atimeNsBigint"] = Napi::BigInt::New(env, int64_t(f[STAT_ATIME_NS]));
+    res["ctimeNsBigint"] = Napi::BigInt::New(env, int64_t(f[STAT_CTIME_NS]));
+    res["mtimeNsBigint"] = Napi::BigInt::New(env, int64_t(f[STAT_MTIME_NS]));
+
+    set_stat_xattr(res, env, xattr_res);
+}
+
+/**
+ * new_stat_res returns the stat result object - by default a plain object with all the fields,
+ * or when compact_stat_class is configured, an instance of it over a single Float64Array
+ * that decodes the fields (and creates Dates and BigInts) only when accessed.
+ */
+static Napi::Object
+new_stat_res(Napi::Env env, struct stat& stat_res, XattrMap& xattr_res)
+{
+    if (compact_stat_class.IsEmpty()) {
+        auto res = Napi::Object::New(env);
+        set_stat_res(res, env, stat_res, xattr_res);
+        return res;
+    }
+    auto fields = Napi::Float64Array::New(env, STAT_FIELDS_COUNT);
+    get_stat_fields(stat_res, fields.Data());
+    auto res = compact_stat_class.New({ fields });
+    set_stat_xattr(res, env, xattr_res);
+    return res;
+}
+
 static void
 set_statfs_res(Napi::Object res, Napi::Env env, struct statfs& statfs_res)
 {
@@ -445,54 +633,6 @@ cmp_ver_id(int64_t link_expected_mtime, int64_t link_expected_inode, struct stat
     return link_expected_mtime == actual_mtimeNs && link_expected_inode == stat_actual_ino;
 }
 
-static int
-get_single_user_xattr(int fd, std::string key, std::string& value)
-{
-    ssize_t value_len = fgetxattr(fd, key.c_str(), NULL, 0);
-    if (value_len == -1) return -1;
-    if (value_len > 0) {
-        Buf val(value_len);
-        value_len = fgetxattr(fd, key.c_str(), val.cdata(), value_len);
-        if (value_len == -1) return -1;
-        value = std::string(val.cdata(), value_len);
-    } else if (value_len == 0) {
-        value = "";
-    }
-    return 0;
-}
-
-static int
-get_fd_xattr(int fd, XattrMap& xattr, const std::vector<std::string>& xattr_keys)
-{
-    if (xattr_keys.size() > 0) { // we won't list the attributes just return the prefefined list
-        for (auto const& key : xattr_keys) {
-            std::string value;
-            int r = get_single_user_xattr(fd, key, value);
-            if (r) {
-                if (errno == ENOATTR) continue;
-                return r;
-            }
-            xattr[key] = value;
-        }
-    } else {
-        ssize_t buf_len = flistxattr(fd, NULL, 0);
-        if (buf_len <= 0) return buf_len;
-        Buf buf(buf_len);
-        buf_len = flistxattr(fd, buf.cdata(), buf_len);
-        // No xattr, nothing to do
-        if (buf_len <= 0) return buf_len;
-        while (buf.length()) {
-            std::string key(buf.cdata());
-            std::string value;
-            int r = get_single_user_xattr(fd, key, value);
-            if (r) return r;
-            xattr[key] = value;
-            buf.slice(key.size() + 1, buf.length());
-        }
-    }
-    return 0;
-}
-
 static int
 get_fd_gpfs_xattr(int fd, XattrMap& xattr, int& gpfs_error, bool use_dmapi)
 {
@@ -537,23 +677,21 @@ get_xattr_from_object(XattrMap& xattr, Napi::Object obj)
 static int
 clear_xattr(int fd, std::string _prefix)
 {
-    ssize_t buf_len = flistxattr(fd, NULL, 0);
+    std::vector<char> fallback;
+    const char* names = 0;
+    ssize_t buf_len = list_fd_xattr(fd, fallback, names);
     // No xattr, nothing to do
     if (buf_len == 0) return 0;
     if (buf_len == -1) return -1;
-    Buf buf(buf_len);
-    buf_len = flistxattr(fd, buf.cdata(), buf_len);
-    // No xattr, nothing to do
-    if (buf_len == 0) return 0;
-    if (buf_len == -1) return -1;
-    while (buf.length()) {
-        std::string key(buf.cdata());
+    const char* end = names + buf_len;
+    while (names < end) {
+        std::string key(names, strnlen(names, end - names));
+        names += key.size() + 1;
         // remove xattr only if its key starts with prefix
         if (key.rfind(_prefix, 0) == 0) {
             ssize_t value_len = fremovexattr(fd, key.c_str());
             if (value_len == -1) return -1;
         }
-        buf.slice(key.size() + 1, buf.length());
     }
     return 0;
 }
@@ -615,6 +753,414 @@ get_groups_as_string()
     return stringfy_vector(groups);
 }
 
+/**
+ * CachedObject is the whole content of a small file with its stat and xattrs.
+ * It is shared by the cache and by the JS buffers that were handed out for it,
+ * so it is freed only when evicted and the last of those buffers was collected.
+ */
+struct CachedObject
+{
+    struct stat _stat;
+    XattrMap _xattr;
+    std::vector<uint8_t> _data;
+
+    size_t cost() const
+    {
+        size_t n = sizeof(CachedObject) + _data.size();
+        for (auto const& it : _xattr) n += it.first.size() + it.second.size();
+        return n;
+    }
+};
+
+/**
+ * ObjectCache is a bounded cache of small hot files keyed by (dev, ino), for serving GETs in one native call.
+ * An entry is valid as long as the size, mtime and ctime of the inode did not change -
+ * the ctime also changes on xattr and permission changes, so the cached xattrs are validated too.
+ * A lookup costs one stat of the path instead of open + fstat + read + close.
+ * The map is split into shards, each with its own lock and LRU list, and the limits are split evenly between the shards.
+ */
+struct ObjectCache
+{
+    static const int NUM_SHARDS = 16;
+    struct Key
+    {
+        dev_t dev;
+        ino_t ino;
+        bool operator==(const Key& o) const { return dev == o.dev && ino == o.ino; }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& k) const { return std::hash<uint64_t>()((uint64_t(k.ino) * 1000003) ^ uint64_t(k.dev)); }
+    };
+    struct Item
+    {
+        std::shared_ptr<const CachedObject> obj;
+        std::list<Key>::iterator lru_it;
+    };
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<Key, Item, KeyHash> map;
+        std::list<Key> lru; // most recently used first
+        size_t bytes = 0;
+    };
+
+    Shard _shards[NUM_SHARDS];
+    std::atomic<int64_t> _max_entries{ 0 };
+    std::atomic<int64_t> _max_bytes{ 0 };
+    std::atomic<int64_t> _max_object_size{ 0 };
+    std::atomic<int64_t> _hits{ 0 };
+    std::atomic<int64_t> _misses{ 0 };
+    std::atomic<int64_t> _inserts{ 0 };
+    std::atomic<int64_t> _evictions{ 0 };
+    std::atomic<int64_t> _invalidations{ 0 };
+
+    bool enabled() { return _max_entries > 0 && _max_bytes > 0 && _max_object_size > 0; }
+
+    void configure(int64_t max_entries, int64_t max_bytes, int64_t max_object_size)
+    {
+        _max_entries = std::max<int64_t>(0, max_entries);
+        _max_bytes = std::max<int64_t>(0, max_bytes);
+        _max_object_size = std::max<int64_t>(0, max_object_size);
+        for (Shard& s : _shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            _evict(s);
+        }
+    }
+
+    static bool same_version(const struct stat& a, const struct stat& b)
+    {
+#ifdef __APPLE__
+        const struct timespec &am = a.st_mtimespec, &bm = b.st_mtimespec, &ac = a.st_ctimespec, &bc = b.st_ctimespec;
+#else
+        const struct timespec &am = a.st_mtim, &bm = b.st_mtim, &ac = a.st_ctim, &bc = b.st_ctim;
+#endif
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+            am.tv_sec == bm.tv_sec && am.tv_nsec == bm.tv_nsec && ac.tv_sec == bc.tv_sec && ac.tv_nsec == bc.tv_nsec;
+    }
+
+    Shard& shard_of(const Key& key) { return _shards[KeyHash()(key) % NUM_SHARDS]; }
+
+    // returns the cached object of the inode if it has the same version as st
+    std::shared_ptr<const CachedObject> lookup(const struct stat& st)
+    {
+        Key key{ st.st_dev, st.st_ino };
+        Shard& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end()) {
+            _misses += 1;
+            return nullptr;
+        }
+        if (!same_version(it->second.obj->_stat, st)) {
+            _erase(s, it);
+            _invalidations += 1;
+            _misses += 1;
+            return nullptr;
+        }
+        s.lru.splice(s.lru.begin(), s.lru, it->second.lru_it);
+        _hits += 1;
+        return it->second.obj;
+    }
+
+    void insert(const std::shared_ptr<const CachedObject>& obj)
+    {
+        if (int64_t(obj->_data.size()) > _max_object_size) return;
+        Key key{ obj->_stat.st_dev, obj->_stat.st_ino };
+        Shard& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it != s.map.end()) _erase(s, it);
+        s.lru.push_front(key);
+        s.map[key] = Item{ obj, s.lru.begin() };
+        s.bytes += obj->cost();
+        _inserts += 1;
+        _evict(s);
+    }
+
+    void _erase(Shard& s, std::unordered_map<Key, Item, KeyHash>::iterator it)
+    {
+        s.bytes -= it->second.obj->cost();
+        s.lru.erase(it->second.lru_it);
+        s.map.erase(it);
+    }
+
+    void _evict(Shard& s)
+    {
+        size_t max_entries = (_max_entries + NUM_SHARDS - 1) / NUM_SHARDS;
+        size_t max_bytes = (_max_bytes + NUM_SHARDS - 1) / NUM_SHARDS;
+        while (!s.lru.empty() && (s.map.size() > max_entries || s.bytes > max_bytes)) {
+            _erase(s, s.map.find(s.lru.back()));
+            _evictions += 1;
+        }
+    }
+};
+
+static ObjectCache object_cache;
+
+/**
+ * CachedFd is a read-only file fd that is shared by the cache and the FileWraps that were opened from it.
+ * The fd is closed only when the last reference is released, so evicting an entry never closes
+ * an fd that is still being read from.
+ */
+struct CachedFd
+{
+    std::string _path;
+    int _fd;
+    int _flags;
+    uid_t _uid;
+    gid_t _gid;
+    std::vector<gid_t> _groups;
+    struct stat _stat;
+    std::atomic<int64_t> _validated_ms;
+    std::atomic<int64_t> _used_ms;
+    std::list<CachedFd*>::iterator _lru_it; // guarded by the FdCache mutex, valid while the entry is cached
+    CachedFd(std::string path, int fd, int flags, uid_t uid, gid_t gid, const std::vector<gid_t>& groups, struct stat& st)
+        : _path(path), _fd(fd), _flags(flags), _uid(uid), _gid(gid), _groups(groups), _stat(st), _validated_ms(now_ms()), _used_ms(now_ms()) {}
+    ~CachedFd()
+    {
+        if (_fd >= 0) ::close(_fd);
+    }
+    bool same_user(int flags, uid_t uid, gid_t gid, const std::vector<gid_t>& groups) const
+    {
+        return _flags == flags && _uid == uid && _gid == gid && _groups == groups;
+    }
+};
+
+/**
+ * FdCache is a bounded cache of read-only file fds for repeated ranged reads of the same files.
+ * Entries are keyed by path and by the user that opened them, so a hit never gives a user
+ * an fd that it could not open by itself, and the open saves the path walk and (on GPFS) the token acquisition.
+ *
+ * Entries are validated by comparing the dev, ino, size, mtime and ctime of the path every validate_ms
+ * (0 validates on every open), and are removed immediately on unlink/rename/link of the path through our own fs ops.
+ * Entries that are not referenced by any open FileWrap for idle_ttl_ms are closed,
+ * and when the cache is full of referenced entries new opens are simply not cached.
+ * The entries are kept in an LRU list (like ObjectCache) so eviction and expiration start from the oldest entry.
+ */
+struct FdCache
+{
+    typedef std::unordered_map<std::string, std::vector<std::shared_ptr<CachedFd>>> Map;
+    std::mutex _mutex;
+    Map _map;
+    std::list<CachedFd*> _lru; // most recently used first, the items are owned by _map
+    std::atomic<int64_t> _size{ 0 };
+    int64_t _max_entries = 0;
+    int64_t _idle_ttl_ms = 10000;
+    int64_t _swept_ms = 0;
+    std::atomic<int64_t> _validate_ms{ 0 };
+    std::atomic<int64_t> _hits{ 0 };
+    std::atomic<int64_t> _misses{ 0 };
+    std::atomic<int64_t> _inserts{ 0 };
+    std::atomic<int64_t> _evictions{ 0 };
+    std::atomic<int64_t> _expirations{ 0 };
+    std::atomic<int64_t> _invalidations{ 0 };
+
+    static bool cacheable_flags(int flags)
+    {
+        return (flags & O_ACCMODE) == O_RDONLY && !(flags & (O_CREAT | O_TRUNC | O_APPEND));
+    }
+
+    bool enabled()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _max_entries > 0;
+    }
+
+    void configure(int64_t max_entries, int64_t idle_ttl_ms, int64_t validate_ms)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _max_entries = std::max<int64_t>(0, max_entries);
+        _idle_ttl_ms = std::max<int64_t>(0, idle_ttl_ms);
+        _validate_ms = std::max<int64_t>(0, validate_ms);
+        if (_max_entries == 0) {
+            _evictions += _size;
+            _lru.clear();
+            _map.clear();
+            _size = 0;
+        }
+        while (_size > _max_entries && _evict_lru()) {}
+    }
+
+    /**
+     * lookup a cached fd of path that was opened with the same flags by the same user.
+     * Called from the worker thread with the user credentials, so the validation stat
+     * also checks that the user can still search the path.
+     */
+    std::shared_ptr<CachedFd> lookup(const std::string& path, int flags, uid_t uid, gid_t gid, const std::vector<gid_t>& groups)
+    {
+        if (_size == 0) return nullptr;
+        std::shared_ptr<CachedFd> item;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _maybe_sweep();
+            auto it = _map.find(DirFdCache::normalize(path));
+            if (it != _map.end()) {
+                for (auto const& i : it->second) {
+                    if (i->same_user(flags, uid, gid, groups)) {
+                        item = i;
+                        _lru.splice(_lru.begin(), _lru, item->_lru_it);
+                        break;
+                    }
+                }
+            }
+        }
+        if (!item) {
+            _misses += 1;
+            return nullptr;
+        }
+        int64_t now = now_ms();
+        if (now - item->_validated_ms >= _validate_ms) {
+            struct stat st;
+            if (::stat(path.c_str(), &st) || !ObjectCache::same_version(st, item->_stat)) {
+                DBG1("FS::FdCache: invalidated " << DVAL(path));
+                invalidate(item);
+                _misses += 1;
+                return nullptr;
+            }
+            item->_validated_ms = now;
+        }
+        item->_used_ms = now;
+        _hits += 1;
+        return item;
+    }
+
+    /**
+     * insert takes ownership of fd and returns the shared item for the FileWrap.
+     * When the cache is disabled or full of referenced entries the item is returned without caching it,
+     * and the fd is closed when the FileWrap releases it.
+     */
+    std::shared_ptr<CachedFd> insert(const std::string& path, int fd, int flags, uid_t uid, gid_t gid, const std::vector<gid_t>& groups, struct stat& st)
+    {
+        auto item = std::make_shared<CachedFd>(DirFdCache::normalize(path), fd, flags, uid, gid, groups, st);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_max_entries == 0) return item;
+        _maybe_sweep();
+        // replace the previous entry of the same user (which was invalidated or raced with this open)
+        auto it = _map.find(item->_path);
+        if (it != _map.end()) {
+            auto& list = it->second;
+            for (size_t i = 0; i < list.size(); ++i) {
+                if (list[i]->same_user(flags, uid, gid, groups)) {
+                    _erase(it, i);
+                    break;
+                }
+            }
+        }
+        if (_size >= _max_entries && !_evict_lru()) return item;
+        _lru.push_front(item.get());
+        item->_lru_it = _lru.begin();
+        _map[item->_path].push_back(item);
+        _size += 1;
+        _inserts += 1;
+        return item;
+    }
+
+    // remove all the entries of path, used by ops that unlink or replace the path
+    void remove(const std::string& path)
+    {
+        if (_size == 0) return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _map.find(DirFdCache::normalize(path));
+        if (it == _map.end()) return;
+        _invalidations += it->second.size();
+        while (_erase(it, it->second.size() - 1)) {}
+    }
+
+    void invalidate(const std::shared_ptr<CachedFd>& item)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _map.find(item->_path);
+        if (it == _map.end()) return;
+        auto& list = it->second;
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (list[i] == item) {
+                _erase(it, i);
+                _invalidations += 1;
+                break;
+            }
+        }
+    }
+
+    // erases the i-th entry of the path, and the path itself with its last entry - returns false if the path was erased
+    bool _erase(Map::iterator it, size_t i)
+    {
+        auto& list = it->second;
+        _lru.erase(list[i]->_lru_it);
+        list.erase(list.begin() + i);
+        _size -= 1;
+        if (!list.empty()) return true;
+        _map.erase(it);
+        return false;
+    }
+
+    // finds the entry of an lru list item
+    void _find(CachedFd* item, Map::iterator& it, size_t& i)
+    {
+        it = _map.find(item->_path);
+        for (i = 0; it->second[i].get() != item; ++i) {}
+    }
+
+    // an entry is idle when only the cache references it
+    static bool idle(const std::shared_ptr<CachedFd>& item) { return item.use_count() == 1; }
+
+    // close the entries that were idle for idle_ttl_ms, checked at most twice per ttl on cache accesses.
+    // the expired entries are at the end of the lru list, so the scan stops at the first recently used entry.
+    void _maybe_sweep()
+    {
+        int64_t now = now_ms();
+        if (now - _swept_ms < _idle_ttl_ms / 2) return;
+        _swept_ms = now;
+        auto pos = _lru.end();
+        while (pos != _lru.begin()) {
+            auto prev = std::prev(pos);
+            if (now - (*prev)->_used_ms < _idle_ttl_ms) break;
+            Map::iterator it;
+            size_t i;
+            _find(*prev, it, i);
+            if (idle(it->second[i])) {
+                _erase(it, i); // erases prev, pos stays valid
+                _expirations += 1;
+            } else {
+                pos = prev;
+            }
+        }
+    }
+
+    // evict the least recently used idle entry, returns false if all the entries are referenced
+    bool _evict_lru()
+    {
+        for (auto lru = _lru.rbegin(); lru != _lru.rend(); ++lru) {
+            Map::iterator it;
+            size_t i;
+            _find(*lru, it, i);
+            if (!idle(it->second[i])) continue;
+            _erase(it, i);
+            _evictions += 1;
+            return true;
+        }
+        return false;
+    }
+};
+
+static FdCache fd_cache;
+
+static ConfigCache config_cache;
+
+// the buffer references the cached file instead of copying it, and releases it when collected
+static Napi::Value
+new_config_file_buffer(Napi::Env env, const std::shared_ptr<const ConfigFile>& file)
+{
+    if (file->data.empty()) return Napi::Buffer<uint8_t>::New(env, 0);
+    auto holder = new std::shared_ptr<const ConfigFile>(file);
+    return Napi::Buffer<uint8_t>::New(
+        env,
+        const_cast<uint8_t*>(file->data.data()),
+        file->data.size(),
+        [](Napi::Env, uint8_t*, std::shared_ptr<const ConfigFile>* h) { delete h; },
+        holder);
+}
+
 /**
  * FSWorker is a general async worker for our fs operations
  */
@@ -636,6 +1182,11 @@ struct FSWorker : public Napi::AsyncWorker
     int _errno;
     int _warn_threshold_ms;
     double _took_time;
+    double _wait_time;
+    int _lane;
+    int _stats_op;
+    bool _failed;
+    std::chrono::steady_clock::time_point _begin_time;
     Napi::FunctionReference _report_fs_stats;
     bool _should_add_thread_capabilities;
     std::vector<gid_t> _supplemental_groups;
@@ -656,6 +1207,10 @@ struct FSWorker : public Napi::AsyncWorker
         , _errno(0)
         , _warn_threshold_ms(0)
         , _took_time(0)
+        , _wait_time(0)
+        , _lane(FS_LANE_META)
+        , _stats_op(-1)
+        , _failed(false)
         , _should_add_thread_capabilities(false)
         , _supplemental_groups()
         , _do_ctime_check(false)
@@ -686,6 +1241,8 @@ struct FSWorker : public Napi::AsyncWorker
     {
         _desc = desc;
         _work_name = _desc.substr(0, _desc.find(" "));
+        _begin_time = std::chrono::steady_clock::now();
+        if (LatencyStats::instance().enabled()) _stats_op = LatencyStats::instance().op_index(_work_name);
         DBG1("FS::FSWorker::Begin: " << _desc);
     }
     virtual void Work() = 0;
@@ -701,16 +1258,32 @@ struct FSWorker : public Napi::AsyncWorker
         if (_should_add_thread_capabilities) {
             tx.add_thread_capabilities();
         }
+        _wait_time = WorkerPool::current_wait_time_ms();
         auto start_time = std::chrono::high_resolution_clock::now();
         Work();
         auto end_time = std::chrono::high_resolution_clock::now();
         _took_time = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        if (_stats_op >= 0) {
+            // wait time is measured from Begin() in the ctor, so it includes the queue time of any pool
+            auto wait_time = std::chrono::steady_clock::now() - _begin_time - (end_time - start_time);
+            LatencyStats::instance().record(
+                _stats_op,
+                std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count(),
+                std::chrono::duration_cast<std::chrono::microseconds>(wait_time).count(),
+                _failed);
+        }
         if (_warn_threshold_ms && _took_time > _warn_threshold_ms) {
             DBG0("FS::FSWorker::Execute: WARNING " << _desc << " took too long: " << _took_time << " ms");
         } else {
             DBG1("FS::FSWorker::Execute: " << _desc << " took: " << _took_time << " ms");
         }
     }
+    // hides AsyncWorker::SetError to track failures for the latency stats
+    void SetError(const std::string& error)
+    {
+        _failed = true;
+        Napi::AsyncWorker::SetError(error);
+    }
     void SetSyscallError()
     {
         if (_errno) {
@@ -728,6 +1301,10 @@ struct FSWorker : public Napi::AsyncWorker
             Napi::Env env = Env();
             auto fs_worker_stats = Napi::Object::New(env);
             set_fs_worker_stats(env, fs_worker_stats, _work_name, _took_time, error);
+            if (_wait_time) {
+                fs_worker_stats["lane"] = Napi::String::New(env, FS_LANE_NAMES[_lane]);
+                fs_worker_stats["wait_time"] = Napi::Number::New(env, _wait_time);
+            }
             _report_fs_stats.Call({ fs_worker_stats });
         }
     }
@@ -825,18 +1402,7 @@ struct Stat : public FSWorker
     }
     virtual void Work()
     {
-        int flags = O_RDONLY; // This default will be used only for none-lstat cases
-        // LINUX - using O_PATH with O_NOFOLLOW allow us to open the symlink itself
-        // instead of openning the file it links to https://man7.org/linux/man-pages/man7/symlink.7.html
-        // MAC - using O_SYMLINK (without O_NOFOLLOW!) allow us to open the symlink itself
-        // https://developer.apple.com/library/archive/documentation/System/Conceptual/ManPages_iPhoneOS/man2/open.2.html
-        // If O_NOFOLLOW is used in the mask and the target file passed to open() is a symbolic link then the open() will fail.
-#ifdef __APPLE__
-        if (_use_lstat) flags = O_SYMLINK;
-#else
-        if (_use_lstat) flags = O_PATH | O_NOFOLLOW;
-#endif
-        int fd = open(_path.c_str(), flags);
+        int fd = open_at(_path, stat_open_flags(_use_lstat));
         CHECK_OPEN_FD(fd);
         SYSCALL_OR_RETURN(fstat(fd, &_stat_res));
         // With O_PATH The file itself is not opened, and other file operations (e.g., fgetxattr(2) - in our case),
@@ -856,8 +1422,7 @@ struct Stat : public FSWorker
     {
         DBG1("FS::Stat::OnOK: " << DVAL(_path) << DVAL(_stat_res.st_ino) << DVAL(_stat_res.st_size));
         Napi::Env env = Env();
-        auto res = Napi::Object::New(env);
-        set_stat_res(res, env, _stat_res, _xattr);
+        auto res = new_stat_res(env, _stat_res, _xattr);
         _deferred.Resolve(res);
         ReportWorkerStats(0);
     }
@@ -907,7 +1472,7 @@ struct CheckAccess : public FSWorker
     }
     virtual void Work()
     {
-        int fd = open(_path.c_str(), O_RDONLY);
+        int fd = open_at(_path, O_RDONLY);
         CHECK_OPEN_FD(fd);
     }
 };
@@ -926,7 +1491,10 @@ struct Unlink : public FSWorker
     }
     virtual void Work()
     {
-        SYSCALL_OR_RETURN(unlink(_path.c_str()));
+        AtPath at(_path);
+        SYSCALL_OR_RETURN(at.call([](int dirfd, const char* p) { return unlinkat(dirfd, p, 0); }));
+        fd_cache.remove(_path);
+        config_cache.remove(_path);
     }
 };
 
@@ -970,7 +1538,13 @@ struct Link : public FSWorker
     }
     virtual void Work()
     {
-        SYSCALL_OR_RETURN(link(_oldpath.c_str(), _newpath.c_str()));
+        AtPath at_old(_oldpath);
+        AtPath at_new(_newpath);
+        SYSCALL_OR_RETURN(at_new.call([&](int dirfd, const char* p) {
+            return at_old.call([&](int olddirfd, const char* oldp) { return linkat(olddirfd, oldp, dirfd, p, 0); });
+        }));
+        fd_cache.remove(_newpath);
+        config_cache.remove(_newpath);
     }
 };
 
@@ -1019,7 +1593,8 @@ struct Symlink : public FSWorker
     }
     virtual void Work()
     {
-        SYSCALL_OR_RETURN(symlink(_target.c_str(), _linkpath.c_str()));
+        AtPath at(_linkpath);
+        SYSCALL_OR_RETURN(at.call([this](int dirfd, const char* p) { return symlinkat(_target.c_str(), dirfd, p); }));
     }
 };
 
@@ -1042,7 +1617,8 @@ struct Mkdir : public FSWorker
     }
     virtual void Work()
     {
-        SYSCALL_OR_RETURN(mkdir(_path.c_str(), _mode));
+        AtPath at(_path);
+        SYSCALL_OR_RETURN(at.call([this](int dirfd, const char* p) { return mkdirat(dirfd, p, _mode); }));
     }
 };
 
@@ -1060,37 +1636,391 @@ struct Rmdir : public FSWorker
     }
     virtual void Work()
     {
-        SYSCALL_OR_RETURN(rmdir(_path.c_str()));
+        AtPath at(_path);
+        SYSCALL_OR_RETURN(at.call([](int dirfd, const char* p) { return unlinkat(dirfd, p, AT_REMOVEDIR); }));
     }
 };
 
 /**
- * SafeLink is an fs op
- * 1. link
- * 2. check if the target has the expected version
- *   2.1. if yes - return
- *   2.2. else - unlink and retry
+ * for_each_dirent calls fn(name, d_type) for the entries of an open directory fd, except . and ..
+ * until fn returns false. Returns -1 with errno on read errors.
+ * On linux it reads the entries with getdents64 directly into a stack buffer,
+ * which saves the DIR allocation and the extra copy of readdir.
  */
-struct SafeLink : public FSWorker
+template <typename F>
+static int
+for_each_dirent(int fd, F fn)
 {
-    std::string _link_from;
-    std::string _link_to;
-    int64_t _link_expected_mtime;
-    int64_t _link_expected_inode;
-    SafeLink(const Napi::CallbackInfo& info)
-        : FSWorker(info)
-    {
-        _link_from = info[1].As<Napi::String>();
-        _link_to = info[2].As<Napi::String>();
-        // TODO: handle lossless
-        bool lossless = true;
-        _link_expected_mtime = info[3].As<Napi::BigInt>().Int64Value(&lossless);
+#ifdef __APPLE__
+    int dup_fd = dup(fd);
+    if (dup_fd < 0) return -1;
+    DIR* dir = fdopendir(dup_fd);
+    if (!dir) {
+        close(dup_fd);
+        return -1;
+    }
+    int r = 0;
+    while (true) {
+        errno = 0;
+        struct dirent* e = readdir(dir);
+        if (!e) {
+            if (errno) r = -1;
+            break;
+        }
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        if (!fn(e->d_name, e->d_type)) break;
+    }
+    int saved_errno = errno;
+    closedir(dir);
+    errno = saved_errno;
+    return r;
+#else
+    struct LinuxDirent64
+    {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+    alignas(LinuxDirent64) char buf[32 * 1024];
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0) return -1;
+        if (n == 0) return 0;
+        for (long pos = 0; pos < n;) {
+            const LinuxDirent64* e = reinterpret_cast<const LinuxDirent64*>(buf + pos);
+            const char* name = buf + pos + offsetof(LinuxDirent64, d_name);
+            pos += e->d_reclen;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+            if (!fn(name, e->d_type)) return 0;
+        }
+    }
+#endif
+}
+
+/**
+ * Rmtree is an fs op that deletes a directory tree (like rm -rf),
+ * instead of calling readdir and unlink/rmdir from JS for every entry.
+ *
+ * The tree is walked by up to `concurrency` threads (this worker and concurrency-1 helper threads)
+ * sharing a stack of directories to scan. Files are unlinked during the scan with unlinkat,
+ * and a directory is removed by the thread that completes its last child.
+ * Symlinks are never followed - they are unlinked like files. Below the root, directories are
+ * opened and removed relative to the fd of their parent (openat/unlinkat with O_NOFOLLOW),
+ * so replacing an ancestor with a symlink during the walk cannot redirect the delete.
+ *
+ * Entries that are already missing are ignored. Other errors do not stop the walk,
+ * the first `max_errors` are returned and the ancestors of the failed entries are left in place.
+ *
+ * The optional `progress` Float64Array is shared with JS while the op is running:
+ * JS sets progress[RMTREE_CANCEL] to non-zero to cancel, and the native threads update
+ * progress[RMTREE_FILES], progress[RMTREE_DIRS] and progress[RMTREE_ERRORS].
+ */
+enum RmtreeProgress
+{
+    RMTREE_CANCEL,
+    RMTREE_FILES,
+    RMTREE_DIRS,
+    RMTREE_ERRORS,
+    RMTREE_PROGRESS_LEN,
+};
+
+struct Rmtree : public FSWorker
+{
+    struct Node
+    {
+        Node* parent;
+        std::string name;
+        std::string path; // for errors only, the syscalls use name relative to parent->fd
+        int fd; // open from the scan until the node completes, so that its children resolve through it
+        int pending; // the scan of the node + its children that were not completed yet
+        int scans;
+        bool failed;
+    };
+    std::string _path;
+    int _concurrency;
+    bool _follow_symlinks;
+    size_t _max_errors;
+    double* _progress;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::vector<Node*> _stack;
+    int _active;
+    std::atomic<uint64_t> _files;
+    std::atomic<uint64_t> _dirs;
+    std::atomic<uint64_t> _error_count;
+    std::atomic<bool> _cancelled;
+    std::vector<std::pair<std::string, int>> _errors;
+    Rmtree(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _concurrency(8)
+        , _follow_symlinks(false)
+        , _max_errors(10)
+        , _progress(0)
+        , _active(0)
+        , _files(0)
+        , _dirs(0)
+        , _error_count(0)
+        , _cancelled(false)
+    {
+        _path = info[1].As<Napi::String>();
+        if (info[2].IsObject()) {
+            auto options = info[2].As<Napi::Object>();
+            _concurrency = std::max(1, std::min(64, napi_get_i32_or(options, "concurrency", _concurrency)));
+            _follow_symlinks = options.Get("follow_symlinks").ToBoolean();
+            _max_errors = napi_get_u32_or(options, "max_errors", _max_errors);
+            auto progress = options.Get("progress");
+            if (progress.IsTypedArray()) {
+                auto arr = progress.As<Napi::TypedArray>();
+                if (arr.TypedArrayType() != napi_float64_array || arr.ElementLength() < RMTREE_PROGRESS_LEN) {
+                    SetError(XSTR() << "FS::Rmtree: expected progress Float64Array of length " << RMTREE_PROGRESS_LEN);
+                } else {
+                    // kept alive by _args_ref for the lifetime of the worker
+                    _progress = progress.As<Napi::Float64Array>().Data();
+                }
+            }
+        }
+        Begin(XSTR() << "Rmtree " << DVAL(_path) << DVAL(_concurrency));
+    }
+    virtual void Work()
+    {
+        if (_follow_symlinks) {
+            SetError("FS::Rmtree: follow_symlinks is not supported");
+            return;
+        }
+        // check the root first so that a missing or non directory root fails the op like rmdir would
+        struct stat st;
+        SYSCALL_OR_RETURN(lstat(_path.c_str(), &st));
+        if (!S_ISDIR(st.st_mode)) {
+            errno = ENOTDIR;
+            SetSyscallError();
+            return;
+        }
+        _stack.push_back(new Node{ nullptr, _path, _path, -1, 1, 0, false });
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < _concurrency; ++i) {
+            try {
+                helpers.emplace_back(&Rmtree::helper_main, this);
+            } catch (const std::system_error& e) {
+                // out of threads - continue with the helpers that started
+                LOG("FS::Rmtree: failed to start helper thread " << DVAL(_path) << DVAL(i) << DVAL(e.what()));
+                break;
+            }
+        }
+        run();
+        for (auto& t : helpers) t.join();
+        dir_fd_cache.remove(_path);
+    }
+    void helper_main()
+    {
+        ThreadScope tx;
+        tx.set_user(_uid, _gid, _supplemental_groups);
+        if (_should_add_thread_capabilities) tx.add_thread_capabilities();
+        run();
+    }
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            while (_stack.empty() && _active > 0) _cond.wait(lock);
+            if (_stack.empty()) break;
+            Node* node = _stack.back();
+            _stack.pop_back();
+            _active += 1;
+            lock.unlock();
+            bool ok = scan(node);
+            complete(node, !ok);
+            lock.lock();
+            _active -= 1;
+            if (_stack.empty() && _active == 0) _cond.notify_all();
+        }
+    }
+    bool cancelled()
+    {
+        if (_cancelled.load(std::memory_order_relaxed)) return true;
+        if (!_progress) return false;
+        double cancel;
+        __atomic_load(&_progress[RMTREE_CANCEL], &cancel, __ATOMIC_RELAXED);
+        if (!cancel) return false;
+        _cancelled = true;
+        return true;
+    }
+    void update_progress(int index, uint64_t value)
+    {
+        if (!_progress) return;
+        double v = value;
+        __atomic_store(&_progress[index], &v, __ATOMIC_RELAXED);
+    }
+    void add_error(const std::string& path, int err)
+    {
+        update_progress(RMTREE_ERRORS, ++_error_count);
+        DBG1("FS::Rmtree: " << DVAL(path) << DVAL(strerror(err)));
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_errors.size() < _max_errors) _errors.emplace_back(path, err);
+    }
+    void push_children(Node* node, std::vector<Node*>& children)
+    {
+        if (children.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            node->pending += children.size();
+            _stack.insert(_stack.end(), children.begin(), children.end());
+        }
+        if (children.size() > 1) {
+            _cond.notify_all();
+        } else {
+            _cond.notify_one();
+        }
+        children.clear();
+    }
+    // unlinks the files of the dir and pushes its subdirs, returns false if anything was left behind
+    bool scan(Node* node)
+    {
+        if (cancelled()) return false;
+        node->scans += 1;
+        const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+        int fd = node->parent ? openat(node->parent->fd, node->name.c_str(), flags) : open(node->path.c_str(), flags);
+        if (fd < 0) {
+            if (errno == ENOENT) return true;
+            add_error(node->path, errno);
+            return false;
+        }
+        node->fd = fd;
+        bool ok = true;
+        std::vector<Node*> children;
+        int r = for_each_dirent(fd, [&](const char* name, unsigned char type) {
+            if (cancelled()) {
+                ok = false;
+                return false;
+            }
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+                    if (errno != ENOENT) {
+                        add_error(node->path + "/" + name, errno);
+                        ok = false;
+                    }
+                    return true;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+            }
+            if (type != DT_DIR) {
+                if (unlinkat(fd, name, 0) == 0) {
+                    update_progress(RMTREE_FILES, ++_files);
+                    return true;
+                }
+                if (errno == ENOENT) return true;
+                // replaced by a directory since the scan read it
+                if (errno != EISDIR) {
+                    add_error(node->path + "/" + name, errno);
+                    ok = false;
+                    return true;
+                }
+            }
+            children.push_back(new Node{ node, name, node->path + "/" + name, -1, 1, 0, false });
+            if (children.size() >= 64) push_children(node, children);
+            return true;
+        });
+        if (r < 0) {
+            add_error(node->path, errno);
+            ok = false;
+        }
+        push_children(node, children);
+        return ok;
+    }
+    // completes the scan or child of node, and removes the dirs that have no pending children up the tree
+    void complete(Node* node, bool failed)
+    {
+        while (node) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (failed) node->failed = true;
+                node->pending -= 1;
+                if (node->pending > 0) return;
+            }
+            // no other thread references the node now
+            if (node->fd >= 0) {
+                close(node->fd);
+                node->fd = -1;
+            }
+            failed = node->failed || cancelled();
+            int dir_fd = node->parent ? node->parent->fd : AT_FDCWD;
+            const char* dir_name = node->parent ? node->name.c_str() : node->path.c_str();
+            if (!failed && unlinkat(dir_fd, dir_name, AT_REMOVEDIR)) {
+                // on filesystems where removing entries during the scan can skip some of the entries, scan again
+                if (errno == ENOTEMPTY && node->scans < 2) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    node->pending = 1;
+                    _stack.push_back(node);
+                    _cond.notify_one();
+                    return;
+                }
+                if (errno != ENOENT) {
+                    add_error(node->path, errno);
+                    failed = true;
+                }
+            }
+            if (!failed) update_progress(RMTREE_DIRS, ++_dirs);
+            Node* parent = node->parent;
+            delete node;
+            node = parent;
+        }
+    }
+    virtual void OnOK()
+    {
+        uint64_t files = _files;
+        uint64_t dirs = _dirs;
+        uint64_t error_count = _error_count;
+        DBG1("FS::Rmtree::OnOK: " << DVAL(_path) << DVAL(files) << DVAL(dirs) << DVAL(error_count));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        res["files"] = Napi::Number::New(env, files);
+        res["dirs"] = Napi::Number::New(env, dirs);
+        res["error_count"] = Napi::Number::New(env, error_count);
+        res["cancelled"] = Napi::Boolean::New(env, _cancelled.load());
+        auto errors = Napi::Array::New(env, _errors.size());
+        for (size_t i = 0; i < _errors.size(); ++i) {
+            auto err = Napi::Object::New(env);
+            err["path"] = Napi::String::New(env, _errors[i].first);
+            err["code"] = Napi::String::New(env, uv_err_name(uv_translate_sys_error(_errors[i].second)));
+            errors[uint32_t(i)] = err;
+        }
+        res["errors"] = errors;
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * SafeLink is an fs op
+ * 1. link
+ * 2. check if the target has the expected version
+ *   2.1. if yes - return
+ *   2.2. else - unlink and retry
+ */
+struct SafeLink : public FSWorker
+{
+    std::string _link_from;
+    std::string _link_to;
+    int64_t _link_expected_mtime;
+    int64_t _link_expected_inode;
+    SafeLink(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+    {
+        _link_from = info[1].As<Napi::String>();
+        _link_to = info[2].As<Napi::String>();
+        // TODO: handle lossless
+        bool lossless = true;
+        _link_expected_mtime = info[3].As<Napi::BigInt>().Int64Value(&lossless);
         _link_expected_inode = info[4].As<Napi::Number>().Int64Value();
         Begin(XSTR() << "SafeLink " << DVAL(_link_from.c_str()) << DVAL(_link_to.c_str()) << DVAL(_link_expected_mtime) << DVAL(_link_expected_inode));
     }
     virtual void Work()
     {
         SYSCALL_OR_RETURN(link(_link_from.c_str(), _link_to.c_str()));
+        fd_cache.remove(_link_to);
+        config_cache.remove(_link_to);
         struct stat _stat_res;
         SYSCALL_OR_RETURN(stat(_link_to.c_str(), &_stat_res));
         if (cmp_ver_id(_link_expected_mtime, _link_expected_inode, _stat_res) == true) return;
@@ -1130,6 +2060,8 @@ struct SafeUnlink : public FSWorker
     virtual void Work()
     {
         SYSCALL_OR_RETURN(rename(_to_unlink.c_str(), _mv_to.c_str()));
+        fd_cache.remove(_to_unlink);
+        config_cache.remove(_to_unlink);
         struct stat _stat_res;
         SYSCALL_OR_RETURN(stat(_mv_to.c_str(), &_stat_res));
         if (cmp_ver_id(_unlink_expected_mtime, _unlink_expected_inode, _stat_res) == true) {
@@ -1159,10 +2091,40 @@ struct Rename : public FSWorker
     }
     virtual void Work()
     {
-        SYSCALL_OR_RETURN(rename(_old_path.c_str(), _new_path.c_str()));
+        AtPath at_old(_old_path);
+        AtPath at_new(_new_path);
+        SYSCALL_OR_RETURN(at_new.call([&](int dirfd, const char* p) {
+            return at_old.call([&](int olddirfd, const char* oldp) { return renameat(olddirfd, oldp, dirfd, p); });
+        }));
+        fd_cache.remove(_old_path);
+        config_cache.remove(_old_path);
+        fd_cache.remove(_new_path);
+        config_cache.remove(_new_path);
     }
 };
 
+/**
+ * preallocate_fd reserves the blocks of [offset, offset+len) so that the data is written to contiguous extents,
+ * and a full filesystem fails with ENOSPC before any data is written.
+ * With keep_size the file size is not changed, so it is safe to use before streaming the data.
+ * Returns 0 when allocated, 1 when the filesystem does not support it, or -1 with errno.
+ */
+static int
+preallocate_fd(int fd, off_t offset, off_t len, bool keep_size)
+{
+    if (len <= 0) return 0;
+#ifdef __APPLE__
+    (void)fd;
+    (void)offset;
+    (void)keep_size;
+    return 1;
+#else
+    if (fallocate(fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0, offset, len) == 0) return 0;
+    if (errno == EOPNOTSUPP || errno == ENOSYS) return 1;
+    return -1;
+#endif
+}
+
 /**
  * Writefile is an fs op
  */
@@ -1173,6 +2135,7 @@ struct Writefile : public FSWorker
     XattrMap _xattr_try;
     bool _set_xattr;
     bool _xattr_need_fsync;
+    bool _preallocate;
     std::string _xattr_clear_prefix;
     const uint8_t* _data;
     size_t _len;
@@ -1180,6 +2143,7 @@ struct Writefile : public FSWorker
     Writefile(const Napi::CallbackInfo& info)
         : FSWorker(info)
         , _set_xattr(false)
+        , _preallocate(false)
         , _mode(0666)
     {
         _path = info[1].As<Napi::String>();
@@ -1189,6 +2153,7 @@ struct Writefile : public FSWorker
         if (info[3].ToBoolean()) {
             Napi::Object options = info[3].As<Napi::Object>();
             if (options.Get("mode").IsNumber()) _mode = options.Get("mode").As<Napi::Number>().Uint32Value();
+            _preallocate = options.Get("preallocate").ToBoolean();
             _xattr_need_fsync = options.Get("xattr_need_fsync").ToBoolean();
             if (options.Get("xattr_clear_prefix").ToBoolean()) {
                 _xattr_clear_prefix = options.Get("xattr_clear_prefix").ToString();
@@ -1202,12 +2167,21 @@ struct Writefile : public FSWorker
                 get_xattr_from_object(_xattr_try, options.Get("xattr_try").As<Napi::Object>());
             }
         }
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "Writefile " << DVAL(_path) << DVAL(_len) << DVAL(_mode));
     }
     virtual void Work()
     {
-        int fd = open(_path.c_str(), O_TRUNC | O_CREAT | O_WRONLY, _mode);
+        AtPath at(_path);
+        int fd = at.call([this](int dirfd, const char* p) { return openat(dirfd, p, O_TRUNC | O_CREAT | O_WRONLY, _mode); });
         CHECK_OPEN_FD(fd);
+        fd_cache.remove(_path);
+        config_cache.remove(_path);
+
+        if (_preallocate && preallocate_fd(fd, 0, _len, false) < 0) {
+            SetSyscallError();
+            return;
+        }
 
         ssize_t len = write(fd, _data, _len);
         if (len < 0) {
@@ -1243,12 +2217,14 @@ struct Readfile : public FSWorker
     struct stat _stat_res;
     XattrMap _xattr;
     uint8_t* _data;
+    uint64_t _ticket;
     int _len;
     std::vector<std::string> _xattr_get_keys;
     Readfile(const Napi::CallbackInfo& info)
         : FSWorker(info)
         , _read_xattr(false)
         , _data(0)
+        , _ticket(0)
         , _len(0)
     {
         _path = info[1].As<Napi::String>();
@@ -1257,16 +2233,18 @@ struct Readfile : public FSWorker
             _read_xattr = options.Get("read_xattr").ToBoolean();
             load_xattr_get_keys(options, _xattr_get_keys);
         }
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "Readfile " << DVAL(_path));
     }
     virtual ~Readfile()
     {
-        buffer_releaser(NULL, _data);
+        dio_free(_data, _ticket);
         _data = 0;
     }
     virtual void Work()
     {
-        int fd = open(_path.c_str(), O_RDONLY);
+        AtPath at(_path);
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, O_RDONLY); });
         CHECK_OPEN_FD(fd);
         SYSCALL_OR_RETURN(fstat(fd, &_stat_res));
         if (_read_xattr) {
@@ -1277,8 +2255,8 @@ struct Readfile : public FSWorker
         }
 
         _len = _stat_res.st_size;
-        int r = posix_memalign((void**)&_data, DIO_BUFFER_MEMALIGN, _len);
-        if (r || (!_data && _len > 0)) {
+        _data = dio_alloc(_len, _ticket);
+        if (!_data && _len > 0) {
             SetError(XSTR() << "FS::readFile: failed to allocate memory " << DVAL(_len) << DVAL(_path));
             return;
         }
@@ -1306,12 +2284,11 @@ struct Readfile : public FSWorker
         DBG1("FS::Readfile::OnOK: " << DVAL(_path));
         Napi::Env env = Env();
 
-        auto res_stat = Napi::Object::New(env);
-        set_stat_res(res_stat, env, _stat_res, _xattr);
+        auto res_stat = new_stat_res(env, _stat_res, _xattr);
 
         auto data = _data;
-        _data = 0; // nullify so dtor will ignore, GC will call buffer_releaser
-        auto buf = Napi::Buffer<uint8_t>::New(env, data, _len, buffer_releaser);
+        _data = 0; // nullify so dtor will ignore, GC will free it
+        auto buf = dio_buffer_new(env, data, _len, _ticket);
 
         auto res = Napi::Object::New(env);
         res["stat"] = res_stat;
@@ -1322,162 +2299,1500 @@ struct Readfile : public FSWorker
 };
 
 /**
- * Readdir is an fs op
+ * BlockHelperPool is a bounded set of helper threads shared by all the block batches of the process,
+ * started on demand and kept for the next batches.
+ * A batch queues its helper tasks and also processes blocks on its own worker thread,
+ * so it always makes progress even when all the helpers are busy with other batches,
+ * and when it is done it cancels its tasks that did not start yet and waits for the running ones.
  */
-struct Readdir : public FSWorker
+struct BlockHelperPool
 {
-    std::string _path;
-    // bool _withFileTypes;
-    std::vector<Entry> _entries;
-    Readdir(const Napi::CallbackInfo& info)
-        : FSWorker(info)
-        , _entries(0)
+    static const int MAX_THREADS = 16;
+    struct Task
     {
-        _path = info[1].As<Napi::String>();
-        // _withFileTypes = info[1].As<Napi::Boolean>();
-        Begin(XSTR() << "Readdir " << DVAL(_path));
-    }
-    virtual void Work()
+        const void* owner;
+        std::function<void()> fn;
+    };
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::condition_variable _done_cond;
+    std::deque<Task> _queue;
+    std::unordered_map<const void*, int> _running; // the number of running tasks by owner
+    int _threads = 0;
+    int _idle = 0;
+
+    void submit(const void* owner, std::function<void()> fn)
     {
-        DIR* dir;
-        dir = opendir(_path.c_str());
-        if (dir == NULL) {
-            SetSyscallError();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(Task{ owner, std::move(fn) });
+        if (_idle > 0 || _threads >= MAX_THREADS) {
+            _cond.notify_one();
             return;
         }
-
-        while (true) {
-            // need to set errno before the call to readdir() to detect between EOF and error
-            errno = 0;
-            struct dirent* e = readdir(dir);
-            if (e) {
-                // Ignore parent and current directories
-                if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
-                    continue;
-                }
-                _entries.push_back(Entry{
-                    std::string(e->d_name),
-                    e->d_ino,
-                    e->d_type,
-                    e->DIR_OFFSET_FIELD,
-                });
-            } else {
-                if (errno) SetSyscallError();
-                break;
-            }
+        try {
+            std::thread(&BlockHelperPool::thread_main, this).detach();
+            _threads += 1;
+        } catch (const std::system_error& e) {
+            // out of threads - the task waits for a running helper or is cancelled by its owner
+            LOG("FS::BlockHelperPool: failed to start helper thread " << DVAL(_threads) << DVAL(e.what()));
         }
+    }
 
-        int r = closedir(dir);
-        if (r) SetSyscallError();
+    // removes the queued tasks of owner that did not start yet, and waits for its running tasks to finish
+    void cancel_and_wait(const void* owner)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _queue.erase(
+            std::remove_if(_queue.begin(), _queue.end(), [owner](const Task& t) { return t.owner == owner; }),
+            _queue.end());
+        while (_running.count(owner)) _done_cond.wait(lock);
     }
-    virtual void OnOK()
+
+    void thread_main()
     {
-        DBG1("FS::Readdir::OnOK: " << DVAL(_path));
-        Napi::Env env = Env();
-        Napi::Array res = Napi::Array::New(env, _entries.size());
-        int index = 0;
-        // if (_withFileTypes) {
-        for (auto it = _entries.begin(); it != _entries.end(); ++it) {
-            auto dir_rec = Napi::Object::New(env);
-            dir_rec["name"] = Napi::String::New(env, it->name);
-            dir_rec["ino"] = Napi::Number::New(env, it->ino);
-            dir_rec["type"] = Napi::Number::New(env, it->type);
-            dir_rec["off"] = Napi::BigInt::New(env, it->off);
-            res[index] = dir_rec;
-            index += 1;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _idle += 1;
+            while (_queue.empty()) _cond.wait(lock);
+            _idle -= 1;
+            Task task = std::move(_queue.front());
+            _queue.pop_front();
+            _running[task.owner] += 1;
+            lock.unlock();
+            task.fn();
+            lock.lock();
+            auto it = _running.find(task.owner);
+            if (--it->second == 0) {
+                _running.erase(it);
+                _done_cond.notify_all();
+            }
         }
-        // } else {
-        //     for (auto it = _entries.begin(); it != _entries.end(); ++it) {
-        //         res[index] = Napi::String::New(env, it->name);;
-        //         index += 1;
-        //     }
-        // }
-        _deferred.Resolve(res);
-        ReportWorkerStats(0);
     }
 };
 
+// never destroyed so that the helper threads can still reach it at exit (like WorkerPool)
+static BlockHelperPool& block_helper_pool = *new BlockHelperPool();
+
 /**
- * Fsync is an fs op
+ * BlockBatch is the base of the batched block ops of the agent block store.
+ * Each block is an independent fs op with its own result, and the blocks are processed by
+ * the worker thread with up to `concurrency - 1` helpers from BlockHelperPool, so a batch takes
+ * a single trip to the worker pool without starting threads of its own.
  */
-struct Fsync : public FSWorker
+struct BlockBatch : public FSWorker
 {
-    std::string _path;
-    Fsync(const Napi::CallbackInfo& info)
+    size_t _count;
+    int _concurrency;
+    std::string _xattr_key;
+    std::vector<int> _errs;
+    std::atomic<size_t> _next;
+    BlockBatch(const Napi::CallbackInfo& info)
         : FSWorker(info)
+        , _count(0)
+        , _concurrency(8)
+        , _next(0)
     {
-        _path = info[1].As<Napi::String>();
-        Begin(XSTR() << "Fsync " << DVAL(_path));
+        _count = info[1].As<Napi::Array>().Length();
+        _errs.resize(_count, 0);
+        if (info[2].IsObject()) {
+            auto options = info[2].As<Napi::Object>();
+            _concurrency = std::max(1, std::min(64, napi_get_i32_or(options, "concurrency", _concurrency)));
+            _xattr_key = napi_get_str_or(options, "xattr_key", "");
+        }
+        _lane = FS_LANE_DATA;
     }
+    // returns 0 or the errno of the block
+    virtual int process(size_t i) = 0;
     virtual void Work()
     {
-        int fd = open(_path.c_str(), 0);
-        CHECK_OPEN_FD(fd);
-        SYSCALL_OR_RETURN(fsync(fd));
+        int helpers = int(std::min<size_t>(_concurrency, _count)) - 1;
+        for (int i = 0; i < helpers; ++i) {
+            block_helper_pool.submit(this, [this]() { helper_main(); });
+        }
+        run();
+        // the helpers that did not start yet have nothing left to do
+        block_helper_pool.cancel_and_wait(this);
+    }
+    void helper_main()
+    {
+        ThreadScope tx;
+        tx.set_user(_uid, _gid, _supplemental_groups);
+        if (_should_add_thread_capabilities) tx.add_thread_capabilities();
+        run();
+    }
+    void run()
+    {
+        while (true) {
+            size_t i = _next.fetch_add(1);
+            if (i >= _count) break;
+            _errs[i] = process(i);
+        }
+    }
+    void set_block_error(Napi::Env env, Napi::Object res, size_t i)
+    {
+        if (!_errs[i]) return;
+        res["code"] = Napi::String::New(env, uv_err_name(uv_translate_sys_error(_errs[i])));
+        res["message"] = Napi::String::New(env, strerror(_errs[i]));
     }
 };
 
+// returns the errno of the last failed call of a block op, or 0 if the call succeeded
+#define BLOCK_ERRNO(x) ((x) < 0 ? errno : 0)
+
 /**
- * GetPwName is an os op
+ * WriteBlocks writes a batch of blocks, each one to its own file.
+ * The block md is set in the xattr_key xattr, or written to meta_path when xattr_key is not set.
+ * An existing block is replaced, and its size (with its meta file) is returned for usage accounting.
  */
-struct GetPwName : public FSWorker
+struct WriteBlocks : public BlockBatch
 {
-    std::string _user;
-    struct passwd _pwd;
-    struct passwd* _getpwnam_res;
-    std::unique_ptr<char[]> _buf;
-    GetPwName(const Napi::CallbackInfo& info)
-        : FSWorker(info)
-        , _getpwnam_res(NULL)
+    struct Block
     {
-        _user = info[1].As<Napi::String>();
-        Begin(XSTR() << "GetPwName " << DVAL(_user));
+        std::string path;
+        std::string meta_path;
+        std::string md;
+        const uint8_t* data;
+        size_t len;
+        int64_t replaced_size;
+    };
+    std::vector<Block> _blocks;
+    bool _preallocate;
+    WriteBlocks(const Napi::CallbackInfo& info)
+        : BlockBatch(info)
+        , _preallocate(false)
+    {
+        auto arr = info[1].As<Napi::Array>();
+        _blocks.resize(_count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto obj = arr.Get(uint32_t(i)).As<Napi::Object>();
+            auto& b = _blocks[i];
+            b.path = napi_get_str(obj, "path");
+            b.meta_path = napi_get_str_or(obj, "meta_path", "");
+            b.md = napi_get_str_or(obj, "md", "");
+            // the buffers are kept alive by _args_ref for the lifetime of the worker
+            auto buf = obj.Get("data").As<Napi::Buffer<uint8_t>>();
+            b.data = buf.Data();
+            b.len = buf.Length();
+            b.replaced_size = -1;
+        }
+        if (info[2].IsObject()) _preallocate = info[2].As<Napi::Object>().Get("preallocate").ToBoolean();
+        Begin(XSTR() << "WriteBlocks " << DVAL(_count) << DVAL(_concurrency));
     }
-    virtual void Work()
+    virtual int process(size_t i)
     {
-        const long passwd_buf_size = ThreadScope::get_passwd_buf_size();
-        _buf.reset(new char[passwd_buf_size]);
-        if (!_buf) {
-            SetSyscallError();
-            return;
+        auto& b = _blocks[i];
+        AtPath at(b.path);
+        struct stat st;
+        if (at.call([&](int dirfd, const char* p) { return fstatat(dirfd, p, &st, 0); }) == 0) {
+            b.replaced_size = st.st_size;
+            if (!b.meta_path.empty()) {
+                // do not leave an old meta file behind on overwrite
+                struct stat meta_st;
+                if (stat(b.meta_path.c_str(), &meta_st) == 0) {
+                    b.replaced_size += meta_st.st_size;
+                    if (unlink(b.meta_path.c_str()) && errno != ENOENT) return errno;
+                }
+            }
+        } else if (errno != ENOENT) {
+            return errno;
         }
-        int rc = getpwnam_r(_user.c_str(), &_pwd, _buf.get(), passwd_buf_size, &_getpwnam_res);
-        if (rc != 0) {
-            SetSyscallError();
-            return;
+
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, O_TRUNC | O_CREAT | O_WRONLY, 0666); });
+        if (fd < 0) return errno;
+        fd_cache.remove(b.path);
+        int err = 0;
+        if (_preallocate && preallocate_fd(fd, 0, b.len, false) < 0) err = errno;
+        if (!err) err = BLOCK_ERRNO(write_full(fd, b.data, b.len));
+        if (!err && !_xattr_key.empty()) {
+            err = BLOCK_ERRNO(fsetxattr(fd, _xattr_key.c_str(), b.md.c_str(), b.md.length(), 0));
         }
-        if (_getpwnam_res == NULL) SetError("NO_SUCH_USER");
-    }
+        if (close(fd) && !err) err = errno;
+        if (err || !_xattr_key.empty() || b.meta_path.empty()) return err;
 
+        fd = open(b.meta_path.c_str(), O_TRUNC | O_CREAT | O_WRONLY, 0666);
+        if (fd < 0) return errno;
+        err = BLOCK_ERRNO(write_full(fd, (const uint8_t*)b.md.c_str(), b.md.length()));
+        if (close(fd) && !err) err = errno;
+        return err;
+    }
     virtual void OnOK()
     {
-        DBG1("FS::GetPwName::OnOK: " << DVAL(_user) << DVAL(_getpwnam_res->pw_uid) << DVAL(_getpwnam_res->pw_gid));
+        DBG1("FS::WriteBlocks::OnOK: " << DVAL(_count));
         Napi::Env env = Env();
-        auto res = Napi::Object::New(env);
-        set_getpwnam_res(env, res, *_getpwnam_res);
+        auto res = Napi::Array::New(env, _count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto r = Napi::Object::New(env);
+            r["replaced_size"] = Napi::Number::New(env, _blocks[i].replaced_size);
+            set_block_error(env, r, i);
+            res[uint32_t(i)] = r;
+        }
         _deferred.Resolve(res);
+        ReportWorkerStats(0);
     }
 };
 
 /**
- * Helper: get supplemental groups via getgrouplist.
- * Returns 0 on success, -1 on failure. Populates groups_res on success.
+ * ReadBlocks reads a batch of blocks with their md from the xattr_key xattr,
+ * falling back to the meta file of the block when the xattr is missing.
  */
-static int
-get_supplemental_groups(const char* user, gid_t gid, std::vector<gid_t>& groups_res)
+struct ReadBlocks : public BlockBatch
 {
-    int ngroups = NGROUPS_MAX;
-#ifdef __APPLE__
-    //for some reason on mac getgrouplist accepts an array of int instead of gid_t. so need to create a vector of int and then insert it into groups
-    std::vector<int> tmp_groups(ngroups);
-    if (getgrouplist(user, gid, &tmp_groups[0], &ngroups) < 0) {
-        return -1;
+    struct Block
+    {
+        std::string path;
+        std::string meta_path;
+        std::string md;
+        uint8_t* data;
+        uint64_t ticket;
+        size_t len;
+    };
+    std::vector<Block> _blocks;
+    ReadBlocks(const Napi::CallbackInfo& info)
+        : BlockBatch(info)
+    {
+        auto arr = info[1].As<Napi::Array>();
+        _blocks.resize(_count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto obj = arr.Get(uint32_t(i)).As<Napi::Object>();
+            auto& b = _blocks[i];
+            b.path = napi_get_str(obj, "path");
+            b.meta_path = napi_get_str_or(obj, "meta_path", "");
+            b.data = 0;
+            b.ticket = 0;
+            b.len = 0;
+        }
+        Begin(XSTR() << "ReadBlocks " << DVAL(_count) << DVAL(_concurrency));
     }
-    groups_res.assign(tmp_groups.begin(), tmp_groups.begin() + ngroups);
-#else
-    groups_res.resize(ngroups);
-    if (getgrouplist(user, gid, &groups_res[0], &ngroups) < 0) {
-        return -1;
+    virtual ~ReadBlocks()
+    {
+        for (auto& b : _blocks) dio_free(b.data, b.ticket);
+    }
+    virtual int process(size_t i)
+    {
+        auto& b = _blocks[i];
+        AtPath at(b.path);
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, O_RDONLY); });
+        if (fd < 0) return errno;
+        int err = read_block(fd, b);
+        if (close(fd) && !err) err = errno;
+        if (err || !b.md.empty() || b.meta_path.empty()) return err;
+
+        // blocks of the old model keep the md in a meta file, which is optional
+        fd = open(b.meta_path.c_str(), O_RDONLY);
+        if (fd < 0) return 0;
+        char buf[4096];
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) > 0) b.md.append(buf, len);
+        close(fd);
+        return 0;
+    }
+    int read_block(int fd, Block& b)
+    {
+        struct stat st;
+        if (fstat(fd, &st)) return errno;
+        if (!_xattr_key.empty() && get_single_user_xattr(fd, _xattr_key, b.md) && errno != ENOATTR) return errno;
+        b.len = st.st_size;
+        b.data = dio_alloc(b.len, b.ticket);
+        if (!b.data && b.len > 0) return ENOMEM;
+        size_t pos = 0;
+        while (pos < b.len) {
+            ssize_t len = read(fd, b.data + pos, b.len - pos);
+            if (len < 0) {
+                if (errno == EINTR) continue;
+                return errno;
+            }
+            // truncated while reading
+            if (len == 0) return EAGAIN;
+            pos += len;
+        }
+        // same as readFile, a block that changed while it was read fails instead of returning mixed data
+        struct stat end_st;
+        if (fstat(fd, &end_st)) return errno;
+        bool changed = _do_ctime_check ? st.st_ctime != end_st.st_ctime : st.st_mtime != end_st.st_mtime;
+        return changed ? EAGAIN : 0;
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::ReadBlocks::OnOK: " << DVAL(_count));
+        Napi::Env env = Env();
+        auto res = Napi::Array::New(env, _count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto& b = _blocks[i];
+            auto r = Napi::Object::New(env);
+            if (_errs[i]) {
+                set_block_error(env, r, i);
+            } else {
+                auto data = b.data;
+                b.data = 0; // nullify so dtor will ignore, GC will free it
+                r["data"] = dio_buffer_new(env, data, b.len, b.ticket);
+                if (!b.md.empty()) r["md"] = Napi::String::New(env, b.md);
+            }
+            res[uint32_t(i)] = r;
+        }
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * DeleteBlocks unlinks a batch of blocks and their meta files.
+ * Missing blocks are not an error, and the size of each deleted block (with its meta file) is returned,
+ * or -1 if the block did not exist (its meta file is still removed).
+ */
+struct DeleteBlocks : public BlockBatch
+{
+    struct Block
+    {
+        std::string path;
+        std::string meta_path;
+        int64_t size;
+    };
+    std::vector<Block> _blocks;
+    DeleteBlocks(const Napi::CallbackInfo& info)
+        : BlockBatch(info)
+    {
+        auto arr = info[1].As<Napi::Array>();
+        _blocks.resize(_count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto obj = arr.Get(uint32_t(i)).As<Napi::Object>();
+            _blocks[i].path = napi_get_str(obj, "path");
+            _blocks[i].meta_path = napi_get_str_or(obj, "meta_path", "");
+            _blocks[i].size = -1;
+        }
+        _lane = FS_LANE_META;
+        Begin(XSTR() << "DeleteBlocks " << DVAL(_count) << DVAL(_concurrency));
+    }
+    virtual int process(size_t i)
+    {
+        auto& b = _blocks[i];
+        AtPath at(b.path);
+        struct stat st;
+        bool exists = true;
+        if (at.call([&](int dirfd, const char* p) { return fstatat(dirfd, p, &st, 0); })) {
+            if (errno != ENOENT) return errno;
+            exists = false;
+        } else {
+            if (at.call([](int dirfd, const char* p) { return unlinkat(dirfd, p, 0); }) && errno != ENOENT) return errno;
+            fd_cache.remove(b.path);
+            b.size = st.st_size;
+        }
+        // the meta file may be left behind by a partial delete, so it is removed even when the block is missing,
+        // but its size is only counted with the block so that usage is not reduced for a block that was already gone
+        if (b.meta_path.empty()) return 0;
+        struct stat meta_st;
+        if (stat(b.meta_path.c_str(), &meta_st)) return errno == ENOENT ? 0 : errno;
+        if (unlink(b.meta_path.c_str()) && errno != ENOENT) return errno;
+        if (exists) b.size += meta_st.st_size;
+        return 0;
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::DeleteBlocks::OnOK: " << DVAL(_count));
+        Napi::Env env = Env();
+        auto res = Napi::Array::New(env, _count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto r = Napi::Object::New(env);
+            r["size"] = Napi::Number::New(env, _blocks[i].size);
+            set_block_error(env, r, i);
+            res[uint32_t(i)] = r;
+        }
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * ReadCachedFile reads a small file with its stat and xattrs through the object cache.
+ * On a hit it costs a stat and an access check of the path and a copy of the data -
+ * the cached data is shared by all the readers, so JS gets its own buffer that it may modify.
+ * Files that are not regular or larger than the cache max_object_size resolve with the stat only.
+ */
+struct ReadCachedFile : public FSWorker
+{
+    std::string _path;
+    struct stat _stat_res;
+    XattrMap _xattr;
+    std::shared_ptr<const CachedObject> _obj;
+    bool _hit;
+    ReadCachedFile(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _hit(false)
+    {
+        _path = info[1].As<Napi::String>();
+        Begin(XSTR() << "ReadCachedFile " << DVAL(_path));
+    }
+    virtual void Work()
+    {
+        AtPath at(_path);
+        SYSCALL_OR_RETURN(at.call([this](int dirfd, const char* p) { return fstatat(dirfd, p, &_stat_res, 0); }));
+        // gpfs xattrs are read with the gpfs lib and are not covered by the ctime, so gpfs is not cached
+        if (!object_cache.enabled() || use_gpfs_lib()) return;
+        if (!S_ISREG(_stat_res.st_mode) || _stat_res.st_size > object_cache._max_object_size) return;
+
+        auto obj = object_cache.lookup(_stat_res);
+        if (obj) {
+            // the cached data skips the open, so check that the caller is allowed to read it
+            SYSCALL_OR_RETURN(at.call([](int dirfd, const char* p) { return faccessat(dirfd, p, R_OK, AT_EACCESS); }));
+            _obj = obj;
+            _xattr = obj->_xattr;
+            _hit = true;
+            return;
+        }
+
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, O_RDONLY); });
+        CHECK_OPEN_FD(fd);
+        auto new_obj = std::make_shared<CachedObject>();
+        SYSCALL_OR_RETURN(fstat(fd, &new_obj->_stat));
+        if (!S_ISREG(new_obj->_stat.st_mode) || new_obj->_stat.st_size > object_cache._max_object_size) {
+            _stat_res = new_obj->_stat;
+            return;
+        }
+        SYSCALL_OR_RETURN(get_fd_xattr(fd, new_obj->_xattr, {}));
+        new_obj->_data.resize(new_obj->_stat.st_size);
+        size_t pos = 0;
+        while (pos < new_obj->_data.size()) {
+            ssize_t len = pread(fd, new_obj->_data.data() + pos, new_obj->_data.size() - pos, pos);
+            if (len < 0) {
+                SetSyscallError();
+                return;
+            }
+            if (len == 0) break;
+            pos += len;
+        }
+        // a file that changed while reading is not cached, and resolves with the stat only
+        SYSCALL_OR_RETURN(fstat(fd, &_stat_res));
+        if (pos != new_obj->_data.size() || !ObjectCache::same_version(new_obj->_stat, _stat_res)) {
+            DBG1("FS::ReadCachedFile: file changed while reading, not caching " << DVAL(_path));
+            return;
+        }
+        object_cache.insert(new_obj);
+        _obj = new_obj;
+        _xattr = new_obj->_xattr;
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::ReadCachedFile::OnOK: " << DVAL(_path) << DVAL(_hit));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        if (_obj) {
+            _stat_res = _obj->_stat;
+            res["data"] = Napi::Buffer<uint8_t>::Copy(env, _obj->_data.data(), _obj->_data.size());
+        }
+        res["stat"] = new_stat_res(env, _stat_res, _xattr);
+        res["cache_hit"] = Napi::Boolean::New(env, _hit);
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * ReadConfigFile reads a small config file through the config cache.
+ * A watched or recently validated entry is served without syscalls, a stale entry costs a stat,
+ * and the data is handed to JS without a copy, so the returned buffer must not be modified.
+ */
+struct ReadConfigFile : public FSWorker
+{
+    std::string _path;
+    std::shared_ptr<const ConfigFile> _file;
+    bool _hit;
+    ReadConfigFile(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _hit(false)
+    {
+        _path = info[1].As<Napi::String>();
+        Begin(XSTR() << "ReadConfigFile " << DVAL(_path));
+    }
+    virtual void Work()
+    {
+        int err = config_cache.read(_path, ConfigCache::User{ _uid, _gid, _supplemental_groups }, _file, _hit);
+        if (err) {
+            errno = err;
+            SetSyscallError();
+        }
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::ReadConfigFile::OnOK: " << DVAL(_path) << DVAL(_hit));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        res["data"] = new_config_file_buffer(env, _file);
+        res["cache_hit"] = Napi::Boolean::New(env, _hit);
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * Readdir is an fs op
+ */
+struct Readdir : public FSWorker
+{
+    std::string _path;
+    // bool _withFileTypes;
+    std::vector<Entry> _entries;
+    Readdir(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _entries(0)
+    {
+        _path = info[1].As<Napi::String>();
+        // _withFileTypes = info[1].As<Napi::Boolean>();
+        Begin(XSTR() << "Readdir " << DVAL(_path));
+    }
+    virtual void Work()
+    {
+        SYSCALL_OR_RETURN(read_dir(_path, _entries));
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::Readdir::OnOK: " << DVAL(_path));
+        Napi::Env env = Env();
+        Napi::Array res = Napi::Array::New(env, _entries.size());
+        int index = 0;
+        // if (_withFileTypes) {
+        for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+            auto dir_rec = Napi::Object::New(env);
+            dir_rec["name"] = Napi::String::New(env, it->name);
+            dir_rec["ino"] = Napi::Number::New(env, it->ino);
+            dir_rec["type"] = Napi::Number::New(env, it->type);
+            dir_rec["off"] = Napi::BigInt::New(env, it->off);
+            res[index] = dir_rec;
+            index += 1;
+        }
+        // } else {
+        //     for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        //         res[index] = Napi::String::New(env, it->name);;
+        //         index += 1;
+        //     }
+        // }
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * js_string_compare compares utf8 strings in the order of JS string comparison (utf16 code units),
+ * which differs from the utf8 byte order only between supplementary characters and U+E000..U+FFFF.
+ */
+static int
+js_string_compare(const std::string& a, const std::string& b)
+{
+    size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) ++i;
+    if (i == n) return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+    // back to the start of the differing characters, which have the same length prefix
+    while (i > 0 && (uint8_t(a[i]) & 0xC0) == 0x80) --i;
+    auto utf16_unit = [](const std::string& s, size_t i) -> uint32_t {
+        uint8_t c = s[i];
+        // a 4 bytes sequence is a supplementary character, which starts with a high surrogate in utf16
+        if ((c & 0xF8) == 0xF0 && i + 3 < s.size()) {
+            uint32_t cp = ((c & 0x07) << 18) | ((s[i + 1] & 0x3F) << 12) | ((s[i + 2] & 0x3F) << 6) | (s[i + 3] & 0x3F);
+            return 0xD800 + ((cp - 0x10000) >> 10);
+        }
+        if ((c & 0xF0) == 0xE0 && i + 2 < s.size()) return ((c & 0x0F) << 12) | ((s[i + 1] & 0x3F) << 6) | (s[i + 2] & 0x3F);
+        return 0;
+    };
+    uint32_t ua = utf16_unit(a, i);
+    uint32_t ub = utf16_unit(b, i);
+    if (ua && ub && ua != ub) return ua < ub ? -1 : 1;
+    return uint8_t(a[i]) < uint8_t(b[i]) ? -1 : 1;
+}
+
+/**
+ * VersionEntry is a directory entry with the object key and version time that order the versions listing,
+ * see the JS sort_entries_by_name_and_time() in namespace_fs.js.
+ */
+struct VersionEntry
+{
+    Entry ent;
+    std::string key;
+    uint64_t mtime;
+
+    static const uint64_t LATEST = UINT64_MAX;
+
+    // parse a "<key>_mtime-<base36>-ino-<base36>" version name, or returns false
+    static bool parse_version_name(const std::string& name, std::string& key, uint64_t& mtime)
+    {
+        size_t mtime_pos = name.find("_mtime-");
+        if (mtime_pos == std::string::npos) return false;
+        size_t ino_pos = name.find("-ino-");
+        if (ino_pos == std::string::npos || ino_pos <= mtime_pos) return false;
+        key = name.substr(0, mtime_pos);
+        // like the JS split('-') the mtime is the third part from the end
+        size_t end = name.rfind('-');
+        end = end == std::string::npos || end == 0 ? std::string::npos : name.rfind('-', end - 1);
+        size_t begin = end == std::string::npos || end == 0 ? std::string::npos : name.rfind('-', end - 1);
+        mtime = 0;
+        if (begin == std::string::npos) return true;
+        for (size_t i = begin + 1; i < end; ++i) {
+            char c = name[i];
+            int d = c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'z' ? c - 'a' + 10 : (c >= 'A' && c <= 'Z' ? c - 'A' + 10 : -1));
+            if (d < 0) break;
+            mtime = mtime * 36 + d;
+        }
+        return true;
+    }
+
+    void parse(const std::string& null_suffix)
+    {
+        if (parse_version_name(ent.name, key, mtime)) return;
+        mtime = LATEST;
+        if (ent.name.size() >= null_suffix.size() &&
+            ent.name.compare(ent.name.size() - null_suffix.size(), null_suffix.size(), null_suffix) == 0) {
+            key = ent.name.substr(0, ent.name.size() - null_suffix.size());
+        } else {
+            key = ent.name;
+        }
+    }
+
+    // key ascending, and the versions of the same key from the latest to the oldest
+    static bool before(const VersionEntry& a, const VersionEntry& b)
+    {
+        int c = js_string_compare(a.key, b.key);
+        if (c) return c < 0;
+        return a.mtime > b.mtime;
+    }
+};
+
+static Napi::Array
+versions_page(Napi::Env env, const std::vector<VersionEntry>& entries, size_t begin, size_t end)
+{
+    Napi::Array res = Napi::Array::New(env, end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        const Entry& ent = entries[i].ent;
+        auto dir_rec = Napi::Object::New(env);
+        dir_rec["name"] = Napi::String::New(env, ent.name);
+        dir_rec["ino"] = Napi::Number::New(env, ent.ino);
+        dir_rec["type"] = Napi::Number::New(env, ent.type);
+        dir_rec["off"] = Napi::BigInt::New(env, ent.off);
+        res[uint32_t(i - begin)] = dir_rec;
+    }
+    return res;
+}
+
+/**
+ * VersionsCursorWrap holds a sorted versions listing between pages.
+ * read(limit) returns the next entries (an empty array at the end), and close() releases them.
+ */
+struct VersionsCursorWrap : public Napi::ObjectWrap<VersionsCursorWrap>
+{
+    std::string _path;
+    std::vector<VersionEntry> _entries;
+    size_t _pos;
+    bool _closed;
+    static Napi::FunctionReference constructor;
+    static void init(Napi::Env env)
+    {
+        constructor = Napi::Persistent(DefineClass(
+            env,
+            "VersionsCursor",
+            {
+                InstanceMethod("close", &VersionsCursorWrap::close),
+                InstanceMethod("read", &VersionsCursorWrap::read),
+            }));
+        constructor.SuppressDestruct();
+    }
+    VersionsCursorWrap(const Napi::CallbackInfo& info)
+        : Napi::ObjectWrap<VersionsCursorWrap>(info)
+        , _pos(0)
+        , _closed(true)
+    {
+    }
+    ~VersionsCursorWrap()
+    {
+        if (!_closed) DBG1("FS::VersionsCursorWrap::dtor: cursor not closed " << DVAL(_path));
+    }
+    Napi::Value read(const Napi::CallbackInfo& info)
+    {
+        size_t limit = _entries.size() - _pos;
+        if (info.Length() > 0 && info[0].IsNumber()) {
+            limit = std::min<size_t>(limit, std::max<int64_t>(0, info[0].As<Napi::Number>().Int64Value()));
+        }
+        size_t begin = _pos;
+        _pos += limit;
+        return versions_page(info.Env(), _entries, begin, _pos);
+    }
+    Napi::Value close(const Napi::CallbackInfo& info)
+    {
+        std::vector<VersionEntry>().swap(_entries);
+        _pos = 0;
+        _closed = true;
+        return info.Env().Undefined();
+    }
+};
+
+Napi::FunctionReference VersionsCursorWrap::constructor;
+
+/**
+ * ReaddirVersions lists one directory level of a versioned bucket - the latest objects in the directory
+ * merged with their older versions from the versions directory, ordered by key and then by version time
+ * from the latest to the oldest. Null versions ("<key>_null") are ordered by their mtime, which costs
+ * a stat of each of them. This replaces reading both directories into JS and sorting them there.
+ * When the versions directory does not exist the entries are ordered by name like a plain listing.
+ *
+ * Options: { versions_dir = '.versions', null_suffix = '_null', start_after, limit, cursor }
+ * start_after continues after the entry of that name (or its sort position if it was removed),
+ * and limit returns at most that many entries.
+ * With cursor: true it resolves to a VersionsCursor that keeps the sorted listing, so paging over
+ * a large directory reads and sorts it once instead of once per page.
+ */
+struct ReaddirVersions : public FSWorker
+{
+    std::string _path;
+    std::string _versions_dir;
+    std::string _null_suffix;
+    std::string _start_after;
+    bool _has_start_after;
+    size_t _limit;
+    bool _cursor;
+    std::vector<VersionEntry> _entries;
+    size_t _begin;
+    size_t _end;
+    ReaddirVersions(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _versions_dir(".versions")
+        , _null_suffix("_null")
+        , _has_start_after(false)
+        , _limit(SIZE_MAX)
+        , _cursor(false)
+        , _begin(0)
+        , _end(0)
+    {
+        _path = info[1].As<Napi::String>();
+        if (info.Length() > 2 && info[2].IsObject()) {
+            auto options = info[2].As<Napi::Object>();
+            _versions_dir = napi_get_str_or(options, "versions_dir", _versions_dir);
+            _null_suffix = napi_get_str_or(options, "null_suffix", _null_suffix);
+            if (options.Get("start_after").IsString()) {
+                _start_after = options.Get("start_after").As<Napi::String>().Utf8Value();
+                _has_start_after = true;
+            }
+            if (options.Get("limit").IsNumber()) _limit = std::max<int64_t>(0, options.Get("limit").As<Napi::Number>().Int64Value());
+            _cursor = options.Get("cursor").ToBoolean();
+        }
+        Begin(XSTR() << "ReaddirVersions " << DVAL(_path) << DVAL(_start_after) << DVAL(_limit) << DVAL(_cursor));
+    }
+    // read the entries of the directory, and for null versions stat them with the dir fd to get their mtime
+    int read_dir(const std::string& dir_path, bool versions)
+    {
+        DIR* dir = opendir(dir_path.c_str());
+        if (!dir) return errno;
+        int err = 0;
+        while (true) {
+            errno = 0;
+            struct dirent* e = readdir(dir);
+            if (!e) {
+                err = errno;
+                break;
+            }
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            VersionEntry v{ Entry{ std::string(e->d_name), e->d_ino, e->d_type, e->DIR_OFFSET_FIELD }, "", 0 };
+            v.parse(_null_suffix);
+            if (versions && v.mtime == VersionEntry::LATEST && v.key.size() != v.ent.name.size()) {
+                struct stat st;
+                // a null version that was removed since the readdir is skipped
+                if (fstatat(dirfd(dir), e->d_name, &st, 0)) continue;
+#ifdef __APPLE__
+                v.mtime = uint64_t(round((double(1e9) * st.st_mtimespec.tv_sec) + st.st_mtimespec.tv_nsec));
+#else
+                v.mtime = uint64_t(round((double(1e9) * st.st_mtim.tv_sec) + st.st_mtim.tv_nsec));
+#endif
+            }
+            _entries.push_back(std::move(v));
+        }
+        closedir(dir);
+        return err;
+    }
+    virtual void Work()
+    {
+        int err = read_dir(_path, false);
+        if (err) {
+            errno = err;
+            SetSyscallError();
+            return;
+        }
+        size_t num_latest = _entries.size();
+        err = read_dir(_path + "/" + _versions_dir, true);
+        if (err == ENOENT) {
+            // without versions, order by name like the plain listing
+            for (auto& v : _entries) {
+                v.key = v.ent.name;
+                v.mtime = 0;
+            }
+        } else if (err) {
+            errno = err;
+            SetSyscallError();
+            return;
+        }
+        DBG1("FS::ReaddirVersions: " << DVAL(_path) << DVAL(num_latest) << DVAL(_entries.size() - num_latest));
+        std::stable_sort(_entries.begin(), _entries.end(), VersionEntry::before);
+
+        _begin = 0;
+        if (_has_start_after) {
+            auto it = std::find_if(_entries.begin(), _entries.end(),
+                [this](const VersionEntry& v) { return v.ent.name == _start_after; });
+            if (it != _entries.end()) {
+                _begin = it - _entries.begin() + 1;
+            } else {
+                VersionEntry marker{ Entry{ _start_after, 0, 0, 0 }, "", 0 };
+                marker.parse(_null_suffix);
+                if (err == ENOENT) {
+                    marker.key = _start_after;
+                    marker.mtime = 0;
+                }
+                _begin = std::upper_bound(_entries.begin(), _entries.end(), marker, VersionEntry::before) - _entries.begin();
+            }
+        }
+        _end = _begin + std::min(_limit, _entries.size() - _begin);
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::ReaddirVersions::OnOK: " << DVAL(_path) << DVAL(_begin) << DVAL(_end));
+        Napi::Env env = Env();
+        if (_cursor) {
+            auto res = VersionsCursorWrap::constructor.New({});
+            VersionsCursorWrap* cursor = VersionsCursorWrap::Unwrap(res);
+            cursor->_path = _path;
+            cursor->_entries = std::move(_entries);
+            cursor->_pos = _begin;
+            cursor->_closed = false;
+            _deferred.Resolve(res);
+            ReportWorkerStats(0);
+            return;
+        }
+        Napi::Array res = versions_page(env, _entries, _begin, _end);
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * Fsync is an fs op
+ */
+struct Fsync : public FSWorker
+{
+    std::string _path;
+    Fsync(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+    {
+        _path = info[1].As<Napi::String>();
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "Fsync " << DVAL(_path));
+    }
+    virtual void Work()
+    {
+        AtPath at(_path);
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, 0); });
+        CHECK_OPEN_FD(fd);
+        if (FsyncGroup::instance().enabled()) {
+            int err = group_fsync(fd, DirFdCache::normalize(_path));
+            if (err) {
+                errno = err;
+                SetSyscallError();
+            }
+            return;
+        }
+        SYSCALL_OR_RETURN(fsync(fd));
+    }
+};
+
+/**
+ * CopyMethod is the way copy_fd_range() managed to copy the data,
+ * from the cheapest (metadata only clone) to the most expensive (user space buffer).
+ */
+enum class CopyMethod
+{
+    NONE,
+    REFLINK,
+    COPY_FILE_RANGE,
+    SPLICE,
+    READ_WRITE,
+};
+
+static const char*
+copy_method_name(CopyMethod m)
+{
+    switch (m) {
+    case CopyMethod::REFLINK: return "reflink";
+    case CopyMethod::COPY_FILE_RANGE: return "copy_file_range";
+    case CopyMethod::SPLICE: return "splice";
+    case CopyMethod::READ_WRITE: return "read_write";
+    default: return "none";
+    }
+}
+
+enum class ReflinkMode
+{
+    AUTO,
+    ALWAYS,
+    NEVER,
+};
+
+static ReflinkMode
+parse_reflink_mode(Napi::Value v)
+{
+    if (!v.IsString()) return ReflinkMode::AUTO;
+    std::string s = v.As<Napi::String>();
+    if (s == "always") return ReflinkMode::ALWAYS;
+    if (s == "never") return ReflinkMode::NEVER;
+    return ReflinkMode::AUTO;
+}
+
+// errors that mean the copy method is not supported for these fds and the next method should be tried
+static bool
+copy_method_unsupported(int err)
+{
+    return err == EXDEV || err == ENOSYS || err == EOPNOTSUPP || err == EINVAL || err == ENOTTY;
+}
+
+static const size_t COPY_RW_BUFFER_SIZE = 1024 * 1024;
+
+/**
+ * copy_fd_range copies up to len bytes from src_fd at src_off to dst_fd at dst_off.
+ * It tries a reflink clone (FICLONE/FICLONERANGE), then copy_file_range(2), then a splice(2)
+ * loop through a pipe, and only then falls back to pread/pwrite with a user space buffer.
+ * Each method continues from where the previous one stopped, so a method that fails midway
+ * (e.g copy_file_range returning EXDEV on old kernels) does not restart the copy.
+ * The len is clamped to the source size, and the copied bytes are returned in done.
+ * Returns 0 on success, or -1 with errno set.
+ */
+static int
+copy_fd_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off, size_t len, ReflinkMode reflink, size_t& done, CopyMethod& method)
+{
+    struct stat st;
+    done = 0;
+    method = CopyMethod::NONE;
+    if (fstat(src_fd, &st)) return -1;
+    if (src_off >= st.st_size) return 0;
+    len = std::min(len, size_t(st.st_size - src_off));
+    if (!len) return 0;
+
+#ifndef __APPLE__
+#ifdef FICLONE
+    if (reflink != ReflinkMode::NEVER) {
+        int r;
+        if (src_off == 0 && dst_off == 0 && len == size_t(st.st_size)) {
+            r = ioctl(dst_fd, FICLONE, src_fd);
+        } else {
+            struct file_clone_range fcr = {};
+            fcr.src_fd = src_fd;
+            fcr.src_offset = src_off;
+            fcr.src_length = len;
+            fcr.dest_offset = dst_off;
+            r = ioctl(dst_fd, FICLONERANGE, &fcr);
+        }
+        if (r == 0) {
+            done = len;
+            method = CopyMethod::REFLINK;
+            return 0;
+        }
+        if (reflink == ReflinkMode::ALWAYS || !copy_method_unsupported(errno)) return -1;
+    }
+#endif
+    if (reflink == ReflinkMode::ALWAYS) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    method = CopyMethod::COPY_FILE_RANGE;
+    // some filesystems (e.g. network/fuse) return 0 from copy_file_range without copying anything,
+    // so 0 before any progress falls back to read/write which tells a truncated source apart
+    bool read_write = false;
+    while (done < len) {
+        loff_t s = src_off + done;
+        loff_t d = dst_off + done;
+        ssize_t n = copy_file_range(src_fd, &s, dst_fd, &d, len - done, 0);
+        if (n > 0) {
+            done += n;
+        } else if (n == 0) {
+            if (done > 0) return 0; // source truncated meanwhile
+            read_write = true;
+            break;
+        } else if (errno != EINTR) {
+            if (!copy_method_unsupported(errno)) return -1;
+            break;
+        }
+    }
+    if (done >= len) return 0;
+
+    int pipefd[2];
+    if (!read_write && pipe2(pipefd, O_CLOEXEC) == 0) {
+        method = CopyMethod::SPLICE;
+        // best effort to move more than the default 64KB per splice
+        fcntl(pipefd[1], F_SETPIPE_SZ, COPY_RW_BUFFER_SIZE);
+        bool unsupported = false;
+        int err = 0;
+        while (done < len) {
+            loff_t s = src_off + done;
+            ssize_t n = splice(src_fd, &s, pipefd[1], NULL, std::min(len - done, COPY_RW_BUFFER_SIZE), SPLICE_F_MOVE);
+            if (n == 0) break;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                unsupported = copy_method_unsupported(err);
+                break;
+            }
+            // the pipe must be drained before continuing, so a failure here is final
+            ssize_t left = n;
+            while (left > 0) {
+                loff_t d = dst_off + done;
+                ssize_t w = splice(pipefd[0], NULL, dst_fd, &d, left, SPLICE_F_MOVE);
+                if (w < 0 && errno == EINTR) continue;
+                if (w <= 0) {
+                    err = w < 0 ? errno : EIO;
+                    break;
+                }
+                left -= w;
+                done += w;
+            }
+            if (left > 0) break;
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+        if (done >= len || (!err && !unsupported)) return 0;
+        if (!unsupported) {
+            errno = err;
+            return -1;
+        }
+    }
+#else
+    if (reflink == ReflinkMode::ALWAYS) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+#endif
+
+    method = CopyMethod::READ_WRITE;
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[COPY_RW_BUFFER_SIZE]);
+    while (done < len) {
+        ssize_t n = pread(src_fd, buf.get(), std::min(len - done, COPY_RW_BUFFER_SIZE), src_off + done);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = pwrite(dst_fd, buf.get() + off, n - off, dst_off + done + off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) return -1;
+            off += w;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/**
+ * CopyFile is an fs op that copies a file (or a byte range of it) from src_path to dst_path
+ * inside the kernel using copy_fd_range(), so server side copies do not pass through node buffers.
+ * When xattr are given they are set on the dst fd before it is closed, which lets callers copy
+ * into a temp path and publish it with link/rename only once data and metadata are complete.
+ * Resolves to { bytes, method }.
+ */
+struct CopyFile : public FSWorker
+{
+    std::string _src_path;
+    std::string _dst_path;
+    off_t _start;
+    int64_t _end;
+    ReflinkMode _reflink;
+    bool _set_xattr;
+    XattrMap _xattr;
+    mode_t _mode;
+    size_t _bytes;
+    CopyMethod _method;
+    CopyFile(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _start(0)
+        , _end(-1)
+        , _reflink(ReflinkMode::AUTO)
+        , _set_xattr(false)
+        , _mode(0666)
+        , _bytes(0)
+        , _method(CopyMethod::NONE)
+    {
+        _src_path = info[1].As<Napi::String>();
+        _dst_path = info[2].As<Napi::String>();
+        if (info.Length() > 3 && info[3].IsObject()) {
+            Napi::Object options = info[3].As<Napi::Object>();
+            if (options.Get("start").IsNumber()) _start = options.Get("start").As<Napi::Number>().Int64Value();
+            if (options.Get("end").IsNumber()) _end = options.Get("end").As<Napi::Number>().Int64Value();
+            if (options.Get("mode").IsNumber()) _mode = options.Get("mode").As<Napi::Number>().Uint32Value();
+            _reflink = parse_reflink_mode(options.Get("reflink"));
+            if (options.Get("xattr").ToBoolean()) {
+                _set_xattr = true;
+                get_xattr_from_object(_xattr, options.Get("xattr").As<Napi::Object>());
+            }
+        }
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "CopyFile " << DVAL(_src_path) << DVAL(_dst_path) << DVAL(_start) << DVAL(_end));
+    }
+    virtual void Work()
+    {
+        if (_start < 0 || (_end >= 0 && _end < _start)) {
+            SetError(XSTR() << "FS::CopyFile: invalid range " << DVAL(_start) << DVAL(_end));
+            return;
+        }
+        AtPath src_at(_src_path);
+        int src_fd = src_at.call([](int dirfd, const char* p) { return openat(dirfd, p, O_RDONLY); });
+        CHECK_OPEN_FD(src_fd);
+        AtPath dst_at(_dst_path);
+        int dst_fd = dst_at.call([this](int dirfd, const char* p) { return openat(dirfd, p, O_TRUNC | O_CREAT | O_WRONLY, _mode); });
+        if (dst_fd < 0) {
+            SetSyscallError();
+            return;
+        }
+        AutoCloser dst_closer(this, dst_fd);
+        size_t len = _end < 0 ? SIZE_MAX : size_t(_end - _start);
+        SYSCALL_OR_RETURN(copy_fd_range(src_fd, _start, dst_fd, 0, len, _reflink, _bytes, _method));
+        if (_set_xattr) {
+            for (auto it = _xattr.begin(); it != _xattr.end(); ++it) {
+                SYSCALL_OR_RETURN(fsetxattr(dst_fd, it->first.c_str(), it->second.c_str(), it->second.length(), 0));
+            }
+        }
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::CopyFile::OnOK: " << DVAL(_src_path) << DVAL(_dst_path) << DVAL(_bytes) << DVAL(copy_method_name(_method)));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        res["bytes"] = Napi::Number::New(env, _bytes);
+        res["method"] = Napi::String::New(env, copy_method_name(_method));
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+static std::string
+to_base36(uint64_t n)
+{
+    static const char* digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+    std::string s;
+    do {
+        s.insert(s.begin(), digits[n % 36]);
+        n /= 36;
+    } while (n);
+    return s;
+}
+
+static int
+hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// decodes hex pairs until the first invalid pair, same as Buffer.from(str, 'hex')
+static void
+hex_decode_prefix(const std::string& hex, std::vector<uint8_t>& out)
+{
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        int hi = hex_nibble(hex[i]);
+        int lo = hex_nibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) break;
+        out.push_back(uint8_t((hi << 4) | lo));
+    }
+}
+
+/**
+ * the version id of a file by its stat, must match _get_version_id_by_stat() in namespace_fs.js
+ * which uses the mtimeNsBigint computed by get_stat_fields()
+ */
+static std::string
+version_id_by_stat(const struct stat& st)
+{
+#ifdef __APPLE__
+    double mtimeNs = (double(1e9) * st.st_mtimespec.tv_sec) + st.st_mtimespec.tv_nsec;
+#else
+    double mtimeNs = (double(1e9) * st.st_mtim.tv_sec) + st.st_mtim.tv_nsec;
+#endif
+    return "mtime-" + to_base36(uint64_t(round(mtimeNs))) + "-ino-" + to_base36(st.st_ino);
+}
+
+/**
+ * CompleteMultipart is an fs op that assembles the parts of a multipart upload into target_path
+ * in a single worker job instead of a few JS round trips per part.
+ * Each part is { md_path, etag } where md_path holds the part xattrs (size, offset and md5 - by the
+ * names in options) and the part data is in the file data_prefix + size at that offset.
+ * 1. read the parts xattrs and verify the etags (md5 xattr, or the version id by stat when missing)
+ * 2. hard link the data file of the longest prefix of parts that is already laid out in it in order,
+ *    unless later parts are read from that file too
+ * 3. fallocate the target and copy the rest with copy_fd_range(), coalescing adjacent ranges
+ * 4. truncate the target to the total size
+ * When options.md5 is set it also computes the md5 of the parts md5 for the multipart etag.
+ * Resolves to { size, num_parts, linked_bytes, md5? }.
+ */
+struct CompleteMultipart : public FSWorker
+{
+    struct Part
+    {
+        std::string md_path;
+        std::string etag;
+        uint64_t size;
+        uint64_t offset;
+    };
+    std::string _target_path;
+    std::string _data_prefix;
+    std::string _size_xattr;
+    std::string _offset_xattr;
+    std::string _md5_xattr;
+    bool _md5;
+    ReflinkMode _reflink;
+    mode_t _mode;
+    std::vector<Part> _parts;
+    uint64_t _total;
+    uint64_t _linked;
+    std::string _md5_hex;
+    DECLARE_ALIGNED(MD5_HASH_CTX_MGR _md5_mgr, 16);
+    DECLARE_ALIGNED(MD5_HASH_CTX _md5_ctx, 16);
+    CompleteMultipart(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _md5(false)
+        , _reflink(ReflinkMode::AUTO)
+        , _mode(0666)
+        , _total(0)
+        , _linked(0)
+    {
+        _target_path = info[1].As<Napi::String>();
+        auto parts = info[2].As<Napi::Array>();
+        auto options = info[3].As<Napi::Object>();
+        _data_prefix = options.Get("data_prefix").As<Napi::String>();
+        _size_xattr = options.Get("size_xattr").As<Napi::String>();
+        _offset_xattr = options.Get("offset_xattr").As<Napi::String>();
+        _md5_xattr = options.Get("md5_xattr").As<Napi::String>();
+        _md5 = options.Get("md5").ToBoolean();
+        _reflink = parse_reflink_mode(options.Get("reflink"));
+        if (options.Get("mode").IsNumber()) _mode = options.Get("mode").As<Napi::Number>().Uint32Value();
+        _parts.resize(parts.Length());
+        for (uint32_t i = 0; i < parts.Length(); ++i) {
+            auto part = parts.Get(i).As<Napi::Object>();
+            _parts[i].md_path = part.Get("md_path").As<Napi::String>();
+            _parts[i].etag = part.Get("etag").As<Napi::String>();
+            _parts[i].size = 0;
+            _parts[i].offset = 0;
+        }
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "CompleteMultipart " << DVAL(_target_path) << DVAL(_parts.size()));
+    }
+    virtual void Work()
+    {
+        for (auto& p : _parts) {
+            if (!load_part(p)) return;
+            _total += p.size;
+        }
+        if (_md5) compute_md5();
+
+        // remove leftovers of a previous attempt, the target is a private path under the upload dir
+        AtPath target_at(_target_path);
+        int r = target_at.call([](int dirfd, const char* p) { return unlinkat(dirfd, p, 0); });
+        if (r && errno != ENOENT) {
+            SetSyscallError();
+            return;
+        }
+
+        // the parts prefix that is already in place in its data file at offsets 0,1*size,2*size,...
+        // linking it means the rest is written into that same file, so it cannot be a source of the rest
+        size_t i = 0;
+        while (i < _parts.size() && _parts[i].size == _parts[0].size && _parts[i].offset == _linked) {
+            _linked += _parts[i].size;
+            i++;
+        }
+        for (size_t k = i; k < _parts.size(); ++k) {
+            if (_parts[k].size == _parts[0].size) {
+                _linked = 0;
+                i = 0;
+                break;
+            }
+        }
+        if (_linked) {
+            std::string data_path = _data_prefix + std::to_string(_parts[0].size);
+            AtPath src_at(data_path);
+            SYSCALL_OR_RETURN(linkat(src_at.fd(), src_at.rel(), target_at.fd(), target_at.rel(), 0));
+        }
+        int fd = target_at.call([this](int dirfd, const char* p) { return openat(dirfd, p, O_CREAT | O_RDWR, _mode); });
+        CHECK_OPEN_FD(fd);
+#ifndef __APPLE__
+        if (_total > _linked && fallocate(fd, 0, _linked, _total - _linked) && errno != EOPNOTSUPP && errno != ENOSYS) {
+            SetSyscallError();
+            return;
+        }
+#endif
+
+        std::map<uint64_t, int> data_fds;
+        uint64_t pos = _linked;
+        bool ok = true;
+        while (ok && i < _parts.size()) {
+            // coalesce parts that are adjacent in the same data file
+            const Part& first = _parts[i];
+            uint64_t len = first.size;
+            size_t j = i + 1;
+            while (j < _parts.size() && _parts[j].size == first.size && _parts[j].offset == first.offset + len) {
+                len += _parts[j].size;
+                j++;
+            }
+            int src_fd = open_data_file(data_fds, first.size);
+            size_t done = 0;
+            CopyMethod method;
+            if (src_fd < 0 || copy_fd_range(src_fd, first.offset, fd, pos, len, _reflink, done, method)) {
+                SetSyscallError();
+                ok = false;
+            } else if (done != len) {
+                SetError(XSTR() << "FS::CompleteMultipart: short part data " << DVAL(first.md_path) << DVAL(len) << DVAL(done));
+                ok = false;
+            }
+            pos += len;
+            i = j;
+        }
+        for (auto& it : data_fds) close(it.second);
+        if (!ok) return;
+        SYSCALL_OR_RETURN(ftruncate(fd, _total));
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::CompleteMultipart::OnOK: " << DVAL(_target_path) << DVAL(_total) << DVAL(_linked) << DVAL(_md5_hex));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        res["size"] = Napi::Number::New(env, _total);
+        res["num_parts"] = Napi::Number::New(env, _parts.size());
+        res["linked_bytes"] = Napi::Number::New(env, _linked);
+        if (_md5) res["md5"] = Napi::String::New(env, _md5_hex);
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+
+private:
+    bool load_part(Part& p)
+    {
+        AtPath at(p.md_path);
+        int fd = at.call([](int dirfd, const char* path) { return openat(dirfd, path, O_RDONLY); });
+        if (fd < 0) {
+            SetSyscallError();
+            return false;
+        }
+        AutoCloser closer(this, fd);
+        std::string size_str;
+        std::string offset_str;
+        std::string etag;
+        if (get_single_user_xattr(fd, _size_xattr, size_str) || get_single_user_xattr(fd, _offset_xattr, offset_str)) {
+            SetSyscallError();
+            return false;
+        }
+        p.size = strtoull(size_str.c_str(), NULL, 10);
+        p.offset = strtoull(offset_str.c_str(), NULL, 10);
+        if (get_single_user_xattr(fd, _md5_xattr, etag)) {
+            if (errno != ENOATTR) {
+                SetSyscallError();
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st)) {
+                SetSyscallError();
+                return false;
+            }
+            etag = version_id_by_stat(st);
+        }
+        if (etag != p.etag) {
+            SetError(XSTR() << "mismatch part etag: " << DVAL(p.md_path) << DVAL(p.etag) << DVAL(etag));
+            return false;
+        }
+        return true;
+    }
+    void compute_md5()
+    {
+        std::vector<uint8_t> etags;
+        etags.reserve(_parts.size() * 16);
+        for (auto& p : _parts) hex_decode_prefix(p.etag, etags);
+        hash_ctx_init(&_md5_ctx);
+        md5_ctx_mgr_init(&_md5_mgr);
+        md5_ctx_mgr_submit(&_md5_mgr, &_md5_ctx, etags.data(), etags.size(), HASH_ENTIRE);
+        while (hash_ctx_processing(&_md5_ctx)) {
+            md5_ctx_mgr_flush(&_md5_mgr);
+        }
+        std::stringstream hex;
+        for (int w = 0; w < MD5_DIGEST_NWORDS; ++w) {
+            uint32_t word = le32toh(hash_ctx_digest(&_md5_ctx)[w]);
+            for (int b = 0; b < 4; ++b) {
+                hex << std::hex << std::setw(2) << std::setfill('0') << ((word >> (8 * b)) & 0xff);
+            }
+        }
+        _md5_hex = hex.str();
+    }
+    int open_data_file(std::map<uint64_t, int>& data_fds, uint64_t size)
+    {
+        auto it = data_fds.find(size);
+        if (it != data_fds.end()) return it->second;
+        std::string data_path = _data_prefix + std::to_string(size);
+        AtPath at(data_path);
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, O_RDONLY); });
+        if (fd >= 0) data_fds[size] = fd;
+        return fd;
+    }
+};
+
+/**
+ * GetPwName is an os op
+ */
+struct GetPwName : public FSWorker
+{
+    std::string _user;
+    struct passwd _pwd;
+    struct passwd* _getpwnam_res;
+    std::unique_ptr<char[]> _buf;
+    GetPwName(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _getpwnam_res(NULL)
+    {
+        _user = info[1].As<Napi::String>();
+        Begin(XSTR() << "GetPwName " << DVAL(_user));
+    }
+    virtual void Work()
+    {
+        const long passwd_buf_size = ThreadScope::get_passwd_buf_size();
+        _buf.reset(new char[passwd_buf_size]);
+        if (!_buf) {
+            SetSyscallError();
+            return;
+        }
+        int rc = getpwnam_r(_user.c_str(), &_pwd, _buf.get(), passwd_buf_size, &_getpwnam_res);
+        if (rc != 0) {
+            SetSyscallError();
+            return;
+        }
+        if (_getpwnam_res == NULL) SetError("NO_SUCH_USER");
+    }
+
+    virtual void OnOK()
+    {
+        DBG1("FS::GetPwName::OnOK: " << DVAL(_user) << DVAL(_getpwnam_res->pw_uid) << DVAL(_getpwnam_res->pw_gid));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        set_getpwnam_res(env, res, *_getpwnam_res);
+        _deferred.Resolve(res);
+    }
+};
+
+/**
+ * Helper: get supplemental groups via getgrouplist.
+ * Returns 0 on success, -1 on failure. Populates groups_res on success.
+ */
+static int
+get_supplemental_groups(const char* user, gid_t gid, std::vector<gid_t>& groups_res)
+{
+    int ngroups = NGROUPS_MAX;
+#ifdef __APPLE__
+    //for some reason on mac getgrouplist accepts an array of int instead of gid_t. so need to create a vector of int and then insert it into groups
+    std::vector<int> tmp_groups(ngroups);
+    if (getgrouplist(user, gid, &tmp_groups[0], &ngroups) < 0) {
+        return -1;
+    }
+    groups_res.assign(tmp_groups.begin(), tmp_groups.begin() + ngroups);
+#else
+    groups_res.resize(ngroups);
+    if (getgrouplist(user, gid, &groups_res[0], &ngroups) < 0) {
+        return -1;
     }
     groups_res.resize(ngroups);
 #endif
@@ -1603,10 +3918,51 @@ struct FcntlGetLock : public FSWorker
     }
 };
 
+/**
+ * DirCacheAdd opens a directory and adds it to the dir fd cache
+ */
+struct DirCacheAdd : public FSWorker
+{
+    std::string _path;
+    DirCacheAdd(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+    {
+        _path = info[1].As<Napi::String>();
+        Begin(XSTR() << "DirCacheAdd " << DVAL(_path));
+    }
+    virtual void Work()
+    {
+        if (!dir_fd_cache.enabled()) return;
+        if (_path.empty() || _path[0] != '/') {
+            SetError(XSTR() << "FS::DirCacheAdd: expected absolute path " << DVAL(_path));
+            return;
+        }
+#ifdef O_PATH
+        int fd = open(_path.c_str(), O_PATH | O_DIRECTORY);
+#else
+        int fd = open(_path.c_str(), O_RDONLY | O_DIRECTORY);
+#endif
+        if (fd < 0) {
+            SetSyscallError();
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st)) {
+            SetSyscallError();
+            ::close(fd);
+            return;
+        }
+        dir_fd_cache.insert(_path, fd, st);
+    }
+};
+
 struct FileWrap : public Napi::ObjectWrap<FileWrap>
 {
     std::string _path;
     int _fd;
+    int _flags;
+    // set when the fd is shared with fd_cache, and then close releases it instead of closing the fd
+    std::shared_ptr<CachedFd> _cached;
     static Napi::FunctionReference constructor;
     static void init(Napi::Env env)
     {
@@ -1618,13 +3974,19 @@ struct FileWrap : public Napi::ObjectWrap<FileWrap>
                 InstanceMethod<&FileWrap::read>("read"),
                 InstanceMethod<&FileWrap::write>("write"),
                 InstanceMethod<&FileWrap::writev>("writev"),
+                InstanceMethod<&FileWrap::sendfile>("sendfile"),
+                InstanceMethod<&FileWrap::copy_range>("copy_range"),
+                InstanceMethod<&FileWrap::allocate>("allocate"),
                 InstanceMethod<&FileWrap::read_rdma>("read_rdma"),
                 InstanceMethod<&FileWrap::write_rdma>("write_rdma"),
                 InstanceMethod<&FileWrap::replacexattr>("replacexattr"),
                 InstanceMethod<&FileWrap::linkfileat>("linkfileat"),
                 InstanceMethod<&FileWrap::unlinkfileat>("unlinkfileat"),
+                InstanceMethod<&FileWrap::publish_file>("publish_file"),
                 InstanceMethod<&FileWrap::stat>("stat"),
                 InstanceMethod<&FileWrap::fsync>("fsync"),
+                InstanceMethod<&FileWrap::advise>("advise"),
+                InstanceMethod<&FileWrap::readahead>("readahead"),
                 InstanceMethod<&FileWrap::flock>("flock"),
                 InstanceMethod<&FileWrap::fcntllock>("fcntllock"),
                 InstanceMethod<&FileWrap::fcntlgetlock>("fcntlgetlock"),
@@ -1635,10 +3997,15 @@ struct FileWrap : public Napi::ObjectWrap<FileWrap>
     FileWrap(const Napi::CallbackInfo& info)
         : Napi::ObjectWrap<FileWrap>(info)
         , _fd(-1)
+        , _flags(0)
     {
     }
     ~FileWrap()
     {
+        if (_cached) {
+            _cached.reset();
+            _fd = -1;
+        }
         if (_fd >= 0) {
             LOG("FS::FileWrap::dtor: file not closed " << DVAL(_path) << DVAL(_fd));
             int r = ::close(_fd);
@@ -1650,13 +4017,19 @@ struct FileWrap : public Napi::ObjectWrap<FileWrap>
     Napi::Value read(const Napi::CallbackInfo& info);
     Napi::Value write(const Napi::CallbackInfo& info);
     Napi::Value writev(const Napi::CallbackInfo& info);
+    Napi::Value sendfile(const Napi::CallbackInfo& info);
+    Napi::Value copy_range(const Napi::CallbackInfo& info);
+    Napi::Value allocate(const Napi::CallbackInfo& info);
     Napi::Value read_rdma(const Napi::CallbackInfo& info);
     Napi::Value write_rdma(const Napi::CallbackInfo& info);
     Napi::Value replacexattr(const Napi::CallbackInfo& info);
     Napi::Value linkfileat(const Napi::CallbackInfo& info);
     Napi::Value unlinkfileat(const Napi::CallbackInfo& info);
+    Napi::Value publish_file(const Napi::CallbackInfo& info);
     Napi::Value stat(const Napi::CallbackInfo& info);
     Napi::Value fsync(const Napi::CallbackInfo& info);
+    Napi::Value advise(const Napi::CallbackInfo& info);
+    Napi::Value readahead(const Napi::CallbackInfo& info);
     Napi::Value getfd(const Napi::CallbackInfo& info);
     Napi::Value flock(const Napi::CallbackInfo& info);
     Napi::Value fcntllock(const Napi::CallbackInfo& info);
@@ -1671,11 +4044,18 @@ struct FileOpen : public FSWorker
     int _fd;
     int _flags;
     mode_t _mode;
+    int64_t _preallocate;
+    bool _keep_size;
+    bool _cache;
+    std::shared_ptr<CachedFd> _cached;
     FileOpen(const Napi::CallbackInfo& info)
         : FSWorker(info)
         , _fd(-1)
         , _flags(0)
         , _mode(0666)
+        , _preallocate(0)
+        , _keep_size(true)
+        , _cache(false)
     {
         _path = info[1].As<Napi::String>();
         if (info.Length() > 2 && !info[2].IsUndefined()) {
@@ -1685,12 +4065,44 @@ struct FileOpen : public FSWorker
         if (info.Length() > 3 && !info[3].IsUndefined()) {
             _mode = info[3].As<Napi::Number>().Uint32Value();
         }
-        Begin(XSTR() << "FileOpen " << DVAL(_path) << DVAL(_flags) << DVAL(_mode));
+        if (info.Length() > 4 && info[4].IsObject()) {
+            Napi::Object options = info[4].As<Napi::Object>();
+            _preallocate = napi_get_i64_or(options, "preallocate", 0);
+            if (options.Has("keep_size")) _keep_size = options.Get("keep_size").ToBoolean();
+            _cache = options.Get("cache").ToBoolean() && FdCache::cacheable_flags(_flags) && _preallocate <= 0;
+        }
+        Begin(XSTR() << "FileOpen " << DVAL(_path) << DVAL(_flags) << DVAL(_mode) << DVAL(_preallocate) << DVAL(_cache));
     }
     virtual void Work()
     {
-        _fd = open(_path.c_str(), _flags, _mode);
-        if (_fd < 0) SetSyscallError();
+        if (_cache) {
+            _cached = fd_cache.lookup(_path, _flags, _uid, _gid, _supplemental_groups);
+            if (_cached) {
+                _fd = _cached->_fd;
+                return;
+            }
+        } else if (!FdCache::cacheable_flags(_flags)) {
+            // opening for write may truncate or modify the file in place
+            fd_cache.remove(_path);
+        }
+        _fd = open_at(_path, _flags, _mode);
+        if (_fd < 0) {
+            SetSyscallError();
+            return;
+        }
+        if (_cache) {
+            struct stat st;
+            if (fstat(_fd, &st) == 0 && S_ISREG(st.st_mode) && fd_cache.enabled()) {
+                _cached = fd_cache.insert(_path, _fd, _flags, _uid, _gid, _supplemental_groups, st);
+            }
+            return;
+        }
+        // upload mode - reserve the declared size up front and fail before any data is written
+        if (_preallocate > 0 && preallocate_fd(_fd, 0, _preallocate, _keep_size) < 0) {
+            SetSyscallError();
+            ::close(_fd);
+            _fd = -1;
+        }
     }
     virtual void OnOK()
     {
@@ -1699,6 +4111,8 @@ struct FileOpen : public FSWorker
         FileWrap* w = FileWrap::Unwrap(res);
         w->_path = _path;
         w->_fd = _fd;
+        w->_flags = _flags;
+        w->_cached = _cached;
         _deferred.Resolve(res);
         ReportWorkerStats(0);
     }
@@ -1713,6 +4127,13 @@ struct FileClose : public FSWrapWorker<FileWrap>
     }
     virtual void Work()
     {
+        if (_wrap->_cached) {
+            // the idle ttl counts from the last close
+            _wrap->_cached->_used_ms = now_ms();
+            _wrap->_cached.reset();
+            _wrap->_fd = -1;
+            return;
+        }
         int fd = _wrap->_fd;
         if (fd >= 0) {
             std::string path = _wrap->_path;
@@ -1743,13 +4164,14 @@ struct FileRead : public FSWrapWorker<FileWrap>
         _offset = info[2].As<Napi::Number>();
         _len = info[3].As<Napi::Number>();
         _pos = info[4].As<Napi::Number>();
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "FileRead " << DVAL(_wrap->_path) << DVAL(_wrap->_fd) << DVAL(_pos) << DVAL(_offset) << DVAL(_len));
     }
     virtual void Work()
     {
         int fd = _wrap->_fd;
         CHECK_WRAP_FD(fd);
-        _br = pread(fd, _buf + _offset, _len, _pos);
+        _br = read_at(fd, _wrap->_flags, _buf + _offset, _len, _pos);
         if (_br < 0) {
             SetSyscallError();
             return;
@@ -1781,18 +4203,14 @@ struct FileWrite : public FSWrapWorker<FileWrap>
         if (info.Length() > 3 && !info[3].IsUndefined()) {
             _offset = info[3].As<Napi::Number>();
         }
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "FileWrite " << DVAL(_wrap->_path) << DVAL(_len) << DVAL(_offset));
     }
     virtual void Work()
     {
         int fd = _wrap->_fd;
         CHECK_WRAP_FD(fd);
-        ssize_t bw = -1;
-        if (_offset >= 0) {
-            bw = pwrite(fd, _buf, _len, _offset);
-        } else {
-            bw = write(fd, _buf, _len);
-        }
+        ssize_t bw = write_at(fd, _buf, _len, _offset);
         if (bw < 0) {
             SetSyscallError();
         } else if ((size_t)bw != _len) {
@@ -1806,10 +4224,14 @@ struct FileWritev : public FSWrapWorker<FileWrap>
     std::vector<struct iovec> iov_vec;
     ssize_t _total_len;
     off_t _offset;
+    uint8_t* _bounce;
+    uint64_t _bounce_ticket;
     FileWritev(const Napi::CallbackInfo& info)
         : FSWrapWorker<FileWrap>(info)
         , _total_len(0)
         , _offset(-1)
+        , _bounce(0)
+        , _bounce_ticket(0)
     {
         auto buffers = info[1].As<Napi::Array>();
         const int buffers_len = buffers.Length();
@@ -1826,24 +4248,293 @@ struct FileWritev : public FSWrapWorker<FileWrap>
         if (info.Length() > 2 && !info[2].IsUndefined()) {
             _offset = info[2].As<Napi::Number>();
         }
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "FileWritev " << DVAL(_wrap->_path) << DVAL(_total_len) << DVAL(buffers_len) << DVAL(_offset));
     }
+    virtual ~FileWritev()
+    {
+        dio_free(_bounce, _bounce_ticket);
+    }
     virtual void Work()
     {
         int fd = _wrap->_fd;
         CHECK_WRAP_FD(fd);
-        ssize_t bw = -1;
-        if (_offset >= 0) {
-            bw = pwritev(fd, iov_vec.data(), iov_vec.size(), _offset);
-        } else {
-            bw = writev(fd, iov_vec.data(), iov_vec.size());
+        if ((_wrap->_flags & DIO_OPEN_FLAG) && !iov_dio_aligned() && !gather_aligned()) {
+            SetError(XSTR() << "FS::FileWritev: failed to allocate direct IO buffer " << DVAL(_total_len));
+            return;
         }
-        if (bw < 0) {
+        // writev takes at most IOV_MAX buffers and may write less than asked (signals, network filesystems),
+        // so writev_full() writes in rounds and resumes each round from where the last one stopped
+        ssize_t total_bw = writev_full(fd, iov_vec.data(), iov_vec.size(), _offset);
+        if (total_bw < 0) {
             SetSyscallError();
-        } else if (bw != _total_len) {
-            // TODO: Handle partial writes as well and not fail the operation
-            SetError(XSTR() << "FS::FileWritev::Execute: partial writev error " << DVAL(bw) << DVAL(_total_len));
+        } else if (total_bw != _total_len) {
+            SetError(XSTR() << "FS::FileWritev::Execute: partial writev error " << DVAL(total_bw) << DVAL(_total_len));
+        }
+    }
+    bool iov_dio_aligned()
+    {
+        for (auto& iov : iov_vec) {
+            if (!is_dio_aligned(iov.iov_base, iov.iov_len, 0)) return false;
+        }
+        return true;
+    }
+    // O_DIRECT fails on unaligned buffers, so gather them to a single aligned buffer
+    bool gather_aligned()
+    {
+        _bounce = dio_alloc(_total_len, _bounce_ticket);
+        if (!_bounce) return false;
+        uint8_t* p = _bounce;
+        for (auto& iov : iov_vec) {
+            memcpy(p, iov.iov_base, iov.iov_len);
+            p += iov.iov_len;
+        }
+        iov_vec.resize(1);
+        iov_vec[0].iov_base = _bounce;
+        iov_vec[0].iov_len = _total_len;
+        return true;
+    }
+};
+
+/**
+ * FileSendfile sends a range of the file directly to a socket fd using sendfile(2),
+ * so the data is moved inside the kernel without being copied to user space buffers.
+ * The socket is expected to be non-blocking (as node sockets are), so when the socket buffer
+ * is full we return the partial count with again=true (EAGAIN) and the caller waits and resumes
+ * (backpressure), instead of holding a data lane thread while the socket drains.
+ * The socket fd is dup'ed in the constructor, so closing the socket in JS during the op
+ * cannot make us write to another connection that reused the fd number.
+ */
+struct FileSendfile : public FSWrapWorker<FileWrap>
+{
+    int _sock_fd;
+    off_t _pos;
+    size_t _len;
+    size_t _sent;
+    bool _again;
+    FileSendfile(const Napi::CallbackInfo& info)
+        : FSWrapWorker<FileWrap>(info)
+        , _sock_fd(-1)
+        , _pos(0)
+        , _len(0)
+        , _sent(0)
+        , _again(false)
+    {
+        int sock_fd = info[1].As<Napi::Number>();
+        _pos = info[2].As<Napi::Number>();
+        _len = info[3].As<Napi::Number>().Int64Value();
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "FileSendfile " << DVAL(_wrap->_path) << DVAL(sock_fd) << DVAL(_pos) << DVAL(_len));
+        _sock_fd = dup(sock_fd);
+        if (_sock_fd < 0) SetSyscallError();
+    }
+    virtual ~FileSendfile()
+    {
+        if (_sock_fd >= 0) ::close(_sock_fd);
+    }
+    virtual void Work()
+    {
+        if (_failed) return;
+        int fd = _wrap->_fd;
+        CHECK_WRAP_FD(fd);
+#ifdef __APPLE__
+        errno = EOPNOTSUPP;
+        SetSyscallError();
+#else
+        off_t off = _pos;
+        while (_sent < _len) {
+            ssize_t n = sendfile(_sock_fd, fd, &off, _len - _sent);
+            if (n > 0) {
+                _sent += n;
+                continue;
+            }
+            if (n == 0) break; // EOF
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                SetSyscallError();
+                return;
+            }
+            _again = true;
+            break;
+        }
+#endif
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::FileSendfile::OnOK: " << DVAL(_wrap->_path) << DVAL(_sent) << DVAL(_again));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        res["bytes"] = Napi::Number::New(env, _sent);
+        res["again"] = Napi::Boolean::New(env, _again);
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * WaitWritable waits in the event loop for a socket fd to become writable, so sendfile can resume after EAGAIN
+ * without a timer or a pool thread. It polls a dup of the fd because libuv keeps one watcher per fd number,
+ * and the fd itself is watched by the node socket. Resolves true when the socket is writable, or has an error
+ * which the next write reports, and false when timeout_ms passed first so the caller can check for aborts.
+ */
+struct WaitWritable
+{
+    uv_poll_t _poll;
+    uv_timer_t _timer;
+    int _fd;
+    int _open_handles;
+    bool _done;
+    Napi::Promise::Deferred _deferred;
+    Napi::AsyncContext _async_context;
+    WaitWritable(Napi::Env env, int fd)
+        : _fd(fd)
+        , _open_handles(0)
+        , _done(false)
+        , _deferred(Napi::Promise::Deferred::New(env))
+        , _async_context(env, "FSWaitWritable")
+    {
+    }
+    int start(uv_loop_t* loop, uint64_t timeout_ms)
+    {
+        int r = uv_poll_init(loop, &_poll, _fd);
+        if (r) return r;
+        _poll.data = this;
+        _open_handles += 1;
+        uv_timer_init(loop, &_timer);
+        _timer.data = this;
+        _open_handles += 1;
+        r = uv_poll_start(&_poll, UV_WRITABLE | UV_DISCONNECT, [](uv_poll_t* h, int, int) {
+            static_cast<WaitWritable*>(h->data)->finish(true);
+        });
+        if (r) return r;
+        uv_timer_start(&_timer, [](uv_timer_t* h) { static_cast<WaitWritable*>(h->data)->finish(false); }, timeout_ms, 0);
+        return 0;
+    }
+    void finish(bool writable)
+    {
+        if (_done) return;
+        _done = true;
+        Napi::Env env = _deferred.Env();
+        {
+            // the callback scope runs the promise reactions when it closes
+            Napi::HandleScope scope(env);
+            Napi::CallbackScope callback_scope(env, _async_context);
+            _deferred.Resolve(Napi::Boolean::New(env, writable));
         }
+        close_handles();
+    }
+    void fail(int uv_err)
+    {
+        _done = true;
+        Napi::Env env = _deferred.Env();
+        auto err = Napi::Error::New(env, uv_strerror(uv_err));
+        err.Set("code", Napi::String::New(env, uv_err_name(uv_err)));
+        _deferred.Reject(err.Value());
+        close_handles();
+    }
+    // deletes this when the last handle is closed
+    void close_handles()
+    {
+        if (_open_handles == 0) {
+            ::close(_fd);
+            delete this;
+            return;
+        }
+        auto on_close = [](uv_handle_t* h) {
+            auto w = static_cast<WaitWritable*>(h->data);
+            if (--w->_open_handles == 0) {
+                ::close(w->_fd);
+                delete w;
+            }
+        };
+        if (_open_handles == 2) uv_close(reinterpret_cast<uv_handle_t*>(&_timer), on_close);
+        uv_close(reinterpret_cast<uv_handle_t*>(&_poll), on_close);
+    }
+};
+
+/**
+ * wait_writable(socket_fd, timeout_ms) => Promise<boolean>, see WaitWritable
+ */
+static Napi::Value
+wait_writable(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    int sock_fd = info[0].As<Napi::Number>();
+    uint64_t timeout_ms = info[1].IsNumber() ? info[1].As<Napi::Number>().Int64Value() : 1000;
+    uv_loop_t* loop = 0;
+    if (napi_get_uv_event_loop(env, &loop) != napi_ok || !loop) {
+        throw Napi::Error::New(env, "FS::wait_writable: failed to get uv loop");
+    }
+    int fd = dup(sock_fd);
+    if (fd < 0) {
+        auto err = Napi::Error::New(env, strerror(errno));
+        err.Set("code", Napi::String::New(env, uv_err_name(uv_translate_sys_error(errno))));
+        throw err;
+    }
+    auto w = new WaitWritable(env, fd);
+    auto promise = w->_deferred.Promise();
+    int r = w->start(loop, timeout_ms);
+    if (r) w->fail(r);
+    return promise;
+}
+
+/**
+ * FileCopyRange copies len bytes from this file at src_pos to another open file at dst_pos
+ * using copy_fd_range(), so the data never passes through node buffers.
+ * Resolves to { bytes, method }.
+ */
+struct FileCopyRange : public FSWrapWorker<FileWrap>
+{
+    FileWrap* _dst;
+    size_t _len;
+    off_t _src_pos;
+    off_t _dst_pos;
+    ReflinkMode _reflink;
+    size_t _bytes;
+    CopyMethod _method;
+    FileCopyRange(const Napi::CallbackInfo& info)
+        : FSWrapWorker<FileWrap>(info)
+        , _dst(0)
+        , _len(0)
+        , _src_pos(0)
+        , _dst_pos(0)
+        , _reflink(ReflinkMode::AUTO)
+        , _bytes(0)
+        , _method(CopyMethod::NONE)
+    {
+        _dst = FileWrap::Unwrap(info[1].As<Napi::Object>());
+        _dst->Ref();
+        _len = info[2].As<Napi::Number>().Int64Value();
+        if (info.Length() > 3 && info[3].IsNumber()) _src_pos = info[3].As<Napi::Number>().Int64Value();
+        if (info.Length() > 4 && info[4].IsNumber()) _dst_pos = info[4].As<Napi::Number>().Int64Value();
+        if (info.Length() > 5) _reflink = parse_reflink_mode(info[5]);
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "FileCopyRange " << DVAL(_wrap->_path) << DVAL(_dst->_path) << DVAL(_len) << DVAL(_src_pos) << DVAL(_dst_pos));
+    }
+    ~FileCopyRange()
+    {
+        _dst->Unref();
+    }
+    virtual void Work()
+    {
+        int fd = _wrap->_fd;
+        CHECK_WRAP_FD(fd);
+        int dst_fd = _dst->_fd;
+        if (dst_fd < 0) {
+            SetError(XSTR() << _desc << ": ERROR not opened " << _dst->_path);
+            return;
+        }
+        SYSCALL_OR_RETURN(copy_fd_range(fd, _src_pos, dst_fd, _dst_pos, _len, _reflink, _bytes, _method));
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::FileCopyRange::OnOK: " << DVAL(_wrap->_path) << DVAL(_dst->_path) << DVAL(_bytes) << DVAL(copy_method_name(_method)));
+        Napi::Env env = Env();
+        auto res = Napi::Object::New(env);
+        res["bytes"] = Napi::Number::New(env, _bytes);
+        res["method"] = Napi::String::New(env, copy_method_name(_method));
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
     }
 };
 
@@ -1936,6 +4627,7 @@ struct FileReadRdma : public FSWrapWorker<FileWrap>
         if (!parse_gpfs_rdma_info(_rdma_info, client_buf_desc, client_buf_offset, dc_key, fabnum)) {
             throw Napi::Error::New(info.Env(), "FS::FileReadRdma: invalid client buffer descriptor");
         }
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "FileReadRdma " << DVAL(_wrap->_path) << DVAL(_count) << DVAL(_file_offset));
     }
     virtual void Work()
@@ -1991,6 +4683,7 @@ struct FileWriteRdma : public FSWrapWorker<FileWrap>
         if (!parse_gpfs_rdma_info(_rdma_info, client_buf_desc, client_buf_offset, dc_key, fabnum)) {
             throw Napi::Error::New(info.Env(), "FS::FileWriteRdma: invalid client buffer descriptor");
         }
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "FileWriteRdma " << DVAL(_wrap->_path) << DVAL(_count) << DVAL(_file_offset));
     }
     virtual void Work()
@@ -2082,6 +4775,233 @@ struct LinkFileAt : public FSWrapWorker<FileWrap>
         } else {
             SYSCALL_OR_RETURN(dlsym_gpfs_linkat(fd, "", AT_FDCWD, _filepath.c_str(), AT_EMPTY_PATH));
         }
+        fd_cache.remove(_filepath);
+        config_cache.remove(_filepath);
+    }
+};
+
+/**
+ * FileAllocate preallocates a range of the file with fallocate.
+ * Resolves to false when the filesystem does not support it.
+ */
+struct FileAllocate : public FSWrapWorker<FileWrap>
+{
+    int64_t _offset;
+    int64_t _len;
+    bool _keep_size;
+    bool _allocated;
+    FileAllocate(const Napi::CallbackInfo& info)
+        : FSWrapWorker<FileWrap>(info)
+        , _offset(0)
+        , _len(0)
+        , _keep_size(false)
+        , _allocated(false)
+    {
+        _offset = info[1].As<Napi::Number>().Int64Value();
+        _len = info[2].As<Napi::Number>().Int64Value();
+        if (info.Length() > 3 && info[3].IsObject()) {
+            _keep_size = info[3].As<Napi::Object>().Get("keep_size").ToBoolean();
+        }
+        if (_offset < 0 || _len < 0) SetError(XSTR() << "FileAllocate: invalid range " << DVAL(_offset) << DVAL(_len));
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "FileAllocate " << DVAL(_wrap->_path) << DVAL(_offset) << DVAL(_len) << DVAL(_keep_size));
+    }
+    virtual void Work()
+    {
+        if (_failed) return;
+        int fd = _wrap->_fd;
+        CHECK_WRAP_FD(fd);
+        int r = preallocate_fd(fd, _offset, _len, _keep_size);
+        if (r < 0) {
+            SetSyscallError();
+            return;
+        }
+        _allocated = r == 0;
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::FileAllocate::OnOK: " << DVAL(_wrap->_path) << DVAL(_allocated));
+        _deferred.Resolve(Napi::Boolean::New(Env(), _allocated));
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * link_fd links an open file (typically an O_TMPFILE) to a new path.
+ * linkat with AT_EMPTY_PATH requires CAP_DAC_READ_SEARCH, so when it is not permitted
+ * we fallback to link the /proc/self/fd magic link, which only requires the fd.
+ */
+static int
+link_fd(int fd, const std::string& to)
+{
+    if (linkat(fd, "", AT_FDCWD, to.c_str(), AT_EMPTY_PATH) == 0) return 0;
+    if (errno != ENOENT && errno != EPERM) return -1;
+    std::string proc_path = XSTR() << "/proc/self/fd/" << fd;
+    return linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, to.c_str(), AT_SYMLINK_FOLLOW);
+}
+
+/**
+ * FilePublish commits an uploaded O_TMPFILE to its target path in a single worker -
+ * 1. set the xattrs
+ * 2. fsync the file
+ * 3. link it to the target path, or if the target exists, link to tmp_path and rename over the target
+ * 4. fsync the target dir
+ * When expected_mtime and expected_ino are given the existing target must have that version -
+ * like SafeLink the file is linked to tmp_path first, and the target is checked after the link and right
+ * before the rename, so no slow step runs between the check and the replace. This requires tmp_path.
+ * With no_replace an existing target fails with EEXIST (linkat never replaces).
+ * Until the link the file has no name, so a crash leaves nothing to cleanup.
+ */
+struct FilePublish : public FSWrapWorker<FileWrap>
+{
+    static const int PUBLISH_CHECK_RETRIES = 3;
+    std::string _target_path;
+    std::string _tmp_path;
+    XattrMap _xattr;
+    std::string _xattr_clear_prefix;
+    bool _fsync;
+    bool _dir_fsync;
+    bool _no_replace;
+    bool _check_version;
+    int64_t _expected_mtime;
+    int64_t _expected_ino;
+    FilePublish(const Napi::CallbackInfo& info)
+        : FSWrapWorker<FileWrap>(info)
+        , _fsync(true)
+        , _dir_fsync(true)
+        , _no_replace(false)
+        , _check_version(false)
+        , _expected_mtime(0)
+        , _expected_ino(0)
+    {
+        _target_path = info[1].As<Napi::String>();
+        if (info.Length() > 2 && info[2].ToBoolean()) {
+            Napi::Object options = info[2].As<Napi::Object>();
+            if (options.Get("xattr").ToBoolean()) {
+                get_xattr_from_object(_xattr, options.Get("xattr").As<Napi::Object>());
+            }
+            if (options.Get("xattr_clear_prefix").ToBoolean()) {
+                _xattr_clear_prefix = options.Get("xattr_clear_prefix").ToString();
+            }
+            if (options.Get("tmp_path").ToBoolean()) {
+                _tmp_path = options.Get("tmp_path").ToString();
+            }
+            if (options.Has("fsync")) _fsync = options.Get("fsync").ToBoolean();
+            if (options.Has("dir_fsync")) _dir_fsync = options.Get("dir_fsync").ToBoolean();
+            _no_replace = options.Get("no_replace").ToBoolean();
+            if (options.Get("expected_mtime").IsBigInt() && options.Get("expected_ino").IsNumber()) {
+                bool lossless = true;
+                _check_version = true;
+                _expected_mtime = options.Get("expected_mtime").As<Napi::BigInt>().Int64Value(&lossless);
+                _expected_ino = options.Get("expected_ino").As<Napi::Number>().Int64Value();
+            }
+        }
+        if (_check_version && _tmp_path.empty()) {
+            SetError("FS::FilePublish: expected_mtime and expected_ino require tmp_path");
+        }
+        _lane = FS_LANE_DATA;
+        // set thread capabilities to allow linkat with AT_EMPTY_PATH from user other than root.
+        AddThreadCapabilities();
+        Begin(XSTR() << "FilePublish " << DVAL(_wrap->_path) << DVAL(_target_path) << DVAL(_tmp_path)
+                     << DVAL(_no_replace) << DVAL(_check_version));
+    }
+    virtual void Work()
+    {
+        if (_failed) return;
+        int fd = _wrap->_fd;
+        CHECK_WRAP_FD(fd);
+
+        if (_xattr_clear_prefix != "") {
+            SYSCALL_OR_RETURN(clear_xattr(fd, _xattr_clear_prefix));
+        }
+        for (auto it = _xattr.begin(); it != _xattr.end(); ++it) {
+            SYSCALL_OR_RETURN(fsetxattr(fd, it->first.c_str(), it->second.c_str(), it->second.length(), 0));
+        }
+
+        if (_fsync) {
+            if (FsyncGroup::instance().enabled() && FsyncGroup::instance().use_syncfs()) {
+                int err = group_fsync(fd, _wrap->_path);
+                if (err) {
+                    errno = err;
+                    SetSyscallError();
+                    return;
+                }
+            } else {
+                SYSCALL_OR_RETURN(fsync(fd));
+            }
+        }
+
+        if (_check_version) {
+            SYSCALL_OR_RETURN(link_fd(fd, _tmp_path));
+            if (!check_target_version()) {
+                SYSCALL_OR_WARN(unlink(_tmp_path.c_str()));
+                return;
+            }
+            if (rename(_tmp_path.c_str(), _target_path.c_str())) {
+                SetSyscallError();
+                SYSCALL_OR_WARN(unlink(_tmp_path.c_str()));
+                return;
+            }
+            fd_cache.remove(_target_path);
+            sync_target_dir();
+            return;
+        } else if (link_fd(fd, _target_path) == 0) {
+            fd_cache.remove(_target_path);
+            sync_target_dir();
+            return;
+        } else if (errno != EEXIST || _no_replace || _tmp_path.empty()) {
+            SetSyscallError();
+            return;
+        }
+
+        // replace the existing target - the tmp name is only visible until the rename
+        SYSCALL_OR_RETURN(link_fd(fd, _tmp_path));
+        if (rename(_tmp_path.c_str(), _target_path.c_str())) {
+            SetSyscallError();
+            SYSCALL_OR_WARN(unlink(_tmp_path.c_str()));
+            return;
+        }
+        fd_cache.remove(_target_path);
+        sync_target_dir();
+    }
+    // returns true if the target has the expected version, or sets the error.
+    // the target can be missing for a moment while SafeUnlink moves it away and links it back, so ENOENT is retried.
+    bool check_target_version()
+    {
+        struct stat stat_res;
+        int r = -1;
+        for (int i = 0; i < PUBLISH_CHECK_RETRIES; ++i) {
+            r = stat(_target_path.c_str(), &stat_res);
+            if (r == 0 || errno != ENOENT) break;
+            std::this_thread::yield();
+        }
+        if (r) {
+            SetSyscallError();
+            return false;
+        }
+        if (cmp_ver_id(_expected_mtime, _expected_ino, stat_res)) return true;
+        DBG0("FS::FilePublish::Work: ERROR target doesn't match the expected inode + mtime"
+            << DVAL(_target_path) << DVAL(_expected_mtime) << DVAL(_expected_ino));
+        SetError(XSTR() << "FS::FilePublish ERROR target doesn't match expected inode and mtime");
+        return false;
+    }
+    void sync_target_dir()
+    {
+        if (!_dir_fsync) return;
+        size_t slash = _target_path.rfind('/');
+        std::string dir_path = slash == std::string::npos ? "." : slash == 0 ? "/" : _target_path.substr(0, slash);
+        AtPath at(dir_path);
+        int fd = at.call([](int dirfd, const char* p) { return openat(dirfd, p, 0); });
+        CHECK_OPEN_FD(fd);
+        if (FsyncGroup::instance().enabled()) {
+            int err = group_fsync(fd, DirFdCache::normalize(dir_path));
+            if (err) {
+                errno = err;
+                SetSyscallError();
+            }
+            return;
+        }
+        SYSCALL_OR_RETURN(fsync(fd));
     }
 };
 
@@ -2104,6 +5024,10 @@ struct UnlinkFileAt : public FSWrapWorker<FileWrap>
         int fd = _wrap->_fd;
         CHECK_WRAP_FD(fd);
         SYSCALL_OR_RETURN(dlsym_gpfs_unlinkat(fd, _filepath.c_str(), _delete_fd));
+        // the file path is relative to the directory of the wrap
+        std::string path = _filepath[0] == '/' ? _filepath : _wrap->_path + "/" + _filepath;
+        fd_cache.remove(path);
+        config_cache.remove(path);
     }
 };
 
@@ -2127,24 +5051,134 @@ struct FileStat : public FSWrapWorker<FileWrap>
     {
         int fd = _wrap->_fd;
         CHECK_WRAP_FD(fd);
-        SYSCALL_OR_RETURN(fstat(fd, &_stat_res));
-        SYSCALL_OR_RETURN(get_fd_xattr(fd, _xattr, _xattr_get_keys));
-        if (use_gpfs_lib()) {
-            GPFS_FCNTL_OR_RETURN(get_fd_gpfs_xattr(fd, _xattr, gpfs_error, _use_dmapi));
-        }
-
-        if (_do_ctime_check) {
-            CHECK_CTIME_CHANGE(fd, _stat_res, _wrap->_path);
+        SYSCALL_OR_RETURN(fstat(fd, &_stat_res));
+        SYSCALL_OR_RETURN(get_fd_xattr(fd, _xattr, _xattr_get_keys));
+        if (use_gpfs_lib()) {
+            GPFS_FCNTL_OR_RETURN(get_fd_gpfs_xattr(fd, _xattr, gpfs_error, _use_dmapi));
+        }
+
+        if (_do_ctime_check) {
+            CHECK_CTIME_CHANGE(fd, _stat_res, _wrap->_path);
+        }
+    }
+    virtual void OnOK()
+    {
+        DBG1("FS::FileStat::OnOK: FileStat " << DVAL(_stat_res.st_ino) << DVAL(_stat_res.st_size));
+        Napi::Env env = Env();
+        auto res = new_stat_res(env, _stat_res, _xattr);
+        _deferred.Resolve(res);
+        ReportWorkerStats(0);
+    }
+};
+
+/**
+ * parse_fadvise returns the posix_fadvise advice of a name, or -1 if unknown
+ */
+static int
+parse_fadvise(const std::string& advice)
+{
+#ifdef __APPLE__
+    // macOS has no posix_fadvise, advise is a no-op there
+    if (advice == "normal" || advice == "sequential" || advice == "random" ||
+        advice == "willneed" || advice == "dontneed" || advice == "noreuse") return 0;
+#else
+    if (advice == "normal") return POSIX_FADV_NORMAL;
+    if (advice == "sequential") return POSIX_FADV_SEQUENTIAL;
+    if (advice == "random") return POSIX_FADV_RANDOM;
+    if (advice == "willneed") return POSIX_FADV_WILLNEED;
+    if (advice == "dontneed") return POSIX_FADV_DONTNEED;
+    if (advice == "noreuse") return POSIX_FADV_NOREUSE;
+#endif
+    return -1;
+}
+
+/**
+ * FileAdvise declares the expected access pattern of a range of the file (len 0 means to the end of the file)
+ * - sequential/random tune the kernel read-ahead, willneed/dontneed load or drop the page cache of the range.
+ */
+struct FileAdvise : public FSWrapWorker<FileWrap>
+{
+    int64_t _offset;
+    int64_t _len;
+    std::string _advice_name;
+    int _advice;
+    FileAdvise(const Napi::CallbackInfo& info)
+        : FSWrapWorker<FileWrap>(info)
+        , _offset(0)
+        , _len(0)
+        , _advice(-1)
+    {
+        _offset = info[1].As<Napi::Number>().Int64Value();
+        _len = info[2].As<Napi::Number>().Int64Value();
+        _advice_name = info[3].As<Napi::String>();
+        _advice = parse_fadvise(_advice_name);
+        if (_advice < 0) {
+            SetError(XSTR() << "FileAdvise: unexpected advice " << DVAL(_advice_name));
+        } else if (_offset < 0 || _len < 0) {
+            SetError(XSTR() << "FileAdvise: invalid range " << DVAL(_offset) << DVAL(_len));
+        }
+        Begin(XSTR() << "FileAdvise " << DVAL(_wrap->_path) << DVAL(_offset) << DVAL(_len) << DVAL(_advice_name));
+    }
+    virtual void Work()
+    {
+        if (_failed) return;
+        int fd = _wrap->_fd;
+        CHECK_WRAP_FD(fd);
+#ifndef __APPLE__
+        // posix_fadvise returns the error instead of setting errno
+        int r = posix_fadvise(fd, _offset, _len, _advice);
+        if (r) {
+            errno = r;
+            SetSyscallError();
+        }
+#endif
+    }
+};
+
+/**
+ * FileReadahead starts reading a range of the file into the page cache, so that the following reads of it
+ * do not wait for the disk. It returns once the reads were submitted (or done), without copying any data.
+ */
+struct FileReadahead : public FSWrapWorker<FileWrap>
+{
+    int64_t _offset;
+    int64_t _len;
+    FileReadahead(const Napi::CallbackInfo& info)
+        : FSWrapWorker<FileWrap>(info)
+        , _offset(0)
+        , _len(0)
+    {
+        _offset = info[1].As<Napi::Number>().Int64Value();
+        _len = info[2].As<Napi::Number>().Int64Value();
+        if (_offset < 0 || _len < 0) SetError(XSTR() << "FileReadahead: invalid range " << DVAL(_offset) << DVAL(_len));
+        _lane = FS_LANE_DATA;
+        Begin(XSTR() << "FileReadahead " << DVAL(_wrap->_path) << DVAL(_offset) << DVAL(_len));
+    }
+    virtual void Work()
+    {
+        if (_failed) return;
+        int fd = _wrap->_fd;
+        CHECK_WRAP_FD(fd);
+        if (!_len) return;
+#ifdef __APPLE__
+        struct radvisory ra;
+        ra.ra_offset = _offset;
+        ra.ra_count = int(std::min<int64_t>(_len, INT_MAX));
+        SYSCALL_OR_RETURN(fcntl(fd, F_RDADVISE, &ra));
+#else
+        // readahead is not supported by some filesystems (e.g fuse), fallback to the willneed advice
+        if (readahead(fd, _offset, _len)) {
+            if (errno != EINVAL) {
+                SetSyscallError();
+                return;
+            }
+            int r = posix_fadvise(fd, _offset, _len, POSIX_FADV_WILLNEED);
+            if (r) {
+                errno = r;
+                SetSyscallError();
+            }
         }
-    }
-    virtual void OnOK()
-    {
-        DBG1("FS::FileStat::OnOK: FileStat " << DVAL(_stat_res.st_ino) << DVAL(_stat_res.st_size));
-        Napi::Env env = Env();
-        auto res = Napi::Object::New(env);
-        set_stat_res(res, env, _stat_res, _xattr);
-        _deferred.Resolve(res);
-        ReportWorkerStats(0);
+#endif
     }
 };
 
@@ -2153,13 +5187,18 @@ struct FileFsync : public FSWrapWorker<FileWrap>
     FileFsync(const Napi::CallbackInfo& info)
         : FSWrapWorker<FileWrap>(info)
     {
+        _lane = FS_LANE_DATA;
         Begin(XSTR() << "FileFsync " << DVAL(_wrap->_path));
     }
     virtual void Work()
     {
         int fd = _wrap->_fd;
         CHECK_WRAP_FD(fd);
-        SYSCALL_OR_RETURN(fsync(fd));
+        int err = fsync_file(fd, _wrap->_path);
+        if (err) {
+            errno = err;
+            SetSyscallError();
+        }
     }
 };
 
@@ -2183,6 +5222,8 @@ struct FileFlock : public FSWrapWorker<FileWrap>
             }
         }
 
+        // unlock never blocks, so it must not queue behind the lock waiters
+        _lane = lock_mode == LOCK_UN ? FS_LANE_META : FS_LANE_LOCK;
         Begin(XSTR() << "FileFlock " << DVAL(_wrap->_path));
     }
     virtual void Work()
@@ -2220,6 +5261,7 @@ struct FileFcntlLock : public FSWrapWorker<FileWrap>
             }
         }
 
+        _lane = fl.l_type == F_UNLCK ? FS_LANE_META : FS_LANE_LOCK;
         Begin(XSTR() << "FileFcntlLock" << DVAL(_wrap->_path));
     }
     virtual void Work()
@@ -2323,25 +5365,24 @@ struct GetSingleXattr : public FSWorker
 
     virtual void Work()
     {
-        ssize_t value_len = getxattr(_path.c_str(), _key.c_str(), NULL, 0);
-
+        std::vector<char>& buf = xattr_thread_buf(false);
+        ssize_t value_len = getxattr(_path.c_str(), _key.c_str(), buf.data(), buf.size());
+        while (value_len == -1 && errno == ERANGE) {
+            value_len = getxattr(_path.c_str(), _key.c_str(), NULL, 0);
+            if (value_len == -1) break;
+            _val.resize(value_len);
+            value_len = getxattr(_path.c_str(), _key.c_str(), _val.data(), _val.size());
+            if (value_len >= 0) {
+                _val.resize(value_len);
+                xattr_thread_buf_grow(buf, value_len);
+                return;
+            }
+        }
         if (value_len == -1) {
             SetSyscallError();
             return;
         }
-
-        if (value_len > 0) {
-            Buf val(value_len);
-            value_len = getxattr(_path.c_str(), _key.c_str(), val.cdata(), value_len);
-            if (value_len == -1) {
-                SetSyscallError();
-                return;
-            }
-
-            _val = std::string(val.cdata(), value_len);
-        } else if (value_len == 0) {
-            _val = "";
-        }
+        _val.assign(buf.data(), value_len);
     }
 
     virtual void OnOK()
@@ -2378,6 +5419,24 @@ FileWrap::writev(const Napi::CallbackInfo& info)
     return api<FileWritev>(info);
 }
 
+Napi::Value
+FileWrap::sendfile(const Napi::CallbackInfo& info)
+{
+    return api<FileSendfile>(info);
+}
+
+Napi::Value
+FileWrap::copy_range(const Napi::CallbackInfo& info)
+{
+    return api<FileCopyRange>(info);
+}
+
+Napi::Value
+FileWrap::allocate(const Napi::CallbackInfo& info)
+{
+    return api<FileAllocate>(info);
+}
+
 Napi::Value
 FileWrap::read_rdma(const Napi::CallbackInfo& info)
 {
@@ -2408,6 +5467,12 @@ FileWrap::unlinkfileat(const Napi::CallbackInfo& info)
     return api<UnlinkFileAt>(info);
 }
 
+Napi::Value
+FileWrap::publish_file(const Napi::CallbackInfo& info)
+{
+    return api<FilePublish>(info);
+}
+
 Napi::Value
 FileWrap::getfd(const Napi::CallbackInfo& info)
 {
@@ -2426,6 +5491,18 @@ FileWrap::fsync(const Napi::CallbackInfo& info)
     return api<FileFsync>(info);
 }
 
+Napi::Value
+FileWrap::advise(const Napi::CallbackInfo& info)
+{
+    return api<FileAdvise>(info);
+}
+
+Napi::Value
+FileWrap::readahead(const Napi::CallbackInfo& info)
+{
+    return api<FileReadahead>(info);
+}
+
 Napi::Value
 FileWrap::flock(const Napi::CallbackInfo& info)
 {
@@ -2550,120 +5627,698 @@ struct SeekDir : public FSWrapWorker<DirWrap>
     SeekDir(const Napi::CallbackInfo& info)
         : FSWrapWorker<DirWrap>(info)
     {
-        bool lossless = true;
-        _seek_pos = info[1].As<Napi::BigInt>().Int64Value(&lossless);
-        if (!lossless) {
-            SetError("seekdir bigint value must convert lossless");
+        bool lossless = true;
+        _seek_pos = info[1].As<Napi::BigInt>().Int64Value(&lossless);
+        if (!lossless) {
+            SetError("seekdir bigint value must convert lossless");
+        }
+        Begin(XSTR() << "SeekDir " << DVAL(_wrap->_path) << DVAL(_seek_pos));
+    }
+    virtual void Work()
+    {
+        DIR* dir = _wrap->_dir;
+        if (!dir) {
+            SetError(XSTR() << "FS::SeekDir::Execute: ERROR not opened " << _wrap->_path);
+            return;
+        }
+        DBG1("FS::SeekDir::Work: " << DVAL(_wrap->_path));
+        seekdir(dir, _seek_pos);
+    }
+};
+
+struct DirClose : public FSWrapWorker<DirWrap>
+{
+    DirClose(const Napi::CallbackInfo& info)
+        : FSWrapWorker<DirWrap>(info)
+    {
+        Begin(XSTR() << "DirClose " << DVAL(_wrap->_path));
+    }
+    virtual void Work()
+    {
+        DIR* dir = _wrap->_dir;
+        std::string path = _wrap->_path;
+        int r = closedir(dir);
+        if (r) SetSyscallError();
+        _wrap->_dir = 0;
+    }
+};
+
+struct DirReadEntry : public FSWrapWorker<DirWrap>
+{
+    Entry _entry;
+    bool _eof;
+    DirReadEntry(const Napi::CallbackInfo& info)
+        : FSWrapWorker<DirWrap>(info)
+        , _eof(false)
+    {
+        Begin(XSTR() << "DirReadEntry " << DVAL(_wrap->_path));
+    }
+    virtual void Work()
+    {
+        DIR* dir = _wrap->_dir;
+        std::string path = _wrap->_path;
+        if (!dir) {
+            SetError(XSTR() << "FS::DirReadEntry::Execute: ERROR not opened " << path);
+            return;
+        }
+        struct dirent* e = 0;
+
+        // loop to skip parent and current directories
+        do {
+            // need to set errno before the call to readdir() to detect between EOF and error
+            errno = 0;
+            e = readdir(dir);
+        } while (e && (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0));
+        if (e) {
+            _entry.name = std::string(e->d_name);
+            _entry.ino = e->d_ino;
+            _entry.type = e->d_type;
+            _entry.off = e->DIR_OFFSET_FIELD;
+        } else {
+            if (errno) {
+                SetSyscallError();
+            } else {
+                _eof = true;
+            }
+        }
+    }
+    virtual void OnOK()
+    {
+        Napi::Env env = Env();
+        if (_eof) {
+            _deferred.Resolve(env.Null());
+        } else {
+            auto res = Napi::Object::New(env);
+            res["name"] = Napi::String::New(env, _entry.name);
+            res["ino"] = Napi::Number::New(env, _entry.ino);
+            res["type"] = Napi::Number::New(env, _entry.type);
+            res["off"] = Napi::BigInt::New(env, _entry.off);
+            _deferred.Resolve(res);
+        }
+        ReportWorkerStats(0);
+    }
+};
+
+Napi::Value
+DirWrap::close(const Napi::CallbackInfo& info)
+{
+    return api<DirClose>(info);
+}
+
+Napi::Value
+DirWrap::read(const Napi::CallbackInfo& info)
+{
+    return api<DirReadEntry>(info);
+}
+
+Napi::Value
+DirWrap::telldir(const Napi::CallbackInfo& info)
+{
+    return api<TellDir>(info);
+}
+
+Napi::Value
+DirWrap::seekdir(const Napi::CallbackInfo& info)
+{
+    return api<SeekDir>(info);
+}
+
+/**
+ * TreeWalk walks a directory tree on multiple native threads and collects the entries that pass the filters,
+ * which are read in batches from JS with WalkWrap.read().
+ *
+ * The walker threads share a stack of directories to scan (LIFO so the walk stays close to depth first),
+ * and pause (also in the middle of a directory) when the matched entries that were not read yet reach max_buffered.
+ * A read does not wait on a thread - it is resolved on the main thread right away when a batch is ready,
+ * or later by the walker thread that fills the batch or ends the walk, through a thread safe function.
+ * Keys are the paths relative to the root, with a trailing / for directories.
+ * Directories that cannot contain the key prefix are not scanned at all, and the filters are checked
+ * from the cheapest - name, then type and stat (fstatat), and only then the xattr which need an open.
+ * Symlinks are never followed - subdirs are opened relative to the fd of their parent (openat with O_NOFOLLOW)
+ * like in Rmtree, so a path component that is replaced by a symlink during the walk does not redirect it.
+ */
+struct TreeWalk
+{
+    enum WalkType
+    {
+        WALK_FILE = 1,
+        WALK_DIR = 2,
+        WALK_SYMLINK = 4,
+    };
+    // an open dir fd shared by the subdirs that were pushed from it, closed when the last of them was opened
+    struct DirFd
+    {
+        int fd;
+        explicit DirFd(int fd_) : fd(fd_) {}
+        ~DirFd() { close(fd); }
+    };
+    struct Dir
+    {
+        std::string path; // for errors only, the open uses name relative to parent->fd
+        std::string key;
+        std::shared_ptr<DirFd> parent;
+        std::string name;
+    };
+    struct Match
+    {
+        std::string key;
+        struct stat st;
+        XattrMap xattr;
+    };
+
+    std::string _root;
+    uid_t _uid;
+    gid_t _gid;
+    std::vector<gid_t> _groups;
+    bool _add_capabilities = false;
+    bool _gpfs_dmapi = false;
+    int _concurrency = 4;
+    size_t _batch_size = 1000;
+    size_t _max_buffered = 4000;
+    size_t _max_errors = 10;
+    int _types = WALK_FILE;
+    std::string _prefix;
+    int64_t _min_size = -1;
+    int64_t _max_size = -1;
+    double _mtime_before_ms = 0;
+    double _mtime_after_ms = 0;
+    double _ctime_before_ms = 0;
+    double _ctime_after_ms = 0;
+    std::vector<std::string> _xattr_keys; // all the keys to read - returned and filtered
+    std::vector<std::string> _xattr_exists;
+    XattrMap _xattr_equals;
+    std::vector<std::string> _exclude_dirs;
+
+    std::mutex _mutex;
+    std::condition_variable _work_cond;
+    std::condition_variable _read_cond;
+    std::vector<Dir> _stack;
+    std::deque<Match> _results;
+    int _active = 0;
+    int _threads = 0;
+    bool _cancelled = false;
+    // a read is waiting for a batch, the thread that makes it ready calls _notify once and clears it
+    bool _read_pending = false;
+    // only used on the main thread
+    Napi::ThreadSafeFunction _notify;
+    std::unique_ptr<Napi::Promise::Deferred> _read_deferred;
+    bool _notify_ref = false;
+    uint64_t _dirs = 0;
+    uint64_t _entries = 0;
+    uint64_t _matched = 0;
+    uint64_t _error_count = 0;
+    std::vector<std::pair<std::string, int>> _errors;
+
+    ~TreeWalk()
+    {
+        if (_notify) _notify.Release();
+    }
+
+    // starts the walker threads, each keeps the walk referenced until it exits
+    static void start(std::shared_ptr<TreeWalk> walk)
+    {
+        std::lock_guard<std::mutex> lock(walk->_mutex);
+        walk->_stack.push_back(Dir{ walk->_root, "", nullptr, "" });
+        for (int i = 0; i < walk->_concurrency; ++i) {
+            walk->_threads += 1;
+            std::thread(&TreeWalk::thread_main, walk).detach();
+        }
+    }
+
+    static void thread_main(std::shared_ptr<TreeWalk> walk)
+    {
+        ThreadScope tx;
+        tx.set_user(walk->_uid, walk->_gid, walk->_groups);
+        if (walk->_add_capabilities) tx.add_thread_capabilities();
+        walk->run(walk);
+    }
+
+    void run(const std::shared_ptr<TreeWalk>& self)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_cancelled) {
+            if (_stack.empty()) {
+                if (_active == 0) break;
+                _work_cond.wait(lock);
+                continue;
+            }
+            if (_results.size() >= _max_buffered) {
+                _work_cond.wait(lock);
+                continue;
+            }
+            Dir dir = std::move(_stack.back());
+            _stack.pop_back();
+            _active += 1;
+            lock.unlock();
+            scan(self, dir);
+            lock.lock();
+            _active -= 1;
+            if (_stack.empty() && _active == 0) _work_cond.notify_all();
+        }
+        _threads -= 1;
+        if (_threads == 0) {
+            _read_cond.notify_all();
+            notify_read_locked(self);
+        }
+    }
+
+    bool read_ready_locked() const
+    {
+        return _results.size() >= _batch_size || _threads == 0;
+    }
+
+    // called by a walker thread with the mutex locked when a batch became ready or the walk ended
+    void notify_read_locked(const std::shared_ptr<TreeWalk>& self)
+    {
+        if (!_read_pending) return;
+        _read_pending = false;
+        _notify.NonBlockingCall([self](Napi::Env env, Napi::Function) { self->deliver(env); });
+    }
+
+    // read resolves with the next batch, or null when the walk is done and all the matches were read
+    Napi::Value read(Napi::Env env)
+    {
+        auto deferred = Napi::Promise::Deferred::New(env);
+        if (_read_deferred) {
+            deferred.Reject(Napi::Error::New(env, "FS::WalkRead: ERROR read already pending").Value());
+            return deferred.Promise();
+        }
+        _read_deferred = std::make_unique<Napi::Promise::Deferred>(deferred);
+        bool ready;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ready = read_ready_locked();
+            if (!ready) _read_pending = true;
+        }
+        if (ready) {
+            deliver(env);
+        } else if (!_notify_ref) {
+            // keep the event loop alive while the read waits for the walker threads
+            _notify.Ref(env);
+            _notify_ref = true;
+        }
+        return deferred.Promise();
+    }
+
+    // runs on the main thread and resolves the pending read with the ready batch
+    void deliver(Napi::Env env)
+    {
+        if (!_read_deferred) return;
+        Napi::HandleScope scope(env);
+        std::vector<Match> batch;
+        bool eof = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!read_ready_locked()) {
+                _read_pending = true;
+                return;
+            }
+            size_t n = std::min(_batch_size, _results.size());
+            for (size_t i = 0; i < n; ++i) {
+                batch.push_back(std::move(_results.front()));
+                _results.pop_front();
+            }
+            eof = n == 0;
+            _work_cond.notify_all();
+        }
+        if (_notify_ref) {
+            _notify.Unref(env);
+            _notify_ref = false;
+        }
+        auto deferred = std::move(_read_deferred);
+        if (eof) {
+            deferred->Resolve(env.Null());
+            return;
+        }
+        auto res = Napi::Array::New(env, batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            auto entry = Napi::Object::New(env);
+            entry["key"] = Napi::String::New(env, batch[i].key);
+            entry["stat"] = new_stat_res(env, batch[i].st, batch[i].xattr);
+            res[uint32_t(i)] = entry;
+        }
+        deferred->Resolve(res);
+    }
+
+    // stops the walk and waits for the threads to exit
+    void cancel()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cancelled = true;
+        _work_cond.notify_all();
+        while (_threads > 0) _read_cond.wait(lock);
+        _stack.clear();
+        _results.clear();
+    }
+
+    void add_error(const std::string& path, int err)
+    {
+        DBG1("FS::TreeWalk: " << DVAL(path) << DVAL(strerror(err)));
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error_count += 1;
+        if (_errors.size() < _max_errors) _errors.emplace_back(path, err);
+    }
+
+    // a dir key can contain matching keys if it is a prefix of the prefix, or the prefix is a prefix of it
+    bool dir_can_match(const std::string& dir_key) const
+    {
+        size_t n = std::min(dir_key.size(), _prefix.size());
+        return _prefix.compare(0, n, dir_key, 0, n) == 0;
+    }
+
+    bool match_stat(struct stat& st) const
+    {
+        if (_min_size >= 0 && st.st_size < _min_size) return false;
+        if (_max_size >= 0 && st.st_size > _max_size) return false;
+        if (_mtime_before_ms || _mtime_after_ms || _ctime_before_ms || _ctime_after_ms) {
+            double f[STAT_FIELDS_COUNT];
+            get_stat_fields(st, f);
+            if (_mtime_before_ms && f[STAT_MTIME_MS] >= _mtime_before_ms) return false;
+            if (_mtime_after_ms && f[STAT_MTIME_MS] < _mtime_after_ms) return false;
+            if (_ctime_before_ms && f[STAT_CTIME_MS] >= _ctime_before_ms) return false;
+            if (_ctime_after_ms && f[STAT_CTIME_MS] < _ctime_after_ms) return false;
+        }
+        return true;
+    }
+
+    bool match_xattr(const XattrMap& xattr) const
+    {
+        for (const auto& key : _xattr_exists) {
+            if (xattr.find(key) == xattr.end()) return false;
+        }
+        for (const auto& it : _xattr_equals) {
+            auto found = xattr.find(it.first);
+            if (found == xattr.end() || found->second != it.second) return false;
+        }
+        return true;
+    }
+
+    // reads the xattr of an entry that passed the stat filters, returns false if it should be skipped
+    bool read_xattr(int dir_fd, const char* name, const std::string& path, XattrMap& xattr)
+    {
+        int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno != ENOENT) add_error(path, errno);
+            return false;
+        }
+        int r = _xattr_keys.empty() ? 0 : get_fd_xattr(fd, xattr, _xattr_keys);
+        int gpfs_error = 0;
+        if (!r && _gpfs_dmapi) r = get_fd_gpfs_xattr(fd, xattr, gpfs_error, true);
+        if (r) add_error(path, gpfs_error ? EIO : errno);
+        close(fd);
+        return r == 0;
+    }
+
+    // pushes the matches and dirs found so far, and waits while the unread matches are over max_buffered
+    // so that a huge flat directory does not buffer without bound
+    void push_results(const std::shared_ptr<TreeWalk>& self, std::vector<Match>& matches, std::vector<Dir>& dirs)
+    {
+        if (matches.empty() && dirs.empty()) return;
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!dirs.empty()) {
+            for (auto& d : dirs) _stack.push_back(std::move(d));
+            _work_cond.notify_all();
+            dirs.clear();
         }
-        Begin(XSTR() << "SeekDir " << DVAL(_wrap->_path) << DVAL(_seek_pos));
+        if (!matches.empty()) {
+            _matched += matches.size();
+            for (auto& m : matches) _results.push_back(std::move(m));
+            if (_results.size() >= _batch_size) notify_read_locked(self);
+            matches.clear();
+        }
+        while (_results.size() >= _max_buffered && !_cancelled) _work_cond.wait(lock);
     }
-    virtual void Work()
+
+    void scan(const std::shared_ptr<TreeWalk>& self, const Dir& dir)
     {
-        DIR* dir = _wrap->_dir;
-        if (!dir) {
-            SetError(XSTR() << "FS::SeekDir::Execute: ERROR not opened " << _wrap->_path);
+        // the root itself might be a symlink (e.g a bucket path), but nothing under it is followed
+        const int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+        int fd = dir.parent ? openat(dir.parent->fd, dir.name.c_str(), flags | O_NOFOLLOW) : open(dir.path.c_str(), flags);
+        if (fd < 0) {
+            if (errno != ENOENT) add_error(dir.path, errno);
             return;
         }
-        DBG1("FS::SeekDir::Work: " << DVAL(_wrap->_path));
-        seekdir(dir, _seek_pos);
+        auto dir_fd = std::make_shared<DirFd>(fd);
+        bool read_xattrs = !_xattr_keys.empty() || _gpfs_dmapi;
+        uint64_t entries = 0;
+        std::vector<Match> matches;
+        std::vector<Dir> dirs;
+        int r = for_each_dirent(fd, [&](const char* name, unsigned char type) {
+            if (_cancelled) return false;
+            entries += 1;
+            std::string key = dir.key + name;
+            struct stat st;
+            bool have_stat = false;
+            if (type == DT_UNKNOWN) {
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+                    if (errno != ENOENT) add_error(dir.path + "/" + name, errno);
+                    return true;
+                }
+                have_stat = true;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            int walk_type = 0;
+            if (type == DT_DIR) {
+                if (std::find(_exclude_dirs.begin(), _exclude_dirs.end(), name) != _exclude_dirs.end()) return true;
+                key += "/";
+                if (!dir_can_match(key)) return true;
+                dirs.push_back(Dir{ dir.path + "/" + name, key, dir_fd, name });
+                walk_type = WALK_DIR;
+            } else if (type == DT_REG) {
+                walk_type = WALK_FILE;
+            } else if (type == DT_LNK) {
+                walk_type = WALK_SYMLINK;
+            }
+            if (!(walk_type & _types)) return true;
+            if (key.compare(0, _prefix.size(), _prefix) != 0) return true;
+            if (!have_stat && fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+                if (errno != ENOENT) add_error(dir.path + "/" + name, errno);
+                return true;
+            }
+            if (!match_stat(st)) return true;
+            XattrMap xattr;
+            if (read_xattrs && walk_type != WALK_SYMLINK) {
+                if (!read_xattr(fd, name, dir.path + "/" + name, xattr)) return true;
+                if (!match_xattr(xattr)) return true;
+            } else if (!_xattr_exists.empty() || !_xattr_equals.empty()) {
+                return true;
+            }
+            matches.push_back(Match{ std::move(key), st, std::move(xattr) });
+            if (matches.size() >= 64 || dirs.size() >= 64) push_results(self, matches, dirs);
+            return true;
+        });
+        if (r < 0) add_error(dir.path, errno);
+        push_results(self, matches, dirs);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _dirs += 1;
+        _entries += entries;
     }
 };
 
-struct DirClose : public FSWrapWorker<DirWrap>
+/**
+ * WalkWrap is the JS handle of a TreeWalk, returned by fs.walk().
+ * read(fs_context) resolves to the next batch of matched entries, or null when the walk is done.
+ * close() stops the walker threads, which is also done if the handle is collected before it is closed.
+ */
+struct WalkWrap : public Napi::ObjectWrap<WalkWrap>
 {
-    DirClose(const Napi::CallbackInfo& info)
-        : FSWrapWorker<DirWrap>(info)
+    std::shared_ptr<TreeWalk> _walk;
+    static Napi::FunctionReference constructor;
+    static void init(Napi::Env env)
     {
-        Begin(XSTR() << "DirClose " << DVAL(_wrap->_path));
+        constructor = Napi::Persistent(DefineClass(
+            env,
+            "Walk",
+            {
+                InstanceMethod("close", &WalkWrap::close),
+                InstanceMethod("read", &WalkWrap::read),
+                InstanceMethod("stats", &WalkWrap::stats),
+            }));
+        constructor.SuppressDestruct();
     }
-    virtual void Work()
+    WalkWrap(const Napi::CallbackInfo& info)
+        : Napi::ObjectWrap<WalkWrap>(info)
     {
-        DIR* dir = _wrap->_dir;
-        std::string path = _wrap->_path;
-        int r = closedir(dir);
-        if (r) SetSyscallError();
-        _wrap->_dir = 0;
     }
+    ~WalkWrap()
+    {
+        if (_walk) {
+            DBG1("FS::WalkWrap::dtor: walk not closed " << DVAL(_walk->_root));
+            std::lock_guard<std::mutex> lock(_walk->_mutex);
+            _walk->_cancelled = true;
+            _walk->_work_cond.notify_all();
+        }
+    }
+    Napi::Value close(const Napi::CallbackInfo& info);
+    Napi::Value read(const Napi::CallbackInfo& info);
+    Napi::Value stats(const Napi::CallbackInfo& info);
 };
 
-struct DirReadEntry : public FSWrapWorker<DirWrap>
+Napi::FunctionReference WalkWrap::constructor;
+
+static void
+napi_get_str_list(Napi::Object options, const char* key, std::vector<std::string>& list)
 {
-    Entry _entry;
-    bool _eof;
-    DirReadEntry(const Napi::CallbackInfo& info)
-        : FSWrapWorker<DirWrap>(info)
-        , _eof(false)
+    auto v = options.Get(key);
+    if (!v.IsArray()) return;
+    auto arr = v.As<Napi::Array>();
+    for (uint32_t i = 0; i < arr.Length(); ++i) list.push_back(arr.Get(i).ToString().Utf8Value());
+}
+
+/**
+ * WalkOpen is an fs op that starts a TreeWalk
+ * walk(fs_context, root, {
+ *      concurrency, batch_size, max_errors,
+ *      types: ['file', 'dir', 'symlink'], prefix, exclude_dirs: [name],
+ *      min_size, max_size, mtime_before_ms, mtime_after_ms, ctime_before_ms, ctime_after_ms,
+ *      xattr: [key], xattr_exists: [key], xattr_equals: {key: value},
+ * })
+ * When fs_context.use_dmapi is set on GPFS the dmapi attributes are read as well and can be filtered.
+ */
+struct WalkOpen : public FSWorker
+{
+    std::shared_ptr<TreeWalk> _walk;
+    WalkOpen(const Napi::CallbackInfo& info)
+        : FSWorker(info)
+        , _walk(std::make_shared<TreeWalk>())
     {
-        Begin(XSTR() << "DirReadEntry " << DVAL(_wrap->_path));
+        TreeWalk& w = *_walk;
+        w._root = info[1].As<Napi::String>();
+        if (info[2].IsObject()) {
+            auto options = info[2].As<Napi::Object>();
+            w._concurrency = std::max(1, std::min(64, napi_get_i32_or(options, "concurrency", w._concurrency)));
+            w._batch_size = std::max(1u, napi_get_u32_or(options, "batch_size", w._batch_size));
+            w._max_buffered = w._batch_size * 4;
+            w._max_errors = napi_get_u32_or(options, "max_errors", w._max_errors);
+            w._prefix = napi_get_str_or(options, "prefix", "");
+            w._min_size = napi_get_i64_or(options, "min_size", -1);
+            w._max_size = napi_get_i64_or(options, "max_size", -1);
+            if (options.Get("mtime_before_ms").IsNumber()) w._mtime_before_ms = options.Get("mtime_before_ms").ToNumber();
+            if (options.Get("mtime_after_ms").IsNumber()) w._mtime_after_ms = options.Get("mtime_after_ms").ToNumber();
+            if (options.Get("ctime_before_ms").IsNumber()) w._ctime_before_ms = options.Get("ctime_before_ms").ToNumber();
+            if (options.Get("ctime_after_ms").IsNumber()) w._ctime_after_ms = options.Get("ctime_after_ms").ToNumber();
+            std::vector<std::string> types;
+            napi_get_str_list(options, "types", types);
+            if (!types.empty()) {
+                w._types = 0;
+                for (const auto& t : types) {
+                    if (t == "file") {
+                        w._types |= TreeWalk::WALK_FILE;
+                    } else if (t == "dir") {
+                        w._types |= TreeWalk::WALK_DIR;
+                    } else if (t == "symlink") {
+                        w._types |= TreeWalk::WALK_SYMLINK;
+                    } else {
+                        SetError(XSTR() << "FS::WalkOpen: unexpected type " << DVAL(t));
+                    }
+                }
+            }
+            napi_get_str_list(options, "exclude_dirs", w._exclude_dirs);
+            napi_get_str_list(options, "xattr", w._xattr_keys);
+            napi_get_str_list(options, "xattr_exists", w._xattr_exists);
+            if (options.Get("xattr_equals").IsObject()) {
+                get_xattr_from_object(w._xattr_equals, options.Get("xattr_equals").As<Napi::Object>());
+            }
+            for (const auto& key : w._xattr_exists) w._xattr_keys.push_back(key);
+            for (const auto& it : w._xattr_equals) w._xattr_keys.push_back(it.first);
+            std::sort(w._xattr_keys.begin(), w._xattr_keys.end());
+            w._xattr_keys.erase(std::unique(w._xattr_keys.begin(), w._xattr_keys.end()), w._xattr_keys.end());
+        }
+        auto noop = Napi::Function::New(info.Env(), [](const Napi::CallbackInfo& info) {});
+        w._notify = Napi::ThreadSafeFunction::New(info.Env(), noop, "FSWalkRead", 0, 1);
+        w._notify.Unref(info.Env());
+        Begin(XSTR() << "WalkOpen " << DVAL(w._root) << DVAL(w._concurrency) << DVAL(w._prefix));
     }
     virtual void Work()
     {
-        DIR* dir = _wrap->_dir;
-        std::string path = _wrap->_path;
-        if (!dir) {
-            SetError(XSTR() << "FS::DirReadEntry::Execute: ERROR not opened " << path);
+        // do not start the walker threads when the constructor failed
+        if (_failed) return;
+        TreeWalk& w = *_walk;
+        struct stat st;
+        SYSCALL_OR_RETURN(stat(w._root.c_str(), &st));
+        if (!S_ISDIR(st.st_mode)) {
+            errno = ENOTDIR;
+            SetSyscallError();
             return;
         }
-        struct dirent* e = 0;
-
-        // loop to skip parent and current directories
-        do {
-            // need to set errno before the call to readdir() to detect between EOF and error
-            errno = 0;
-            e = readdir(dir);
-        } while (e && (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0));
-        if (e) {
-            _entry.name = std::string(e->d_name);
-            _entry.ino = e->d_ino;
-            _entry.type = e->d_type;
-            _entry.off = e->DIR_OFFSET_FIELD;
-        } else {
-            if (errno) {
-                SetSyscallError();
-            } else {
-                _eof = true;
-            }
-        }
+        w._uid = _uid;
+        w._gid = _gid;
+        w._groups = _supplemental_groups;
+        w._add_capabilities = _should_add_thread_capabilities;
+        w._gpfs_dmapi = _use_dmapi && use_gpfs_lib();
+        TreeWalk::start(_walk);
     }
     virtual void OnOK()
     {
-        Napi::Env env = Env();
-        if (_eof) {
-            _deferred.Resolve(env.Null());
-        } else {
-            auto res = Napi::Object::New(env);
-            res["name"] = Napi::String::New(env, _entry.name);
-            res["ino"] = Napi::Number::New(env, _entry.ino);
-            res["type"] = Napi::Number::New(env, _entry.type);
-            res["off"] = Napi::BigInt::New(env, _entry.off);
-            _deferred.Resolve(res);
-        }
+        DBG1("FS::WalkOpen::OnOK: " << DVAL(_walk->_root));
+        Napi::Object res = WalkWrap::constructor.New({});
+        WalkWrap* w = WalkWrap::Unwrap(res);
+        w->_walk = _walk;
+        _deferred.Resolve(res);
         ReportWorkerStats(0);
     }
 };
 
-Napi::Value
-DirWrap::close(const Napi::CallbackInfo& info)
+struct WalkClose : public FSWrapWorker<WalkWrap>
 {
-    return api<DirClose>(info);
-}
+    std::shared_ptr<TreeWalk> _walk;
+    WalkClose(const Napi::CallbackInfo& info)
+        : FSWrapWorker<WalkWrap>(info)
+        , _walk(_wrap->_walk)
+    {
+        _wrap->_walk.reset();
+        Begin(XSTR() << "WalkClose " << "root=" << (_walk ? _walk->_root : std::string()));
+    }
+    virtual void Work()
+    {
+        if (_walk) _walk->cancel();
+    }
+};
 
 Napi::Value
-DirWrap::read(const Napi::CallbackInfo& info)
+WalkWrap::close(const Napi::CallbackInfo& info)
 {
-    return api<DirReadEntry>(info);
+    return api<WalkClose>(info);
 }
 
+/**
+ * read(fs_context) is served on the main thread from the matches that the walker threads buffered,
+ * so it does not occupy a pool thread while waiting for them.
+ */
 Napi::Value
-DirWrap::telldir(const Napi::CallbackInfo& info)
+WalkWrap::read(const Napi::CallbackInfo& info)
 {
-    return api<TellDir>(info);
+    Napi::Env env = info.Env();
+    if (!_walk) {
+        auto deferred = Napi::Promise::Deferred::New(env);
+        deferred.Reject(Napi::Error::New(env, "FS::WalkRead: ERROR not opened").Value());
+        return deferred.Promise();
+    }
+    return _walk->read(env);
 }
 
 Napi::Value
-DirWrap::seekdir(const Napi::CallbackInfo& info)
+WalkWrap::stats(const Napi::CallbackInfo& info)
 {
-    return api<SeekDir>(info);
+    Napi::Env env = info.Env();
+    auto res = Napi::Object::New(env);
+    if (!_walk) return res;
+    std::lock_guard<std::mutex> lock(_walk->_mutex);
+    res["dirs"] = Napi::Number::New(env, _walk->_dirs);
+    res["entries"] = Napi::Number::New(env, _walk->_entries);
+    res["matched"] = Napi::Number::New(env, _walk->_matched);
+    res["buffered"] = Napi::Number::New(env, _walk->_results.size());
+    res["done"] = Napi::Boolean::New(env, _walk->_threads == 0);
+    res["error_count"] = Napi::Number::New(env, _walk->_error_count);
+    auto errors = Napi::Array::New(env, _walk->_errors.size());
+    for (size_t i = 0; i < _walk->_errors.size(); ++i) {
+        auto err = Napi::Object::New(env);
+        err["path"] = Napi::String::New(env, _walk->_errors[i].first);
+        err["code"] = Napi::String::New(env, uv_err_name(uv_translate_sys_error(_walk->_errors[i].second)));
+        errors[uint32_t(i)] = err;
+    }
+    res["errors"] = errors;
+    return res;
 }
 
 static Napi::Value
@@ -2691,6 +6346,340 @@ set_log_config(const Napi::CallbackInfo& info)
     return info.Env().Undefined();
 }
 
+static Napi::Value
+dir_cache_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    uint32_t max_entries = napi_get_u32_or(params, "max_entries", 0);
+    int64_t validate_ms = napi_get_i64_or(params, "validate_ms", 1000);
+    dir_fd_cache.configure(max_entries, validate_ms);
+    DBG1("FS::dir_cache_config " << DVAL(max_entries) << DVAL(validate_ms));
+    return info.Env().Undefined();
+}
+
+/**
+ * object_cache_config({ max_entries, max_bytes, max_object_size }) - zero in any of them disables the cache
+ */
+static Napi::Value
+object_cache_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    int64_t max_entries = napi_get_i64_or(params, "max_entries", 0);
+    int64_t max_bytes = napi_get_i64_or(params, "max_bytes", 0);
+    int64_t max_object_size = napi_get_i64_or(params, "max_object_size", 0);
+    object_cache.configure(max_entries, max_bytes, max_object_size);
+    DBG1("FS::object_cache_config " << DVAL(max_entries) << DVAL(max_bytes) << DVAL(max_object_size));
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+object_cache_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info.Length() > 0 && info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    size_t entries = 0;
+    size_t bytes = 0;
+    for (auto& s : object_cache._shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        entries += s.map.size();
+        bytes += s.bytes;
+    }
+    auto res = Napi::Object::New(env);
+    res["entries"] = Napi::Number::New(env, entries);
+    res["bytes"] = Napi::Number::New(env, bytes);
+    res["max_entries"] = Napi::Number::New(env, object_cache._max_entries);
+    res["max_bytes"] = Napi::Number::New(env, object_cache._max_bytes);
+    res["max_object_size"] = Napi::Number::New(env, object_cache._max_object_size);
+    res["hits"] = Napi::Number::New(env, reset ? object_cache._hits.exchange(0) : object_cache._hits.load());
+    res["misses"] = Napi::Number::New(env, reset ? object_cache._misses.exchange(0) : object_cache._misses.load());
+    res["inserts"] = Napi::Number::New(env, reset ? object_cache._inserts.exchange(0) : object_cache._inserts.load());
+    res["evictions"] = Napi::Number::New(env, reset ? object_cache._evictions.exchange(0) : object_cache._evictions.load());
+    res["invalidations"] = Napi::Number::New(env,
+        reset ? object_cache._invalidations.exchange(0) : object_cache._invalidations.load());
+    return res;
+}
+
+/**
+ * fd_cache_config({ max_entries, idle_ttl_ms, validate_ms }) - zero max_entries disables the cache
+ */
+static Napi::Value
+fd_cache_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    int64_t max_entries = napi_get_i64_or(params, "max_entries", 0);
+    int64_t idle_ttl_ms = napi_get_i64_or(params, "idle_ttl_ms", 10000);
+    int64_t validate_ms = napi_get_i64_or(params, "validate_ms", 0);
+    fd_cache.configure(max_entries, idle_ttl_ms, validate_ms);
+    DBG1("FS::fd_cache_config " << DVAL(max_entries) << DVAL(idle_ttl_ms) << DVAL(validate_ms));
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+fd_cache_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info.Length() > 0 && info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    auto res = Napi::Object::New(env);
+    {
+        std::lock_guard<std::mutex> lock(fd_cache._mutex);
+        fd_cache._maybe_sweep();
+        size_t in_use = 0;
+        for (auto const& it : fd_cache._map) {
+            for (auto const& item : it.second) {
+                if (!FdCache::idle(item)) in_use += 1;
+            }
+        }
+        res["entries"] = Napi::Number::New(env, fd_cache._size);
+        res["in_use"] = Napi::Number::New(env, in_use);
+        res["max_entries"] = Napi::Number::New(env, fd_cache._max_entries);
+        res["idle_ttl_ms"] = Napi::Number::New(env, fd_cache._idle_ttl_ms);
+        res["validate_ms"] = Napi::Number::New(env, fd_cache._validate_ms);
+    }
+    res["hits"] = Napi::Number::New(env, reset ? fd_cache._hits.exchange(0) : fd_cache._hits.load());
+    res["misses"] = Napi::Number::New(env, reset ? fd_cache._misses.exchange(0) : fd_cache._misses.load());
+    res["inserts"] = Napi::Number::New(env, reset ? fd_cache._inserts.exchange(0) : fd_cache._inserts.load());
+    res["evictions"] = Napi::Number::New(env, reset ? fd_cache._evictions.exchange(0) : fd_cache._evictions.load());
+    res["expirations"] = Napi::Number::New(env, reset ? fd_cache._expirations.exchange(0) : fd_cache._expirations.load());
+    res["invalidations"] = Napi::Number::New(env,
+        reset ? fd_cache._invalidations.exchange(0) : fd_cache._invalidations.load());
+    return res;
+}
+
+/**
+ * config_cache_config({ max_entries, max_bytes, max_file_size, validate_ms, watch }) - zero max_entries disables the cache
+ */
+static Napi::Value
+config_cache_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    ConfigCache::Config config;
+    config.max_entries = napi_get_i64_or(params, "max_entries", 0);
+    config.max_bytes = napi_get_i64_or(params, "max_bytes", 16 * 1024 * 1024);
+    config.max_file_size = napi_get_i64_or(params, "max_file_size", config.max_file_size);
+    config.validate_ms = napi_get_i64_or(params, "validate_ms", config.validate_ms);
+    if (params.Has("watch")) config.watch = params.Get("watch").ToBoolean();
+    config_cache.configure(config);
+    DBG1("FS::config_cache_config " << DVAL(config.max_entries) << DVAL(config.max_bytes)
+        << DVAL(config.max_file_size) << DVAL(config.validate_ms) << DVAL(config.watch));
+    return info.Env().Undefined();
+}
+
+/**
+ * config_cache_get(fs_context, path) => Buffer | undefined
+ * Synchronously returns the cached content of a config file when it can be served without syscalls,
+ * otherwise the caller should use read_config_file(). The returned buffer must not be modified.
+ */
+static Napi::Value
+config_cache_get(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    if (!config_cache.enabled()) return env.Undefined();
+    ConfigCache::User user{ ThreadScope::orig_uid, ThreadScope::orig_gid, {} };
+    if (info[0].ToBoolean()) {
+        Napi::Object fs_context = info[0].As<Napi::Object>();
+        if (fs_context.Get("uid").IsNumber()) user.uid = fs_context.Get("uid").ToNumber();
+        if (fs_context.Get("gid").IsNumber()) user.gid = fs_context.Get("gid").ToNumber();
+        if (fs_context.Has("supplemental_groups")) {
+            user.groups = convert_napi_number_array_to_number_vector<gid_t>(fs_context.Get("supplemental_groups").As<Napi::Array>());
+        }
+    }
+    std::string path = info[1].As<Napi::String>();
+    auto file = config_cache.get(path, user);
+    if (!file) return env.Undefined();
+    return new_config_file_buffer(env, file);
+}
+
+static Napi::Value
+config_cache_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info.Length() > 0 && info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    ConfigCache::Stats s = config_cache.stats(reset);
+    auto res = Napi::Object::New(env);
+    res["entries"] = Napi::Number::New(env, s.entries);
+    res["bytes"] = Napi::Number::New(env, s.bytes);
+    res["watched_entries"] = Napi::Number::New(env, s.watched_entries);
+    res["watches"] = Napi::Number::New(env, s.watches);
+    res["hits"] = Napi::Number::New(env, s.hits);
+    res["misses"] = Napi::Number::New(env, s.misses);
+    res["validations"] = Napi::Number::New(env, s.validations);
+    res["inserts"] = Napi::Number::New(env, s.inserts);
+    res["evictions"] = Napi::Number::New(env, s.evictions);
+    res["invalidations"] = Napi::Number::New(env, s.invalidations);
+    res["watch_events"] = Napi::Number::New(env, s.watch_events);
+    res["watch_errors"] = Napi::Number::New(env, s.watch_errors);
+    return res;
+}
+
+static Napi::Value
+xattr_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    uint32_t buf_size = napi_get_u32_or(params, "buf_size", 4096);
+    xattr_buf_size = std::max<size_t>(256, std::min<size_t>(buf_size, XATTR_BUF_MAX));
+    xattr_packed = params.Get("packed").ToBoolean();
+    DBG1("FS::xattr_config " << DVAL(xattr_buf_size) << DVAL(xattr_packed));
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+stat_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    Napi::Value compact_class = params.Get("compact_class");
+    if (compact_class.IsFunction()) {
+        compact_stat_class = Napi::Persistent(compact_class.As<Napi::Function>());
+    } else {
+        compact_stat_class.Reset();
+    }
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+fs_pool_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    std::vector<int> threads{
+        int(napi_get_u32_or(params, "meta_threads", 0)),
+        int(napi_get_u32_or(params, "data_threads", 0)),
+        int(napi_get_u32_or(params, "lock_threads", 0)),
+    };
+    WorkerPool::instance().configure(info.Env(), FS_LANE_NAMES, threads);
+    DBG1("FS::fs_pool_config " << DVAL(threads[FS_LANE_META]) << DVAL(threads[FS_LANE_DATA]) << DVAL(threads[FS_LANE_LOCK]));
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+fs_pool_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    auto res = Napi::Object::New(env);
+    for (const auto& s : WorkerPool::instance().stats(reset)) {
+        auto lane = Napi::Object::New(env);
+        lane["threads"] = Napi::Number::New(env, s.threads);
+        lane["queued"] = Napi::Number::New(env, s.queued);
+        lane["max_queued"] = Napi::Number::New(env, s.max_queued);
+        lane["running"] = Napi::Number::New(env, s.running);
+        lane["completed"] = Napi::Number::New(env, s.completed);
+        lane["wait_time_ms"] = Napi::Number::New(env, s.wait_time_ms);
+        lane["max_wait_time_ms"] = Napi::Number::New(env, s.max_wait_time_ms);
+        lane["run_time_ms"] = Napi::Number::New(env, s.run_time_ms);
+        lane["max_run_time_ms"] = Napi::Number::New(env, s.max_run_time_ms);
+        res[s.name] = lane;
+    }
+    return res;
+}
+
+/**
+ * fsync_group_config({ enabled, window_us, max_batch, syncfs })
+ * coalesces concurrent fsync calls of the same directory (or filesystem with syncfs) into one syscall.
+ */
+static Napi::Value
+fsync_group_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    FsyncGroup::Config config;
+    config.enabled = params.Get("enabled").ToBoolean();
+    config.window_us = napi_get_i64_or(params, "window_us", config.window_us);
+    config.max_batch = napi_get_i32_or(params, "max_batch", config.max_batch);
+#ifndef __APPLE__
+    config.use_syncfs = params.Get("syncfs").ToBoolean();
+#endif
+    FsyncGroup::instance().configure(config);
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+fsync_group_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    FsyncGroup::Config config = FsyncGroup::instance().config();
+    FsyncGroup::Stats s = FsyncGroup::instance().stats(reset);
+    auto res = Napi::Object::New(env);
+    res["enabled"] = Napi::Boolean::New(env, config.enabled);
+    res["syncfs"] = Napi::Boolean::New(env, config.use_syncfs);
+    res["window_us"] = Napi::Number::New(env, config.window_us);
+    res["max_batch"] = Napi::Number::New(env, config.max_batch);
+    res["requests"] = Napi::Number::New(env, s.requests);
+    res["syncs"] = Napi::Number::New(env, s.syncs);
+    res["errors"] = Napi::Number::New(env, s.errors);
+    res["max_batch_seen"] = Napi::Number::New(env, s.max_batch);
+    res["window_wait_us"] = Napi::Number::New(env, s.window_wait_us);
+    res["sync_time_us"] = Napi::Number::New(env, s.sync_time_us);
+    res["max_sync_time_us"] = Napi::Number::New(env, s.max_sync_time_us);
+    return res;
+}
+
+static Napi::Value
+latency_stats_config(const Napi::CallbackInfo& info)
+{
+    Napi::Object params = info[0].As<Napi::Object>();
+    LatencyStats::instance().set_enabled(params.Get("enabled").ToBoolean());
+    return info.Env().Undefined();
+}
+
+static Napi::Object
+latency_hist_res(Napi::Env env, const LatencyStats::Hist& h)
+{
+    auto res = Napi::Object::New(env);
+    res["count"] = Napi::Number::New(env, h.count);
+    res["sum_us"] = Napi::Number::New(env, h.sum_us);
+    res["min_us"] = Napi::Number::New(env, h.min_us);
+    res["max_us"] = Napi::Number::New(env, h.max_us);
+    res["p50_us"] = Napi::Number::New(env, h.percentile(0.5));
+    res["p90_us"] = Napi::Number::New(env, h.percentile(0.9));
+    res["p99_us"] = Napi::Number::New(env, h.percentile(0.99));
+    res["p999_us"] = Napi::Number::New(env, h.percentile(0.999));
+    return res;
+}
+
+/**
+ * get_stats returns the latency stats of fs ops since the last reset,
+ * per op name - count, error_count and histograms of the run time (successful ops) and wait time.
+ */
+static Napi::Value
+get_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    auto res = Napi::Object::New(env);
+    for (const auto& op : LatencyStats::instance().snapshot(reset)) {
+        auto op_res = Napi::Object::New(env);
+        op_res["count"] = Napi::Number::New(env, op.count);
+        op_res["error_count"] = Napi::Number::New(env, op.errors);
+        op_res["run"] = latency_hist_res(env, op.run);
+        op_res["wait"] = latency_hist_res(env, op.wait);
+        res[op.name] = op_res;
+    }
+    return res;
+}
+
+static Napi::Value
+dir_cache_remove(const Napi::CallbackInfo& info)
+{
+    dir_fd_cache.remove(napi_get_str(info[0]));
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+dir_cache_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    auto res = Napi::Object::New(env);
+    {
+        std::lock_guard<std::mutex> lock(dir_fd_cache._mutex);
+        res["entries"] = Napi::Number::New(env, dir_fd_cache._map.size());
+        res["max_entries"] = Napi::Number::New(env, dir_fd_cache._max_entries);
+    }
+    res["hits"] = Napi::Number::New(env, dir_fd_cache._hits);
+    res["misses"] = Napi::Number::New(env, dir_fd_cache._misses);
+    res["evictions"] = Napi::Number::New(env, dir_fd_cache._evictions);
+    res["invalidations"] = Napi::Number::New(env, dir_fd_cache._invalidations);
+    return res;
+}
+
 /**
  * register noobaa args to GPFS
  */
@@ -2722,12 +6711,71 @@ static Napi::Value
 dio_buffer_alloc(const Napi::CallbackInfo& info)
 {
     int size = info[0].As<Napi::Number>();
-    uint8_t* buf = 0;
-    int r = posix_memalign((void**)&buf, DIO_BUFFER_MEMALIGN, size);
-    if (r || (!buf && size > 0)) {
+    uint64_t ticket = 0;
+    uint8_t* buf = dio_alloc(size, ticket);
+    if (!buf && size > 0) {
         throw Napi::Error::New(info.Env(), "FS::dio_buffer_alloc: failed to allocate memory");
     }
-    return Napi::Buffer<uint8_t>::New(info.Env(), buf, size, buffer_releaser);
+    return dio_buffer_new(info.Env(), buf, size, ticket);
+}
+
+/**
+ * Release a buffer from dio_buffer_alloc back to the slab without waiting for the GC.
+ * The buffer must not be used after this call. Returns false if it was not a slab buffer.
+ */
+static Napi::Value
+dio_buffer_release(const Napi::CallbackInfo& info)
+{
+    auto buf = info[0].As<Napi::Buffer<uint8_t>>();
+    bool released = Slab::instance().release(buf.Data());
+    return Napi::Boolean::New(info.Env(), released);
+}
+
+static Napi::Value
+dio_slab_config(const Napi::CallbackInfo& info)
+{
+    auto options = info[0].As<Napi::Object>();
+    Slab::Config config;
+    if (options.Get("sizes").IsArray()) {
+        auto sizes = options.Get("sizes").As<Napi::Array>();
+        for (uint32_t i = 0; i < sizes.Length(); ++i) {
+            config.sizes.push_back(napi_get_i64(sizes.Get(i)));
+        }
+    }
+    config.max_bytes = napi_get_i64_or(options, "max_bytes", 0);
+    config.thread_cache = napi_get_u32_or(options, "thread_cache", 8);
+    config.hugepages = options.Get("hugepages").ToBoolean();
+    Slab::instance().configure(config);
+    return info.Env().Undefined();
+}
+
+static Napi::Value
+dio_slab_stats(const Napi::CallbackInfo& info)
+{
+    Napi::Env env = info.Env();
+    Slab::Stats stats = Slab::instance().stats();
+    auto res = Napi::Object::New(env);
+    auto classes = Napi::Array::New(env, stats.classes.size());
+    for (size_t i = 0; i < stats.classes.size(); ++i) {
+        const Slab::ClassStats& cs = stats.classes[i];
+        auto c = Napi::Object::New(env);
+        c["size"] = Napi::Number::New(env, cs.size);
+        c["regions"] = Napi::Number::New(env, cs.regions);
+        c["total"] = Napi::Number::New(env, cs.total);
+        c["in_use"] = Napi::Number::New(env, cs.in_use);
+        c["free"] = Napi::Number::New(env, cs.free);
+        c["cached"] = Napi::Number::New(env, cs.cached);
+        classes[uint32_t(i)] = c;
+    }
+    res["enabled"] = Napi::Boolean::New(env, Slab::instance().enabled());
+    res["classes"] = classes;
+    res["mapped_bytes"] = Napi::Number::New(env, stats.mapped_bytes);
+    res["hugepage_regions"] = Napi::Number::New(env, stats.hugepage_regions);
+    res["fallback_allocs"] = Napi::Number::New(env, stats.fallback_allocs);
+    res["fallback_in_use"] = Napi::Number::New(env, stats.fallback_in_use);
+    res["thread_cache_hits"] = Napi::Number::New(env, stats.thread_cache_hits);
+    res["ignored_frees"] = Napi::Number::New(env, stats.ignored_frees);
+    return res;
 }
 
 /**
@@ -2812,13 +6860,20 @@ fs_napi(Napi::Env env, Napi::Object exports)
     exports_fs["rename"] = Napi::Function::New(env, api<Rename>);
     exports_fs["mkdir"] = Napi::Function::New(env, api<Mkdir>);
     exports_fs["rmdir"] = Napi::Function::New(env, api<Rmdir>);
+    exports_fs["rmtree"] = Napi::Function::New(env, api<Rmtree>);
     exports_fs["writeFile"] = Napi::Function::New(env, api<Writefile>);
     exports_fs["readFile"] = Napi::Function::New(env, api<Readfile>);
+    exports_fs["write_blocks"] = Napi::Function::New(env, api<WriteBlocks>);
+    exports_fs["read_blocks"] = Napi::Function::New(env, api<ReadBlocks>);
+    exports_fs["delete_blocks"] = Napi::Function::New(env, api<DeleteBlocks>);
     exports_fs["readdir"] = Napi::Function::New(env, api<Readdir>);
+    exports_fs["readdir_versions"] = Napi::Function::New(env, api<ReaddirVersions>);
     exports_fs["safe_link"] = Napi::Function::New(env, api<SafeLink>);
     exports_fs["link"] = Napi::Function::New(env, api<Link>);
     exports_fs["linkat"] = Napi::Function::New(env, api<Linkat>);
     exports_fs["fsync"] = Napi::Function::New(env, api<Fsync>);
+    exports_fs["copy_file"] = Napi::Function::New(env, api<CopyFile>);
+    exports_fs["complete_multipart"] = Napi::Function::New(env, api<CompleteMultipart>);
     exports_fs["realpath"] = Napi::Function::New(env, api<RealPath>);
     exports_fs["getsinglexattr"] = Napi::Function::New(env, api<GetSingleXattr>);
     exports_fs["getpwname"] = Napi::Function::New(env, api<GetPwName>);
@@ -2826,6 +6881,28 @@ fs_napi(Napi::Env env, Napi::Object exports)
     exports_fs["getSupplementalGroupsByUserName"] = Napi::Function::New(env, api<GetSupplementalGroupsByUserName>);
     exports_fs["symlink"] = Napi::Function::New(env, api<Symlink>);
     exports_fs["fcntlgetlock"] = Napi::Function::New(env, api<FcntlGetLock>);
+    exports_fs["dir_cache_add"] = Napi::Function::New(env, api<DirCacheAdd>);
+    exports_fs["dir_cache_remove"] = Napi::Function::New(env, dir_cache_remove);
+    exports_fs["dir_cache_config"] = Napi::Function::New(env, dir_cache_config);
+    exports_fs["dir_cache_stats"] = Napi::Function::New(env, dir_cache_stats);
+    exports_fs["read_cached_file"] = Napi::Function::New(env, api<ReadCachedFile>);
+    exports_fs["object_cache_config"] = Napi::Function::New(env, object_cache_config);
+    exports_fs["object_cache_stats"] = Napi::Function::New(env, object_cache_stats);
+    exports_fs["fd_cache_config"] = Napi::Function::New(env, fd_cache_config);
+    exports_fs["fd_cache_stats"] = Napi::Function::New(env, fd_cache_stats);
+    exports_fs["read_config_file"] = Napi::Function::New(env, api<ReadConfigFile>);
+    exports_fs["config_cache_get"] = Napi::Function::New(env, config_cache_get);
+    exports_fs["config_cache_config"] = Napi::Function::New(env, config_cache_config);
+    exports_fs["config_cache_stats"] = Napi::Function::New(env, config_cache_stats);
+    exports_fs["xattr_config"] = Napi::Function::New(env, xattr_config);
+    exports_fs["stat_config"] = Napi::Function::New(env, stat_config);
+    exports_fs["fs_pool_config"] = Napi::Function::New(env, fs_pool_config);
+    exports_fs["fs_pool_stats"] = Napi::Function::New(env, fs_pool_stats);
+    exports_fs["latency_stats_config"] = Napi::Function::New(env, latency_stats_config);
+    exports_fs["get_stats"] = Napi::Function::New(env, get_stats);
+    exports_fs["fsync_group_config"] = Napi::Function::New(env, fsync_group_config);
+    exports_fs["fsync_group_stats"] = Napi::Function::New(env, fsync_group_stats);
+    exports_fs["wait_writable"] = Napi::Function::New(env, wait_writable);
 
     FileWrap::init(env);
     exports_fs["open"] = Napi::Function::New(env, api<FileOpen>);
@@ -2833,12 +6910,21 @@ fs_napi(Napi::Env env, Napi::Object exports)
     DirWrap::init(env);
     exports_fs["opendir"] = Napi::Function::New(env, api<DirOpen>);
 
+    WalkWrap::init(env);
+    VersionsCursorWrap::init(env);
+    exports_fs["walk"] = Napi::Function::New(env, api<WalkOpen>);
+
     exports_fs["S_IFMT"] = Napi::Number::New(env, S_IFMT);
     exports_fs["S_IFDIR"] = Napi::Number::New(env, S_IFDIR);
     exports_fs["S_IFLNK"] = Napi::Number::New(env, S_IFLNK);
     exports_fs["DT_DIR"] = Napi::Number::New(env, DT_DIR);
     exports_fs["DT_LNK"] = Napi::Number::New(env, DT_LNK);
     exports_fs["PLATFORM_IOV_MAX"] = Napi::Number::New(env, IOV_MAX);
+    auto stat_fields = Napi::Array::New(env, STAT_COMPACT_FIELDS.size());
+    for (size_t i = 0; i < STAT_COMPACT_FIELDS.size(); ++i) {
+        stat_fields[uint32_t(i)] = Napi::String::New(env, STAT_COMPACT_FIELDS[i]);
+    }
+    exports_fs["STAT_COMPACT_FIELDS"] = stat_fields;
     ThreadScope::init_passwd_buf_size();
 
 #ifdef O_DIRECT
@@ -2849,6 +6935,9 @@ fs_napi(Napi::Env env, Napi::Object exports)
 #endif
 
     exports_fs["dio_buffer_alloc"] = Napi::Function::New(env, dio_buffer_alloc);
+    exports_fs["dio_buffer_release"] = Napi::Function::New(env, dio_buffer_release);
+    exports_fs["dio_slab_config"] = Napi::Function::New(env, dio_slab_config);
+    exports_fs["dio_slab_stats"] = Napi::Function::New(env, dio_slab_stats);
     exports_fs["set_debug_level"] = Napi::Function::New(env, set_debug_level);
     exports_fs["set_log_config"] = Napi::Function::New(env, set_log_config);
 
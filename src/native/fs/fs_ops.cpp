@@ -0,0 +1,395 @@
+/* Copyright (C) 2016 NooBaa */
+#include "fs_ops.h"
+
+#include <chrono>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../util/fsync_group.h"
+#include "../util/slab.h"
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+DirFdCache dir_fd_cache;
+
+std::atomic<size_t> xattr_buf_size(4096);
+
+/**
+ * dio_alloc allocates an aligned buffer for direct IO from the slab when it is enabled,
+ * in which case the ticket is non zero and the buffer must be freed with dio_free().
+ */
+uint8_t*
+dio_alloc(size_t size, uint64_t& ticket)
+{
+    ticket = 0;
+    if (Slab::instance().enabled()) return Slab::instance().alloc(size, ticket);
+    uint8_t* buf = 0;
+    int r = posix_memalign((void**)&buf, DIO_BUFFER_MEMALIGN, size);
+    return r ? 0 : buf;
+}
+
+void
+dio_free(uint8_t* buf, uint64_t ticket)
+{
+    if (ticket) {
+        Slab::instance().free(buf, ticket);
+    } else if (buf) {
+        free(buf);
+    }
+}
+
+bool
+is_dio_aligned(const void* buf, size_t len, off_t pos)
+{
+    return (uintptr_t(buf) % DIO_BUFFER_MEMALIGN) == 0 && (len % DIO_BUFFER_MEMALIGN) == 0 && (pos % DIO_BUFFER_MEMALIGN) == 0;
+}
+
+/**
+ * dio_bounce_pread reads into an unaligned buffer from a file opened with O_DIRECT
+ * by reading the covering aligned range into an aligned buffer and copying out.
+ */
+ssize_t
+dio_bounce_pread(int fd, uint8_t* buf, size_t len, off_t pos)
+{
+    off_t aligned_pos = pos - (pos % DIO_BUFFER_MEMALIGN);
+    size_t head = pos - aligned_pos;
+    size_t aligned_len = ROUNDUP(head + len, size_t(DIO_BUFFER_MEMALIGN));
+    uint64_t ticket = 0;
+    uint8_t* bounce = dio_alloc(aligned_len, ticket);
+    if (!bounce) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ssize_t br = pread(fd, bounce, aligned_len, aligned_pos);
+    if (br > 0) {
+        br = br > ssize_t(head) ? std::min(size_t(br) - head, len) : 0;
+        memcpy(buf, bounce + head, br);
+    }
+    dio_free(bounce, ticket);
+    return br;
+}
+
+int64_t
+now_ms()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::shared_ptr<CachedDirFd>
+DirFdCache::lookup(const std::string& orig_path, std::string& rel)
+{
+    if (orig_path.empty() || orig_path[0] != '/') return nullptr;
+    // collapse repeated slashes so that rel never starts with '/' (which *at() treats as absolute)
+    std::string path;
+    path.reserve(orig_path.size());
+    for (char c : orig_path) {
+        if (c != '/' || path.empty() || path.back() != '/') path += c;
+    }
+    size_t end = path.size();
+    while (end > 1 && path[end - 1] == '/') end -= 1;
+    std::shared_ptr<CachedDirFd> item;
+    size_t pos = end;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_map.empty()) return nullptr;
+        while (pos > 0) {
+            pos = path.rfind('/', pos - 1);
+            if (pos == std::string::npos || pos == 0) break;
+            auto it = _map.find(path.substr(0, pos));
+            if (it != _map.end()) {
+                item = it->second;
+                break;
+            }
+        }
+    }
+    if (!item) {
+        _misses += 1;
+        return nullptr;
+    }
+    int64_t now = now_ms();
+    if (now - item->_validated_ms >= _validate_ms) {
+        struct stat st;
+        if (::stat(item->_path.c_str(), &st) || st.st_dev != item->_dev || st.st_ino != item->_ino) {
+            DBG1("FS::DirFdCache: invalidated " << DVAL(item->_path));
+            invalidate(item);
+            _misses += 1;
+            return nullptr;
+        }
+        item->_validated_ms = now;
+    }
+    item->_used_ms = now;
+    _hits += 1;
+    rel = path.substr(pos + 1);
+    return item;
+}
+
+void
+DirFdCache::_evict_lru()
+{
+    auto lru = _map.begin();
+    for (auto it = _map.begin(); it != _map.end(); ++it) {
+        if (it->second->_used_ms < lru->second->_used_ms) lru = it;
+    }
+    if (lru != _map.end()) {
+        _map.erase(lru);
+        _evictions += 1;
+    }
+}
+
+std::vector<char>&
+xattr_thread_buf(bool list)
+{
+    static thread_local std::vector<char> value_buf;
+    static thread_local std::vector<char> list_buf;
+    std::vector<char>& buf = list ? list_buf : value_buf;
+    if (buf.size() < xattr_buf_size) buf.resize(xattr_buf_size);
+    return buf;
+}
+
+void
+xattr_thread_buf_grow(std::vector<char>& buf, size_t len)
+{
+    if (len > buf.size() && len <= XATTR_BUF_MAX) buf.resize(len);
+}
+
+int
+get_single_user_xattr(int fd, std::string key, std::string& value)
+{
+    std::vector<char>& buf = xattr_thread_buf(false);
+    ssize_t value_len = fgetxattr(fd, key.c_str(), buf.data(), buf.size());
+    if (value_len >= 0) {
+        value.assign(buf.data(), value_len);
+        return 0;
+    }
+    if (errno != ERANGE) return -1;
+    // the value might change between the calls, so retry as long as we get ERANGE
+    while (true) {
+        value_len = fgetxattr(fd, key.c_str(), NULL, 0);
+        if (value_len == -1) return -1;
+        value.resize(value_len);
+        value_len = fgetxattr(fd, key.c_str(), value.data(), value.size());
+        if (value_len >= 0) break;
+        if (errno != ERANGE) return -1;
+    }
+    value.resize(value_len);
+    xattr_thread_buf_grow(buf, value_len);
+    return 0;
+}
+
+// lists the xattr names into the thread list buffer, or into the given fallback buffer when too large
+ssize_t
+list_fd_xattr(int fd, std::vector<char>& fallback, const char*& names)
+{
+    std::vector<char>& buf = xattr_thread_buf(true);
+    ssize_t buf_len = flistxattr(fd, buf.data(), buf.size());
+    if (buf_len >= 0) {
+        names = buf.data();
+        return buf_len;
+    }
+    if (errno != ERANGE) return -1;
+    while (true) {
+        buf_len = flistxattr(fd, NULL, 0);
+        if (buf_len <= 0) return buf_len;
+        fallback.resize(buf_len);
+        buf_len = flistxattr(fd, fallback.data(), fallback.size());
+        if (buf_len >= 0) break;
+        if (errno != ERANGE) return -1;
+    }
+    xattr_thread_buf_grow(buf, buf_len);
+    names = fallback.data();
+    return buf_len;
+}
+
+int
+get_fd_xattr(int fd, XattrMap& xattr, const std::vector<std::string>& xattr_keys)
+{
+    if (xattr_keys.size() > 0) { // we won't list the attributes just return the prefefined list
+        for (auto const& key : xattr_keys) {
+            std::string value;
+            int r = get_single_user_xattr(fd, key, value);
+            if (r) {
+                if (errno == ENOATTR) continue;
+                return r;
+            }
+            xattr[key] = value;
+        }
+    } else {
+        std::vector<char> fallback;
+        const char* names = 0;
+        ssize_t buf_len = list_fd_xattr(fd, fallback, names);
+        // No xattr, nothing to do
+        if (buf_len <= 0) return buf_len;
+        const char* end = names + buf_len;
+        while (names < end) {
+            std::string key(names, strnlen(names, end - names));
+            names += key.size() + 1;
+            std::string value;
+            int r = get_single_user_xattr(fd, key, value);
+            if (r) {
+                // removed after listing
+                if (errno == ENOATTR) continue;
+                return r;
+            }
+            xattr[key] = value;
+        }
+    }
+    return 0;
+}
+
+int
+write_full(int fd, const uint8_t* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = write(fd, data, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/**
+ * group_fsync syncs fd through the FsyncGroup, coalesced with the concurrent requests for the same path,
+ * or with syncfs for the same filesystem when configured.
+ * Every caller opens its own fd first, so the leader syncs with an fd the caller was allowed to open.
+ * Returns 0 or errno.
+ */
+int
+group_fsync(int fd, const std::string& path)
+{
+    FsyncGroup& group = FsyncGroup::instance();
+#ifndef __APPLE__
+    if (group.use_syncfs()) {
+        struct stat st;
+        if (fstat(fd, &st)) return errno;
+        return group.sync(XSTR() << "dev:" << st.st_dev, [fd]() { return syncfs(fd) ? errno : 0; });
+    }
+#endif
+    return group.sync(path, [fd]() { return fsync(fd) ? errno : 0; });
+}
+
+int
+stat_open_flags(bool use_lstat)
+{
+    int flags = O_RDONLY; // This default will be used only for none-lstat cases
+    // LINUX - using O_PATH with O_NOFOLLOW allow us to open the symlink itself
+    // instead of openning the file it links to https://man7.org/linux/man-pages/man7/symlink.7.html
+    // MAC - using O_SYMLINK (without O_NOFOLLOW!) allow us to open the symlink itself
+    // https://developer.apple.com/library/archive/documentation/System/Conceptual/ManPages_iPhoneOS/man2/open.2.html
+    // If O_NOFOLLOW is used in the mask and the target file passed to open() is a symbolic link then the open() will fail.
+#ifdef __APPLE__
+    if (use_lstat) flags = O_SYMLINK;
+#else
+    if (use_lstat) flags = O_PATH | O_NOFOLLOW;
+#endif
+    return flags;
+}
+
+int
+open_at(const std::string& path, int flags, mode_t mode)
+{
+    AtPath at(path);
+    return at.call([flags, mode](int dirfd, const char* p) { return openat(dirfd, p, flags, mode); });
+}
+
+int
+read_dir(const std::string& path, std::vector<Entry>& entries)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) return -1;
+    int err = 0;
+    while (true) {
+        // need to set errno before the call to readdir() to detect between EOF and error
+        errno = 0;
+        struct dirent* e = readdir(dir);
+        if (!e) {
+            err = errno;
+            break;
+        }
+        // Ignore parent and current directories
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        entries.push_back(Entry{
+            std::string(e->d_name),
+            e->d_ino,
+            e->d_type,
+            e->DIR_OFFSET_FIELD,
+        });
+    }
+    if (closedir(dir) && !err) err = errno;
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t
+read_at(int fd, int open_flags, uint8_t* buf, size_t len, off_t pos)
+{
+    if ((open_flags & DIO_OPEN_FLAG) && !is_dio_aligned(buf, len, pos)) return dio_bounce_pread(fd, buf, len, pos);
+    return pread(fd, buf, len, pos);
+}
+
+ssize_t
+write_at(int fd, const uint8_t* buf, size_t len, off_t offset)
+{
+    if (offset >= 0) return pwrite(fd, buf, len, offset);
+    return write(fd, buf, len);
+}
+
+ssize_t
+writev_full(int fd, struct iovec* iov, size_t iov_cnt, off_t offset)
+{
+    ssize_t total_bw = 0;
+    while (iov_cnt > 0) {
+        // skip empty buffers so that writing 0 bytes means no progress
+        if (iov->iov_len == 0) {
+            ++iov;
+            --iov_cnt;
+            continue;
+        }
+        const int round_cnt = std::min<size_t>(iov_cnt, IOV_MAX);
+        ssize_t bw = -1;
+        if (offset >= 0) {
+            bw = pwritev(fd, iov, round_cnt, offset);
+        } else {
+            bw = writev(fd, iov, round_cnt);
+        }
+        if (bw < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (bw == 0) break;
+        total_bw += bw;
+        if (offset >= 0) offset += bw;
+        while (iov_cnt > 0 && (size_t)bw >= iov->iov_len) {
+            bw -= iov->iov_len;
+            ++iov;
+            --iov_cnt;
+        }
+        if (bw > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + bw;
+            iov->iov_len -= bw;
+        }
+    }
+    return total_bw;
+}
+
+int
+fsync_file(int fd, const std::string& path)
+{
+    // files are only coalesced per filesystem, each file needs its own fsync otherwise
+    if (FsyncGroup::instance().enabled() && FsyncGroup::instance().use_syncfs()) return group_fsync(fd, path);
+    return fsync(fd) ? errno : 0;
+}
+
+} // namespace noobaa
@@ -0,0 +1,260 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/xattr.h>
+
+#include "../util/common.h"
+
+#define ROUNDUP(X, Y) ((Y) * (((X) + (Y) - 1) / (Y)))
+
+#ifndef __APPLE__
+    #define ENOATTR ENODATA
+#endif
+
+#ifdef __APPLE__
+    #define flistxattr(a, b, c) ::flistxattr(a, b, c, 0)
+    #define getxattr(a, b, c, d) ::getxattr(a, b, c, d, 0, 0)
+    #define fgetxattr(a, b, c, d) ::fgetxattr(a, b, c, d, 0, 0)
+    #define fsetxattr(a, b, c, d, e) ::fsetxattr(a, b, c, d, e, 0)
+    #define fremovexattr(a, b) ::fremovexattr(a, b, 0)
+#endif
+
+#ifdef __APPLE__
+typedef unsigned long long DirOffset;
+    #define DIR_OFFSET_FIELD d_seekoff
+#else
+typedef long DirOffset;
+    #define DIR_OFFSET_FIELD d_off
+#endif
+
+namespace noobaa
+{
+
+/**
+ * fs_ops are the syscall sequences of the fs workers without the N-API parts,
+ * so they can be called from the workers in fs_napi.cpp and from native tools like the fs bench
+ * (see src/native/test/fs_bench.cpp). Functions return 0 or -1 with errno unless noted otherwise.
+ */
+
+typedef std::map<std::string, std::string> XattrMap;
+
+struct Entry
+{
+    std::string name;
+    ino_t ino;
+    uint8_t type;
+    DirOffset off;
+};
+
+static const int DIO_BUFFER_MEMALIGN = 4096;
+
+#ifdef O_DIRECT
+static const int DIO_OPEN_FLAG = O_DIRECT;
+#else
+static const int DIO_OPEN_FLAG = 0;
+#endif
+
+uint8_t* dio_alloc(size_t size, uint64_t& ticket);
+void dio_free(uint8_t* buf, uint64_t ticket);
+bool is_dio_aligned(const void* buf, size_t len, off_t pos);
+ssize_t dio_bounce_pread(int fd, uint8_t* buf, size_t len, off_t pos);
+
+int64_t now_ms();
+
+/**
+ * CachedDirFd is an open directory fd that is shared by the cache and the workers using it.
+ * The fd is closed only when the last reference is released, so a worker that resolved a path
+ * through it can safely finish its *at() syscall even if the entry was evicted meanwhile.
+ */
+struct CachedDirFd
+{
+    std::string _path;
+    int _fd;
+    dev_t _dev;
+    ino_t _ino;
+    std::atomic<int64_t> _validated_ms;
+    std::atomic<int64_t> _used_ms;
+    CachedDirFd(std::string path, int fd, struct stat& st)
+        : _path(path), _fd(fd), _dev(st.st_dev), _ino(st.st_ino), _validated_ms(now_ms()), _used_ms(now_ms()) {}
+    ~CachedDirFd()
+    {
+        if (_fd >= 0) ::close(_fd);
+    }
+};
+
+/**
+ * DirFdCache is a bounded cache of open directory fds (bucket roots and hot prefixes) keyed by path.
+ * Path based fs ops resolve through the deepest cached ancestor with the *at() syscalls,
+ * which saves the kernel from walking all the path components from "/" on every call.
+ *
+ * Entries are validated by comparing the dev+ino of the path to the cached fd every validate_ms,
+ * and are invalidated immediately when a syscall through them returns ESTALE.
+ *
+ * NOTE: resolving from a cached fd skips the search permission checks on the ancestors of the
+ * cached dir, so only directories that every caller is allowed to traverse should be added.
+ */
+struct DirFdCache
+{
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<CachedDirFd>> _map;
+    size_t _max_entries = 0;
+    std::atomic<int64_t> _validate_ms{ 1000 };
+    std::atomic<int64_t> _hits{ 0 };
+    std::atomic<int64_t> _misses{ 0 };
+    std::atomic<int64_t> _evictions{ 0 };
+    std::atomic<int64_t> _invalidations{ 0 };
+
+    static std::string normalize(const std::string& path)
+    {
+        size_t end = path.size();
+        while (end > 1 && path[end - 1] == '/') end -= 1;
+        return path.substr(0, end);
+    }
+
+    bool enabled()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _max_entries > 0;
+    }
+
+    void configure(size_t max_entries, int64_t validate_ms)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _max_entries = max_entries;
+        _validate_ms = validate_ms;
+        while (_map.size() > _max_entries) _evict_lru();
+    }
+
+    // insert takes ownership of fd in any case
+    void insert(const std::string& path, int fd, struct stat& st)
+    {
+        auto item = std::make_shared<CachedDirFd>(normalize(path), fd, st);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_max_entries == 0) return;
+        if (_map.find(item->_path) == _map.end()) {
+            while (_map.size() >= _max_entries) _evict_lru();
+        }
+        _map[item->_path] = item;
+    }
+
+    void remove(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _map.erase(normalize(path));
+    }
+
+    void invalidate(const std::shared_ptr<CachedDirFd>& item)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _map.find(item->_path);
+        if (it != _map.end() && it->second == item) {
+            _map.erase(it);
+            _invalidations += 1;
+        }
+    }
+
+    /**
+     * lookup the deepest cached strict ancestor of path.
+     * On success returns the cached item and sets rel to the path relative to it.
+     */
+    std::shared_ptr<CachedDirFd> lookup(const std::string& orig_path, std::string& rel);
+
+    void _evict_lru();
+};
+
+extern DirFdCache dir_fd_cache;
+
+/**
+ * AtPath resolves a path to a (dirfd, relative path) pair for the *at() syscalls,
+ * using the deepest cached ancestor from dir_fd_cache, or AT_FDCWD with the original path.
+ * The AtPath keeps the cached fd referenced until it goes out of scope.
+ */
+struct AtPath
+{
+    const std::string& _path;
+    std::shared_ptr<CachedDirFd> _dir;
+    std::string _rel;
+    AtPath(const std::string& path)
+        : _path(path)
+    {
+        _dir = dir_fd_cache.lookup(path, _rel);
+    }
+    int fd() const { return _dir ? _dir->_fd : AT_FDCWD; }
+    const char* rel() const { return _dir ? _rel.c_str() : _path.c_str(); }
+    // on ESTALE drop the cached dir and fallback to the full path, returns true if a retry is needed
+    bool stale()
+    {
+        if (!_dir || errno != ESTALE) return false;
+        dir_fd_cache.invalidate(_dir);
+        _dir.reset();
+        return true;
+    }
+    // call fn(dirfd, relpath) with an *at() syscall, and retry once with the full path if the cached dir went stale
+    template <typename F>
+    int call(F fn)
+    {
+        int r = fn(fd(), rel());
+        if (r < 0 && stale()) r = fn(fd(), rel());
+        return r;
+    }
+};
+
+/**
+ * Xattr values and lists are read into a per-thread buffer with a single syscall,
+ * and only probe the size when the buffer is too small (ERANGE).
+ * The kernel allocates and zeroes a temporary buffer of the size we pass on every call,
+ * so the thread buffer starts at xattr_buf_size and only grows to the largest size seen up to XATTR_BUF_MAX.
+ */
+static const size_t XATTR_BUF_MAX = 64 * 1024;
+extern std::atomic<size_t> xattr_buf_size;
+
+std::vector<char>& xattr_thread_buf(bool list);
+void xattr_thread_buf_grow(std::vector<char>& buf, size_t len);
+int get_single_user_xattr(int fd, std::string key, std::string& value);
+ssize_t list_fd_xattr(int fd, std::vector<char>& fallback, const char*& names);
+int get_fd_xattr(int fd, XattrMap& xattr, const std::vector<std::string>& xattr_keys);
+
+int write_full(int fd, const uint8_t* data, size_t len);
+
+// see fs_ops.cpp, returns 0 or errno
+int group_fsync(int fd, const std::string& path);
+
+// the open flags of Stat, which opens the symlink itself with use_lstat
+int stat_open_flags(bool use_lstat);
+
+// open path (through the dir fd cache), returns the fd or -1 with errno
+int open_at(const std::string& path, int flags, mode_t mode = 0);
+
+// read the entries of a directory without "." and ".."
+int read_dir(const std::string& path, std::vector<Entry>& entries);
+
+// pread that bounces unaligned buffers of files opened with O_DIRECT, returns the bytes read or -1 with errno
+ssize_t read_at(int fd, int open_flags, uint8_t* buf, size_t len, off_t pos);
+
+// pwrite at offset, or write at the file position when offset < 0, returns the bytes written or -1 with errno
+ssize_t write_at(int fd, const uint8_t* buf, size_t len, off_t offset);
+
+/**
+ * writev_full writes all the buffers in rounds of up to IOV_MAX buffers, resuming each round
+ * from where a partial write stopped, and modifies iov accordingly.
+ * Returns the bytes written, which is less than the total only when a round wrote nothing, or -1 with errno.
+ */
+ssize_t writev_full(int fd, struct iovec* iov, size_t iov_cnt, off_t offset);
+
+// fsync a file, through the FsyncGroup when it coalesces by filesystem, returns 0 or errno
+int fsync_file(int fd, const std::string& path);
+
+} // namespace noobaa
@@ -0,0 +1,423 @@
+/* Copyright (C) 2016 NooBaa */
+#include "log_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+// how many times to reopen the active file when it was replaced while we were locking it
+static const int OPEN_RETRIES = 10;
+static const int IDLE_WAKEUP_MS = 1000;
+
+static int64_t
+now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+static size_t
+round_up_pow2(size_t n)
+{
+    size_t p = 4096;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// sets the fcntl lock of the active file, F_UNLCK releases it
+static int
+set_file_lock(int fd, short type, bool wait)
+{
+    struct flock fl = {};
+    fl.l_whence = SEEK_SET;
+    fl.l_type = type;
+#ifdef F_OFD_SETLKW
+    return fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl);
+#else
+    return fcntl(fd, wait ? F_SETLKW : F_SETLK, &fl);
+#endif
+}
+
+LogWriter::LogWriter(const Config& config)
+    : _config(config)
+{
+    _cap = round_up_pow2(_config.buffer_size);
+    _ring.reset(new uint8_t[_cap]);
+    if (_config.flush_size > _cap / 2) _config.flush_size = _cap / 2;
+    if (_config.flush_interval_ms <= 0) _config.flush_interval_ms = 1;
+}
+
+LogWriter::~LogWriter()
+{
+    close();
+}
+
+std::string
+LogWriter::_active_path() const
+{
+    return _config.dir + "/" + _config.ns + ".log";
+}
+
+int
+LogWriter::open()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_running) return 0;
+    int err = _open_file();
+    if (err) return err;
+    _stop = false;
+    _error = 0;
+    _running = true;
+    _flusher = std::thread(&LogWriter::_flusher_main, this);
+    return 0;
+}
+
+int
+LogWriter::close()
+{
+    std::thread flusher;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_running) return 0;
+        _stop = true;
+        _flusher_cond.notify_one();
+        flusher = std::move(_flusher);
+    }
+    // the flusher writes the pending records before it exits
+    flusher.join();
+    std::unique_lock<std::mutex> lock(_mutex);
+    _running = false;
+    _flushed_cond.notify_all();
+    _close_file();
+    return _committed.load() == _consumed.load() ? 0 : _error ? _error : EIO;
+}
+
+/**
+ * Opens the active file the same way as native_fs_utils.open_with_lock() -
+ * the file might be renamed by the log processor between the open and the lock,
+ * so after locking we check that the path still refers to the file we locked.
+ */
+int
+LogWriter::_open_file()
+{
+    const std::string path = _active_path();
+    for (int i = 0; i < OPEN_RETRIES; ++i) {
+        int fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0) return errno;
+        if (_config.lock != LOCK_NONE) {
+            int r = set_file_lock(fd, _config.lock == LOCK_EXCLUSIVE ? F_WRLCK : F_RDLCK, true);
+            if (r) {
+                int err = errno;
+                ::close(fd);
+                return err;
+            }
+        }
+        struct stat fd_st;
+        struct stat path_st;
+        if (fstat(fd, &fd_st)) {
+            int err = errno;
+            ::close(fd);
+            return err;
+        }
+        if (stat(path.c_str(), &path_st) == 0 && path_st.st_ino == fd_st.st_ino && fd_st.st_nlink > 0) {
+            _fd = fd;
+            _file_size = fd_st.st_size;
+            _file_open_ms = now_ms();
+            _last_check_ms = _file_open_ms;
+            return 0;
+        }
+        ::close(fd);
+    }
+    LOG("LogWriter: failed to open and lock the active file " << DVAL(path));
+    return EAGAIN;
+}
+
+void
+LogWriter::_close_file()
+{
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+}
+
+int
+LogWriter::append(const void* data, size_t len, uint64_t& seq)
+{
+    if (len == 0) return EINVAL;
+    if (len > _cap) return EMSGSIZE;
+
+    // reserve [pos, pos + len) in the ring
+    uint64_t pos = _reserved.load(std::memory_order_relaxed);
+    do {
+        if (pos + len - _consumed.load(std::memory_order_acquire) > _cap) {
+            _full_errors.fetch_add(1, std::memory_order_relaxed);
+            return ENOBUFS;
+        }
+    } while (!_reserved.compare_exchange_weak(pos, pos + len, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    // copy, wrapping around the end of the ring
+    size_t off = pos & (_cap - 1);
+    size_t first = std::min(len, _cap - off);
+    memcpy(_ring.get() + off, data, first);
+    if (first < len) memcpy(_ring.get(), (const uint8_t*)data + first, len - first);
+
+    // publish in reservation order, so the flusher never sees a gap of a record that is still being copied.
+    // the wait is only for producers that reserved just before us and are in the middle of their memcpy.
+    uint64_t expected = pos;
+    while (!_committed.compare_exchange_weak(expected, pos + len, std::memory_order_release, std::memory_order_relaxed)) {
+        expected = pos;
+        std::this_thread::yield();
+    }
+    _appended_records.fetch_add(1, std::memory_order_relaxed);
+    seq = pos + len;
+
+    // wake the flusher when the ring becomes non empty or crosses flush_size,
+    // so the lock is only taken once per batch and not for every record
+    uint64_t consumed = _consumed.load(std::memory_order_relaxed);
+    if (pos == consumed || (pos - consumed < _config.flush_size && seq - consumed >= _config.flush_size)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flusher_cond.notify_one();
+    }
+    return 0;
+}
+
+int
+LogWriter::flush(uint64_t& flushed)
+{
+    uint64_t target = _committed.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_running) {
+        flushed = _consumed.load();
+        return flushed >= target ? 0 : EBADF;
+    }
+    _flush_requested = true;
+    _flusher_cond.notify_one();
+    // a failed flush is retried by the flusher, but callers get the error instead of waiting for a recovery
+    uint64_t errors = _stats.flush_errors;
+    _flushed_cond.wait(lock, [&] {
+        return _consumed.load() >= target || _stats.flush_errors != errors || !_running;
+    });
+    flushed = _consumed.load();
+    if (flushed >= target) return 0;
+    return _error ? _error : EIO;
+}
+
+void
+LogWriter::_flusher_main()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        // sleep while idle (waking up for the rotation and reopen checks),
+        // and once records are pending wait up to flush_interval_ms for more records to batch
+        _flusher_cond.wait_for(lock, std::chrono::milliseconds(IDLE_WAKEUP_MS), [this] {
+            return _stop || _flush_requested || _committed.load() != _consumed.load();
+        });
+        _flusher_cond.wait_for(lock, std::chrono::milliseconds(_config.flush_interval_ms), [this] {
+            return _stop || _flush_requested || _committed.load() - _consumed.load() >= _config.flush_size;
+        });
+        bool stop = _stop;
+        _flush_requested = false;
+        lock.unlock();
+        int err = _flush_pending();
+        lock.lock();
+        if (err) _error = err;
+        _flushed_cond.notify_all();
+        if (stop) break;
+    }
+}
+
+/**
+ * Writes [_consumed, _committed) to the active file. Runs only on the flusher thread.
+ */
+int
+LogWriter::_flush_pending()
+{
+    int64_t now = now_ms();
+    int err = _check_active_file(now);
+    uint64_t begin = _consumed.load(std::memory_order_relaxed);
+    uint64_t end = _committed.load(std::memory_order_acquire);
+    if (err || begin == end) {
+        if (err) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stats.flush_errors += 1;
+            _stats.last_error = err;
+        }
+        return err;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t written = 0;
+    err = _write_range(begin, end, written);
+    if (!err && _config.fsync && fdatasync(_fd)) err = errno;
+    _file_size += written;
+    // written bytes are released even if the sync failed - writing them again would duplicate records,
+    // and the error is returned to the flush() callers
+    _consumed.store(begin + written, std::memory_order_release);
+    auto took_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.flushes += 1;
+    _stats.flushed_bytes += written;
+    if (_config.fsync && !err) _stats.fsyncs += 1;
+    _stats.max_backlog_bytes = std::max<uint64_t>(_stats.max_backlog_bytes, end - begin);
+    _stats.flush_time_us += took_us;
+    _stats.max_flush_time_us = std::max<uint64_t>(_stats.max_flush_time_us, took_us);
+    if (err) {
+        _stats.flush_errors += 1;
+        _stats.last_error = err;
+        LOG("LogWriter: flush failed " << DVAL(_active_path()) << DVAL(strerror(err)));
+    }
+    return err;
+}
+
+int
+LogWriter::_write_range(uint64_t begin, uint64_t end, uint64_t& written)
+{
+    struct iovec iov[2];
+    int iovcnt = 0;
+    size_t off = begin & (_cap - 1);
+    size_t len = end - begin;
+    size_t first = std::min(len, _cap - off);
+    iov[iovcnt++] = { _ring.get() + off, first };
+    if (first < len) iov[iovcnt++] = { _ring.get(), len - first };
+
+    struct iovec* p = iov;
+    while (iovcnt > 0) {
+        ssize_t n = writev(_fd, p, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (n == 0) return EIO;
+        written += n;
+        while (iovcnt > 0 && size_t(n) >= p->iov_len) {
+            n -= p->iov_len;
+            ++p;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            p->iov_base = (uint8_t*)p->iov_base + n;
+            p->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reopens the active file if the log processor renamed or removed it,
+ * and rotates it when it reached the configured size or age.
+ */
+int
+LogWriter::_check_active_file(int64_t now)
+{
+    if (_fd < 0) return _reopen_file();
+    bool rotate = _file_size > 0 && now >= _rotate_retry_ms &&
+        ((_config.rotate_size && _file_size >= _config.rotate_size) ||
+            (_config.rotate_age_ms && now - _file_open_ms >= _config.rotate_age_ms));
+    bool check = rotate || (_config.reopen_check_ms && now - _last_check_ms >= _config.reopen_check_ms);
+    if (!check) return 0;
+    _last_check_ms = now;
+
+    struct stat fd_st;
+    struct stat path_st;
+    bool replaced = fstat(_fd, &fd_st) || stat(_active_path().c_str(), &path_st) || path_st.st_ino != fd_st.st_ino;
+    if (!replaced && rotate) {
+        int err = _rotate();
+        // other writers hold the file - keep writing to it and try again on the next check
+        if (err == EAGAIN) {
+            _rotate_retry_ms = now + IDLE_WAKEUP_MS;
+            return 0;
+        }
+        if (err) return err;
+    }
+    if (replaced || rotate) return _reopen_file();
+    return 0;
+}
+
+int
+LogWriter::_reopen_file()
+{
+    _close_file();
+    // opening might wait for the lock, so it is done without holding the mutex
+    int err = _open_file();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.reopens += 1;
+    return err;
+}
+
+/**
+ * Moves the active file to an inactive name that the log processor picks up.
+ * Rotation needs an exclusive lock of the active file - with a shared lock the lock is upgraded
+ * without waiting, so while other writers hold the file it is not rotated, and is checked again later.
+ * The file is linked through our fd and not by the path, and the path is unlinked only if it still
+ * refers to our file, so a writer never rotates a file that another writer already replaced.
+ * link() fails on an existing name, so two writers rotating in the same millisecond
+ * never overwrite each other's file like rename() would.
+ * Returns EAGAIN when the file is not rotated because of other writers.
+ */
+int
+LogWriter::_rotate()
+{
+    if (_config.lock != LOCK_EXCLUSIVE && set_file_lock(_fd, F_WRLCK, false)) {
+        return errno == EACCES || errno == EAGAIN ? EAGAIN : errno;
+    }
+    int err = 0;
+    const std::string path = _active_path();
+    const std::string fd_path = "/proc/self/fd/" + std::to_string(_fd);
+    auto is_active_path = [&]() {
+        struct stat fd_st;
+        struct stat path_st;
+        return fstat(_fd, &fd_st) == 0 && stat(path.c_str(), &path_st) == 0 &&
+            path_st.st_ino == fd_st.st_ino && path_st.st_dev == fd_st.st_dev;
+    };
+    for (int64_t ms = now_ms();; ++ms) {
+        std::string inactive = _config.dir + "/" + _config.ns + "." + std::to_string(ms) + ".log";
+        int r = linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, inactive.c_str(), AT_SYMLINK_FOLLOW);
+        // without /proc (macOS) link the path, after checking that it still refers to our file
+        if (r && errno == ENOENT && is_active_path()) r = link(path.c_str(), inactive.c_str());
+        if (r == 0) break;
+        if (errno != EEXIST) {
+            err = errno;
+            break;
+        }
+    }
+    if (!err && is_active_path() && unlink(path.c_str()) && errno != ENOENT) err = errno;
+    // the file is reopened after a rotation, which takes the configured lock again
+    if (err && _config.lock != LOCK_EXCLUSIVE) {
+        set_file_lock(_fd, _config.lock == LOCK_SHARED ? F_RDLCK : F_UNLCK, false);
+    }
+    if (err) return err;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.rotations += 1;
+    return 0;
+}
+
+LogWriter::Stats
+LogWriter::stats(bool reset)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats s = _stats;
+    s.appended_records = _appended_records.load();
+    s.appended_bytes = _committed.load();
+    s.full_errors = _full_errors.load();
+    s.backlog_bytes = s.appended_bytes - _consumed.load();
+    if (reset) {
+        _stats = Stats();
+        _appended_records = 0;
+        _full_errors = 0;
+    }
+    return s;
+}
+
+} // namespace noobaa
@@ -0,0 +1,137 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../util/common.h"
+
+namespace noobaa
+{
+
+/**
+ * LogWriter appends newline separated records to the active file of a persistent log
+ * (<dir>/<namespace>.log, see util/persistent_logger.js) from an in-memory ring buffer.
+ *
+ * append() only copies the record to the ring, so it is cheap enough to call synchronously from JS.
+ * Producers reserve ring space with an atomic compare-and-swap and publish in reservation order,
+ * so multiple threads can append without taking a lock.
+ * A flusher thread writes the pending bytes with writev when flush_size bytes are pending,
+ * every flush_interval_ms, or when flush() is called, and fdatasync's each batch when fsync is set,
+ * so all the records of a batch share a single write and sync (group commit).
+ *
+ * The active file is opened with the configured fcntl lock. The flusher reopens it when it was
+ * renamed or removed by the log processor, and rotates it to <namespace>.<ms>.log by size or age
+ * (only under an exclusive lock, so a shared file is rotated by the last writer that holds it).
+ */
+class LogWriter
+{
+public:
+    enum Lock
+    {
+        LOCK_NONE,
+        LOCK_SHARED,
+        LOCK_EXCLUSIVE,
+    };
+
+    struct Config
+    {
+        std::string dir;
+        std::string ns;
+        Lock lock = LOCK_NONE;
+        // rounded up to a power of 2
+        size_t buffer_size = 16 * 1024 * 1024;
+        size_t flush_size = 256 * 1024;
+        int flush_interval_ms = 5;
+        bool fsync = true;
+        // rotate the active file when it reaches this size or age (0 to disable)
+        uint64_t rotate_size = 0;
+        int64_t rotate_age_ms = 0;
+        // check that the active file was not renamed or removed (0 to disable)
+        int64_t reopen_check_ms = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t appended_records = 0;
+        uint64_t appended_bytes = 0;
+        uint64_t full_errors = 0;
+        uint64_t flushes = 0;
+        uint64_t flushed_bytes = 0;
+        uint64_t flush_errors = 0;
+        uint64_t fsyncs = 0;
+        uint64_t rotations = 0;
+        uint64_t reopens = 0;
+        uint64_t backlog_bytes = 0;
+        uint64_t max_backlog_bytes = 0;
+        uint64_t flush_time_us = 0;
+        uint64_t max_flush_time_us = 0;
+        int last_error = 0;
+    };
+
+    explicit LogWriter(const Config& config);
+    ~LogWriter();
+
+    // opens and locks the active file and starts the flusher
+    int open();
+    // flushes the pending records, stops the flusher and closes the file
+    int close();
+
+    /**
+     * Copies the record to the ring buffer and sets seq to its end position in the log stream.
+     * Returns ENOBUFS when the ring is full, and the caller should flush() and retry.
+     */
+    int append(const void* data, size_t len, uint64_t& seq);
+
+    // waits until all the records appended before the call are written (and synced), and sets the flushed position
+    int flush(uint64_t& flushed);
+
+    Stats stats(bool reset);
+    const Config& config() const { return _config; }
+
+private:
+    std::string _active_path() const;
+    int _open_file();
+    void _close_file();
+    int _reopen_file();
+    void _flusher_main();
+    int _flush_pending();
+    int _write_range(uint64_t begin, uint64_t end, uint64_t& written);
+    int _check_active_file(int64_t now_ms);
+    int _rotate();
+
+    Config _config;
+    std::unique_ptr<uint8_t[]> _ring;
+    size_t _cap = 0;
+
+    // ring positions grow forever and are masked into the ring:
+    // _consumed <= _committed <= _reserved, where [_consumed, _committed) is ready to be written
+    std::atomic<uint64_t> _reserved{ 0 };
+    std::atomic<uint64_t> _committed{ 0 };
+    std::atomic<uint64_t> _consumed{ 0 };
+    std::atomic<uint64_t> _appended_records{ 0 };
+    std::atomic<uint64_t> _full_errors{ 0 };
+
+    // only accessed by the flusher thread (or by open/close while it is not running)
+    int _fd = -1;
+    uint64_t _file_size = 0;
+    int64_t _file_open_ms = 0;
+    int64_t _last_check_ms = 0;
+    int64_t _rotate_retry_ms = 0;
+
+    std::mutex _mutex;
+    std::condition_variable _flusher_cond;
+    std::condition_variable _flushed_cond;
+    std::thread _flusher;
+    bool _running = false;
+    bool _stop = false;
+    bool _flush_requested = false;
+    int _error = 0;
+    Stats _stats;
+};
+
+} // namespace noobaa
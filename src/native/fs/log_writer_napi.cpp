@@ -0,0 +1,258 @@
+/* Copyright (C) 2016 NooBaa */
+#include "../util/common.h"
+#include "../util/napi.h"
+#include "../util/worker.h"
+#include "log_writer.h"
+
+#include <uv.h>
+
+namespace noobaa
+{
+
+DBG_INIT(0);
+
+/**
+ * LogWriterNapi is a napi object wrapper for LogWriter.
+ * append() and stats() are synchronous, the rest run on the libuv threadpool and return a promise.
+ */
+struct LogWriterNapi : public Napi::ObjectWrap<LogWriterNapi>
+{
+    static Napi::FunctionReference constructor;
+    std::shared_ptr<LogWriter> _writer;
+
+    static Napi::Function Init(Napi::Env env);
+    LogWriterNapi(const Napi::CallbackInfo& info);
+    Napi::Value open(const Napi::CallbackInfo& info);
+    Napi::Value close(const Napi::CallbackInfo& info);
+    Napi::Value append(const Napi::CallbackInfo& info);
+    Napi::Value flush(const Napi::CallbackInfo& info);
+    Napi::Value stats(const Napi::CallbackInfo& info);
+};
+
+Napi::FunctionReference LogWriterNapi::constructor;
+
+Napi::Function
+LogWriterNapi::Init(Napi::Env env)
+{
+    constructor = Napi::Persistent(DefineClass(env,
+        "LogWriter",
+        {
+            InstanceMethod<&LogWriterNapi::open>("open"),
+            InstanceMethod<&LogWriterNapi::close>("close"),
+            InstanceMethod<&LogWriterNapi::append>("append"),
+            InstanceMethod<&LogWriterNapi::flush>("flush"),
+            InstanceMethod<&LogWriterNapi::stats>("stats"),
+        }));
+    constructor.SuppressDestruct();
+    return constructor.Value();
+}
+
+static Napi::Error
+log_writer_error(Napi::Env env, const std::string& desc, int err)
+{
+    auto error = Napi::Error::New(env, XSTR() << desc << ": " << strerror(err));
+    error.Set("code", Napi::String::New(env, uv_err_name(uv_translate_sys_error(err))));
+    return error;
+}
+
+/**
+ * new LogWriter({ dir, namespace, lock, buffer_size, flush_size, flush_interval_ms,
+ *                 fsync, rotate_size, rotate_age_ms, reopen_check_ms })
+ */
+LogWriterNapi::LogWriterNapi(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<LogWriterNapi>(info)
+{
+    auto env = info.Env();
+    if (!info[0].IsObject()) {
+        throw Napi::TypeError::New(env, "LogWriter: expected params object");
+    }
+    auto params = info[0].As<Napi::Object>();
+    if (!params.Get("dir").IsString() || !params.Get("namespace").IsString()) {
+        throw Napi::TypeError::New(env, "LogWriter: expected params.dir and params.namespace");
+    }
+    LogWriter::Config config;
+    config.dir = napi_get_str(params, "dir");
+    config.ns = napi_get_str(params, "namespace");
+    auto lock = napi_get_str_or(params, "lock", "");
+    if (lock == "SHARED") {
+        config.lock = LogWriter::LOCK_SHARED;
+    } else if (lock == "EXCLUSIVE") {
+        config.lock = LogWriter::LOCK_EXCLUSIVE;
+    } else if (!lock.empty()) {
+        throw Napi::TypeError::New(env, "LogWriter: invalid lock type " + lock);
+    }
+    config.buffer_size = napi_get_i64_or(params, "buffer_size", config.buffer_size);
+    config.flush_size = napi_get_i64_or(params, "flush_size", config.flush_size);
+    config.flush_interval_ms = napi_get_i32_or(params, "flush_interval_ms", config.flush_interval_ms);
+    if (params.Has("fsync")) config.fsync = params.Get("fsync").ToBoolean();
+    config.rotate_size = napi_get_i64_or(params, "rotate_size", config.rotate_size);
+    config.rotate_age_ms = napi_get_i64_or(params, "rotate_age_ms", config.rotate_age_ms);
+    config.reopen_check_ms = napi_get_i64_or(params, "reopen_check_ms", config.reopen_check_ms);
+    _writer = std::make_shared<LogWriter>(config);
+    DBG1("LogWriterNapi::ctor " << DVAL(config.dir) << DVAL(config.ns) << DVAL(config.buffer_size) << DVAL(config.fsync));
+}
+
+/**
+ * LogWriterWorker is the base worker of the async LogWriter methods.
+ * It keeps the writer alive for the worker lifetime, and rejects with an error code like the fs module.
+ */
+struct LogWriterWorker : public ObjectWrapWorker<LogWriterNapi>
+{
+    std::shared_ptr<LogWriter> _writer;
+    std::string _desc;
+    int _errno;
+
+    LogWriterWorker(const Napi::CallbackInfo& info)
+        : ObjectWrapWorker<LogWriterNapi>(info)
+        , _writer(_wrap->_writer)
+        , _errno(0)
+    {
+    }
+    void Begin(std::string desc)
+    {
+        _desc = desc;
+        DBG1("LogWriterWorker::Begin: " << _desc);
+    }
+    void SetErrno(int err)
+    {
+        _errno = err;
+        SetError(XSTR() << _desc << ": " << strerror(err));
+    }
+    virtual void OnError(Napi::Error const& error) override
+    {
+        auto env = Env();
+        DBG1("LogWriterWorker::OnError: " << _desc << " " << DVAL(error.Message()));
+        auto obj = error.Value();
+        if (_errno) obj.Set("code", Napi::String::New(env, uv_err_name(uv_translate_sys_error(_errno))));
+        _promise.Reject(obj);
+    }
+};
+
+struct LogWriterOpen : public LogWriterWorker
+{
+    LogWriterOpen(const Napi::CallbackInfo& info)
+        : LogWriterWorker(info)
+    {
+        Begin(XSTR() << "LogWriter::open " << _writer->config().dir << "/" << _writer->config().ns);
+    }
+    virtual void Execute() override
+    {
+        int err = _writer->open();
+        if (err) SetErrno(err);
+    }
+};
+
+struct LogWriterClose : public LogWriterWorker
+{
+    LogWriterClose(const Napi::CallbackInfo& info)
+        : LogWriterWorker(info)
+    {
+        Begin(XSTR() << "LogWriter::close " << _writer->config().dir << "/" << _writer->config().ns);
+    }
+    virtual void Execute() override
+    {
+        int err = _writer->close();
+        if (err) SetErrno(err);
+    }
+};
+
+struct LogWriterFlush : public LogWriterWorker
+{
+    uint64_t _flushed;
+    LogWriterFlush(const Napi::CallbackInfo& info)
+        : LogWriterWorker(info)
+        , _flushed(0)
+    {
+        Begin(XSTR() << "LogWriter::flush " << _writer->config().dir << "/" << _writer->config().ns);
+    }
+    virtual void Execute() override
+    {
+        int err = _writer->flush(_flushed);
+        if (err) SetErrno(err);
+    }
+    virtual void OnOK() override
+    {
+        _promise.Resolve(Napi::Number::New(Env(), _flushed));
+    }
+};
+
+Napi::Value
+LogWriterNapi::open(const Napi::CallbackInfo& info)
+{
+    return await_worker<LogWriterOpen>(info);
+}
+
+Napi::Value
+LogWriterNapi::close(const Napi::CallbackInfo& info)
+{
+    return await_worker<LogWriterClose>(info);
+}
+
+/**
+ * append(data: string | Buffer) => seq
+ * Copies the record to the ring buffer and returns its end position in the log,
+ * which is covered by any flush() that resolves with a position >= seq.
+ * Throws with code ENOBUFS when the buffer is full, which requires to flush() and retry.
+ */
+Napi::Value
+LogWriterNapi::append(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+    uint64_t seq = 0;
+    int err = 0;
+    if (info[0].IsBuffer()) {
+        auto buf = info[0].As<Napi::Buffer<uint8_t>>();
+        err = _writer->append(buf.Data(), buf.Length(), seq);
+    } else if (info[0].IsString()) {
+        std::string str = info[0].As<Napi::String>().Utf8Value();
+        err = _writer->append(str.data(), str.size(), seq);
+    } else {
+        throw Napi::TypeError::New(env, "LogWriter.append: expected string or buffer");
+    }
+    if (err) throw log_writer_error(env, "LogWriter.append", err);
+    return Napi::Number::New(env, seq);
+}
+
+/**
+ * flush() => flushed position
+ */
+Napi::Value
+LogWriterNapi::flush(const Napi::CallbackInfo& info)
+{
+    return await_worker<LogWriterFlush>(info);
+}
+
+/**
+ * stats({ reset }) => counters and flush latency
+ */
+Napi::Value
+LogWriterNapi::stats(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+    bool reset = info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean();
+    LogWriter::Stats s = _writer->stats(reset);
+    auto res = Napi::Object::New(env);
+    res["appended_records"] = Napi::Number::New(env, s.appended_records);
+    res["appended_bytes"] = Napi::Number::New(env, s.appended_bytes);
+    res["full_errors"] = Napi::Number::New(env, s.full_errors);
+    res["flushes"] = Napi::Number::New(env, s.flushes);
+    res["flushed_bytes"] = Napi::Number::New(env, s.flushed_bytes);
+    res["flush_errors"] = Napi::Number::New(env, s.flush_errors);
+    res["fsyncs"] = Napi::Number::New(env, s.fsyncs);
+    res["rotations"] = Napi::Number::New(env, s.rotations);
+    res["reopens"] = Napi::Number::New(env, s.reopens);
+    res["backlog_bytes"] = Napi::Number::New(env, s.backlog_bytes);
+    res["max_backlog_bytes"] = Napi::Number::New(env, s.max_backlog_bytes);
+    res["flush_time_ms"] = Napi::Number::New(env, s.flush_time_us / 1000.0);
+    res["max_flush_time_ms"] = Napi::Number::New(env, s.max_flush_time_us / 1000.0);
+    if (s.last_error) res["last_error"] = Napi::String::New(env, uv_err_name(uv_translate_sys_error(s.last_error)));
+    return res;
+}
+
+void
+log_writer_napi(Napi::Env env, Napi::Object exports)
+{
+    exports["LogWriter"] = LogWriterNapi::Init(env);
+}
+
+} // namespace noobaa
@@ -10,6 +10,9 @@ void syslog_napi(Napi::Env env, Napi::Object exports);
 void splitter_napi(Napi::Env env, Napi::Object exports);
 void chunk_coder_napi(napi_env env, napi_value exports);
 void fs_napi(Napi::Env env, Napi::Object exports);
+void log_writer_napi(Napi::Env env, Napi::Object exports);
+void bucket_index_napi(Napi::Env env, Napi::Object exports);
+void block_log_napi(Napi::Env env, Napi::Object exports);
 void crypto_napi(Napi::Env env, Napi::Object exports);
 void cuobj_server_napi(Napi::Env env, Napi::Object exports);
 void cuobj_client_napi(Napi::Env env, Napi::Object exports);
@@ -28,6 +31,9 @@ nb_native_napi(Napi::Env env, Napi::Object exports)
     splitter_napi(env, exports);
     chunk_coder_napi(env, exports);
     fs_napi(env, exports);
+    log_writer_napi(env, exports);
+    bucket_index_napi(env, exports);
+    block_log_napi(env, exports);
     crypto_napi(env, exports);
     cuobj_server_napi(env, exports);
     cuobj_client_napi(env, exports);
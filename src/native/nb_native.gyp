@@ -66,6 +66,10 @@
             'util/struct_buf.cpp',
             'util/common.h',
             'util/common.cpp',
+            'util/fsync_group.h',
+            'util/fsync_group.cpp',
+            'util/latency_stats.h',
+            'util/latency_stats.cpp',
             'util/napi.h',
             'util/napi.cpp',
             'util/os.h',
@@ -73,13 +77,31 @@
             'util/os_darwin.cpp',
             'util/rabin.h',
             'util/rabin.cpp',
+            'util/slab.h',
+            'util/slab.cpp',
             'util/snappy.h',
             'util/snappy.cpp',
             'util/worker.h',
+            'util/worker_pool.h',
+            'util/worker_pool.cpp',
             'util/zlib.h',
             'util/zlib.cpp',
             # fs
             'fs/fs_napi.cpp',
+            'fs/fs_ops.h',
+            'fs/fs_ops.cpp',
+            'fs/config_cache.h',
+            'fs/config_cache.cpp',
+            'fs/log_writer.h',
+            'fs/log_writer.cpp',
+            'fs/log_writer_napi.cpp',
+            'fs/bucket_index.h',
+            'fs/bucket_index.cpp',
+            'fs/bucket_index_napi.cpp',
+            # block store
+            'block_store/block_log.h',
+            'block_store/block_log.cpp',
+            'block_store/block_log_napi.cpp',
             # cuobj/cuda
             'cuobj/cuobj_server_napi.cpp',
             'cuobj/cuobj_client_napi.cpp',
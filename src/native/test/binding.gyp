@@ -10,5 +10,22 @@
             '../util/os_linux.cpp',
             '../util/os_darwin.cpp',
         ],
+    }, {
+        'target_name': 'fs_bench',
+        'type': 'executable',
+        'sources': [
+            'fs_bench.cpp',
+            '../fs/fs_ops.h',
+            '../fs/fs_ops.cpp',
+            '../util/common.h',
+            '../util/common.cpp',
+            '../util/fsync_group.h',
+            '../util/fsync_group.cpp',
+            '../util/os.h',
+            '../util/os_linux.cpp',
+            '../util/os_darwin.cpp',
+            '../util/slab.h',
+            '../util/slab.cpp',
+        ],
     }],
 }
@@ -0,0 +1,424 @@
+/*
+ * fs_bench is a micro-benchmark of the native fs ops, which runs the same fs_ops functions
+ * as the fs workers (see fs/fs_ops.h) on native threads against a local directory,
+ * so the measured latency does not include the N-API and libuv costs of every op.
+ * Comparing it with the same ops from JS (see src/tools/fs_speed.js) separates the syscall,
+ * uid switching, xattr and N-API costs.
+ *
+ * Every thread picks ops by their weights in a loop, until the time passed or it ran --ops ops.
+ * With --switch_user every op sets and restores the user like FSWorker::Execute(),
+ * otherwise the threads run as that user for the whole benchmark.
+ *
+ * Usage:
+ * $ node-gyp -C src/native/test/ rebuild
+ * $ src/native/test/build/Release/fs_bench --dir /mnt/fs/bench --threads 16 --mix stat:8,read:1,xattr:1 --compare
+ *
+ *  --dir <path>          (default "./fs_bench_output") directory to run in
+ *  --time <sec>          (default 5) limit time to run
+ *  --ops <n>             (default unlimited) limit the number of ops per thread instead of time
+ *  --threads <n>         (default 1) number of threads
+ *  --mix <op:w,...>      (default "stat:1") op weights, ops are stat, open, read, write, writev, fsync, readdir, xattr
+ *  --files <n>           (default 100) number of files to stat/open/read
+ *  --file_size <n>       (default 64) file size in KB
+ *  --io_size <n>         (default 4) read/write size in KB
+ *  --nvec <n>            (default 4) number of buffers for writev
+ *  --xattrs <n>          (default 4) number of user xattrs per file
+ *  --uid <n> --gid <n>   (default is the process user) user to run the ops as
+ *  --switch_user         set and restore the user on every op like the fs workers do
+ *  --compare             run once without and once with --switch_user
+ *  --keep                keep the files
+ */
+#include "../fs/fs_ops.h"
+#include "../util/common.h"
+#include "../util/os.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <thread>
+
+using namespace noobaa;
+
+/**
+ * BenchHist is a log-linear histogram of latencies in nanoseconds with 32 sub-buckets per power of 2,
+ * which bounds the error of the reported percentiles to ~3%.
+ */
+struct BenchHist
+{
+    static const int SUB_BITS = 5;
+    static const int SUB = 1 << SUB_BITS;
+    static const int NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB;
+    uint64_t count = 0;
+    uint64_t errors = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(NUM_BUCKETS);
+
+    static int bucket_of(uint64_t ns)
+    {
+        if (ns < SUB) return ns;
+        int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+        return (shift + 1) * SUB + ((ns >> shift) & (SUB - 1));
+    }
+    static uint64_t bucket_upper_bound(int b)
+    {
+        if (b < SUB) return b;
+        int shift = b / SUB - 1;
+        return ((uint64_t(SUB + b % SUB) << shift) + (uint64_t(1) << shift) - 1);
+    }
+    void add(uint64_t ns)
+    {
+        count += 1;
+        sum_ns += ns;
+        max_ns = std::max(max_ns, ns);
+        buckets[bucket_of(ns)] += 1;
+    }
+    void merge(const BenchHist& h)
+    {
+        count += h.count;
+        errors += h.errors;
+        sum_ns += h.sum_ns;
+        max_ns = std::max(max_ns, h.max_ns);
+        for (int i = 0; i < NUM_BUCKETS; ++i) buckets[i] += h.buckets[i];
+    }
+    uint64_t percentile(double p) const
+    {
+        if (!count) return 0;
+        uint64_t target = std::max<uint64_t>(1, uint64_t(ceil(p * count)));
+        uint64_t sum = 0;
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            sum += buckets[i];
+            if (sum >= target) return std::min(bucket_upper_bound(i), max_ns);
+        }
+        return max_ns;
+    }
+};
+
+enum Op
+{
+    BENCH_STAT,
+    BENCH_OPEN,
+    BENCH_READ,
+    BENCH_WRITE,
+    BENCH_WRITEV,
+    BENCH_FSYNC,
+    BENCH_READDIR,
+    BENCH_XATTR,
+    BENCH_OPS_COUNT,
+};
+
+static const char* OP_NAMES[BENCH_OPS_COUNT] = { "stat", "open", "read", "write", "writev", "fsync", "readdir", "xattr" };
+
+struct ThreadResult
+{
+    BenchHist hists[BENCH_OPS_COUNT];
+    int first_error = 0;
+};
+
+struct FsBench
+{
+    std::string _dir = "fs_bench_output";
+    int _threads = 1;
+    int64_t _duration_ms = 5000;
+    int64_t _ops_per_thread = 0;
+    double _weights[BENCH_OPS_COUNT] = { 1 };
+    int _files = 100;
+    int64_t _file_size = 64 * 1024;
+    int64_t _io_size = 4096;
+    int _nvec = 4;
+    int _xattrs = 4;
+    uid_t _uid = getuid();
+    gid_t _gid = getgid();
+    std::vector<gid_t> _groups = ThreadScope::get_process_groups();
+    bool _switch_user = false;
+    bool _cleanup = true;
+    std::vector<ThreadResult> _results;
+    double _elapsed_ms = 0;
+
+    std::string file_path(int i) const { return XSTR() << _dir << "/bench_" << i; }
+    std::string write_path(int t) const { return XSTR() << _dir << "/bench_w_" << t; }
+
+    // create the files with data and nsfs-like xattrs, xattrs are optional since tmpfs may not support them
+    int setup()
+    {
+        if (mkdir(_dir.c_str(), 0755) && errno != EEXIST) return errno;
+        std::vector<uint8_t> data(_file_size, 'x');
+        std::string xattr_value(32, 'v');
+        for (int i = 0; i < _files + _threads; ++i) {
+            std::string path = i < _files ? file_path(i) : write_path(i - _files);
+            int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+            if (fd < 0) return errno;
+            if (i < _files) {
+                int r = write_full(fd, data.data(), data.size()) ? errno : 0;
+                for (int x = 0; x < _xattrs && r == 0; ++x) {
+                    std::string key = XSTR() << "user.noobaa.bench_" << x;
+                    fsetxattr(fd, key.c_str(), xattr_value.data(), xattr_value.size(), 0);
+                }
+                if (r) {
+                    close(fd);
+                    return r;
+                }
+            } else if (ftruncate(fd, _file_size)) {
+                int err = errno;
+                close(fd);
+                return err;
+            }
+            close(fd);
+        }
+        return 0;
+    }
+
+    void cleanup()
+    {
+        for (int i = 0; i < _files; ++i) unlink(file_path(i).c_str());
+        for (int t = 0; t < _threads; ++t) unlink(write_path(t).c_str());
+    }
+
+    // runs one op with the fs_ops functions of its fs worker and returns 0 or errno
+    int run_op(int op, int rfd, int wfd, uint64_t rnd, std::vector<uint8_t>& buf, const std::vector<struct iovec>& iov)
+    {
+        off_t off = ((rnd >> 16) % std::max<int64_t>(1, _file_size / _io_size)) * _io_size;
+        switch (op) {
+        case BENCH_STAT: {
+            // like Stat::Work()
+            int fd = open_at(file_path(rnd % _files), stat_open_flags(false));
+            if (fd < 0) return errno;
+            struct stat st;
+            XattrMap xattr;
+            int err = fstat(fd, &st) ? errno : (get_fd_xattr(fd, xattr, {}) ? errno : 0);
+            close(fd);
+            return err;
+        }
+        case BENCH_OPEN: {
+            int fd = open_at(file_path(rnd % _files), O_RDONLY);
+            if (fd < 0) return errno;
+            close(fd);
+            return 0;
+        }
+        case BENCH_READ:
+            return read_at(rfd, O_RDONLY, buf.data(), _io_size, off) < 0 ? errno : 0;
+        case BENCH_WRITE:
+            return write_at(wfd, buf.data(), _io_size, off) < 0 ? errno : 0;
+        case BENCH_WRITEV: {
+            // writev_full() advances the buffers of partial writes
+            std::vector<struct iovec> v(iov);
+            return writev_full(wfd, v.data(), v.size(), off) < 0 ? errno : 0;
+        }
+        case BENCH_FSYNC:
+            return fsync_file(wfd, write_path(0));
+        case BENCH_READDIR: {
+            std::vector<Entry> entries;
+            return read_dir(_dir, entries) ? errno : 0;
+        }
+        case BENCH_XATTR: {
+            XattrMap xattr;
+            return get_fd_xattr(rfd, xattr, {}) ? errno : 0;
+        }
+        }
+        return EINVAL;
+    }
+
+    void run_thread(int t, std::chrono::steady_clock::time_point deadline, ThreadResult& res)
+    {
+        ThreadScope tx;
+        if (!_switch_user) tx.set_user(_uid, _gid, _groups);
+        int rfd = open(file_path(t % _files).c_str(), O_RDONLY);
+        int wfd = open(write_path(t).c_str(), O_RDWR);
+        if (rfd < 0 || wfd < 0) {
+            res.first_error = errno;
+            if (rfd >= 0) close(rfd);
+            if (wfd >= 0) close(wfd);
+            return;
+        }
+        std::vector<uint8_t> buf(_io_size, 'y');
+        std::vector<struct iovec> iov;
+        int64_t vec_size = std::max<int64_t>(1, _io_size / _nvec);
+        for (int64_t pos = 0; pos < _io_size; pos += vec_size) {
+            iov.push_back({ buf.data() + pos, size_t(std::min(vec_size, _io_size - pos)) });
+        }
+        // cumulative weights, so a random number in [0, total) picks an op by binary search
+        double cumulative[BENCH_OPS_COUNT];
+        double total_weight = 0;
+        for (int op = 0; op < BENCH_OPS_COUNT; ++op) cumulative[op] = (total_weight += _weights[op]);
+        uint64_t rnd = 0x9E3779B97F4A7C15ULL * (t + 1);
+        for (int64_t n = 0; !_ops_per_thread || n < _ops_per_thread; ++n) {
+            auto start = std::chrono::steady_clock::now();
+            if (!_ops_per_thread && start >= deadline) break;
+            // xorshift64
+            rnd ^= rnd << 13;
+            rnd ^= rnd >> 7;
+            rnd ^= rnd << 17;
+            double pick = (rnd % 1000000) * total_weight / 1000000;
+            int op = std::upper_bound(cumulative, cumulative + BENCH_OPS_COUNT, pick) - cumulative;
+            if (op >= BENCH_OPS_COUNT) continue;
+            int err;
+            if (op == BENCH_FSYNC) {
+                // dirty the file so the fsync has something to write, and measure only the fsync
+                if (pwrite(wfd, buf.data(), std::min<int64_t>(_io_size, 4096), 0) < 0) res.first_error = errno;
+                start = std::chrono::steady_clock::now();
+            }
+            if (_switch_user) {
+                ThreadScope op_tx;
+                op_tx.set_user(_uid, _gid, _groups);
+                err = run_op(op, rfd, wfd, rnd, buf, iov);
+            } else {
+                err = run_op(op, rfd, wfd, rnd, buf, iov);
+            }
+            auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            if (err) {
+                res.hists[op].errors += 1;
+                if (!res.first_error) res.first_error = err;
+            } else {
+                res.hists[op].add(took);
+            }
+        }
+        close(rfd);
+        close(wfd);
+    }
+
+    int run()
+    {
+        int err = setup();
+        if (err) {
+            cleanup();
+            return err;
+        }
+        _results.clear();
+        _results.resize(_threads);
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::milliseconds(_duration_ms);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < _threads; ++t) {
+            threads.emplace_back(&FsBench::run_thread, this, t, deadline, std::ref(_results[t]));
+        }
+        for (auto& th : threads) th.join();
+        _elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (_cleanup) cleanup();
+        return 0;
+    }
+
+    void print()
+    {
+        uint64_t total_ops = 0;
+        int first_error = 0;
+        for (int op = 0; op < BENCH_OPS_COUNT; ++op) {
+            for (auto const& r : _results) total_ops += r.hists[op].count;
+        }
+        for (auto const& r : _results) {
+            if (!first_error) first_error = r.first_error;
+        }
+        printf("\nthreads %d switch_user %s: %lu ops in %.0f ms = %.0f ops/sec\n",
+            _threads, _switch_user ? "true" : "false", (unsigned long)total_ops, _elapsed_ms,
+            _elapsed_ms > 0 ? total_ops * 1000.0 / _elapsed_ms : 0);
+        printf("%-8s%10s%10s%10s%10s%10s%10s%10s%8s\n", "op", "ops/sec", "avg_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us", "errors");
+        for (int op = 0; op < BENCH_OPS_COUNT; ++op) {
+            if (_weights[op] <= 0) continue;
+            BenchHist h;
+            for (auto const& r : _results) h.merge(r.hists[op]);
+            printf("%-8s%10.1f%10.1f%10.1f%10.1f%10.1f%10.1f%10.1f%8lu\n",
+                OP_NAMES[op],
+                _elapsed_ms > 0 ? h.count * 1000.0 / _elapsed_ms : 0,
+                h.count ? h.sum_ns / 1000.0 / h.count : 0,
+                h.percentile(0.5) / 1000.0,
+                h.percentile(0.9) / 1000.0,
+                h.percentile(0.99) / 1000.0,
+                h.percentile(0.999) / 1000.0,
+                h.max_ns / 1000.0,
+                (unsigned long)h.errors);
+        }
+        if (first_error) printf("first error: %s\n", strerror(first_error));
+    }
+
+    // parses "op:w,op:w" into the op weights, returns false on an unknown op
+    bool parse_mix(const std::string& mix)
+    {
+        for (double& w : _weights) w = 0;
+        size_t pos = 0;
+        while (pos < mix.size()) {
+            size_t end = mix.find(',', pos);
+            if (end == std::string::npos) end = mix.size();
+            std::string item = mix.substr(pos, end - pos);
+            size_t colon = item.find(':');
+            std::string name = item.substr(0, colon);
+            double weight = colon == std::string::npos ? 1 : atof(item.c_str() + colon + 1);
+            int op = 0;
+            while (op < BENCH_OPS_COUNT && name != OP_NAMES[op]) ++op;
+            if (op == BENCH_OPS_COUNT) return false;
+            _weights[op] = std::max(0.0, weight);
+            pos = end + 1;
+        }
+        return true;
+    }
+};
+
+int
+main(int argc, char* argv[])
+{
+    FsBench bench;
+    bool compare = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--switch_user") {
+            bench._switch_user = true;
+            continue;
+        } else if (arg == "--compare") {
+            compare = true;
+            continue;
+        } else if (arg == "--keep") {
+            bench._cleanup = false;
+            continue;
+        }
+        i += 1;
+        if (arg == "--dir") {
+            bench._dir = val;
+        } else if (arg == "--time") {
+            bench._duration_ms = std::max<int64_t>(0, atof(val) * 1000);
+        } else if (arg == "--ops") {
+            bench._ops_per_thread = std::max<int64_t>(0, atoll(val));
+        } else if (arg == "--threads") {
+            bench._threads = std::clamp(atoi(val), 1, 1024);
+        } else if (arg == "--mix") {
+            if (!bench.parse_mix(val)) {
+                fprintf(stderr, "fs_bench: invalid --mix %s\n", val);
+                return 1;
+            }
+        } else if (arg == "--files") {
+            bench._files = std::max(1, atoi(val));
+        } else if (arg == "--file_size") {
+            bench._file_size = std::max<int64_t>(1, atoll(val) * 1024);
+        } else if (arg == "--io_size") {
+            bench._io_size = std::max<int64_t>(1, atoll(val) * 1024);
+        } else if (arg == "--nvec") {
+            bench._nvec = std::clamp(atoi(val), 1, 1024);
+        } else if (arg == "--xattrs") {
+            bench._xattrs = std::max(0, atoi(val));
+        } else if (arg == "--uid") {
+            bench._uid = atoi(val);
+        } else if (arg == "--gid") {
+            bench._gid = atoi(val);
+        } else {
+            fprintf(stderr, "fs_bench: unknown option %s, see the usage in src/native/test/fs_bench.cpp\n", arg.c_str());
+            return 1;
+        }
+    }
+    bench._io_size = std::min(bench._io_size, bench._file_size);
+    double total_weight = 0;
+    for (double w : bench._weights) total_weight += w;
+    if (total_weight <= 0) {
+        fprintf(stderr, "fs_bench: expected a positive weight for at least one op\n");
+        return 1;
+    }
+    for (int pass = compare ? 0 : 1; pass < 2; ++pass) {
+        if (compare) bench._switch_user = pass == 1;
+        int err = bench.run();
+        if (err) {
+            fprintf(stderr, "fs_bench: setup failed %s\n", strerror(err));
+            return 1;
+        }
+        bench.print();
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* Copyright (C) 2016 NooBaa */
+#include "fsync_group.h"
+
+#include <chrono>
+
+namespace noobaa
+{
+
+FsyncGroup&
+FsyncGroup::instance()
+{
+    // never destroyed so that worker threads can still reach it at exit
+    static FsyncGroup* group = new FsyncGroup();
+    return *group;
+}
+
+void
+FsyncGroup::configure(const Config& config)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _config = config;
+    _config.window_us = std::max<int64_t>(0, config.window_us);
+    _config.max_batch = std::max(1, config.max_batch);
+    _enabled = config.enabled;
+    _use_syncfs = config.use_syncfs;
+}
+
+FsyncGroup::Config
+FsyncGroup::config()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _config;
+}
+
+int
+FsyncGroup::sync(const std::string& key, const std::function<int()>& do_sync)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto& g = _groups[key];
+    if (!g) g.reset(new Group());
+    Group* group = g.get();
+    group->users += 1;
+    uint64_t ticket = ++group->requested;
+    _stats.requests += 1;
+    // wake a leader that is waiting in its window once the batch is full
+    if (group->in_progress && group->requested - group->completed >= uint64_t(_config.max_batch)) {
+        group->cond.notify_all();
+    }
+    while (group->completed < ticket) {
+        if (group->in_progress) {
+            group->cond.wait(lock);
+            continue;
+        }
+
+        // become the leader, and give more requests a chance to join before the sync
+        group->in_progress = true;
+        auto start = std::chrono::steady_clock::now();
+        if (_config.window_us > 0) {
+            auto deadline = start + std::chrono::microseconds(_config.window_us);
+            while (group->requested - group->completed < uint64_t(_config.max_batch)) {
+                if (group->cond.wait_until(lock, deadline) == std::cv_status::timeout) break;
+            }
+        }
+        // every request up to here was issued before the sync starts, so the sync covers it
+        uint64_t covered = group->requested;
+        auto sync_start = std::chrono::steady_clock::now();
+        lock.unlock();
+        int r = do_sync();
+        auto sync_end = std::chrono::steady_clock::now();
+        lock.lock();
+
+        uint64_t batch = covered - group->completed;
+        uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(sync_start - start).count();
+        uint64_t sync_us = std::chrono::duration_cast<std::chrono::microseconds>(sync_end - sync_start).count();
+        _stats.syncs += 1;
+        if (r) _stats.errors += 1;
+        _stats.max_batch = std::max(_stats.max_batch, batch);
+        _stats.window_wait_us += wait_us;
+        _stats.sync_time_us += sync_us;
+        _stats.max_sync_time_us = std::max(_stats.max_sync_time_us, sync_us);
+        if (r) group->failures[covered] = Failure{ group->completed + 1, r, batch };
+        group->completed = covered;
+        group->in_progress = false;
+        group->cond.notify_all();
+    }
+    // the result of the sync that covered this request - a later successful sync must not hide its error
+    int result = 0;
+    auto it = group->failures.lower_bound(ticket);
+    if (it != group->failures.end() && it->second.first_ticket <= ticket) {
+        result = it->second.err;
+        if (--it->second.waiters == 0) group->failures.erase(it);
+    }
+
+    group->users -= 1;
+    if (group->users == 0) _groups.erase(key);
+    return result;
+}
+
+FsyncGroup::Stats
+FsyncGroup::stats(bool reset)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats s = _stats;
+    if (reset) _stats = Stats();
+    return s;
+}
+
+} // namespace noobaa
@@ -0,0 +1,95 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common.h"
+
+namespace noobaa
+{
+
+/**
+ * FsyncGroup coalesces concurrent fsync requests for the same key (a directory path,
+ * or a filesystem device when syncing with syncfs) into a single syscall - group commit.
+ *
+ * The first request of a key becomes the leader. It may wait up to window_us for more requests
+ * (or until max_batch are waiting), and then calls the sync function once for all the requests
+ * that arrived before the sync started. Requests that arrive while a sync is running
+ * are not covered by it and wait for the next one, so every caller gets a sync that started
+ * after its request, which is the same durability as calling fsync by itself.
+ */
+class FsyncGroup
+{
+public:
+    struct Config
+    {
+        bool enabled = false;
+        bool use_syncfs = false;
+        int64_t window_us = 0;
+        int max_batch = 64;
+    };
+
+    struct Stats
+    {
+        uint64_t requests = 0;
+        uint64_t syncs = 0;
+        uint64_t errors = 0;
+        uint64_t max_batch = 0;
+        uint64_t window_wait_us = 0;
+        uint64_t sync_time_us = 0;
+        uint64_t max_sync_time_us = 0;
+    };
+
+    static FsyncGroup& instance();
+
+    void configure(const Config& config);
+    Config config();
+    bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+    bool use_syncfs() { return _use_syncfs.load(std::memory_order_relaxed); }
+
+    /**
+     * Waits for a sync of key that started after this call.
+     * do_sync is called by the leader and returns 0 or an errno, which is returned to all the requests it covered.
+     */
+    int sync(const std::string& key, const std::function<int()>& do_sync);
+
+    Stats stats(bool reset);
+
+private:
+    // a failed sync, kept until every request it covered took the error
+    struct Failure
+    {
+        uint64_t first_ticket = 0;
+        int err = 0;
+        uint64_t waiters = 0;
+    };
+
+    struct Group
+    {
+        std::condition_variable cond;
+        uint64_t requested = 0;
+        uint64_t completed = 0;
+        int users = 0;
+        bool in_progress = false;
+        // failed syncs by the last ticket they covered
+        std::map<uint64_t, Failure> failures;
+    };
+
+    FsyncGroup() {}
+
+    std::atomic<bool> _enabled{ false };
+    std::atomic<bool> _use_syncfs{ false };
+    std::mutex _mutex;
+    Config _config;
+    Stats _stats;
+    std::unordered_map<std::string, std::unique_ptr<Group>> _groups;
+};
+
+} // namespace noobaa
@@ -0,0 +1,145 @@
+/* Copyright (C) 2016 NooBaa */
+#include "latency_stats.h"
+
+namespace noobaa
+{
+
+LatencyStats&
+LatencyStats::instance()
+{
+    // never destroyed so that threads can still record at exit
+    static LatencyStats* stats = new LatencyStats();
+    return *stats;
+}
+
+int
+LatencyStats::bucket_of(uint64_t us)
+{
+    if (us < SUB_BUCKETS) return int(us);
+    int msb = 63 - __builtin_clzll(us);
+    int sub = int(us >> (msb - SUB_BUCKETS_BITS)) & (SUB_BUCKETS - 1);
+    int bucket = (msb - SUB_BUCKETS_BITS + 1) * SUB_BUCKETS + sub;
+    return std::min(bucket, NUM_BUCKETS - 1);
+}
+
+uint64_t
+LatencyStats::bucket_upper_bound(int bucket)
+{
+    if (bucket < SUB_BUCKETS) return bucket;
+    int msb = bucket / SUB_BUCKETS + SUB_BUCKETS_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << (msb - SUB_BUCKETS_BITS)) - 1;
+}
+
+uint64_t
+LatencyStats::Hist::percentile(double p) const
+{
+    if (!count) return 0;
+    uint64_t rank = uint64_t(p * count);
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen > rank) return std::min(bucket_upper_bound(i), max_us);
+    }
+    return max_us;
+}
+
+void
+LatencyStats::Counters::add(uint64_t us)
+{
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(us, std::memory_order_relaxed);
+    buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+    // only the owner thread updates min/max, so a plain compare is enough (reset may race and lose one sample)
+    if (us < min_us.load(std::memory_order_relaxed)) min_us.store(us, std::memory_order_relaxed);
+    if (us > max_us.load(std::memory_order_relaxed)) max_us.store(us, std::memory_order_relaxed);
+}
+
+void
+LatencyStats::Counters::collect(Hist& h, bool reset)
+{
+    uint64_t c = reset ? count.exchange(0, std::memory_order_relaxed) : count.load(std::memory_order_relaxed);
+    if (!c) return;
+    uint64_t min = reset ? min_us.exchange(UINT64_MAX, std::memory_order_relaxed) : min_us.load(std::memory_order_relaxed);
+    uint64_t max = reset ? max_us.exchange(0, std::memory_order_relaxed) : max_us.load(std::memory_order_relaxed);
+    h.min_us = h.count ? std::min(h.min_us, min) : min;
+    h.max_us = std::max(h.max_us, max);
+    h.count += c;
+    h.sum_us += reset ? sum_us.exchange(0, std::memory_order_relaxed) : sum_us.load(std::memory_order_relaxed);
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        h.buckets[i] += reset ? buckets[i].exchange(0, std::memory_order_relaxed) : buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+int
+LatencyStats::op_index(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _op_index.find(name);
+    if (it != _op_index.end()) return it->second;
+    if (_op_names.size() >= MAX_OPS) return -1;
+    int index = _op_names.size();
+    _op_names.push_back(name);
+    _op_index[name] = index;
+    return index;
+}
+
+LatencyStats::Shard*
+LatencyStats::thread_shard()
+{
+    static thread_local Shard* shard = 0;
+    if (!shard) {
+        shard = new Shard();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _shards.push_back(shard);
+    }
+    return shard;
+}
+
+void
+LatencyStats::record(int op, uint64_t run_us, uint64_t wait_us, bool error)
+{
+    if (op < 0 || op >= MAX_OPS) return;
+    Shard* shard = thread_shard();
+    OpCounters* c = shard->ops[op].load(std::memory_order_acquire);
+    if (!c) {
+        c = new OpCounters();
+        shard->ops[op].store(c, std::memory_order_release);
+    }
+    c->count.fetch_add(1, std::memory_order_relaxed);
+    if (error) {
+        c->errors.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        c->run.add(run_us);
+    }
+    c->wait.add(wait_us);
+}
+
+std::vector<LatencyStats::OpSnapshot>
+LatencyStats::snapshot(bool reset)
+{
+    std::vector<std::string> names;
+    std::vector<Shard*> shards;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        names = _op_names;
+        shards = _shards;
+    }
+    std::vector<OpSnapshot> res;
+    for (size_t op = 0; op < names.size(); ++op) {
+        OpSnapshot s;
+        s.name = names[op];
+        for (Shard* shard : shards) {
+            OpCounters* c = shard->ops[op].load(std::memory_order_acquire);
+            if (!c) continue;
+            s.count += reset ? c->count.exchange(0, std::memory_order_relaxed) : c->count.load(std::memory_order_relaxed);
+            s.errors += reset ? c->errors.exchange(0, std::memory_order_relaxed) : c->errors.load(std::memory_order_relaxed);
+            c->run.collect(s.run, reset);
+            c->wait.collect(s.wait, reset);
+        }
+        if (s.count) res.push_back(std::move(s));
+    }
+    return res;
+}
+
+} // namespace noobaa
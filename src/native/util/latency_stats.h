@@ -0,0 +1,104 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+namespace noobaa
+{
+
+/**
+ * LatencyStats keeps per operation counters and latency histograms (run time and queue wait time)
+ * in native memory, so that the hot path does not need to call into JS for every operation.
+ *
+ * Every thread records into its own shard with relaxed atomic increments (no locks, no sharing of cache lines
+ * between threads), and snapshot() sums the shards. With reset the counters are exchanged with zero,
+ * so increments that race with the snapshot are counted in either this snapshot or the next one.
+ *
+ * The histograms are log-linear (HDR style) over microseconds - 4 sub-buckets per power of 2,
+ * which bounds the error of the reported percentiles to 25%.
+ */
+class LatencyStats
+{
+public:
+    static const int SUB_BUCKETS_BITS = 2;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKETS_BITS;
+    static const int NUM_BUCKETS = 36 * SUB_BUCKETS; // up to 2^36 us (~19 hours)
+    static const int MAX_OPS = 128;
+
+    struct Hist
+    {
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+        uint64_t min_us = 0;
+        uint64_t max_us = 0;
+        uint64_t buckets[NUM_BUCKETS] = {};
+        uint64_t percentile(double p) const;
+    };
+
+    struct OpSnapshot
+    {
+        std::string name;
+        uint64_t count = 0;
+        uint64_t errors = 0;
+        Hist run; // successful ops only
+        Hist wait;
+    };
+
+    static LatencyStats& instance();
+
+    bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+    void set_enabled(bool enabled) { _enabled = enabled; }
+
+    // returns the index of the op name to pass to record(), or -1 when there are too many names
+    int op_index(const std::string& name);
+
+    void record(int op, uint64_t run_us, uint64_t wait_us, bool error);
+
+    std::vector<OpSnapshot> snapshot(bool reset);
+
+    static int bucket_of(uint64_t us);
+    static uint64_t bucket_upper_bound(int bucket);
+
+private:
+    struct Counters
+    {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sum_us{ 0 };
+        std::atomic<uint64_t> min_us{ UINT64_MAX };
+        std::atomic<uint64_t> max_us{ 0 };
+        std::atomic<uint64_t> buckets[NUM_BUCKETS] = {};
+        void add(uint64_t us);
+        void collect(Hist& h, bool reset);
+    };
+
+    struct OpCounters
+    {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> errors{ 0 };
+        Counters run;
+        Counters wait;
+    };
+
+    // shards are never freed so that the counts of exited threads are still reported
+    struct Shard
+    {
+        std::atomic<OpCounters*> ops[MAX_OPS] = {};
+    };
+
+    LatencyStats() {}
+    Shard* thread_shard();
+
+    std::atomic<bool> _enabled{ false };
+    std::mutex _mutex;
+    std::unordered_map<std::string, int> _op_index;
+    std::vector<std::string> _op_names;
+    std::vector<Shard*> _shards;
+};
+
+} // namespace noobaa
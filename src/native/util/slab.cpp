@@ -0,0 +1,300 @@
+/* Copyright (C) 2016 NooBaa */
+#include "slab.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+namespace noobaa
+{
+
+static const size_t SLAB_REGION_TARGET = 2 * 1024 * 1024;
+static const size_t SLAB_HUGEPAGE_SIZE = 2 * 1024 * 1024;
+
+/**
+ * ThreadCache keeps free slots per size class for the current thread,
+ * and returns them to the class free lists when the thread exits.
+ */
+struct Slab::ThreadCache
+{
+    std::vector<std::vector<Slot>> slots;
+    ~ThreadCache()
+    {
+        Slab& slab = Slab::instance();
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slab.flush(*this, i, 0);
+        }
+    }
+};
+
+Slab&
+Slab::instance()
+{
+    // never destroyed so that thread caches and late GC finalizers can still reach it at exit
+    static Slab* slab = new Slab();
+    return *slab;
+}
+
+Slab::ThreadCache&
+Slab::thread_cache()
+{
+    static thread_local ThreadCache tc;
+    return tc;
+}
+
+void
+Slab::configure(const Config& config)
+{
+    _max_bytes = config.max_bytes;
+    _thread_cache = config.thread_cache;
+    _hugepages = config.hugepages;
+    if (_classes.empty()) {
+        std::vector<size_t> sizes = config.sizes;
+        std::sort(sizes.begin(), sizes.end());
+        for (size_t size : sizes) {
+            size = (size + ALIGN - 1) / ALIGN * ALIGN;
+            if (size && (_classes.empty() || _classes.back()->size != size)) {
+                _classes.emplace_back(new SizeClass(size));
+            }
+        }
+    }
+    _enabled = !config.sizes.empty() && !_classes.empty();
+}
+
+Slab::SizeClass*
+Slab::find_class(size_t size)
+{
+    // use the smallest class that fits, unless it wastes more than half of the slot
+    for (auto& cls : _classes) {
+        if (size <= cls->size) {
+            if (cls->size <= ALIGN || size * 2 >= cls->size) return cls.get();
+            return 0;
+        }
+    }
+    return 0;
+}
+
+bool
+Slab::grow(SizeClass* cls)
+{
+    size_t nslots = std::max<size_t>(1, SLAB_REGION_TARGET / cls->size);
+    size_t len = nslots * cls->size;
+    bool hugepages = _hugepages;
+    if (hugepages) len = (len + SLAB_HUGEPAGE_SIZE - 1) / SLAB_HUGEPAGE_SIZE * SLAB_HUGEPAGE_SIZE;
+    nslots = len / cls->size;
+    size_t max_bytes = _max_bytes;
+    if (max_bytes && _mapped_bytes.fetch_add(len) + len > max_bytes) {
+        _mapped_bytes -= len;
+        return false;
+    }
+
+    void* base = MAP_FAILED;
+    bool huge = false;
+#ifdef MAP_HUGETLB
+    if (hugepages) {
+        base = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = base != MAP_FAILED;
+    }
+#endif
+    if (base == MAP_FAILED) {
+        base = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            if (max_bytes) _mapped_bytes -= len;
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        // no reserved hugepages - ask for transparent hugepages instead
+        if (hugepages) madvise(base, len, MADV_HUGEPAGE);
+#endif
+    }
+
+    std::unique_ptr<Region> region(new Region());
+    region->base = static_cast<uint8_t*>(base);
+    region->len = len;
+    region->cls = cls;
+    region->nslots = nslots;
+    region->huge = huge;
+    region->state.reset(new std::atomic<uint64_t>[nslots]);
+    for (size_t i = 0; i < nslots; ++i) region->state[i] = 0;
+
+    Region* r = region.get();
+    {
+        std::unique_lock<std::shared_mutex> lock(_regions_mutex);
+        _regions[uintptr_t(base)] = std::move(region);
+    }
+    if (!max_bytes) _mapped_bytes += len;
+    if (huge) _hugepage_regions++;
+    cls->regions++;
+    cls->total += nslots;
+    for (size_t i = 0; i < nslots; ++i) {
+        cls->free_slots.push_back(Slot{ r->base + i * cls->size, r, i });
+    }
+    return true;
+}
+
+// moves a batch of free slots from the class (growing it when empty) to the thread cache
+bool
+Slab::refill(ThreadCache& tc, size_t class_index)
+{
+    SizeClass* cls = _classes[class_index].get();
+    std::vector<Slot>& cache = tc.slots[class_index];
+    size_t batch = std::max<size_t>(1, _thread_cache / 2);
+    std::lock_guard<std::mutex> lock(cls->mutex);
+    if (cls->free_slots.empty() && !grow(cls)) return false;
+    while (batch-- && !cls->free_slots.empty()) {
+        cache.push_back(cls->free_slots.back());
+        cls->free_slots.pop_back();
+        cls->cached++;
+    }
+    return true;
+}
+
+void
+Slab::flush(ThreadCache& tc, size_t class_index, size_t keep)
+{
+    SizeClass* cls = _classes[class_index].get();
+    std::vector<Slot>& cache = tc.slots[class_index];
+    if (cache.size() <= keep) return;
+    std::lock_guard<std::mutex> lock(cls->mutex);
+    while (cache.size() > keep) {
+        cls->free_slots.push_back(cache.back());
+        cache.pop_back();
+        cls->cached--;
+    }
+}
+
+void
+Slab::put(ThreadCache& tc, size_t class_index, const Slot& slot)
+{
+    std::vector<Slot>& cache = tc.slots[class_index];
+    cache.push_back(slot);
+    _classes[class_index]->cached++;
+    size_t max_cache = _thread_cache;
+    if (cache.size() > max_cache) flush(tc, class_index, max_cache / 2);
+}
+
+uint8_t*
+Slab::alloc(size_t size, uint64_t& ticket)
+{
+    SizeClass* cls = enabled() ? find_class(size) : 0;
+    if (!cls) return fallback_alloc(size, ticket);
+    size_t class_index = 0;
+    while (_classes[class_index].get() != cls) class_index++;
+
+    ThreadCache& tc = thread_cache();
+    if (tc.slots.size() < _classes.size()) tc.slots.resize(_classes.size());
+    std::vector<Slot>& cache = tc.slots[class_index];
+    if (cache.empty()) {
+        if (!refill(tc, class_index)) return fallback_alloc(size, ticket);
+    } else {
+        _thread_cache_hits++;
+    }
+    Slot slot = cache.back();
+    cache.pop_back();
+    cls->cached--;
+    std::atomic<uint64_t>& state = slot.region->state[slot.index];
+    ticket = state.load() | 1;
+    state.store(ticket);
+    return slot.data;
+}
+
+Slab::Region*
+Slab::lookup(uint8_t* data)
+{
+    std::shared_lock<std::shared_mutex> lock(_regions_mutex);
+    auto it = _regions.upper_bound(uintptr_t(data));
+    if (it == _regions.begin()) return 0;
+    --it;
+    Region* region = it->second.get();
+    return data < region->base + region->len ? region : 0;
+}
+
+bool
+Slab::free(uint8_t* data, uint64_t ticket)
+{
+    if (!data) return false;
+    Region* region = lookup(data);
+    if (!region) return fallback_free(data, ticket, false);
+    size_t index = (data - region->base) / region->cls->size;
+    uint64_t expected = ticket;
+    if (!(ticket & 1) || !region->state[index].compare_exchange_strong(expected, ticket + 1)) {
+        _ignored_frees++;
+        return false;
+    }
+    size_t class_index = 0;
+    while (_classes[class_index].get() != region->cls) class_index++;
+    ThreadCache& tc = thread_cache();
+    if (tc.slots.size() < _classes.size()) tc.slots.resize(_classes.size());
+    put(tc, class_index, Slot{ data, region, index });
+    return true;
+}
+
+bool
+Slab::release(uint8_t* data)
+{
+    if (!data) return false;
+    Region* region = lookup(data);
+    if (!region) return fallback_free(data, 0, true);
+    size_t index = (data - region->base) / region->cls->size;
+    return free(data, region->state[index].load());
+}
+
+uint8_t*
+Slab::fallback_alloc(size_t size, uint64_t& ticket)
+{
+    uint8_t* data = 0;
+    int r = posix_memalign((void**)&data, ALIGN, size);
+    if (r || !data) return 0;
+    _fallback_allocs++;
+    std::lock_guard<std::mutex> lock(_fallback_mutex);
+    ticket = ++_fallback_ticket;
+    _fallback[data] = ticket;
+    return data;
+}
+
+bool
+Slab::fallback_free(uint8_t* data, uint64_t ticket, bool any_ticket)
+{
+    {
+        std::lock_guard<std::mutex> lock(_fallback_mutex);
+        auto it = _fallback.find(data);
+        if (it == _fallback.end() || (!any_ticket && it->second != ticket)) {
+            _ignored_frees++;
+            return false;
+        }
+        _fallback.erase(it);
+    }
+    ::free(data);
+    return true;
+}
+
+Slab::Stats
+Slab::stats()
+{
+    Stats s;
+    for (auto& cls : _classes) {
+        ClassStats cs;
+        cs.size = cls->size;
+        cs.regions = cls->regions;
+        cs.total = cls->total;
+        cs.cached = cls->cached;
+        {
+            std::lock_guard<std::mutex> lock(cls->mutex);
+            cs.free = cls->free_slots.size();
+        }
+        cs.in_use = cs.total - std::min(cs.total, cs.free + cs.cached);
+        s.classes.push_back(cs);
+    }
+    s.mapped_bytes = _mapped_bytes;
+    s.hugepage_regions = _hugepage_regions;
+    s.fallback_allocs = _fallback_allocs;
+    s.thread_cache_hits = _thread_cache_hits;
+    s.ignored_frees = _ignored_frees;
+    {
+        std::lock_guard<std::mutex> lock(_fallback_mutex);
+        s.fallback_in_use = _fallback.size();
+    }
+    return s;
+}
+
+} // namespace noobaa
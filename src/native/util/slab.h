@@ -0,0 +1,147 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+namespace noobaa
+{
+
+/**
+ * Slab is an allocator of page aligned buffers (for direct I/O) in fixed size classes.
+ *
+ * Buffers are carved from mmap regions (optionally hugepage backed) that are kept for reuse,
+ * so allocating and freeing a buffer is a free list pop/push instead of posix_memalign/free,
+ * and the memory stays bounded by max_bytes no matter how late the GC finalizes JS buffers.
+ * Every thread keeps a small cache of free buffers per class to skip the class lock on the hot path.
+ * Sizes that do not fit a class, or would pass max_bytes, fall back to posix_memalign.
+ *
+ * Every allocation returns a ticket (slot generation) that free() must present,
+ * so a late free of a buffer that was already released (e.g the GC finalizer of a JS buffer
+ * after an explicit release) is ignored even if the slot was reallocated since.
+ */
+class Slab
+{
+public:
+    static const size_t ALIGN = 4096;
+
+    struct Config
+    {
+        std::vector<size_t> sizes;
+        size_t max_bytes = 0;
+        size_t thread_cache = 8;
+        bool hugepages = false;
+    };
+
+    struct ClassStats
+    {
+        size_t size;
+        size_t regions;
+        size_t total;
+        size_t in_use;
+        size_t free;
+        size_t cached;
+    };
+
+    struct Stats
+    {
+        std::vector<ClassStats> classes;
+        size_t mapped_bytes;
+        size_t hugepage_regions;
+        size_t fallback_in_use;
+        size_t fallback_allocs;
+        size_t thread_cache_hits;
+        size_t ignored_frees;
+    };
+
+    static Slab& instance();
+
+    bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * sizes can only be changed while no region was mapped yet,
+     * later calls only update max_bytes, thread_cache and hugepages.
+     */
+    void configure(const Config& config);
+
+    // returns an ALIGN aligned buffer of at least size bytes (null on failure) and its ticket for free()
+    uint8_t* alloc(size_t size, uint64_t& ticket);
+
+    // frees the buffer if the ticket is still current, returns false when ignored
+    bool free(uint8_t* data, uint64_t ticket);
+
+    // frees the buffer whatever its ticket is, the caller guarantees it is no longer used
+    bool release(uint8_t* data);
+
+    Stats stats();
+
+private:
+    struct Region;
+
+    struct Slot
+    {
+        uint8_t* data;
+        Region* region;
+        size_t index;
+    };
+
+    struct SizeClass
+    {
+        size_t size;
+        std::mutex mutex;
+        std::vector<Slot> free_slots;
+        std::atomic<size_t> regions{ 0 };
+        std::atomic<size_t> total{ 0 };
+        std::atomic<size_t> cached{ 0 };
+        explicit SizeClass(size_t s)
+            : size(s) {}
+    };
+
+    // slot state is (generation << 1) | in_use
+    struct Region
+    {
+        uint8_t* base;
+        size_t len;
+        SizeClass* cls;
+        size_t nslots;
+        bool huge;
+        std::unique_ptr<std::atomic<uint64_t>[]> state;
+    };
+
+    struct ThreadCache;
+
+    Slab() {}
+    SizeClass* find_class(size_t size);
+    bool grow(SizeClass* cls);
+    Region* lookup(uint8_t* data);
+    bool refill(ThreadCache& tc, size_t class_index);
+    void put(ThreadCache& tc, size_t class_index, const Slot& slot);
+    void flush(ThreadCache& tc, size_t class_index, size_t keep);
+    uint8_t* fallback_alloc(size_t size, uint64_t& ticket);
+    bool fallback_free(uint8_t* data, uint64_t ticket, bool any_ticket);
+    static ThreadCache& thread_cache();
+
+    std::atomic<bool> _enabled{ false };
+    std::vector<std::unique_ptr<SizeClass>> _classes;
+    std::shared_mutex _regions_mutex;
+    std::map<uintptr_t, std::unique_ptr<Region>> _regions;
+    std::atomic<size_t> _mapped_bytes{ 0 };
+    std::atomic<size_t> _hugepage_regions{ 0 };
+    std::atomic<size_t> _max_bytes{ 0 };
+    std::atomic<size_t> _thread_cache{ 8 };
+    std::atomic<bool> _hugepages{ false };
+    std::atomic<size_t> _thread_cache_hits{ 0 };
+    std::atomic<size_t> _ignored_frees{ 0 };
+    std::atomic<size_t> _fallback_allocs{ 0 };
+    std::mutex _fallback_mutex;
+    std::unordered_map<uint8_t*, uint64_t> _fallback;
+    uint64_t _fallback_ticket = 0;
+};
+
+} // namespace noobaa
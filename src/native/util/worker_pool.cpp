@@ -0,0 +1,163 @@
+/* Copyright (C) 2016 NooBaa */
+#include "worker_pool.h"
+
+#include <thread>
+
+namespace noobaa
+{
+
+thread_local double WorkerPool::_current_wait_time_ms = 0;
+
+WorkerPool&
+WorkerPool::instance()
+{
+    // never destroyed so that pool threads can still reach it at exit
+    static WorkerPool* pool = new WorkerPool();
+    return *pool;
+}
+
+void
+WorkerPool::configure(Napi::Env env, const std::vector<std::string>& names, const std::vector<int>& threads)
+{
+    if (!_env) {
+        uv_loop_t* loop = 0;
+        if (napi_get_uv_event_loop(env, &loop) != napi_ok || !loop) {
+            throw Napi::Error::New(env, "WorkerPool::configure: failed to get uv loop");
+        }
+        _env = env;
+        _async_context.reset(new Napi::AsyncContext(env, "WorkerPool"));
+        // the async handle is unreferenced while nothing is inflight so it won't keep the event loop alive,
+        // and submit() and completion_cb() will ref/unref accordingly (see ThreadPool)
+        uv_async_init(loop, &_async_completion, [](uv_async_t* async) {
+            static_cast<WorkerPool*>(async->data)->completion_cb();
+        });
+        uv_unref(reinterpret_cast<uv_handle_t*>(&_async_completion));
+        _async_completion.data = this;
+        for (const auto& name : names) {
+            _lanes.emplace_back(new Lane());
+            _lanes.back()->name = name;
+        }
+    } else if (napi_env(env) != _env) {
+        throw Napi::Error::New(env, "WorkerPool::configure: already configured by another env");
+    }
+
+    for (size_t i = 0; i < _lanes.size() && i < threads.size(); ++i) {
+        Lane* lane = _lanes[i].get();
+        std::lock_guard<std::mutex> lock(lane->mutex);
+        // a lane that accepted workers keeps at least one thread so that its queue is never stranded
+        lane->threads = std::max(lane->threads > 0 ? 1 : 0, threads[i]);
+        // when shrinking, the extra threads exit once they are done with their current worker
+        for (; lane->alive < lane->threads; ++lane->alive) {
+            std::thread(&WorkerPool::thread_main, this, lane).detach();
+        }
+        lane->cond.notify_all();
+    }
+}
+
+bool
+WorkerPool::submit(Napi::AsyncWorker* worker, size_t lane_index, Napi::Env env)
+{
+    if (!_env || napi_env(env) != _env || lane_index >= _lanes.size()) return false;
+    Lane* lane = _lanes[lane_index].get();
+    {
+        std::lock_guard<std::mutex> lock(lane->mutex);
+        if (lane->threads <= 0) return false;
+        lane->queue.push_back(Item{ worker, std::chrono::steady_clock::now() });
+        lane->max_queued = std::max(lane->max_queued, lane->queue.size());
+    }
+    lane->cond.notify_one();
+    if (_inflight++ == 0) uv_ref(reinterpret_cast<uv_handle_t*>(&_async_completion));
+    return true;
+}
+
+void
+WorkerPool::thread_main(Lane* lane)
+{
+    std::unique_lock<std::mutex> lock(lane->mutex);
+    while (true) {
+        while (lane->queue.empty() && lane->alive <= lane->threads) lane->cond.wait(lock);
+        if (lane->alive > lane->threads) {
+            lane->alive--;
+            // pass the wakeup to a thread that stays, in case we consumed the notify of a new item
+            if (!lane->queue.empty()) lane->cond.notify_one();
+            return;
+        }
+        Item item = lane->queue.front();
+        lane->queue.pop_front();
+        lane->running++;
+        auto start_time = std::chrono::steady_clock::now();
+        double wait_time_ms = std::chrono::duration<double, std::milli>(start_time - item.queued_time).count();
+        lane->wait_time_ms += wait_time_ms;
+        lane->max_wait_time_ms = std::max(lane->max_wait_time_ms, wait_time_ms);
+        lock.unlock();
+
+        _current_wait_time_ms = wait_time_ms;
+        item.worker->OnExecute(Napi::Env(_env));
+        _current_wait_time_ms = 0;
+        double run_time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+
+        lock.lock();
+        lane->running--;
+        lane->completed++;
+        lane->run_time_ms += run_time_ms;
+        lane->max_run_time_ms = std::max(lane->max_run_time_ms, run_time_ms);
+        {
+            std::lock_guard<std::mutex> completed_lock(_completed_mutex);
+            _completed.push_back(item.worker);
+        }
+        uv_async_send(&_async_completion);
+    }
+}
+
+void
+WorkerPool::completion_cb()
+{
+    std::vector<Napi::AsyncWorker*> completed;
+    {
+        std::lock_guard<std::mutex> lock(_completed_mutex);
+        completed.swap(_completed);
+    }
+    if (completed.empty()) return;
+    _inflight -= completed.size();
+    if (_inflight == 0) uv_unref(reinterpret_cast<uv_handle_t*>(&_async_completion));
+    // the callback scope runs the promise reactions when it closes, like the libuv pool after_work
+    Napi::Env env(_env);
+    Napi::HandleScope scope(env);
+    Napi::CallbackScope callback_scope(env, *_async_context);
+    for (Napi::AsyncWorker* worker : completed) {
+        worker->OnWorkComplete(env, napi_ok); // deletes the worker
+    }
+}
+
+std::vector<WorkerPool::LaneStats>
+WorkerPool::stats(bool reset)
+{
+    std::vector<LaneStats> res;
+    for (auto& l : _lanes) {
+        Lane* lane = l.get();
+        std::lock_guard<std::mutex> lock(lane->mutex);
+        LaneStats s;
+        s.name = lane->name;
+        s.threads = lane->threads;
+        s.queued = lane->queue.size();
+        s.max_queued = lane->max_queued;
+        s.running = lane->running;
+        s.completed = lane->completed;
+        s.wait_time_ms = lane->wait_time_ms;
+        s.max_wait_time_ms = lane->max_wait_time_ms;
+        s.run_time_ms = lane->run_time_ms;
+        s.max_run_time_ms = lane->max_run_time_ms;
+        res.push_back(s);
+        if (reset) {
+            lane->max_queued = lane->queue.size();
+            lane->completed = 0;
+            lane->wait_time_ms = 0;
+            lane->max_wait_time_ms = 0;
+            lane->run_time_ms = 0;
+            lane->max_run_time_ms = 0;
+        }
+    }
+    return res;
+}
+
+} // namespace noobaa
@@ -0,0 +1,100 @@
+/* Copyright (C) 2016 NooBaa */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <uv.h>
+#include <vector>
+
+#include "common.h"
+#include "napi.h"
+
+namespace noobaa
+{
+
+/**
+ * WorkerPool runs Napi::AsyncWorker's on dedicated native threads instead of the libuv default pool,
+ * which is shared with dns, zlib, crypto and the rest of the addons.
+ *
+ * The pool has a fixed set of lanes (e.g metadata and data), each with its own queue and threads,
+ * so a burst of slow workers in one lane cannot delay the workers of another lane.
+ * Completed workers are handed back to the event loop thread with an async handle,
+ * which calls OnWorkComplete() just like the libuv pool would.
+ *
+ * The pool is bound to the env that configured it, workers of other envs (worker threads)
+ * or of lanes without threads are not accepted by submit() and should be queued as usual.
+ */
+class WorkerPool
+{
+public:
+    struct LaneStats
+    {
+        std::string name;
+        int threads;
+        size_t queued;
+        size_t max_queued;
+        size_t running;
+        size_t completed;
+        double wait_time_ms;
+        double max_wait_time_ms;
+        double run_time_ms;
+        double max_run_time_ms;
+    };
+
+    static WorkerPool& instance();
+
+    /**
+     * Must be called from the event loop thread of env.
+     * The lanes are set by the first call, later calls can only change the number of threads per lane.
+     */
+    void configure(Napi::Env env, const std::vector<std::string>& names, const std::vector<int>& threads);
+
+    // returns false when the worker should be queued to the libuv pool instead
+    bool submit(Napi::AsyncWorker* worker, size_t lane, Napi::Env env);
+
+    std::vector<LaneStats> stats(bool reset);
+
+    // the queue wait time of the worker running in the current thread (0 outside the pool)
+    static double current_wait_time_ms() { return _current_wait_time_ms; }
+
+private:
+    struct Item
+    {
+        Napi::AsyncWorker* worker;
+        std::chrono::steady_clock::time_point queued_time;
+    };
+
+    struct Lane
+    {
+        std::string name;
+        int threads = 0;
+        int alive = 0;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<Item> queue;
+        size_t max_queued = 0;
+        size_t running = 0;
+        size_t completed = 0;
+        double wait_time_ms = 0;
+        double max_wait_time_ms = 0;
+        double run_time_ms = 0;
+        double max_run_time_ms = 0;
+    };
+
+    WorkerPool() {}
+    void thread_main(Lane* lane);
+    void completion_cb();
+
+    napi_env _env = nullptr;
+    std::unique_ptr<Napi::AsyncContext> _async_context;
+    uv_async_t _async_completion;
+    std::vector<std::unique_ptr<Lane>> _lanes;
+    std::mutex _completed_mutex;
+    std::vector<Napi::AsyncWorker*> _completed;
+    size_t _inflight = 0; // only accessed from the event loop thread
+
+    static thread_local double _current_wait_time_ms;
+};
+
+} // namespace noobaa
@@ -274,7 +274,7 @@ class ConfigFS {
      */
     async get_config_data(config_file_path, options = {}) {
         try {
-            const { data } = await nb_native().fs.readFile(this.fs_context, config_file_path);
+            const data = await this._read_config_file(config_file_path);
             const config_data = JSON.parse(data.toString());
             return config_data;
         } catch (err) {
@@ -284,6 +284,24 @@ class ConfigFS {
         }
     }
 
+    /**
+     * _read_config_file returns the raw content of a config file,
+     * through the native config cache when it is enabled (synchronously on a fresh hit)
+     * @param {string} config_file_path
+     * @returns {Promise<Buffer>}
+     */
+    async _read_config_file(config_file_path) {
+        const fs = nb_native().fs;
+        if (config.NSFS_CONFIG_CACHE_SIZE > 0) {
+            const cached = fs.config_cache_get(this.fs_context, config_file_path);
+            if (cached) return cached;
+            const { data } = await fs.read_config_file(this.fs_context, config_file_path);
+            return data;
+        }
+        const { data } = await fs.readFile(this.fs_context, config_file_path);
+        return data;
+    }
+
     ///////////////////////////////////////
     ////// ACCOUNT CONFIG DIR FUNCS  //////
     ///////////////////////////////////////
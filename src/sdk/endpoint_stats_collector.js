@@ -8,6 +8,8 @@ const dbg = require('../util/debug_module')(__filename);
 const prom_report = require('../server/analytic_services/prometheus_reporting');
 const stats_aggregator = require('../server/system_services/stats_aggregator');
 const DelayedCollector = require('../util/delayed_collector');
+const nb_native = require('../util/nb_native');
+const { native_writers } = require('../util/persistent_logger');
 const config = require('../../config');
 const cluster = /** @type {import('node:cluster').Cluster} */ (
     /** @type {unknown} */
@@ -33,6 +35,18 @@ const cluster = /** @type {import('node:cluster').Cluster} */ (
  *      max_time?: number;
  *      sum_time?: number;
  * }} OpStats
+ *
+ * @typedef {OpStats & {
+ *      requests?: number;
+ *      max_batch?: number;
+ *      window_wait_time?: number;
+ * }} FsyncGroupStats
+ *
+ * @typedef {OpStats & {
+ *      flushed_bytes?: number;
+ *      max_backlog_bytes?: number;
+ *      full_errors?: number;
+ * }} LogWriterStats
  * 
  * @typedef {{
  *      bucket_counters?: { [bucket_name: string]: { [content_type: string]: IoStats } }
@@ -43,7 +57,7 @@ const cluster = /** @type {import('node:cluster').Cluster} */ (
  *      io_stats?: IoStats;
  *      op_stats?: { [op: string]: OpStats }
  *      iam_stats?: { [op: string]: OpStats }
- *      fs_workers_stats?: { [op: string]: OpStats }
+ *      fs_workers_stats?: { [op: string]: OpStats | FsyncGroupStats | LogWriterStats }
  * }} NsfsStats
  * 
  */
@@ -87,7 +101,11 @@ class EndpointStatsCollector {
         this.rpc_client = null;
 
         // exposing a self-bound reporter function (to be used as callback without `this` from native code)
-        this.update_fs_stats = fs_worker_stats => this._update_fs_stats(fs_worker_stats);
+        // when the native code keeps the fs stats by itself (NSFS_FS_NATIVE_STATS) there is no per op callback,
+        // and the stats are collected from nb_native().fs.get_stats() when processing the nsfs stats.
+        this.update_fs_stats = config.NSFS_FS_NATIVE_STATS ?
+            undefined :
+            fs_worker_stats => this._update_fs_stats(fs_worker_stats);
 
         this.prom_metrics_report = prom_report.get_endpoint_report();
         this.semaphore_reports = {
@@ -96,6 +114,8 @@ class EndpointStatsCollector {
             nsfs_m: [],
             nsfs_s: [],
             nsfs_xs: [],
+            fs_pool_meta: [],
+            fs_pool_data: [],
         };
     }
 
@@ -156,6 +176,9 @@ class EndpointStatsCollector {
      * @returns {Promise<void>}
      */
     async _process_nsfs_stats(data) {
+        if (config.NSFS_FS_NATIVE_STATS) this._collect_native_fs_stats(data);
+        if (config.NSFS_FSYNC_GROUP_ENABLED) this._collect_fsync_group_stats(data);
+        this._collect_log_writer_stats(data);
         dbg.log0('nsfs stats - IO counters :', data.io_stats);
         for (const [k, v] of Object.entries(data.op_stats ?? {})) {
             dbg.log0(`nsfs stats - S3 op=${k} :`, v);
@@ -177,21 +200,111 @@ class EndpointStatsCollector {
         }
     }
 
+    /**
+     * merges the native fs stats since the last call into the nsfs stats data,
+     * with the queue wait time of the fs pool lanes as queue_<lane> entries, like the per op callback reports them.
+     * @param {NsfsStats} data
+     */
+    _collect_native_fs_stats(data) {
+        const native_stats = nb_native().fs.get_stats({ reset: true });
+        const fs_workers_stats = {};
+        for (const [name, { count, error_count, run }] of Object.entries(native_stats)) {
+            fs_workers_stats[name.toLowerCase()] = {
+                count,
+                error_count,
+                min_time: run.count ? run.min_us : undefined,
+                max_time: run.count ? run.max_us : undefined,
+                sum_time: run.count ? run.sum_us : undefined,
+            };
+        }
+        const pool_stats = nb_native().fs.fs_pool_stats({ reset: true });
+        for (const [lane, { completed, wait_time_ms, max_wait_time_ms }] of Object.entries(pool_stats)) {
+            if (!completed) continue;
+            fs_workers_stats[`queue_${lane}`] = {
+                count: completed,
+                error_count: 0,
+                max_time: Math.floor(max_wait_time_ms * 1000), // microsec
+                sum_time: Math.floor(wait_time_ms * 1000),
+            };
+        }
+        merge_func(data, { fs_workers_stats });
+    }
+
+    /**
+     * merges the fsync group commit stats as the fsync_group fs op - count and times are of the syscalls,
+     * requests counts the fsync calls that they covered (so requests / count is the average batch),
+     * max_batch is the largest batch, and window_wait_time is the total time leaders waited for a batch.
+     * @param {NsfsStats} data
+     */
+    _collect_fsync_group_stats(data) {
+        const stats = nb_native().fs.fsync_group_stats({ reset: true });
+        if (!stats.requests) return;
+        merge_func(data, {
+            fs_workers_stats: {
+                fsync_group: {
+                    count: stats.syncs,
+                    error_count: stats.errors,
+                    max_time: stats.max_sync_time_us,
+                    sum_time: stats.sync_time_us,
+                    requests: stats.requests,
+                    max_batch: stats.max_batch_seen,
+                    window_wait_time: stats.window_wait_us,
+                },
+            }
+        });
+    }
+
+    /**
+     * merges the stats of the native persistent log writers as the log_writer fs op - count and times are of the flushes,
+     * max_backlog_bytes is the largest amount of appended records that waited for a flush,
+     * and full_errors counts the appends that found the ring buffer full.
+     * @param {NsfsStats} data
+     */
+    _collect_log_writer_stats(data) {
+        for (const writer of native_writers) {
+            const stats = writer.stats({ reset: true });
+            if (!stats.flushes && !stats.flush_errors && !stats.full_errors) continue;
+            merge_func(data, {
+                fs_workers_stats: {
+                    log_writer: {
+                        count: stats.flushes,
+                        error_count: stats.flush_errors,
+                        max_time: Math.floor(stats.max_flush_time_ms * 1000), // microsec
+                        sum_time: Math.floor(stats.flush_time_ms * 1000),
+                        flushed_bytes: stats.flushed_bytes,
+                        max_backlog_bytes: stats.max_backlog_bytes,
+                        full_errors: stats.full_errors,
+                    },
+                }
+            });
+        }
+    }
+
     _update_fs_stats(fs_worker_stats) {
         const time = Math.floor(fs_worker_stats.took_time * 1000); // microsec
         const op_name = fs_worker_stats.name.toLowerCase();
         const error = fs_worker_stats.error;
-        this.nsfs_stats_collector.update({
-            fs_workers_stats: {
-                [op_name]: {
-                    count: 1,
-                    error_count: error,
-                    min_time: error ? undefined : time,
-                    max_time: error ? undefined : time,
-                    sum_time: error ? undefined : time,
-                }
+        const fs_workers_stats = {
+            [op_name]: {
+                count: 1,
+                error_count: error,
+                min_time: error ? undefined : time,
+                max_time: error ? undefined : time,
+                sum_time: error ? undefined : time,
             }
-        });
+        };
+        // when running on the native fs pool, also collect the queue wait time per lane
+        if (fs_worker_stats.lane) {
+            const wait_time = Math.floor(fs_worker_stats.wait_time * 1000); // microsec
+            fs_workers_stats[`queue_${fs_worker_stats.lane}`] = {
+                count: 1,
+                error_count: 0,
+                min_time: wait_time,
+                max_time: wait_time,
+                sum_time: wait_time,
+            };
+        }
+        this.nsfs_stats_collector.update({ fs_workers_stats });
     }
 
     update_namespace_read_stats({ namespace_resource_id, bucket_name = undefined, size = 0, count = 0, is_err = false }) {
@@ -65,6 +65,7 @@ const multi_buffer_pool = new buffer_utils.MultiSizeBuffersPool({
     sem_timeout_error_code: 'IO_STREAM_ITEM_TIMEOUT',
     sem_warning_timeout: config.NSFS_SEM_WARNING_TIMEOUT,
     buffer_alloc: size => nb_native().fs.dio_buffer_alloc(size),
+    buffer_release: buf => nb_native().fs.dio_buffer_release(buf),
 });
 
 const XATTR_USER_PREFIX = 'user.';
@@ -87,6 +88,11 @@ const XATTR_RETENTION_DATE = XATTR_NOOBAA_INTERNAL_PREFIX + 'retention_date';
 const HIDDEN_VERSIONS_PATH = '.versions';
 const NULL_VERSION_ID = 'null';
 const NULL_VERSION_SUFFIX = '_' + NULL_VERSION_ID;
+// options of nb_native().fs.readdir_versions() for the bucket versions layout
+const READDIR_VERSIONS_OPTIONS = Object.freeze({
+    versions_dir: HIDDEN_VERSIONS_PATH,
+    null_suffix: NULL_VERSION_SUFFIX,
+});
 
 const VERSIONING_STATUS_ENUM = Object.freeze({
     VER_ENABLED: 'ENABLED',
@@ -97,11 +103,13 @@ const version_format = /^[a-z0-9]+$/;
 
 // describes the status of the copy that was done, default is fallback
 // LINKED = the file was linked on the server side
+// COPIED = the file data was copied on the server side by the native copy_file (reflink/copy_file_range)
 // IS_SAME_INODE = source and target are the same inode, nothing to copy
 // FALLBACK = will be reported when link on server side copy failed
 // or on non server side copy
 const COPY_STATUS_ENUM = Object.freeze({
     LINKED: 'LINKED',
+    COPIED: 'COPIED',
     SAME_INODE: 'SAME_INODE',
     FALLBACK: 'FALLBACK'
 });
@@ -401,7 +409,13 @@ const versions_dir_cache = new LRUCache({
         }
         let sorted_entries;
         let usage = config.NSFS_DIR_CACHE_MIN_DIR_SIZE;
-        if (stat.size + ver_dir_stat_size <= config.NSFS_DIR_CACHE_MAX_DIR_SIZE) {
+        if (stat.size + ver_dir_stat_size <= config.NSFS_DIR_CACHE_MAX_DIR_SIZE && config.NSFS_LIST_VERSIONS_NATIVE) {
+            // the native merge returns the same order as the JS sort below
+            sorted_entries = await nb_native().fs.readdir_versions(fs_context, dir_path, READDIR_VERSIONS_OPTIONS);
+            for (const ent of sorted_entries) {
+                usage += ent.name.length + 4;
+            }
+        } else if (stat.size + ver_dir_stat_size <= config.NSFS_DIR_CACHE_MAX_DIR_SIZE) {
             const latest_versions = await nb_native().fs.readdir(fs_context, dir_path);
             if (is_version_path_exists) {
                 const old_versions = await nb_native().fs.readdir(fs_context, version_path);
@@ -478,6 +492,20 @@ const nsfs_bucket_statfs_cache = new LRUCache({
 
 const nsfs_low_space_fsids = new Set();
 
+/**
+ * bucket_indexes keeps the native bucket indexes (see config.NSFS_BUCKET_INDEX_ENABLED) by index file path.
+ * The NamespaceFS instances of a bucket share one index, because the file locks of the index are per process.
+ * @typedef {{
+ *  index: nb.BucketIndex,
+ *  index_path: string,
+ *  opened: Promise<void>,
+ *  rebuild_time: number,
+ *  rebuilding: boolean,
+ * }} BucketIndexItem
+ * @type {Map<string, BucketIndexItem>}
+ */
+const bucket_indexes = new Map();
+
 /**
  * NamespaceFS map objets to files in a filesystem.
  * @implements {nb.Namespace}
@@ -672,6 +700,11 @@ class NamespaceFS {
             // This is used in order to follow aws spec and behaviour
             if (!limit) return { is_truncated: false, objects: [], common_prefixes: [] };
 
+            if (!list_versions) {
+                const index_res = await this._list_objects_from_index(fs_context, { bucket, delimiter, prefix, key_marker, limit });
+                if (index_res) return index_res;
+            }
+
             let is_truncated = false;
 
             /**
@@ -882,6 +915,34 @@ class NamespaceFS {
                     }
                     return;
                 }
+                // large versioned dirs are paged natively in the listing order
+                if (list_versions && config.NSFS_LIST_VERSIONS_NATIVE) {
+                    // the marker is inside a sub directory, which sorts before the marker itself
+                    if (!delimiter && marker_curr.includes('/')) {
+                        await process_dir(path.join(dir_key, marker_curr.slice(0, marker_curr.indexOf('/')), '/'));
+                        if (is_truncated) return;
+                    }
+                    const page_size = config.NSFS_LIST_VERSIONS_NATIVE_PAGE_SIZE;
+                    const start_after = (marker_curr && !marker_curr.includes('/')) ?
+                        (version_id_marker || marker_curr) : undefined;
+                    // the cursor keeps the sorted listing, so the dir is read and sorted once for all the pages
+                    const cursor = await nb_native().fs.readdir_versions(fs_context, dir_path, {
+                        ...READDIR_VERSIONS_OPTIONS, start_after, cursor: true,
+                    });
+                    try {
+                        for (; ;) {
+                            const page = cursor.read(page_size);
+                            for (const ent of page) {
+                                if (ent.name === config.NSFS_FOLDER_OBJECT_NAME && dir_key === marker_dir) continue;
+                                await process_entry(ent, is_disabled_dir_content);
+                                if (is_truncated) return;
+                            }
+                            if (page.length < page_size) return;
+                        }
+                    } finally {
+                        cursor.close();
+                    }
+                }
                 // for large dirs we cannot keep all entries in memory
                 // so we have to stream the entries one by one while filtering only the needed ones.
                 try {
@@ -999,7 +1060,7 @@ class NamespaceFS {
                             const dir_content_path = await this._find_version_path(fs_context, params);
                             const dir_content_path_stat = await nb_native().fs.stat(fs_context, dir_content_path);
                             const xattr = stat.xattr;
-                            stat = { ...dir_content_path_stat, xattr };
+                            stat = native_fs_utils.clone_stat(dir_content_path_stat, xattr);
                         }
                     }
                     if (this._is_mismatch_version_id(stat, params.version_id)) {
@@ -1058,6 +1119,8 @@ class NamespaceFS {
         const signal = object_sdk.abort_controller.signal;
         let file_path;
         let file;
+        let file_reader;
+        let cached;
 
         try {
             await this._load_bucket(params, fs_context);
@@ -1081,11 +1144,18 @@ class NamespaceFS {
                         return null;
                     }
 
+                    cached = await this._read_cached_object(fs_context, file_path, params);
+                    if (cached) {
+                        stat = cached.stat;
+                        break;
+                    }
+
                     file = await nb_native().fs.open(
                         fs_context,
                         file_path,
                         config.NSFS_OPEN_READ_MODE,
                         native_fs_utils.get_umasked_mode(config.BASE_MODE_FILE),
+                        config.NSFS_FD_CACHE_SIZE > 0 ? { cache: true } : undefined,
                     );
                     stat = await file.stat(fs_context);
                     if (this._is_mismatch_version_id(stat, params.version_id)) {
@@ -1132,10 +1202,25 @@ class NamespaceFS {
             object_sdk.throw_if_aborted();
 
             dbg.log1('NamespaceFS: read_object_stream', {
-                file_path, start, end, size: stat.size,
+                file_path, start, end, size: stat.size, cache_hit: cached?.cache_hit,
             });
 
-            const file_reader = new FileReader({
+            if (cached) {
+                // small object served from the native object cache - the data is already in memory
+                const data = cached.data.subarray(Math.min(start, stat.size), Math.min(end, stat.size));
+                res.end(data);
+                this.stats?.update_nsfs_read_stats({
+                    namespace_resource_id: this.namespace_resource_id,
+                    size: data.length,
+                    count: 1,
+                    bucket_name: params.bucket,
+                });
+                object_sdk.throw_if_aborted();
+                await stream.promises.finished(res, { signal });
+                return null;
+            }
+
+            file_reader = new FileReader({
                 fs_context,
                 file,
                 file_path,
@@ -1147,6 +1232,8 @@ class NamespaceFS {
                 stats: this.stats,
                 bucket: params.bucket,
                 namespace_resource_id: this.namespace_resource_id,
+                drop_behind: config.NSFS_GET_DROP_BEHIND_MIN_SIZE > 0 &&
+                    Math.min(end, stat.size) - start >= config.NSFS_GET_DROP_BEHIND_MIN_SIZE,
             });
 
             const start_time = process.hrtime.bigint();
@@ -1182,6 +1269,7 @@ class NamespaceFS {
                 await this._glacier_force_expire_on_get(fs_context, file_path, file, stat);
             }
 
+            await file_reader.wait_for_hints();
             await file.close(fs_context);
             file = null;
 
@@ -1211,6 +1299,7 @@ class NamespaceFS {
             try {
                 if (file) {
                     dbg.log0('NamespaceFS: read_object_stream finally closing file', file_path);
+                    await file_reader?.wait_for_hints();
                     await file.close(fs_context);
                 }
             } catch (err) {
@@ -1220,6 +1309,25 @@ class NamespaceFS {
     }
 
 
+    /**
+     * _read_cached_object reads a small object with the native object cache (see NSFS_OBJECT_CACHE_SIZE).
+     * Returns undefined when the object should be read from the file instead -
+     * too large for the cache, another version, or a glacier object that needs the restore checks.
+     * The object md that the GET read before is used to skip the native call for objects too large for the cache.
+     * @param {nb.NativeFSContext} fs_context
+     * @param {string} file_path
+     * @param {Record<any, any>} params
+     */
+    async _read_cached_object(fs_context, file_path, params) {
+        if (!config.NSFS_OBJECT_CACHE_SIZE || params.rdma_info) return;
+        if (params.object_md?.size > config.NSFS_OBJECT_CACHE_MAX_OBJECT_SIZE) return;
+        const cached = await nb_native().fs.read_cached_file(fs_context, file_path);
+        if (!cached.data) return;
+        if (this._is_mismatch_version_id(cached.stat, params.version_id)) return;
+        if (s3_utils.GLACIER_STORAGE_CLASSES.includes(Glacier.storage_class_from_xattr(cached.stat.xattr))) return;
+        return cached;
+    }
+
     ///////////////////
     // OBJECT UPLOAD //
     ///////////////////
@@ -1228,8 +1336,9 @@ class NamespaceFS {
         const fs_context = this.prepare_fs_context(object_sdk);
         await this._load_bucket(params, fs_context);
         await this._throw_if_low_space(fs_context, params.size);
-        const open_mode = native_fs_utils._is_gpfs(fs_context) ? 'wt' : 'w';
         const file_path = this._get_file_path(params);
+        const open_mode = (native_fs_utils._is_gpfs(fs_context) || this._should_publish_tmpfile(fs_context, file_path, params)) ?
+            'wt' : 'w';
         let upload_params;
         try {
             await this._check_path_in_bucket_boundaries(fs_context, file_path);
@@ -1253,6 +1362,9 @@ class NamespaceFS {
                 upload_res = await bp.sem.surround_count(
                     bp.buf_size, async () => this._upload_stream(upload_params));
                 upload_params.digest = upload_res.digest;
+            } else if (upload_params.copy_res === COPY_STATUS_ENUM.COPIED && params.md5_b64) {
+                // the data was copied as is, so the source md5 still describes it
+                upload_params.digest = Buffer.from(params.md5_b64, 'base64').toString('hex');
             }
 
             const upload_info = await this._finish_upload(upload_params);
@@ -1304,7 +1416,11 @@ class NamespaceFS {
                 if (copy_res === COPY_STATUS_ENUM.SAME_INODE) open_path = file_path;
             }
         }
-        const target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, open_path, open_mode);
+        // preallocate only when the data is going to be written by the upload stream
+        const preallocate = config.NSFS_UPLOAD_PREALLOCATE && params.size >= config.NSFS_UPLOAD_PREALLOCATE_MIN_SIZE &&
+            (!copy_res || copy_res === COPY_STATUS_ENUM.FALLBACK);
+        const target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, open_path, open_mode,
+            undefined, preallocate ? { preallocate: params.size } : undefined);
         return { fs_context, params, object_sdk, open_mode, file_path, upload_path, target_file, copy_res };
     }
 
@@ -1312,7 +1428,9 @@ class NamespaceFS {
     // on server side copy -
     // 1. check if source and target is same inode and return if do nothing if true, status is SAME_INODE
     // 2. else we try link - on link success, status is LINKED
-    // 3. if link failed - status is fallback - read the stream from the source and upload it as regular upload
+    // 3. if link failed or versioning is enabled and NSFS_COPY_FILE_RANGE_ENABLED -
+    //    copy the data on the server side with the native copy_file - on success, status is COPIED
+    // 4. otherwise status is fallback - read the stream from the source and upload it as regular upload
     // on non server side copy - we will immediatly do the fallback
     async _try_copy_file(fs_context, params, file_path, upload_path) {
         const source_file_path = await this._find_version_path(fs_context, params.copy_source);
@@ -1331,6 +1449,23 @@ class NamespaceFS {
                 dbg.warn('NamespaceFS: COPY using link failed with:', e);
             }
         }
+        if (res === COPY_STATUS_ENUM.FALLBACK && config.NSFS_COPY_FILE_RANGE_ENABLED) {
+            try {
+                const source_stat = await nb_native().fs.stat(fs_context, source_file_path);
+                const copy_res = await nb_native().fs.copy_file(fs_context, source_file_path, upload_path, {
+                    reflink: config.NSFS_COPY_FILE_REFLINK,
+                    mode: native_fs_utils.get_umasked_mode(config.BASE_MODE_FILE),
+                });
+                dbg.log1('NamespaceFS: COPY using copy_file', source_file_path, upload_path, copy_res);
+                if (copy_res.bytes !== source_stat.size) {
+                    throw new Error(`copy_file copied ${copy_res.bytes} bytes of ${source_stat.size}`);
+                }
+                res = COPY_STATUS_ENUM.COPIED;
+            } catch (e) {
+                dbg.warn('NamespaceFS: COPY using copy_file failed with:', e);
+                await nb_native().fs.unlink(fs_context, upload_path).catch(_.noop);
+            }
+        }
         return res;
     }
 
@@ -1370,13 +1505,15 @@ class NamespaceFS {
     // put part upload should NOT contain -  versioning & move to dest steps
     // if copy status is SAME_INODE - NO xattr replace/move_to_dest
     // if copy status is LINKED - NO xattr replace
+    // if copy status is COPIED - xattr are replaced as on FALLBACK since the copy is a new inode
     // xattr_copy = false implies on non server side copy fallback copy (copy status = FALLBACK)
     // target file can be undefined when it's a folder created and size is 0
     async _finish_upload({ fs_context, params, open_mode, target_file, upload_path, file_path, digest = undefined,
         copy_res = undefined, offset, object_sdk }) {
         const part_upload = file_path === upload_path;
         const same_inode = params.copy_source && copy_res === COPY_STATUS_ENUM.SAME_INODE;
-        const should_replace_xattr = params.copy_source ? copy_res === COPY_STATUS_ENUM.FALLBACK : true;
+        const should_replace_xattr = params.copy_source ?
+            (copy_res === COPY_STATUS_ENUM.FALLBACK || copy_res === COPY_STATUS_ENUM.COPIED) : true;
         const is_disabled_dir_content = this._is_directory_content(file_path, params.key) && this._is_versioning_disabled();
 
         const stat = await target_file.stat(fs_context);
@@ -1428,19 +1565,29 @@ class NamespaceFS {
                 });
             }
         }
-        if (fs_xattr && !is_disabled_dir_content && should_replace_xattr) {
-            await target_file.replacexattr(fs_context, fs_xattr);
-        }
-        // fsync
-        if (config.NSFS_TRIGGER_FSYNC) await target_file.fsync(fs_context);
-        dbg.log1('NamespaceFS._finish_upload:', open_mode, file_path, upload_path, fs_xattr);
-
-        if (!same_inode && !part_upload) {
+        const publish_tmpfile = open_mode === 'wt' && !upload_path && !native_fs_utils._is_gpfs(fs_context);
+        if (publish_tmpfile) {
+            // xattr, fsync and the move to dest are all done by publish_file
+            dbg.log1('NamespaceFS._finish_upload: publish', open_mode, file_path, fs_xattr);
             if (file_path_stat) {
                 await this.append_to_reclaim_wal(fs_context, file_path, file_path_stat);
             }
+            await this._publish_file(fs_context, target_file, file_path, fs_xattr);
+        } else {
+            if (fs_xattr && !is_disabled_dir_content && should_replace_xattr) {
+                await target_file.replacexattr(fs_context, fs_xattr);
+            }
+            // fsync
+            if (config.NSFS_TRIGGER_FSYNC) await target_file.fsync(fs_context);
+            dbg.log1('NamespaceFS._finish_upload:', open_mode, file_path, upload_path, fs_xattr);
+
+            if (!same_inode && !part_upload) {
+                if (file_path_stat) {
+                    await this.append_to_reclaim_wal(fs_context, file_path, file_path_stat);
+                }
 
-            await this._move_to_dest(fs_context, upload_path, file_path, target_file, open_mode, params.key);
+                await this._move_to_dest(fs_context, upload_path, file_path, target_file, open_mode, params.key);
+            }
         }
 
         // when object is a dir, xattr are set on the folder itself and the content is in .folder file
@@ -1449,6 +1596,7 @@ class NamespaceFS {
             await this._assign_dir_content_to_xattr(fs_context, fs_xattr, { ...params, size: stat.size }, copy_xattr);
         }
         stat.xattr = { ...stat.xattr, ...fs_xattr };
+        if (!part_upload) await this._update_bucket_index(fs_context, params.key);
         const upload_info = this._get_upload_info(stat, fs_xattr && fs_xattr[XATTR_VERSION_ID]);
         return upload_info;
     }
@@ -1472,10 +1620,52 @@ class NamespaceFS {
         await native_fs_utils.unlink_ignore_enoent(fs_context, file_path);
         const dir_path = this._get_directory_path(params);
         const stat = await nb_native().fs.stat(fs_context, dir_path);
+        await this._update_bucket_index(fs_context, params.key);
         const upload_info = this._get_upload_info(stat, fs_xattr[XATTR_VERSION_ID]);
         return upload_info;
     }
 
+    /**
+     * _should_publish_tmpfile returns true when a PUT can be written to an O_TMPFILE and committed with publish_file.
+     * GPFS has its own 'wt' flow, and copies, directory objects and versioned buckets still need the upload path.
+     * @param {nb.NativeFSContext} fs_context
+     * @param {string} file_path
+     * @param {Record<any, any>} params
+     * @returns {boolean}
+     */
+    _should_publish_tmpfile(fs_context, file_path, params) {
+        return Boolean(config.NSFS_UPLOAD_PUBLISH_TMPFILE) &&
+            process.platform === 'linux' &&
+            !native_fs_utils._is_gpfs(fs_context) &&
+            this._is_versioning_disabled() &&
+            !params.copy_source &&
+            !this._is_directory_content(file_path, params.key);
+    }
+
+    // publish the uploaded tmpfile to dest_path - when dest_path exists the file is linked to a tmp path
+    // in the bucket tmpdir and renamed over it. retries when the dirs are deleted concurrently.
+    async _publish_file(fs_context, target_file, dest_path, fs_xattr) {
+        const tmp_path = path.join(this.get_bucket_tmpdir_full_path(), 'uploads', crypto.randomUUID());
+        let retries = config.NSFS_RENAME_RETRIES;
+        for (;;) {
+            try {
+                await target_file.publish_file(fs_context, dest_path, {
+                    xattr: fs_xattr,
+                    tmp_path,
+                    fsync: config.NSFS_TRIGGER_FSYNC,
+                    dir_fsync: config.NSFS_TRIGGER_FSYNC,
+                });
+                return;
+            } catch (err) {
+                retries -= 1;
+                if (retries <= 0 || err.code !== 'ENOENT') throw err;
+                dbg.warn(`NamespaceFS: Retrying failed publish retries=${retries} dest_path=${dest_path}`, err);
+                await native_fs_utils._make_path_dirs(dest_path, fs_context);
+                await native_fs_utils._make_path_dirs(tmp_path, fs_context);
+            }
+        }
+    }
+
     // move to dest GPFS (wt) / POSIX (w / undefined) - non part upload
     async _move_to_dest(fs_context, source_path, dest_path, target_file, open_mode, key) {
         dbg.log2('_move_to_dest', fs_context, source_path, dest_path, target_file, open_mode, key);
@@ -1928,7 +2118,8 @@ class NamespaceFS {
         const open_mode = 'w*';
         try {
             const md5_enabled = this._is_force_md5_enabled(object_sdk);
-            const MD5Async = md5_enabled ? new (nb_native().crypto.MD5Async)() : undefined;
+            const MD5Async = md5_enabled && !config.NSFS_COMPLETE_MULTIPART_NATIVE ?
+                new (nb_native().crypto.MD5Async)() : undefined;
             const { multiparts = [] } = params;
             multiparts.sort((a, b) => a.num - b.num);
             await this._load_multipart(params, fs_context);
@@ -1948,54 +2139,59 @@ class NamespaceFS {
             let total_size = 0;
             const last_multipart_num = multiparts[multiparts.length - 1]?.num || 0;
             const is_non_continuous_upload = last_multipart_num !== multiparts.length;
-            for (const { num, etag } of multiparts) {
-                const md_part_path = this._get_part_md_path({ ...params, num });
-                const md_part_stat = await nb_native().fs.stat(fs_context, md_part_path);
-                const part_size = Number(md_part_stat.xattr[XATTR_PART_SIZE]);
-                const part_offset = Number(md_part_stat.xattr[XATTR_PART_OFFSET]);
-                if (etag !== this._get_etag(md_part_stat)) {
-                    throw new Error('mismatch part etag: ' + util.inspect({ num, etag, md_part_path, md_part_stat, params }));
-                }
-                if (MD5Async) await MD5Async.update(Buffer.from(etag, 'hex'));
-
-                const data_part_path = this._get_part_data_path({ ...params, size: part_size });
-                if (part_size_to_fd_map.has(part_size)) {
-                    read_file = part_size_to_fd_map.get(part_size);
-                } else {
-                    read_file = await native_fs_utils.open_file(fs_context, this.bucket_path, data_part_path, config.NSFS_OPEN_READ_MODE);
-                    part_size_to_fd_map.set(part_size, read_file);
-                }
+            let native_md5;
+            if (config.NSFS_COMPLETE_MULTIPART_NATIVE) {
+                native_md5 = await this._complete_parts_native(fs_context, params, multiparts, upload_path, md5_enabled);
+            } else {
+                for (const { num, etag } of multiparts) {
+                    const md_part_path = this._get_part_md_path({ ...params, num });
+                    const md_part_stat = await nb_native().fs.stat(fs_context, md_part_path);
+                    const part_size = Number(md_part_stat.xattr[XATTR_PART_SIZE]);
+                    const part_offset = Number(md_part_stat.xattr[XATTR_PART_OFFSET]);
+                    if (etag !== this._get_etag(md_part_stat)) {
+                        throw new Error('mismatch part etag: ' + util.inspect({ num, etag, md_part_path, md_part_stat, params }));
+                    }
+                    if (MD5Async) await MD5Async.update(Buffer.from(etag, 'hex'));
 
-                // 1
-                if (part_size_to_fd_map.size === 1 && !is_non_continuous_upload) {
-                    if (num === multiparts.length) {
-                        await nb_native().fs.link(fs_context, data_part_path, upload_path);
-                        break;
+                    const data_part_path = this._get_part_data_path({ ...params, size: part_size });
+                    if (part_size_to_fd_map.has(part_size)) {
+                        read_file = part_size_to_fd_map.get(part_size);
                     } else {
-                        prev_part_size = part_size;
-                        total_size += part_size;
-                        continue;
+                        read_file = await native_fs_utils.open_file(fs_context, this.bucket_path, data_part_path, config.NSFS_OPEN_READ_MODE);
+                        part_size_to_fd_map.set(part_size, read_file);
                     }
-                } else if (part_size_to_fd_map.size === 2 && should_copy_file_prefix && !is_non_continuous_upload) { // 2
-                    if (num === multiparts.length) {
-                        const prev_data_part_path = this._get_part_data_path({ ...params, size: prev_part_size });
-                        await nb_native().fs.link(fs_context, prev_data_part_path, upload_path);
-                    } else {
-                        const prev_read_file = part_size_to_fd_map.get(prev_part_size);
-                        if (!target_file) {
-                            target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, upload_path, open_mode);
+
+                    // 1
+                    if (part_size_to_fd_map.size === 1 && !is_non_continuous_upload) {
+                        if (num === multiparts.length) {
+                            await nb_native().fs.link(fs_context, data_part_path, upload_path);
+                            break;
+                        } else {
+                            prev_part_size = part_size;
+                            total_size += part_size;
+                            continue;
                         }
-                        // copy (num - 1) parts, all the same size of the prev part
-                        const copy_size = prev_part_size * (num - 1);
-                        await native_fs_utils.copy_bytes(multi_buffer_pool, fs_context, prev_read_file, target_file, copy_size, 0, 0);
+                    } else if (part_size_to_fd_map.size === 2 && should_copy_file_prefix && !is_non_continuous_upload) { // 2
+                        if (num === multiparts.length) {
+                            const prev_data_part_path = this._get_part_data_path({ ...params, size: prev_part_size });
+                            await nb_native().fs.link(fs_context, prev_data_part_path, upload_path);
+                        } else {
+                            const prev_read_file = part_size_to_fd_map.get(prev_part_size);
+                            if (!target_file) {
+                                target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, upload_path, open_mode);
+                            }
+                            // copy (num - 1) parts, all the same size of the prev part
+                            const copy_size = prev_part_size * (num - 1);
+                            await native_fs_utils.copy_bytes(multi_buffer_pool, fs_context, prev_read_file, target_file, copy_size, 0, 0);
+                        }
+                        should_copy_file_prefix = false;
                     }
-                    should_copy_file_prefix = false;
+                    // 3
+                    if (!target_file) target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, upload_path, open_mode);
+                    await native_fs_utils.copy_bytes(multi_buffer_pool, fs_context, read_file, target_file, part_size, total_size, part_offset);
+                    prev_part_size = part_size;
+                    total_size += part_size;
                 }
-                // 3
-                if (!target_file) target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, upload_path, open_mode);
-                await native_fs_utils.copy_bytes(multi_buffer_pool, fs_context, read_file, target_file, part_size, total_size, part_offset);
-                prev_part_size = part_size;
-                total_size += part_size;
             }
             if (!target_file) target_file = await native_fs_utils.open_file(fs_context, this.bucket_path, upload_path, open_mode);
 
@@ -2008,7 +2204,11 @@ class NamespaceFS {
             const create_params_parsed = JSON.parse(create_params_buffer.toString());
             upload_params.params.xattr = create_params_parsed.xattr;
             upload_params.params.storage_class = create_params_parsed.storage_class;
-            upload_params.digest = MD5Async && (((await MD5Async.digest()).toString('hex')) + '-' + multiparts.length);
+            if (native_md5) {
+                upload_params.digest = native_md5 + '-' + multiparts.length;
+            } else {
+                upload_params.digest = MD5Async && (((await MD5Async.digest()).toString('hex')) + '-' + multiparts.length);
+            }
             upload_params.params.content_type = create_params_parsed.content_type;
             upload_params.params.content_encoding = create_params_parsed.content_encoding;
             upload_params.params.lock_settings = create_params_parsed.lock_settings;
@@ -2031,6 +2231,27 @@ class NamespaceFS {
     }
 
 
+    /**
+     * _complete_parts_native assembles the parts into upload_path in a single native call
+     * that verifies the parts etags, links or copies the parts data inside the kernel,
+     * and computes the multipart md5 (without the parts count suffix) when md5 is enabled.
+     * @returns {Promise<string|undefined>}
+     */
+    async _complete_parts_native(fs_context, params, multiparts, upload_path, md5_enabled) {
+        const parts = multiparts.map(({ num, etag }) => ({ md_path: this._get_part_md_path({ ...params, num }), etag }));
+        const res = await nb_native().fs.complete_multipart(fs_context, upload_path, parts, {
+            data_prefix: this._get_part_data_path({ ...params, size: '' }),
+            size_xattr: XATTR_PART_SIZE,
+            offset_xattr: XATTR_PART_OFFSET,
+            md5_xattr: XATTR_MD5_KEY,
+            md5: md5_enabled,
+            reflink: config.NSFS_COPY_FILE_REFLINK,
+            mode: native_fs_utils.get_umasked_mode(config.BASE_MODE_FILE),
+        });
+        dbg.log1('NamespaceFS: _complete_parts_native', upload_path, res);
+        return res.md5;
+    }
+
     // complete_object_upload method has too many statements
     async complete_object_upload_finally(buffer_pool_cleanup, read_file_arr, write_file, fs_context) {
         try {
@@ -2166,6 +2387,7 @@ class NamespaceFS {
         if (this._is_directory_content(file_path, params.key)) {
             await this._clear_user_xattr(fs_context, await this._get_file_md_path(fs_context, params), XATTR_USER_PREFIX);
         }
+        await this._update_bucket_index(fs_context, params.key);
     }
 
     ///////////////////////
@@ -2225,6 +2447,7 @@ class NamespaceFS {
             dbg.error(`NamespaceFS.delete_object_tagging: failed in dir ${file_path} with error: `, err);
             throw native_fs_utils.translate_error_codes(err, native_fs_utils.entity_enum.OBJECT);
         }
+        await this._update_bucket_index(fs_context, params.key);
         return { version_id: params.version_id };
     }
 
@@ -2245,6 +2468,7 @@ class NamespaceFS {
             dbg.error(`NamespaceFS.put_object_tagging: failed in dir ${file_path} with error: `, err);
             throw native_fs_utils.translate_error_codes(err, native_fs_utils.entity_enum.OBJECT);
         }
+        await this._update_bucket_index(fs_context, params.key);
         return { tagging: [], version_id: params.version_id };
     }
 
@@ -2451,6 +2675,7 @@ class NamespaceFS {
             dbg.error(`NamespaceFS.put_object_legal_hold: failed for file ${file_path} with error: `, err);
             throw native_fs_utils.translate_error_codes(err, native_fs_utils.entity_enum.OBJECT);
         }
+        await this._update_bucket_index(fs_context, params.key);
     }
 
     async get_object_retention(params, object_sdk) {
@@ -2498,6 +2723,7 @@ class NamespaceFS {
             dbg.error(`NamespaceFS.put_object_retention: failed for file ${file_path} with error: `, err);
             throw native_fs_utils.translate_error_codes(err, native_fs_utils.entity_enum.OBJECT);
         }
+        await this._update_bucket_index(fs_context, params.key);
     }
 
     ////////////////////
@@ -2984,6 +3210,206 @@ class NamespaceFS {
         }
     }
 
+    //////////////////
+    // BUCKET INDEX //
+    //////////////////
+
+    /**
+     * _get_bucket_index returns the open index of the bucket, or undefined when the index is disabled,
+     * cannot describe this bucket (versioned, GPFS, glacier) or failed to open (retried by the next op).
+     * The index is opened and updated with the credentials of the process and not of the requesting account,
+     * so that accounts of different users share one index file, which only the process can read because
+     * it holds the metadata of all the objects. Lists filter its entries by the access of the account.
+     * When remove_on_error is set (by an op that changed the bucket) and the index cannot be opened,
+     * the index file is removed, so no process keeps serving lists from an index that misses the change.
+     * @param {nb.NativeFSContext} fs_context
+     * @param {boolean} [remove_on_error]
+     * @returns {Promise<BucketIndexItem|undefined>}
+     */
+    async _get_bucket_index(fs_context, remove_on_error = false) {
+        if (!config.NSFS_BUCKET_INDEX_ENABLED || !this.bucket_id || !this._is_versioning_disabled() ||
+            config.NSFS_GLACIER_ENABLED || native_fs_utils._is_gpfs(fs_context)) {
+            return;
+        }
+        const index_path = path.join(this.get_bucket_tmpdir_full_path(), config.NSFS_BUCKET_INDEX_FILE_NAME);
+        let item = bucket_indexes.get(index_path);
+        if (!item) {
+            const index = new (nb_native().BucketIndex)({ path: index_path, sync: config.NSFS_BUCKET_INDEX_SYNC });
+            const opened = native_fs_utils._make_path_dirs(index_path, fs_context)
+                .then(() => index.open());
+            item = { index, index_path, opened, rebuild_time: 0, rebuilding: false };
+            bucket_indexes.set(index_path, item);
+        }
+        try {
+            await item.opened;
+            return item;
+        } catch (err) {
+            dbg.warn('NamespaceFS: bucket index open failed', index_path, err);
+            this._drop_bucket_index(item);
+            if (remove_on_error) await this._remove_bucket_index(fs_context, index_path);
+        }
+    }
+
+    /**
+     * _drop_bucket_index forgets an index that failed, so the next op opens the index file again
+     * (or creates a new incomplete index when the file was removed).
+     * @param {BucketIndexItem} item
+     */
+    _drop_bucket_index(item) {
+        if (bucket_indexes.get(item.index_path) === item) bucket_indexes.delete(item.index_path);
+    }
+
+    /**
+     * _remove_bucket_index invalidates an index that cannot be updated by removing its file,
+     * which fails the lists of the processes that have it open until they open a new incomplete index.
+     * @param {nb.NativeFSContext} fs_context
+     * @param {string} index_path
+     */
+    async _remove_bucket_index(fs_context, index_path) {
+        try {
+            await nb_native().fs.unlink(fs_context, index_path);
+        } catch (err) {
+            if (err.code !== 'ENOENT') dbg.error('NamespaceFS: bucket index remove failed, lists may miss changes', index_path, err);
+        }
+    }
+
+    /**
+     * _get_bucket_index_scan_params returns what the bucket index reads from the bucket directory,
+     * for rebuild and refresh
+     */
+    _get_bucket_index_scan_params() {
+        return {
+            root: this.bucket_path,
+            skip_prefixes: [config.NSFS_TEMP_DIR_NAME],
+            skip_names: [HIDDEN_VERSIONS_PATH],
+            dir_content_xattr: XATTR_DIR_CONTENT,
+            folder_object_name: config.NSFS_FOLDER_OBJECT_NAME,
+            xattr_prefixes: [XATTR_USER_PREFIX],
+        };
+    }
+
+    /**
+     * _update_bucket_index sets the index entry of key to the object as it is now on the filesystem,
+     * or removes the entry when the object does not exist.
+     * The object is read by the index while it is locked for write, so when concurrent ops change the key,
+     * the last update to commit has the last state of the object.
+     * A failed update marks the index incomplete instead of failing the op, so it stops serving lists until rebuilt,
+     * and when the index cannot be opened or marked incomplete its file is removed instead.
+     * @param {nb.NativeFSContext} fs_context
+     * @param {string} key
+     */
+    async _update_bucket_index(fs_context, key) {
+        const item = await this._get_bucket_index(fs_context, true);
+        if (!item) return;
+        try {
+            await item.index.refresh(this._get_bucket_index_scan_params(), [key]);
+        } catch (err) {
+            dbg.warn('NamespaceFS: bucket index update failed', this.bucket_path, key, err);
+            try {
+                await item.index.invalidate();
+            } catch (err2) {
+                dbg.warn('NamespaceFS: bucket index invalidate failed', this.bucket_path, err2);
+                this._drop_bucket_index(item);
+                await this._remove_bucket_index(fs_context, item.index_path);
+            }
+        }
+    }
+
+    /**
+     * _list_objects_from_index serves ListObjects from the bucket index when it is complete and was rebuilt
+     * in the last NSFS_BUCKET_INDEX_MAX_AGE_MS, and returns undefined to list from the filesystem otherwise.
+     * The index holds the objects of every account, so like the filesystem list, an entry is listed only when
+     * the account can access all the directories of its key (checked once per directory in a list).
+     * Entries whose xattrs were too large for the index are read with stat.
+     * @param {nb.NativeFSContext} fs_context
+     * @param {{ bucket: string, delimiter: string, prefix: string, key_marker: string, limit: number }} params
+     */
+    async _list_objects_from_index(fs_context, { bucket, delimiter, prefix, key_marker, limit }) {
+        if (!config.NSFS_BUCKET_INDEX_LIST) return;
+        const item = await this._get_bucket_index(fs_context);
+        if (!item) return;
+        const prefix_dir = prefix.slice(0, prefix.lastIndexOf('/') + 1);
+        if (!(await this.check_access(fs_context, path.join(this.bucket_path, prefix_dir)))) {
+            return { is_truncated: false, objects: [], common_prefixes: [] };
+        }
+        let list_res;
+        try {
+            list_res = await item.index.list({ prefix, delimiter, start_after: key_marker, limit });
+        } catch (err) {
+            // the index file was removed or replaced by a broken file, list from the filesystem
+            dbg.warn('NamespaceFS: bucket index list failed', this.bucket_path, err);
+            this._drop_bucket_index(item);
+            return;
+        }
+        const max_age = config.NSFS_BUCKET_INDEX_MAX_AGE_MS;
+        const age = Date.now() - list_res.built_time_ms;
+        if (!list_res.complete || (max_age > 0 && age > max_age)) {
+            this._rebuild_bucket_index_in_background(item);
+            return;
+        }
+        const res = {
+            objects: [],
+            common_prefixes: list_res.common_prefixes,
+            is_truncated: list_res.is_truncated,
+            next_marker: list_res.is_truncated ? list_res.next_marker : undefined,
+            next_version_id_marker: undefined,
+        };
+        /** @type {Map<string, boolean>} */
+        const dirs_access = new Map();
+        for (const entry of list_res.entries) {
+            // the directories below the prefix dir, including the directory of a directory object
+            let accessible = true;
+            for (let pos = entry.key.indexOf('/', prefix_dir.length); pos >= 0 && accessible; pos = entry.key.indexOf('/', pos + 1)) {
+                const dir = entry.key.slice(0, pos + 1);
+                if (!dirs_access.has(dir)) dirs_access.set(dir, await this.check_access(fs_context, path.join(this.bucket_path, dir)));
+                accessible = dirs_access.get(dir);
+            }
+            if (!accessible) continue;
+            let stat;
+            if (entry.xattr_overflow) {
+                stat = await native_fs_utils.stat_if_exists(fs_context, path.join(this.bucket_path, entry.key),
+                    false, config.NSFS_LIST_IGNORE_ENTRY_ON_EACCES);
+                if (!stat) continue;
+            } else {
+                const mtime = new Date(Number(entry.mtime_ns / 1000000n));
+                stat = {
+                    size: entry.size,
+                    ino: entry.ino,
+                    mtimeNsBigint: entry.mtime_ns,
+                    mtime,
+                    ctime: mtime,
+                    xattr: entry.xattr,
+                };
+            }
+            res.objects.push(this._get_object_info(bucket, entry.key, stat, false));
+        }
+        return res;
+    }
+
+    /**
+     * _rebuild_bucket_index_in_background starts a rebuild of an incomplete or old index,
+     * at most once every NSFS_BUCKET_INDEX_REBUILD_INTERVAL_MS per process.
+     * The scan runs with the credentials of the process, so the index has the objects of every account.
+     * @param {BucketIndexItem} item
+     */
+    _rebuild_bucket_index_in_background(item) {
+        if (!config.NSFS_BUCKET_INDEX_AUTO_REBUILD || item.rebuilding) return;
+        const now = Date.now();
+        if (item.rebuild_time && now < item.rebuild_time + config.NSFS_BUCKET_INDEX_REBUILD_INTERVAL_MS) return;
+        item.rebuild_time = now;
+        item.rebuilding = true;
+        item.index.rebuild(this._get_bucket_index_scan_params())
+            .then(count => dbg.log0('NamespaceFS: bucket index rebuilt', this.bucket_path, 'objects', count))
+            .catch(err => {
+                // another process (or thread) of this bucket is rebuilding the index
+                if (err.code === 'EBUSY') return dbg.log1('NamespaceFS: bucket index rebuild busy', this.bucket_path);
+                dbg.warn('NamespaceFS: bucket index rebuild failed', this.bucket_path, err);
+            })
+            .finally(() => {
+                item.rebuilding = false;
+            });
+    }
+
     async _load_bucket(params, fs_context) {
         // TODO(guymguym): for performance tests we can skip stat, but for prod we might want small cache (even 1 second ttl)
         if (!config.NSFS_CHECK_BUCKET_PATH_EXISTS) return;
@@ -2993,6 +3419,11 @@ class NamespaceFS {
             dbg.warn('_load_bucket failed, on bucket_path', this.bucket_path, 'got error', err);
             throw native_fs_utils.translate_error_codes(err, native_fs_utils.entity_enum.BUCKET);
         }
+        if (config.NSFS_DIR_FD_CACHE_SIZE > 0 && !this.dir_fd_cached) {
+            // keep the bucket root open in the native dir fd cache so object paths resolve relative to it
+            await nb_native().fs.dir_cache_add(fs_context, this.bucket_path);
+            this.dir_fd_cached = true;
+        }
     }
 
     _get_mpu_info(create_params, stat) {
@@ -4080,7 +4511,7 @@ class NamespaceFS {
             const dir_stat = is_dir_content && await dir_file.stat(fs_context);
             const is_empty_directory_content = dir_stat && dir_stat.xattr && dir_stat.xattr[XATTR_DIR_CONTENT] === '0';
             const src_stat = !is_empty_directory_content && await src_file.stat(fs_context);
-            const stat = is_empty_directory_content ? dir_stat : is_dir_content && { ...src_stat, xattr: dir_stat.xattr } || src_stat;
+            const stat = is_empty_directory_content ? dir_stat : is_dir_content && native_fs_utils.clone_stat(src_stat, dir_stat.xattr) || src_stat;
 
             this._check_lifecycle_filter_before_deletion(params, stat);
             const bucket_tmp_dir_path = this.get_bucket_tmpdir_full_path();
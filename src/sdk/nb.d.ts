@@ -1017,11 +1017,22 @@ interface Native {
     CuObjServerNapi: { new(params: CuObjServerNapiParams): CuObjServerNapi };
     CuObjClientNapi: { new(): CuObjClientNapi };
     CudaMemory: { new(size: number): CudaMemory };
+    BlockLog: { new(params: BlockLogParams): BlockLog };
+    LogWriter: { new(params: LogWriterParams): LogWriter };
+    BucketIndex: { new(params: BucketIndexParams): BucketIndex };
 }
 
 interface NativeFS {
-    open(fs_context: NativeFSContext, path: string, flags?: string, mode?: number): Promise<NativeFile>;
+    open(fs_context: NativeFSContext, path: string, flags?: string, mode?: number, options?: {
+        /** fallocate this size on open, fails with ENOSPC before any data is written */
+        preallocate?: number;
+        /** do not change the file size when preallocating (default true) */
+        keep_size?: boolean;
+        /** share a read-only fd from the native fd cache, close releases it instead of closing the fd */
+        cache?: boolean;
+    }): Promise<NativeFile>;
     opendir(fs_context: NativeFSContext, path: string, flags?: string, mode?: number): Promise<NativeDir>;
+    walk(fs_context: NativeFSContext, root: string, options?: NativeWalkOptions): Promise<NativeWalk>;
 
     stat(
         fs_context: NativeFSContext,
@@ -1058,9 +1069,33 @@ interface NativeFS {
         xattr_try?: NativeFSXattr;
         xattr_need_fsync?: boolean;
         xattr_clear_prefix?: string;
+        preallocate?: boolean;
     }): Promise<void>;
+    /** batched block ops of the agent block store - each block resolves with its own result or error code */
+    write_blocks(fs_context: NativeFSContext, blocks: { path: string; data: Buffer; md?: string; meta_path?: string }[],
+        options?: NativeFSBlocksOptions & { preallocate?: boolean }): Promise<{ replaced_size: number; code?: string; message?: string }[]>;
+    read_blocks(fs_context: NativeFSContext, blocks: { path: string; meta_path?: string }[],
+        options?: NativeFSBlocksOptions): Promise<{ data?: Buffer; md?: string; code?: string; message?: string }[]>;
+    delete_blocks(fs_context: NativeFSContext, blocks: { path: string; meta_path?: string }[],
+        options?: NativeFSBlocksOptions): Promise<{ size: number; code?: string; message?: string }[]>;
     fsync(fs_context: NativeFSContext, path: string): Promise<void>;
     fcntlgetlock(fs_context: NativeFSContext, path: string): Promise<LockType>;
+    copy_file(fs_context: NativeFSContext, src_path: string, dst_path: string, options?: {
+        start?: number;
+        end?: number;
+        mode?: number;
+        reflink?: NativeFSReflinkMode;
+        xattr?: NativeFSXattr;
+    }): Promise<NativeFSCopyResult>;
+    complete_multipart(fs_context: NativeFSContext, target_path: string, parts: { md_path: string; etag: string }[], options: {
+        data_prefix: string;
+        size_xattr: string;
+        offset_xattr: string;
+        md5_xattr: string;
+        md5?: boolean;
+        mode?: number;
+        reflink?: NativeFSReflinkMode;
+    }): Promise<{ size: number; num_parts: number; linked_bytes: number; md5?: string }>;
 
     rename(fs_context: NativeFSContext, from_path: string, to_path: string): Promise<void>;
     link(fs_context: NativeFSContext, from_path: string, to_path: string): Promise<void>;
@@ -1072,10 +1107,174 @@ interface NativeFS {
     symlink(fs_context: NativeFSContext, target: string, linkpath: string): Promise<void>;
 
     readdir(fs_context: NativeFSContext, path: string): Promise<fs.Dirent[]>;
+    readdir_versions(fs_context: NativeFSContext, path: string, options?: {
+        versions_dir?: string;
+        null_suffix?: string;
+        start_after?: string;
+        limit?: number;
+    }): Promise<fs.Dirent[]>;
+    readdir_versions(fs_context: NativeFSContext, path: string, options: {
+        versions_dir?: string;
+        null_suffix?: string;
+        start_after?: string;
+        cursor: true;
+    }): Promise<NativeVersionsCursor>;
     mkdir(fs_context: NativeFSContext, path: string, mode?: number): Promise<void>;
     rmdir(fs_context: NativeFSContext, path: string): Promise<void>;
+    rmtree(fs_context: NativeFSContext, path: string, options?: {
+        concurrency?: number;
+        follow_symlinks?: false;
+        max_errors?: number;
+        progress?: Float64Array;
+    }): Promise<{
+        files: number;
+        dirs: number;
+        error_count: number;
+        cancelled: boolean;
+        errors: { path: string; code: string; }[];
+    }>;
+
+    dir_cache_add(fs_context: NativeFSContext, path: string): Promise<void>;
+    dir_cache_remove(path: string): void;
+    dir_cache_config(params: { max_entries: number; validate_ms?: number }): void;
+    dir_cache_stats(): {
+        entries: number;
+        max_entries: number;
+        hits: number;
+        misses: number;
+        evictions: number;
+        invalidations: number;
+    };
+
+    /**
+     * read a small file with its stat and xattrs through the native object cache.
+     * data is missing when the file is not cached - not a regular file or larger than max_object_size.
+     */
+    read_cached_file(fs_context: NativeFSContext, path: string): Promise<{
+        stat: NativeFSStats;
+        data?: Buffer;
+        cache_hit: boolean;
+    }>;
+    object_cache_config(params: { max_entries: number; max_bytes: number; max_object_size: number }): void;
+    object_cache_stats(options?: { reset?: boolean }): {
+        entries: number;
+        bytes: number;
+        max_entries: number;
+        max_bytes: number;
+        max_object_size: number;
+        hits: number;
+        misses: number;
+        inserts: number;
+        evictions: number;
+        invalidations: number;
+    };
+
+    fd_cache_config(params: { max_entries: number; idle_ttl_ms?: number; validate_ms?: number }): void;
+    fd_cache_stats(options?: { reset?: boolean }): {
+        entries: number;
+        in_use: number;
+        max_entries: number;
+        idle_ttl_ms: number;
+        validate_ms: number;
+        hits: number;
+        misses: number;
+        inserts: number;
+        evictions: number;
+        expirations: number;
+        invalidations: number;
+    };
+
+    read_config_file(fs_context: NativeFSContext, path: string): Promise<{ data: Buffer; cache_hit: boolean; }>;
+    config_cache_get(fs_context: NativeFSContext, path: string): Buffer | undefined;
+    config_cache_config(params: {
+        max_entries: number;
+        max_bytes?: number;
+        max_file_size?: number;
+        validate_ms?: number;
+        watch?: boolean;
+    }): void;
+    config_cache_stats(options?: { reset?: boolean }): {
+        entries: number;
+        bytes: number;
+        watched_entries: number;
+        watches: number;
+        hits: number;
+        misses: number;
+        validations: number;
+        inserts: number;
+        evictions: number;
+        invalidations: number;
+        watch_events: number;
+        watch_errors: number;
+    };
 
     dio_buffer_alloc(size: number): Buffer;
+    dio_buffer_release(buf: Buffer): boolean;
+    xattr_config(options: { buf_size?: number; packed?: boolean; }): void;
+    stat_config(options: { compact_class?: new (fields: Float64Array) => NativeFSStats; }): void;
+    STAT_COMPACT_FIELDS: string[];
+    fs_pool_config(options: { meta_threads?: number; data_threads?: number; lock_threads?: number; }): void;
+    latency_stats_config(options: { enabled: boolean; }): void;
+    fsync_group_config(options: { enabled: boolean; window_us?: number; max_batch?: number; syncfs?: boolean; }): void;
+    /** resolves true when the socket fd is writable (or has an error), false after timeout_ms */
+    wait_writable(socket_fd: number, timeout_ms?: number): Promise<boolean>;
+    fsync_group_stats(options?: { reset?: boolean; }): {
+        enabled: boolean;
+        syncfs: boolean;
+        window_us: number;
+        max_batch: number;
+        requests: number;
+        syncs: number;
+        errors: number;
+        max_batch_seen: number;
+        window_wait_us: number;
+        sync_time_us: number;
+        max_sync_time_us: number;
+    };
+    get_stats(options?: { reset?: boolean; }): {
+        [op: string]: {
+            count: number;
+            error_count: number;
+            run: NativeFSLatencyHistogram;
+            wait: NativeFSLatencyHistogram;
+        };
+    };
+    fs_pool_stats(options?: { reset?: boolean; }): {
+        [lane: string]: {
+            threads: number;
+            queued: number;
+            max_queued: number;
+            running: number;
+            completed: number;
+            wait_time_ms: number;
+            max_wait_time_ms: number;
+            run_time_ms: number;
+            max_run_time_ms: number;
+        };
+    };
+    dio_slab_config(options: {
+        sizes: number[];
+        max_bytes?: number;
+        thread_cache?: number;
+        hugepages?: boolean;
+    }): void;
+    dio_slab_stats(): {
+        enabled: boolean;
+        classes: {
+            size: number;
+            regions: number;
+            total: number;
+            in_use: number;
+            free: number;
+            cached: number;
+        }[];
+        mapped_bytes: number;
+        hugepage_regions: number;
+        fallback_allocs: number;
+        fallback_in_use: number;
+        thread_cache_hits: number;
+        ignored_frees: number;
+    };
     set_debug_level(level: number);
     set_log_config(stderr_enabled: boolean, syslog_enabled: boolean, debug_facility: string);
 
@@ -1100,9 +1299,34 @@ interface NativeFile {
     read(fs_context: NativeFSContext, buffer: Buffer, offset: number, length: number, pos: number): Promise<number>;
     write(fs_context: NativeFSContext, buffer: Buffer, len: number, offset?: number): Promise<void>;
     writev(fs_context: NativeFSContext, buffers: Buffer[], offset?: number): Promise<void>;
+    sendfile(fs_context: NativeFSContext, socket_fd: number, pos: number, len: number): Promise<{ bytes: number; again: boolean }>;
+    copy_range(fs_context: NativeFSContext, dst_file: NativeFile, len: number, src_pos?: number, dst_pos?: number,
+        reflink?: NativeFSReflinkMode): Promise<NativeFSCopyResult>;
+    /** fallocate a range of the file, resolves false when the filesystem does not support it */
+    allocate(fs_context: NativeFSContext, offset: number, len: number, options?: { keep_size?: boolean }): Promise<boolean>;
     replacexattr(fs_context: NativeFSContext, xattr: NativeFSXattr, clear_prefix?: string): Promise<void>;
     linkfileat(fs_context: NativeFSContext, path: string, fd?: number, should_not_override?: boolean): Promise<void>;
+    /**
+     * publish an O_TMPFILE - set xattr, fsync, link to path and fsync the dir in one call.
+     * an existing path is replaced by linking to tmp_path and renaming over it,
+     * unless no_replace is set or the expected version does not match (expected_mtime and expected_ino require tmp_path).
+     */
+    publish_file(fs_context: NativeFSContext, path: string, options?: {
+        xattr?: NativeFSXattr;
+        xattr_clear_prefix?: string;
+        tmp_path?: string;
+        fsync?: boolean;
+        dir_fsync?: boolean;
+        no_replace?: boolean;
+        expected_mtime?: bigint;
+        expected_ino?: number;
+    }): Promise<void>;
     fsync(fs_context: NativeFSContext): Promise<void>;
+    /** posix_fadvise the access pattern of a range (len 0 means to the end of the file), a no-op on macOS */
+    advise(fs_context: NativeFSContext, offset: number, len: number,
+        advice: 'normal' | 'sequential' | 'random' | 'willneed' | 'dontneed' | 'noreuse'): Promise<void>;
+    /** start loading a range into the page cache without copying it */
+    readahead(fs_context: NativeFSContext, offset: number, len: number): Promise<void>;
     fd: number;
     flock(fs_context: NativeFSContext, operation: "EXCLUSIVE" | "SHARED" | "UNLOCK"): Promise<void>;
     fcntllock(fs_context: NativeFSContext, operation: "EXCLUSIVE" | "SHARED" | "UNLOCK"): Promise<void>;
@@ -1142,6 +1366,43 @@ interface NativeDir {
     // TODO
 }
 
+interface NativeWalkOptions {
+    concurrency?: number;
+    batch_size?: number;
+    max_errors?: number;
+    types?: ('file' | 'dir' | 'symlink')[];
+    prefix?: string;
+    exclude_dirs?: string[];
+    min_size?: number;
+    max_size?: number;
+    mtime_before_ms?: number;
+    mtime_after_ms?: number;
+    ctime_before_ms?: number;
+    ctime_after_ms?: number;
+    xattr?: string[];
+    xattr_exists?: string[];
+    xattr_equals?: { [key: string]: string };
+}
+
+interface NativeWalk {
+    read(fs_context: NativeFSContext): Promise<{ key: string; stat: NativeFSStats; }[] | null>;
+    close(fs_context: NativeFSContext): Promise<void>;
+    stats(): {
+        dirs: number;
+        entries: number;
+        matched: number;
+        buffered: number;
+        done: boolean;
+        error_count: number;
+        errors: { path: string; code: string; }[];
+    };
+}
+
+interface NativeVersionsCursor {
+    read(limit?: number): fs.Dirent[];
+    close(): void;
+}
+
 interface NativeFSContext {
     uid?: number;
     gid?: number;
@@ -1160,6 +1421,28 @@ type GPFSNooBaaArgs = {
 };
 
 type NativeFSXattr = { [key: string]: string };
+
+interface NativeFSLatencyHistogram {
+    count: number;
+    sum_us: number;
+    min_us: number;
+    max_us: number;
+    p50_us: number;
+    p90_us: number;
+    p99_us: number;
+    p999_us: number;
+}
+type NativeFSReflinkMode = 'auto' | 'always' | 'never';
+type NativeFSCopyResult = {
+    bytes: number;
+    method: 'none' | 'reflink' | 'copy_file_range' | 'splice' | 'read_write';
+};
+type NativeFSBlocksOptions = {
+    /** blocks processed in parallel by the native worker (default 8) */
+    concurrency?: number;
+    /** the xattr of the block md, when not set the md is in the meta_path file */
+    xattr_key?: string;
+};
 type NativeFSStats = fs.Stats & {
     atimeNsBigint: bigint;
     ctimeNsBigint: bigint;
@@ -1309,6 +1592,185 @@ interface CuObjClientNapi {
     ): Promise<number>;
 }
 
+interface LogWriterParams {
+    /** the active file is <dir>/<namespace>.log, like PersistentLogger */
+    dir: string;
+    namespace: string;
+    lock?: 'SHARED' | 'EXCLUSIVE';
+    /** ring buffer size, rounded up to a power of 2 */
+    buffer_size?: number;
+    /** flush when this many bytes are pending, or every flush_interval_ms */
+    flush_size?: number;
+    flush_interval_ms?: number;
+    /** fdatasync every flushed batch (default true) */
+    fsync?: boolean;
+    rotate_size?: number;
+    rotate_age_ms?: number;
+    /** reopen the active file when it was renamed or removed, checked at this interval */
+    reopen_check_ms?: number;
+}
+
+/**
+ * LogWriter is a native append-only writer of newline separated log records,
+ * with an in-memory ring buffer that a native thread flushes in batches.
+ */
+interface LogWriter {
+    open(): Promise<void>;
+    /** flushes the pending records and closes the file */
+    close(): Promise<void>;
+    /** returns the end position of the record, throws with code ENOBUFS when the buffer is full */
+    append(data: string | Buffer): number;
+    /** resolves with the flushed position once all the records appended before the call are written */
+    flush(): Promise<number>;
+    stats(options?: { reset?: boolean }): {
+        appended_records: number;
+        appended_bytes: number;
+        full_errors: number;
+        flushes: number;
+        flushed_bytes: number;
+        flush_errors: number;
+        fsyncs: number;
+        rotations: number;
+        reopens: number;
+        backlog_bytes: number;
+        max_backlog_bytes: number;
+        flush_time_ms: number;
+        max_flush_time_ms: number;
+        last_error?: string;
+    };
+}
+
+interface BucketIndexParams {
+    /** the index file, created on open() when missing */
+    path: string;
+    /** fdatasync every transaction before apply() resolves (default true) */
+    sync?: boolean;
+    /** the mode of a new index file before the umask (default 0o600), it is used with the credentials of the process */
+    mode?: number;
+}
+
+interface BucketIndexEntry {
+    key: string;
+    size: number;
+    mtime_ns: bigint;
+    ino: number;
+    /** the indexed xattrs, empty when xattr_overflow is set */
+    xattr: { [key: string]: string };
+    /** the xattrs were too large to index, so the object should be read with stat */
+    xattr_overflow?: boolean;
+}
+
+interface BucketIndexScanParams {
+    root: string;
+    skip_prefixes?: string[];
+    skip_names?: string[];
+    dir_content_xattr?: string;
+    folder_object_name?: string;
+    xattr_keys?: string[];
+    xattr_prefixes?: string[];
+}
+
+/**
+ * BucketIndex is a native B+tree index of the objects of a bucket directory,
+ * kept in a memory-mapped file that is updated in transactions and shared by processes.
+ */
+interface BucketIndex {
+    open(): Promise<void>;
+    close(): Promise<void>;
+    /** puts and deletes in one transaction, mtime_ns accepts a bigint or a number */
+    apply(
+        puts: { key: string; size: number; mtime_ns?: bigint | number; ino?: number; xattr?: { [key: string]: string } }[],
+        deletes: string[],
+    ): Promise<void>;
+    /** sets the entries of keys to their objects in params.root, or deletes them, in one transaction */
+    refresh(params: BucketIndexScanParams, keys: string[]): Promise<void>;
+    /** rejects with code ENOENT when the key is not indexed */
+    get(key: string): Promise<BucketIndexEntry>;
+    list(params: {
+        prefix?: string;
+        delimiter?: string;
+        start_after?: string;
+        limit?: number;
+        min_size?: number;
+        max_size?: number;
+        modified_before_ns?: bigint | number;
+        xattr?: { [key: string]: string };
+    }): Promise<{
+        entries: BucketIndexEntry[];
+        common_prefixes: string[];
+        is_truncated: boolean;
+        /** false when the index may be missing changes, see rebuild() */
+        complete: boolean;
+        /** the time that the scan of the last rebuild started, 0 if never rebuilt */
+        built_time_ms: number;
+        next_marker: string;
+        scanned: number;
+    }>;
+    usage(): Promise<{ objects: number; bytes: number; txn: number; complete: boolean; built_time_ms: number }>;
+    /**
+     * scans the bucket directory as the process user into a new complete index on a thread of its own,
+     * and reads again the keys changed during the scan, resolves with the object count.
+     * rejects with code EBUSY when the index is already being rebuilt by this or another process.
+     */
+    rebuild(params: BucketIndexScanParams): Promise<number>;
+    /** marks the index incomplete, after changes to the bucket that were not applied */
+    invalidate(): Promise<void>;
+    stats(): {
+        pages: number;
+        free_pages: number;
+        depth: number;
+        txns: number;
+        written_pages: number;
+        rebuilds: number;
+        rebuild_entries: number;
+    };
+}
+
+interface BlockLogParams {
+    root_path: string;
+    /** new records go to a new segment file when the active one reaches this size */
+    segment_size?: number;
+    /** read and write the segments with O_DIRECT, records are aligned to 4K */
+    direct_io?: boolean;
+    /** fdatasync the segment and the WAL before write and remove resolve (default true) */
+    sync?: boolean;
+}
+
+/**
+ * BlockLog is a native log-structured block store -
+ * blocks are appended to segment files with an in-memory index persisted by a WAL and checkpoints.
+ */
+interface BlockLog {
+    open(): Promise<void>;
+    /** checkpoints the index if the WAL is not empty and closes the files */
+    close(): Promise<void>;
+    write(block_id: string, md: string, data: Buffer): Promise<void>;
+    /** rejects with code ENOENT when the block does not exist */
+    read(block_id: string): Promise<{ md: string; data: Buffer }>;
+    remove(block_ids: string[]): Promise<{ removed: string[]; missing: string[] }>;
+    checkpoint(): Promise<void>;
+    compact(params?: { min_garbage_ratio?: number; max_segments?: number }): Promise<{
+        segments: number;
+        blocks: number;
+        bytes: number;
+        reclaimed_bytes: number;
+    }>;
+    stats(): {
+        blocks: number;
+        data_bytes: number;
+        live_bytes: number;
+        total_bytes: number;
+        segments: number;
+        wal_bytes: number;
+        wal_gen: number;
+        recovered_wal_records: number;
+        checkpoints: number;
+        compacted_segments: number;
+        compacted_blocks: number;
+        compacted_bytes: number;
+    };
+}
+
 interface CudaMemory {
     free(): void;
     fill(value: number, start?: number, end?: number): number;
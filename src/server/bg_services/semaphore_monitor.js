@@ -4,6 +4,7 @@
 const dbg = require('../../util/debug_module')(__filename);
 const config = require('../../../config');
 const endpoint_stats_collector = require('../../sdk/endpoint_stats_collector').instance();
+const nb_native = require('../../util/nb_native');
 const { multi_buffer_pool } = require('../../sdk/namespace_fs');
 
 const nsfs_semaphores = {
@@ -40,6 +41,7 @@ class SemaphoreMonitor {
         try {
             if (config.ENABLE_OBJECT_IO_SEMAPHORE_MONITOR) this.sample_object_io_semaphore();
             Object.keys(nsfs_semaphores).forEach(s => this.sample_nsfs_semaphore(s));
+            if (config.NSFS_FS_POOL_META_THREADS > 0 || config.NSFS_FS_POOL_DATA_THREADS > 0) this.sample_fs_pool();
         } catch (err) {
             dbg.error('semaphore_monitor:', err, err.stack);
         }
@@ -100,6 +102,30 @@ class SemaphoreMonitor {
         }
     }
 
+    // reports the native fs pool lanes like semaphores - threads as the cap, queued workers as the waiters
+    // and the average queue wait time since the last sample
+    sample_fs_pool() {
+        try {
+            const fs_pool_stats = nb_native().fs.fs_pool_stats({ reset: true });
+            for (const [lane, stats] of Object.entries(fs_pool_stats)) {
+                if (!stats.threads) continue;
+                const semaphore_report = {
+                    timestamp: Date.now(),
+                    semaphore_state: {
+                        semaphore_cap: stats.threads,
+                        value: stats.threads - stats.running,
+                        waiting_value: stats.queued,
+                        waiting_time: stats.completed ? stats.wait_time_ms / stats.completed : 0,
+                        waiting_queue: stats.queued,
+                    }
+                };
+                endpoint_stats_collector.update_semaphore_state(semaphore_report, `fs_pool_${lane}`, this.report_sample_sizes);
+            }
+        } catch (err) {
+            dbg.error('Could not submit fs pool monitor report, got:', err);
+        }
+    }
+
 }
 
 
@@ -131,6 +131,42 @@ describe('FileReader', () => {
     });
 
 
+    describe('with readahead and drop behind hints', () => {
+        for (const [start, end] of [[0, Infinity], [1, 1025], [123, 345]]) {
+            it(`test read ${start}-${end} ${path.basename(__filename)}`, async () => {
+                await native_fs_utils.use_file({
+                    fs_context,
+                    bucket_path: __filename,
+                    open_path: __filename,
+                    scope: async file => {
+                        const stat = await file.stat(fs_context);
+                        const file_reader = new FileReader({
+                            fs_context,
+                            file,
+                            file_path: __filename,
+                            stat,
+                            start,
+                            end,
+                            signal: new AbortController().signal,
+                            multi_buffer_pool,
+                            highWaterMark: 1024, // bytes
+                            readahead_size: 4096,
+                            drop_behind: true,
+                        });
+                        const data = await buffer_utils.read_stream_join(file_reader);
+                        const node_fs_stream = fs.createReadStream(__filename, { start, end: end > 0 ? end - 1 : 0 });
+                        const node_fs_data = await buffer_utils.read_stream_join(node_fs_stream);
+                        assert.strictEqual(data.toString(), node_fs_data.toString());
+                        assert(file_reader.readahead_pos > start);
+                        await file_reader.wait_for_hints();
+                        assert.strictEqual(file_reader.hint_promise, null);
+                    }
+                });
+            });
+        }
+    });
+
+
     // Abort tests are disabled temporarily due to flakiness 
     //
     // describe('abort during read_into_stream', () => {
@@ -0,0 +1,105 @@
+/* Copyright (C) 2016 NooBaa */
+'use strict';
+
+const os = require('os');
+const path = require('path');
+const crypto = require('crypto');
+const mocha = require('mocha');
+const assert = require('assert');
+const fs_utils = require('../../../util/fs_utils');
+const nb_native = require('../../../util/nb_native');
+
+mocha.describe('nb_native block log', function() {
+
+    const root_path = path.join(os.tmpdir(), `test_nb_native_block_log_${process.pid}`);
+    let block_log;
+
+    function new_block_log() {
+        return new (nb_native().BlockLog)({ root_path, segment_size: 1024 * 1024 });
+    }
+
+    mocha.beforeEach(async function() {
+        await fs_utils.folder_delete(root_path);
+        block_log = new_block_log();
+        await block_log.open();
+    });
+
+    mocha.afterEach(async function() {
+        await block_log.close();
+        await fs_utils.folder_delete(root_path);
+    });
+
+    mocha.it('write read remove', async function() {
+        const data = crypto.randomBytes(12345);
+        await block_log.write('block1', '{"id":"block1"}', data);
+        const res = await block_log.read('block1');
+        assert.strictEqual(res.md, '{"id":"block1"}');
+        assert.deepStrictEqual(res.data, data);
+        assert.strictEqual(block_log.stats().blocks, 1);
+        assert.strictEqual(block_log.stats().data_bytes, data.length);
+
+        const { removed, missing } = await block_log.remove(['block1', 'block2']);
+        assert.deepStrictEqual(removed, ['block1']);
+        assert.deepStrictEqual(missing, ['block2']);
+        await assert.rejects(block_log.read('block1'), { code: 'ENOENT' });
+        assert.strictEqual(block_log.stats().blocks, 0);
+    });
+
+    mocha.it('overwrite', async function() {
+        await block_log.write('block1', 'md1', Buffer.from('first'));
+        await block_log.write('block1', 'md2', Buffer.from('second'));
+        const res = await block_log.read('block1');
+        assert.strictEqual(res.md, 'md2');
+        assert.strictEqual(res.data.toString(), 'second');
+        assert.strictEqual(block_log.stats().blocks, 1);
+        assert.strictEqual(block_log.stats().data_bytes, 6);
+    });
+
+    mocha.it('recovers from WAL and checkpoint on reopen', async function() {
+        const blocks = new Map();
+        for (let i = 0; i < 20; ++i) {
+            const data = crypto.randomBytes(1000 + i);
+            blocks.set(`block${i}`, data);
+            await block_log.write(`block${i}`, `md${i}`, data);
+            if (i === 10) await block_log.checkpoint();
+        }
+        await block_log.remove(['block3', 'block15']);
+        blocks.delete('block3');
+        blocks.delete('block15');
+        await block_log.close();
+
+        block_log = new_block_log();
+        await block_log.open();
+        assert.strictEqual(block_log.stats().blocks, blocks.size);
+        for (const [id, data] of blocks) {
+            const res = await block_log.read(id);
+            assert.deepStrictEqual(res.data, data);
+        }
+        await assert.rejects(block_log.read('block3'), { code: 'ENOENT' });
+        await assert.rejects(block_log.read('block15'), { code: 'ENOENT' });
+    });
+
+    mocha.it('compact reclaims segments of deleted blocks', async function() {
+        const data = crypto.randomBytes(100 * 1024);
+        const ids = [];
+        // fill a few segments so that the first ones are sealed
+        for (let i = 0; i < 30; ++i) {
+            ids.push(`block${i}`);
+            await block_log.write(`block${i}`, '', data);
+        }
+        const removed_ids = ids.filter((id, i) => i % 4 !== 0);
+        await block_log.remove(removed_ids);
+        const before = block_log.stats();
+        const res = await block_log.compact({ min_garbage_ratio: 0.5 });
+        assert(res.segments > 0, 'expected compacted segments');
+        const after = block_log.stats();
+        assert(after.total_bytes < before.total_bytes);
+        assert.strictEqual(after.blocks, before.blocks);
+        for (const id of ids) {
+            if (removed_ids.includes(id)) continue;
+            const read_res = await block_log.read(id);
+            assert.deepStrictEqual(read_res.data, data);
+        }
+    });
+
+});
@@ -0,0 +1,175 @@
+/* Copyright (C) 2016 NooBaa */
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const mocha = require('mocha');
+const assert = require('assert');
+const fs_utils = require('../../../util/fs_utils');
+const nb_native = require('../../../util/nb_native');
+
+mocha.describe('nb_native bucket index', function() {
+
+    const dir = path.join(os.tmpdir(), `test_nb_native_bucket_index_${process.pid}`);
+    const bucket_path = path.join(dir, 'bucket');
+    const index_path = path.join(dir, 'bucket.index');
+
+    mocha.beforeEach(async function() {
+        await fs_utils.create_fresh_path(dir);
+        await fs_utils.create_fresh_path(bucket_path);
+    });
+
+    mocha.after(async function() {
+        await fs_utils.folder_delete(dir);
+    });
+
+    async function open_index() {
+        const index = new (nb_native().BucketIndex)({ path: index_path, sync: false });
+        await index.open();
+        return index;
+    }
+
+    function entry(key, size) {
+        return { key, size, mtime_ns: 1000000n * BigInt(size), ino: size, xattr: { 'user.k': `v${size}` } };
+    }
+
+    mocha.it('applies, gets and deletes entries', async function() {
+        const index = await open_index();
+        await index.apply([entry('a', 1), entry('b/c', 2)], []);
+        const e = await index.get('b/c');
+        assert.strictEqual(e.key, 'b/c');
+        assert.strictEqual(e.size, 2);
+        assert.strictEqual(e.mtime_ns, 2000000n);
+        assert.deepStrictEqual(e.xattr, { 'user.k': 'v2' });
+        await index.apply([], ['b/c']);
+        await assert.rejects(index.get('b/c'), { code: 'ENOENT' });
+        const usage = await index.usage();
+        assert.strictEqual(usage.objects, 1);
+        assert.strictEqual(usage.bytes, 1);
+        assert.strictEqual(usage.complete, false);
+        assert.strictEqual(usage.built_time_ms, 0);
+        await index.close();
+    });
+
+    mocha.it('lists with prefix, delimiter and marker across pages', async function() {
+        const index = await open_index();
+        const puts = [];
+        for (let i = 0; i < 3000; ++i) puts.push(entry(`dir${i % 3}/obj${String(i).padStart(5, '0')}`, i + 1));
+        puts.push(entry('top', 1));
+        await index.apply(puts, []);
+
+        const res = await index.list({ delimiter: '/', limit: 1000 });
+        assert.deepStrictEqual(res.common_prefixes, ['dir0/', 'dir1/', 'dir2/']);
+        assert.deepStrictEqual(res.entries.map(e => e.key), ['top']);
+        assert.strictEqual(res.is_truncated, false);
+
+        const keys = [];
+        let start_after = '';
+        for (;;) {
+            const page = await index.list({ prefix: 'dir1/', start_after, limit: 400 });
+            for (const e of page.entries) keys.push(e.key);
+            if (!page.is_truncated) break;
+            start_after = page.next_marker;
+        }
+        assert.strictEqual(keys.length, 1000);
+        assert.deepStrictEqual(keys, [...keys].sort());
+        assert(keys.every(k => k.startsWith('dir1/')));
+        await index.close();
+    });
+
+    mocha.it('keeps the committed entries after reopen', async function() {
+        const index = await open_index();
+        await index.apply([entry('x', 5)], []);
+        await index.close();
+        const index2 = await open_index();
+        const e = await index2.get('x');
+        assert.strictEqual(e.size, 5);
+        await index2.close();
+    });
+
+    mocha.it('rebuilds from the bucket directory and invalidates', async function() {
+        fs.mkdirSync(path.join(bucket_path, 'a/b'), { recursive: true });
+        fs.mkdirSync(path.join(bucket_path, '.noobaa-nsfs_tmp'));
+        fs.writeFileSync(path.join(bucket_path, 'a/b/c'), 'abc');
+        fs.writeFileSync(path.join(bucket_path, 'd'), 'de');
+        fs.writeFileSync(path.join(bucket_path, '.noobaa-nsfs_tmp/skipped'), 'x');
+
+        const index = await open_index();
+        await index.apply([entry('stale', 7)], []);
+        const start_time = Date.now();
+        const count = await index.rebuild({
+            root: bucket_path,
+            skip_prefixes: ['.noobaa-nsfs_tmp'],
+            xattr_prefixes: ['user.'],
+        });
+        assert.strictEqual(count, 2);
+        let res = await index.list({});
+        assert.strictEqual(res.complete, true);
+        assert(res.built_time_ms >= start_time - 1 && res.built_time_ms <= Date.now());
+        assert.deepStrictEqual(res.entries.map(e => e.key), ['a/b/c', 'd']);
+        assert.strictEqual(res.entries[0].size, 3);
+        assert.strictEqual(res.entries[0].ino, fs.statSync(path.join(bucket_path, 'a/b/c')).ino);
+
+        await index.invalidate();
+        res = await index.list({});
+        assert.strictEqual(res.complete, false);
+        assert.strictEqual(res.entries.length, 2);
+        await index.close();
+    });
+
+    mocha.it('rebuilds one at a time and stays complete with changes during the scan', async function() {
+        for (let i = 0; i < 200; ++i) fs.writeFileSync(path.join(bucket_path, `obj${i}`), 'x');
+        const index = await open_index();
+        const params = { root: bucket_path, skip_prefixes: ['.noobaa-nsfs_tmp'], xattr_prefixes: ['user.'] };
+        const rebuilds = [index.rebuild(params), index.rebuild(params)];
+        // a change applied during the scan is read again from the bucket directory when the rebuild ends
+        fs.writeFileSync(path.join(bucket_path, 'new'), 'abc');
+        await index.apply([entry('new', 3)], []);
+        // the second one is rejected with EBUSY unless the first one already ended
+        const results = await Promise.allSettled(rebuilds);
+        assert(results.some(r => r.status === 'fulfilled'));
+        for (const r of results) assert(r.status === 'fulfilled' || r.reason.code === 'EBUSY', r.reason);
+        const res = await index.list({ prefix: 'new' });
+        assert.strictEqual(res.complete, true);
+        assert.deepStrictEqual(res.entries.map(e => e.key), ['new']);
+        assert.strictEqual(res.entries[0].ino, fs.statSync(path.join(bucket_path, 'new')).ino);
+        assert.strictEqual((await index.usage()).objects, 201);
+        await index.close();
+    });
+
+    mocha.it('refreshes entries from the bucket directory', async function() {
+        fs.mkdirSync(path.join(bucket_path, 'dir'));
+        fs.writeFileSync(path.join(bucket_path, 'dir/obj'), 'abcd');
+        const index = await open_index();
+        await index.apply([entry('gone', 3)], []);
+        const params = { root: bucket_path, skip_prefixes: ['.noobaa-nsfs_tmp'], xattr_prefixes: ['user.'] };
+        await index.refresh(params, ['dir/obj', 'gone', 'dir/', '.noobaa-nsfs_tmp/x']);
+        const res = await index.list({});
+        assert.deepStrictEqual(res.entries.map(e => e.key), ['dir/obj']);
+        assert.strictEqual(res.entries[0].size, 4);
+        assert.strictEqual(res.entries[0].ino, fs.statSync(path.join(bucket_path, 'dir/obj')).ino);
+        await index.close();
+    });
+
+    mocha.it('creates the index file only for the process user, or with the given mode', async function() {
+        const index = await open_index();
+        // eslint-disable-next-line no-bitwise
+        assert.strictEqual(fs.statSync(index_path).mode & 0o777, 0o600 & ~process.umask());
+        await index.close();
+        fs.unlinkSync(index_path);
+        const index2 = new (nb_native().BucketIndex)({ path: index_path, sync: false, mode: 0o666 });
+        await index2.open();
+        // eslint-disable-next-line no-bitwise
+        assert.strictEqual(fs.statSync(index_path).mode & 0o777, 0o666 & ~process.umask());
+        await index2.close();
+    });
+
+    mocha.it('rejects invalid keys', async function() {
+        const index = await open_index();
+        await assert.rejects(index.apply([entry('', 1)], []), { code: 'EINVAL' });
+        await assert.rejects(index.apply([entry('k'.repeat(2000), 1)], []), { code: 'EINVAL' });
+        await index.close();
+    });
+
+});
@@ -3,13 +3,17 @@
 /*eslint max-lines-per-function: ["error", 500]*/
 
 const _ = require('lodash');
+const crypto = require('crypto');
+const events = require('events');
 const fs = require('fs');
+const net = require('net');
 const mocha = require('mocha');
 const assert = require('assert');
+const config = require('../../../../config');
 const fs_utils = require('../../../util/fs_utils');
 const os_utils = require('../../../util/os_utils');
 const nb_native = require('../../../util/nb_native');
-const { get_process_fs_context } = require('../../../util/native_fs_utils');
+const { get_process_fs_context, clone_stat, rmtree } = require('../../../util/native_fs_utils');
 
 const DEFAULT_FS_CONFIG = get_process_fs_context();
 
@@ -238,6 +242,24 @@ mocha.describe('nb_native fs', async function() {
     //     });
     // });
 
+    mocha.describe('FileWrap writev', async function() {
+        mocha.it('writes more buffers than IOV_MAX', async function() {
+            const { open, PLATFORM_IOV_MAX } = nb_native().fs;
+            const PATH = `/tmp/writevtest_${Date.now()}`;
+            const buffers = _.times(PLATFORM_IOV_MAX * 2 + 100, i => Buffer.alloc(i % 7, String.fromCharCode(97 + (i % 26))));
+            const data = Buffer.concat(buffers);
+            const tmpfile = await open(DEFAULT_FS_CONFIG, PATH, 'w');
+            try {
+                await tmpfile.writev(DEFAULT_FS_CONFIG, buffers);
+                await tmpfile.writev(DEFAULT_FS_CONFIG, buffers, data.length);
+            } finally {
+                await tmpfile.close(DEFAULT_FS_CONFIG);
+            }
+            assert.deepStrictEqual(await fs.promises.readFile(PATH), Buffer.concat([data, data]));
+            await fs.promises.unlink(PATH);
+        });
+    });
+
     mocha.describe('FileWrap Getxattr, Replacexattr', async function() {
         mocha.it('set, get', async function() {
             const { open } = nb_native().fs;
@@ -445,6 +467,918 @@ mocha.describe('nb_native fs', async function() {
             }
         });
     });
+
+    mocha.describe('Dir fd cache', async function() {
+        const DIR = `/tmp/dir_fd_cache_${Date.now()}`;
+        mocha.before(async function() {
+            await fs.promises.mkdir(`${DIR}/sub`, { recursive: true });
+            nb_native().fs.dir_cache_config({ max_entries: 2, validate_ms: 0 });
+        });
+        mocha.after(async function() {
+            nb_native().fs.dir_cache_config({ max_entries: 0 });
+            await fs.promises.rm(DIR, { recursive: true, force: true });
+        });
+
+        mocha.it('resolves ops relative to cached dirs', async function() {
+            await nb_native().fs.dir_cache_add(DEFAULT_FS_CONFIG, DIR);
+            const stats1 = nb_native().fs.dir_cache_stats();
+            assert.strictEqual(stats1.entries, 1);
+            const PATH1 = `${DIR}/sub/file1`;
+            const PATH2 = `${DIR}/sub/file2`;
+            await nb_native().fs.writeFile(DEFAULT_FS_CONFIG, PATH1, Buffer.from('dir_fd_cache'));
+            await nb_native().fs.rename(DEFAULT_FS_CONFIG, PATH1, PATH2);
+            const { data } = await nb_native().fs.readFile(DEFAULT_FS_CONFIG, PATH2);
+            assert.strictEqual(data.toString(), 'dir_fd_cache');
+            await nb_native().fs.unlink(DEFAULT_FS_CONFIG, PATH2);
+            await fs_utils.file_must_not_exist(PATH2);
+            const stats2 = nb_native().fs.dir_cache_stats();
+            assert(stats2.hits > stats1.hits);
+        });
+
+        mocha.it('invalidates a replaced dir', async function() {
+            await nb_native().fs.dir_cache_add(DEFAULT_FS_CONFIG, `${DIR}/sub`);
+            await fs.promises.rename(`${DIR}/sub`, `${DIR}/sub_old`);
+            await fs.promises.mkdir(`${DIR}/sub`);
+            await create_file(`${DIR}/sub/file3`);
+            const res = await nb_native().fs.stat(DEFAULT_FS_CONFIG, `${DIR}/sub/file3`);
+            const res2 = await fs.promises.stat(`${DIR}/sub/file3`);
+            assert.strictEqual(res.ino, res2.ino);
+            assert(nb_native().fs.dir_cache_stats().invalidations > 0);
+        });
+    });
+
+    mocha.describe('FileWrap sendfile', async function() {
+        mocha.it('sends file range to socket', async function() {
+            if (os_utils.IS_MAC) this.skip(); // eslint-disable-line no-invalid-this
+            const PATH = `/tmp/sendfile_${Date.now()}`;
+            const data = Buffer.alloc(1024 * 1024, 'sendfile');
+            await fs.promises.writeFile(PATH, data);
+            const server = net.createServer();
+            await new Promise(resolve => server.listen(0, '127.0.0.1', resolve));
+            try {
+                const received = [];
+                const client = net.connect(server.address().port, '127.0.0.1');
+                client.on('data', chunk => received.push(chunk));
+                const [conn] = await events.once(server, 'connection');
+                const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, PATH);
+                let pos = 1000;
+                const end = data.length - 1000;
+                while (pos < end) {
+                    const { bytes, again } = await file.sendfile(DEFAULT_FS_CONFIG, conn._handle.fd, pos, end - pos);
+                    pos += bytes;
+                    if (again) await nb_native().fs.wait_writable(conn._handle.fd, 1000);
+                }
+                await file.close(DEFAULT_FS_CONFIG);
+                conn.end();
+                await events.once(client, 'end');
+                assert.deepStrictEqual(Buffer.concat(received), data.subarray(1000, end));
+            } finally {
+                server.close();
+                await fs_utils.file_delete(PATH);
+            }
+        });
+    });
+});
+
+mocha.describe('nb_native fs copy', async function() {
+    const DIR = `/tmp/nb_native_copy_${Date.now()}`;
+    const data = Buffer.alloc(3 * 1024 * 1024 + 17, 'copy_file');
+    mocha.before(async function() {
+        await fs.promises.mkdir(DIR, { recursive: true });
+        await fs.promises.writeFile(`${DIR}/src`, data);
+    });
+    mocha.after(async function() {
+        await fs.promises.rm(DIR, { recursive: true, force: true });
+    });
+
+    mocha.it('copy_file whole file with xattr', async function() {
+        const xattr = { 'user.copy': 'yes' };
+        const res = await nb_native().fs.copy_file(DEFAULT_FS_CONFIG, `${DIR}/src`, `${DIR}/dst1`, { xattr });
+        assert.strictEqual(res.bytes, data.length);
+        assert.notStrictEqual(res.method, 'none');
+        assert.deepStrictEqual(await fs.promises.readFile(`${DIR}/dst1`), data);
+        const stat = await nb_native().fs.stat(DEFAULT_FS_CONFIG, `${DIR}/dst1`);
+        assert.strictEqual(stat.xattr['user.copy'], 'yes');
+    });
+
+    mocha.it('copy_file range without reflink', async function() {
+        const start = 1000;
+        const end = data.length - 1000;
+        const res = await nb_native().fs.copy_file(DEFAULT_FS_CONFIG, `${DIR}/src`, `${DIR}/dst2`,
+            { start, end, reflink: 'never' });
+        assert.strictEqual(res.bytes, end - start);
+        assert.notStrictEqual(res.method, 'reflink');
+        assert.deepStrictEqual(await fs.promises.readFile(`${DIR}/dst2`), data.subarray(start, end));
+    });
+
+    mocha.it('FileWrap copy_range to offset', async function() {
+        const src_file = await nb_native().fs.open(DEFAULT_FS_CONFIG, `${DIR}/src`);
+        const dst_file = await nb_native().fs.open(DEFAULT_FS_CONFIG, `${DIR}/dst3`, 'w');
+        try {
+            const res = await src_file.copy_range(DEFAULT_FS_CONFIG, dst_file, 4096, 100, 10);
+            assert.strictEqual(res.bytes, 4096);
+        } finally {
+            await src_file.close(DEFAULT_FS_CONFIG);
+            await dst_file.close(DEFAULT_FS_CONFIG);
+        }
+        const copied = await fs.promises.readFile(`${DIR}/dst3`);
+        assert.deepStrictEqual(copied.subarray(10), data.subarray(100, 100 + 4096));
+    });
+
+    mocha.it('complete_multipart links the prefix and copies the rest', async function() {
+        const MPU = `${DIR}/mpu`;
+        await fs.promises.mkdir(MPU);
+        const parts_data = [data.subarray(0, 100), data.subarray(100, 200), data.subarray(200, 230)];
+        await fs.promises.writeFile(`${MPU}/parts-size-100`, Buffer.concat(parts_data.slice(0, 2)));
+        await fs.promises.writeFile(`${MPU}/parts-size-30`, Buffer.concat([Buffer.alloc(60), parts_data[2]]));
+        const parts = [];
+        for (let i = 0; i < parts_data.length; ++i) {
+            const size = parts_data[i].length;
+            const etag = crypto.createHash('md5').update(parts_data[i]).digest('hex');
+            const md_path = `${MPU}/part-${i + 1}`;
+            await nb_native().fs.writeFile(DEFAULT_FS_CONFIG, md_path, Buffer.alloc(0), {
+                xattr: { 'user.part_size': String(size), 'user.part_offset': String(size * i), 'user.md5': etag },
+            });
+            parts.push({ md_path, etag });
+        }
+        const options = {
+            data_prefix: `${MPU}/parts-size-`,
+            size_xattr: 'user.part_size',
+            offset_xattr: 'user.part_offset',
+            md5_xattr: 'user.md5',
+            md5: true,
+        };
+        const res = await nb_native().fs.complete_multipart(DEFAULT_FS_CONFIG, `${MPU}/final`, parts, options);
+        assert.strictEqual(res.size, 230);
+        assert.strictEqual(res.linked_bytes, 200);
+        const md5 = crypto.createHash('md5');
+        for (const { etag } of parts) md5.update(Buffer.from(etag, 'hex'));
+        assert.strictEqual(res.md5, md5.digest('hex'));
+        assert.deepStrictEqual(await fs.promises.readFile(`${MPU}/final`), Buffer.concat(parts_data));
+
+        parts[1].etag = 'bad';
+        await assert.rejects(nb_native().fs.complete_multipart(DEFAULT_FS_CONFIG, `${MPU}/final2`, parts, options),
+            /mismatch part etag/);
+    });
+});
+
+mocha.describe('nb_native fs xattr', function() {
+    const PATH = `/tmp/nb_native_xattr_${Date.now()}`;
+    mocha.after(async function() {
+        nb_native().fs.xattr_config({ buf_size: config.NSFS_XATTR_BUF_SIZE, packed: config.NSFS_XATTR_PACKED });
+        await fs_utils.file_delete(PATH);
+    });
+
+    mocha.it('packed xattr larger than the thread buffer', async function() {
+        nb_native().fs.xattr_config({ buf_size: 256, packed: true });
+        const xattr = { 'user.small': 'a', 'user.empty': '', 'user.large': 'x'.repeat(1000) };
+        await nb_native().fs.writeFile(DEFAULT_FS_CONFIG, PATH, Buffer.from('xattr'), { xattr });
+        const stat = await nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH);
+        assert.strictEqual(Object.keys(stat).includes('_xattr_packed'), false);
+        assert.deepStrictEqual(_.pick(stat.xattr, Object.keys(xattr)), xattr);
+        stat.xattr = { ...stat.xattr, 'user.more': 'b' };
+        assert.strictEqual(stat.xattr['user.more'], 'b');
+        const { stat: stat2 } = await nb_native().fs.readFile(DEFAULT_FS_CONFIG, PATH, { read_xattr: true });
+        assert.deepStrictEqual(_.pick(stat2.xattr, Object.keys(xattr)), xattr);
+    });
+});
+
+mocha.describe('nb_native fs compact stat', function() {
+    const PATH = `/tmp/nb_native_compact_stat_${Date.now()}`;
+    mocha.after(async function() {
+        nb_native().fs.stat_config({});
+        await fs_utils.file_delete(PATH);
+    });
+
+    mocha.it('compact stat matches the full stat', async function() {
+        const xattr = { 'user.compact': 'stat' };
+        await nb_native().fs.writeFile(DEFAULT_FS_CONFIG, PATH, Buffer.from('compact'), { xattr });
+        const full = await nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH);
+        nb_native().fs.stat_config({ compact_class: nb_native.make_compact_stat_class(nb_native().fs.STAT_COMPACT_FIELDS) });
+        const compact = await nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH);
+        for (const key of Object.keys(full)) {
+            assert.deepStrictEqual(compact[key], full[key], key);
+        }
+        const clone = clone_stat(compact, { 'user.other': 'x' });
+        assert.strictEqual(clone.mtimeNsBigint, full.mtimeNsBigint);
+        assert.deepStrictEqual(clone.xattr, { 'user.other': 'x' });
+    });
+});
+
+mocha.describe('nb_native fs pool', function() {
+    const PATH = `/tmp/nb_native_fs_pool_${Date.now()}`;
+    mocha.after(async function() {
+        await fs_utils.file_delete(PATH);
+    });
+
+    mocha.it('runs metadata and data calls on separate lanes', async function() {
+        const data = Buffer.alloc(1024 * 1024, 'fs_pool');
+        await fs.promises.writeFile(PATH, data);
+        nb_native().fs.fs_pool_config({ meta_threads: 2, data_threads: 2 });
+        nb_native().fs.fs_pool_stats({ reset: true });
+        const stats = await Promise.all(_.times(20, () => nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH)));
+        const reads = await Promise.all(_.times(10, () => nb_native().fs.readFile(DEFAULT_FS_CONFIG, PATH)));
+        for (const stat of stats) assert.strictEqual(stat.size, data.length);
+        for (const { data: buf } of reads) assert.deepStrictEqual(buf, data);
+        await assert.rejects(nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH + '.missing'), { code: 'ENOENT' });
+        const pool = nb_native().fs.fs_pool_stats();
+        assert.strictEqual(pool.meta.completed, 21);
+        assert.strictEqual(pool.data.completed, 10);
+        assert.strictEqual(pool.meta.queued, 0);
+    });
+});
+
+mocha.describe('nb_native fs rmtree', function() {
+    const PATH = `/tmp/nb_native_fs_rmtree_${Date.now()}`;
+    const LINK_TARGET = PATH + '_target';
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(LINK_TARGET);
+        await create_file(LINK_TARGET + '/keep');
+        for (let i = 0; i < 5; ++i) {
+            await fs_utils.create_fresh_path(`${PATH}/d${i}/a/b`);
+            await fs.promises.symlink(LINK_TARGET, `${PATH}/d${i}/link`);
+            for (let j = 0; j < 10; ++j) {
+                await create_file(`${PATH}/d${i}/f${j}`);
+                await create_file(`${PATH}/d${i}/a/b/f${j}`);
+            }
+        }
+    });
+    mocha.after(async function() {
+        await fs_utils.folder_delete(PATH);
+        await fs_utils.folder_delete(LINK_TARGET);
+    });
+
+    mocha.it('deletes the tree without following symlinks', async function() {
+        const progress = new Float64Array(4);
+        const res = await nb_native().fs.rmtree(DEFAULT_FS_CONFIG, PATH, { concurrency: 4, progress });
+        assert.strictEqual(res.files, 105);
+        assert.strictEqual(res.dirs, 16);
+        assert.strictEqual(res.error_count, 0);
+        assert.strictEqual(res.cancelled, false);
+        assert.deepStrictEqual(res.errors, []);
+        assert.deepStrictEqual(Array.from(progress), [0, 105, 16, 0]);
+        assert.strictEqual(fs.existsSync(PATH), false);
+        assert.strictEqual(fs.existsSync(LINK_TARGET + '/keep'), true);
+        await assert.rejects(nb_native().fs.rmtree(DEFAULT_FS_CONFIG, PATH), { code: 'ENOENT' });
+    });
+
+    mocha.it('cancels', async function() {
+        await fs_utils.create_fresh_path(`${PATH}/a/b`);
+        const controller = new AbortController();
+        controller.abort();
+        await assert.rejects(rmtree(DEFAULT_FS_CONFIG, PATH, { signal: controller.signal }),
+            { name: 'AbortError' });
+        const progress = new Float64Array(4);
+        progress[0] = 1;
+        const res = await nb_native().fs.rmtree(DEFAULT_FS_CONFIG, PATH, { progress });
+        assert.strictEqual(res.cancelled, true);
+        assert.strictEqual(fs.existsSync(`${PATH}/a/b`), true);
+        await rmtree(DEFAULT_FS_CONFIG, PATH);
+        assert.strictEqual(fs.existsSync(PATH), false);
+    });
+});
+
+mocha.describe('nb_native fs walk', function() {
+    const PATH = `/tmp/nb_native_fs_walk_${Date.now()}`;
+    mocha.before(async function() {
+        for (let i = 0; i < 3; ++i) {
+            await fs_utils.create_fresh_path(`${PATH}/d${i}/a`);
+            await fs_utils.create_fresh_path(`${PATH}/d${i}/.versions`);
+            await create_file(`${PATH}/d${i}/.versions/old`);
+            await fs.promises.symlink('/etc', `${PATH}/d${i}/link`);
+            for (let j = 0; j < 5; ++j) {
+                await create_file(`${PATH}/d${i}/f${j}`);
+                await create_file(`${PATH}/d${i}/a/f${j}`);
+            }
+        }
+        await fs.promises.writeFile(`${PATH}/d1/big`, Buffer.alloc(4096));
+        await nb_native().fs.writeFile(DEFAULT_FS_CONFIG, `${PATH}/d2/tagged`, Buffer.from('tagged'),
+            { xattr: { 'user.noobaa.tag.k': 'v' } });
+    });
+    mocha.after(async function() {
+        await fs_utils.folder_delete(PATH);
+    });
+
+    async function walk_keys(options) {
+        const walker = await nb_native().fs.walk(DEFAULT_FS_CONFIG, PATH, { batch_size: 4, ...options });
+        const keys = [];
+        try {
+            for (let entries = await walker.read(DEFAULT_FS_CONFIG); entries; entries = await walker.read(DEFAULT_FS_CONFIG)) {
+                assert(entries.length <= 4);
+                for (const { key, stat } of entries) {
+                    assert.strictEqual(typeof stat.size, 'number');
+                    keys.push(key);
+                }
+            }
+            assert.strictEqual(walker.stats().done, true);
+            assert.strictEqual(walker.stats().error_count, 0);
+        } finally {
+            await walker.close(DEFAULT_FS_CONFIG);
+        }
+        return keys.sort();
+    }
+
+    mocha.it('walks files', async function() {
+        const keys = await walk_keys({ exclude_dirs: ['.versions'] });
+        assert.strictEqual(keys.length, 32);
+        assert(!keys.some(key => key.includes('.versions') || key.endsWith('link')));
+    });
+
+    mocha.it('filters by prefix, type, size and xattr', async function() {
+        assert.deepStrictEqual(await walk_keys({ prefix: 'd1/a' }),
+            ['d1/a/f0', 'd1/a/f1', 'd1/a/f2', 'd1/a/f3', 'd1/a/f4']);
+        assert.deepStrictEqual(await walk_keys({ prefix: 'd0/', types: ['dir', 'symlink'] }),
+            ['d0/', 'd0/.versions/', 'd0/a/', 'd0/link']);
+        assert.deepStrictEqual(await walk_keys({ min_size: 1000 }), ['d1/big']);
+        assert.deepStrictEqual(await walk_keys({ xattr_equals: { 'user.noobaa.tag.k': 'v' } }), ['d2/tagged']);
+        assert.deepStrictEqual(await walk_keys({ mtime_before_ms: Date.now() - 60000 }), []);
+    });
+
+    mocha.it('closes before done', async function() {
+        const walker = await nb_native().fs.walk(DEFAULT_FS_CONFIG, PATH, { batch_size: 1, concurrency: 2 });
+        const entries = await walker.read(DEFAULT_FS_CONFIG);
+        assert.strictEqual(entries.length, 1);
+        await walker.close(DEFAULT_FS_CONFIG);
+    });
+});
+
+mocha.describe('nb_native fs fsync group', function() {
+    const PATH = `/tmp/nb_native_fs_fsync_group_${Date.now()}`;
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH);
+    });
+    mocha.after(async function() {
+        nb_native().fs.fsync_group_config({ enabled: false });
+        await fs_utils.folder_delete(PATH);
+    });
+
+    mocha.it('coalesces concurrent fsyncs of the same dir', async function() {
+        nb_native().fs.fsync_group_config({ enabled: true, window_us: 20000, max_batch: 10 });
+        nb_native().fs.fsync_group_stats({ reset: true });
+        await Promise.all(_.times(10, () => nb_native().fs.fsync(DEFAULT_FS_CONFIG, PATH)));
+        await assert.rejects(nb_native().fs.fsync(DEFAULT_FS_CONFIG, PATH + '/missing'), { code: 'ENOENT' });
+        const stats = nb_native().fs.fsync_group_stats({ reset: true });
+        assert.strictEqual(stats.enabled, true);
+        assert.strictEqual(stats.requests, 10);
+        assert(stats.syncs < 10, `expected fewer syncs than requests ${stats.syncs}`);
+        assert.strictEqual(stats.errors, 0);
+    });
+});
+
+mocha.describe('nb_native fs publish file', function() {
+    const PATH = `/tmp/nb_native_fs_publish_file_${Date.now()}`;
+    const target = PATH + '/target';
+    mocha.before(async function() {
+        if (os_utils.IS_MAC) this.skip(); // eslint-disable-line no-invalid-this
+        await fs_utils.create_fresh_path(PATH);
+    });
+    mocha.after(async function() {
+        await fs_utils.folder_delete(PATH);
+    });
+
+    async function write_tmpfile(data) {
+        const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, PATH, 'wt');
+        await file.write(DEFAULT_FS_CONFIG, Buffer.from(data), data.length);
+        return file;
+    }
+
+    mocha.it('links a new file with xattr', async function() {
+        const file = await write_tmpfile('first');
+        try {
+            await file.publish_file(DEFAULT_FS_CONFIG, target, { xattr: { 'user.key': 'v1' } });
+        } finally {
+            await file.close(DEFAULT_FS_CONFIG);
+        }
+        assert.strictEqual(fs.readFileSync(target, 'utf8'), 'first');
+        const stat = await nb_native().fs.stat(DEFAULT_FS_CONFIG, target);
+        assert.strictEqual(stat.xattr['user.key'], 'v1');
+    });
+
+    mocha.it('replaces an existing file only when allowed', async function() {
+        const old_stat = await nb_native().fs.stat(DEFAULT_FS_CONFIG, target);
+        const file = await write_tmpfile('second');
+        try {
+            await assert.rejects(file.publish_file(DEFAULT_FS_CONFIG, target, { no_replace: true }), { code: 'EEXIST' });
+            await assert.rejects(file.publish_file(DEFAULT_FS_CONFIG, target), { code: 'EEXIST' });
+            await assert.rejects(file.publish_file(DEFAULT_FS_CONFIG, target, {
+                expected_mtime: old_stat.mtimeNsBigint, expected_ino: old_stat.ino,
+            }), /require tmp_path/);
+            await assert.rejects(file.publish_file(DEFAULT_FS_CONFIG, target, {
+                tmp_path: PATH + '/tmp1', expected_mtime: old_stat.mtimeNsBigint + BigInt(1), expected_ino: old_stat.ino,
+            }), /doesn't match expected inode and mtime/);
+            await file.publish_file(DEFAULT_FS_CONFIG, target, {
+                tmp_path: PATH + '/tmp2', expected_mtime: old_stat.mtimeNsBigint, expected_ino: old_stat.ino,
+            });
+        } finally {
+            await file.close(DEFAULT_FS_CONFIG);
+        }
+        assert.strictEqual(fs.readFileSync(target, 'utf8'), 'second');
+        assert.deepStrictEqual(fs.readdirSync(PATH), ['target']);
+    });
+});
+
+mocha.describe('nb_native fs allocate', function() {
+    const PATH = `/tmp/nb_native_fs_allocate_${Date.now()}`;
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH);
+    });
+    mocha.after(async function() {
+        await fs_utils.folder_delete(PATH);
+    });
+
+    mocha.it('preallocates on open keeping the size', async function() {
+        const file_path = PATH + '/open';
+        const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, file_path, 'w', 0o600, { preallocate: 1024 * 1024 });
+        try {
+            const stat = await file.stat(DEFAULT_FS_CONFIG);
+            assert.strictEqual(stat.size, 0);
+            const allocated = await file.allocate(DEFAULT_FS_CONFIG, 0, 4096);
+            const stat2 = await file.stat(DEFAULT_FS_CONFIG);
+            assert.strictEqual(stat2.size, allocated ? 4096 : 0);
+            await assert.rejects(file.allocate(DEFAULT_FS_CONFIG, -1, 4096), /invalid range/);
+        } finally {
+            await file.close(DEFAULT_FS_CONFIG);
+        }
+    });
+
+    mocha.it('writeFile with preallocate', async function() {
+        const file_path = PATH + '/writefile';
+        const data = crypto.randomBytes(10000);
+        await nb_native().fs.writeFile(DEFAULT_FS_CONFIG, file_path, data, { preallocate: true });
+        assert.deepStrictEqual(fs.readFileSync(file_path), data);
+    });
+});
+
+mocha.describe('nb_native fs advise', function() {
+    const PATH = `/tmp/nb_native_fs_advise_${Date.now()}`;
+    mocha.before(async function() {
+        fs.writeFileSync(PATH, crypto.randomBytes(1024 * 1024));
+    });
+    mocha.after(async function() {
+        fs.rmSync(PATH, { force: true });
+    });
+
+    mocha.it('advises and reads ahead', async function() {
+        const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, PATH);
+        try {
+            for (const advice of ['sequential', 'willneed', 'dontneed', 'noreuse', 'random', 'normal']) {
+                await file.advise(DEFAULT_FS_CONFIG, 0, 0, advice);
+            }
+            await file.readahead(DEFAULT_FS_CONFIG, 0, 512 * 1024);
+            await file.readahead(DEFAULT_FS_CONFIG, 512 * 1024, 0);
+            // @ts-ignore
+            await assert.rejects(file.advise(DEFAULT_FS_CONFIG, 0, 0, 'forget'), /unexpected advice/);
+            await assert.rejects(file.readahead(DEFAULT_FS_CONFIG, -1, 10), /invalid range/);
+        } finally {
+            await file.close(DEFAULT_FS_CONFIG);
+        }
+    });
+});
+
+mocha.describe('nb_native fs object cache', function() {
+    const PATH = `/tmp/nb_native_fs_object_cache_${Date.now()}`;
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH);
+        nb_native().fs.object_cache_config({ max_entries: 100, max_bytes: 1024 * 1024, max_object_size: 4096 });
+        nb_native().fs.object_cache_stats({ reset: true });
+    });
+    mocha.after(async function() {
+        nb_native().fs.object_cache_config({
+            max_entries: config.NSFS_OBJECT_CACHE_SIZE,
+            max_bytes: config.NSFS_OBJECT_CACHE_MAX_BYTES,
+            max_object_size: config.NSFS_OBJECT_CACHE_MAX_OBJECT_SIZE,
+        });
+        await fs_utils.folder_delete(PATH);
+    });
+
+    async function set_xattr(file_path, xattr) {
+        const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, file_path, 'r');
+        try {
+            await file.replacexattr(DEFAULT_FS_CONFIG, xattr);
+        } finally {
+            await file.close(DEFAULT_FS_CONFIG);
+        }
+    }
+
+    mocha.it('caches small files until they change', async function() {
+        const file_path = PATH + '/small';
+        fs.writeFileSync(file_path, 'first');
+        await set_xattr(file_path, { 'user.key': 'v1' });
+        const res1 = await nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, file_path);
+        assert.strictEqual(res1.cache_hit, false);
+        assert.strictEqual(res1.data.toString(), 'first');
+        assert.strictEqual(res1.stat.xattr['user.key'], 'v1');
+        const res2 = await nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, file_path);
+        assert.strictEqual(res2.cache_hit, true);
+        assert.strictEqual(res2.data.toString(), 'first');
+        assert.strictEqual(res2.stat.xattr['user.key'], 'v1');
+        // every read gets its own copy of the cached data
+        res2.data.fill(0);
+        const res2b = await nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, file_path);
+        assert.strictEqual(res2b.cache_hit, true);
+        assert.strictEqual(res2b.data.toString(), 'first');
+
+        // xattr changes update the ctime and invalidate the entry
+        await set_xattr(file_path, { 'user.key': 'v2' });
+        const res3 = await nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, file_path);
+        assert.strictEqual(res3.cache_hit, false);
+        assert.strictEqual(res3.stat.xattr['user.key'], 'v2');
+
+        fs.writeFileSync(file_path, 'second!');
+        const res4 = await nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, file_path);
+        assert.strictEqual(res4.cache_hit, false);
+        assert.strictEqual(res4.data.toString(), 'second!');
+
+        const stats = nb_native().fs.object_cache_stats({ reset: true });
+        assert.strictEqual(stats.hits, 2);
+        assert.strictEqual(stats.invalidations, 2);
+        assert.strictEqual(stats.entries, 1);
+    });
+
+    mocha.it('returns only the stat of large files', async function() {
+        const file_path = PATH + '/large';
+        fs.writeFileSync(file_path, crypto.randomBytes(8192));
+        const res = await nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, file_path);
+        assert.strictEqual(res.data, undefined);
+        assert.strictEqual(res.stat.size, 8192);
+        await assert.rejects(nb_native().fs.read_cached_file(DEFAULT_FS_CONFIG, PATH + '/missing'), { code: 'ENOENT' });
+    });
+});
+
+mocha.describe('nb_native fs fd cache', function() {
+    const PATH = `/tmp/nb_native_fs_fd_cache_${Date.now()}`;
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH);
+        nb_native().fs.fd_cache_config({ max_entries: 2, idle_ttl_ms: 60000, validate_ms: 0 });
+        nb_native().fs.fd_cache_stats({ reset: true });
+    });
+    mocha.after(async function() {
+        nb_native().fs.fd_cache_config({
+            max_entries: config.NSFS_FD_CACHE_SIZE,
+            idle_ttl_ms: config.NSFS_FD_CACHE_IDLE_TTL_MS,
+            validate_ms: config.NSFS_FD_CACHE_VALIDATE_MS,
+        });
+        await fs_utils.folder_delete(PATH);
+    });
+
+    async function read_all(file_path) {
+        const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, file_path, 'r', undefined, { cache: true });
+        try {
+            const stat = await file.stat(DEFAULT_FS_CONFIG);
+            const buf = Buffer.alloc(stat.size);
+            await file.read(DEFAULT_FS_CONFIG, buf, 0, buf.length, 0);
+            return buf.toString();
+        } finally {
+            await file.close(DEFAULT_FS_CONFIG);
+        }
+    }
+
+    mocha.it('shares the fd of repeated opens', async function() {
+        const file_path = PATH + '/shared';
+        fs.writeFileSync(file_path, 'shared data');
+        const file1 = await nb_native().fs.open(DEFAULT_FS_CONFIG, file_path, 'r', undefined, { cache: true });
+        const file2 = await nb_native().fs.open(DEFAULT_FS_CONFIG, file_path, 'r', undefined, { cache: true });
+        assert.strictEqual(file1.fd, file2.fd);
+        let stats = nb_native().fs.fd_cache_stats({ reset: true });
+        assert.strictEqual(stats.hits, 1);
+        assert.strictEqual(stats.in_use, 1);
+        await file1.close(DEFAULT_FS_CONFIG);
+        // the shared fd stays open for the other file
+        const buf = Buffer.alloc(6);
+        await file2.read(DEFAULT_FS_CONFIG, buf, 0, buf.length, 0);
+        assert.strictEqual(buf.toString(), 'shared');
+        await file2.close(DEFAULT_FS_CONFIG);
+        stats = nb_native().fs.fd_cache_stats();
+        assert.strictEqual(stats.in_use, 0);
+        assert.strictEqual(stats.entries, 1);
+    });
+
+    mocha.it('invalidates on unlink, rename and external changes', async function() {
+        const file_path = PATH + '/changing';
+        fs.writeFileSync(file_path, 'first');
+        assert.strictEqual(await read_all(file_path), 'first');
+        assert.strictEqual(await read_all(file_path), 'first');
+        nb_native().fs.fd_cache_stats({ reset: true });
+
+        await nb_native().fs.unlink(DEFAULT_FS_CONFIG, file_path);
+        fs.writeFileSync(file_path, 'second');
+        assert.strictEqual(await read_all(file_path), 'second');
+
+        fs.writeFileSync(PATH + '/replacement', 'third');
+        await nb_native().fs.rename(DEFAULT_FS_CONFIG, PATH + '/replacement', file_path);
+        assert.strictEqual(await read_all(file_path), 'third');
+
+        // replaced without our ops is caught by the validation
+        fs.writeFileSync(PATH + '/replacement', 'fourth');
+        fs.renameSync(PATH + '/replacement', file_path);
+        assert.strictEqual(await read_all(file_path), 'fourth');
+
+        const stats = nb_native().fs.fd_cache_stats({ reset: true });
+        assert.strictEqual(stats.hits, 0);
+        assert.strictEqual(stats.invalidations, 3);
+    });
+
+    mocha.it('does not cache write opens and evicts idle fds when full', async function() {
+        const file_path = PATH + '/write';
+        fs.writeFileSync(file_path, 'data');
+        const file = await nb_native().fs.open(DEFAULT_FS_CONFIG, file_path, 'r+', undefined, { cache: true });
+        await file.close(DEFAULT_FS_CONFIG);
+        assert.strictEqual(nb_native().fs.fd_cache_stats({ reset: true }).inserts, 0);
+
+        for (let i = 0; i < 4; ++i) {
+            fs.writeFileSync(`${PATH}/evict${i}`, 'data');
+            await read_all(`${PATH}/evict${i}`);
+        }
+        const stats = nb_native().fs.fd_cache_stats({ reset: true });
+        assert.strictEqual(stats.entries, 2);
+        assert.ok(stats.evictions >= 2);
+    });
+});
+
+mocha.describe('nb_native fs blocks', function() {
+    const PATH = `/tmp/nb_native_fs_blocks_${Date.now()}`;
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH);
+    });
+    mocha.after(async function() {
+        await fs_utils.folder_delete(PATH);
+    });
+
+    function block(i) {
+        return { path: `${PATH}/block${i}.data`, meta_path: `${PATH}/block${i}.meta` };
+    }
+
+    mocha.it('writes, reads and deletes a batch', async function() {
+        const blocks = [];
+        for (let i = 0; i < 20; ++i) {
+            blocks.push({ ...block(i), data: crypto.randomBytes(1000 + i), md: JSON.stringify({ id: `block${i}` }) });
+        }
+        const write_res = await nb_native().fs.write_blocks(DEFAULT_FS_CONFIG, blocks, { concurrency: 4 });
+        assert.deepStrictEqual(write_res.map(r => r.replaced_size), blocks.map(() => -1));
+        assert.strictEqual(fs.readFileSync(blocks[3].meta_path, 'utf8'), blocks[3].md);
+
+        // include a missing block which fails only its own entry
+        const read_res = await nb_native().fs.read_blocks(DEFAULT_FS_CONFIG, [...blocks.map(b => _.pick(b, 'path', 'meta_path')), block(99)]);
+        assert.strictEqual(read_res.length, 21);
+        for (let i = 0; i < 20; ++i) {
+            assert.strictEqual(read_res[i].code, undefined);
+            assert.deepStrictEqual(read_res[i].data, blocks[i].data);
+            assert.strictEqual(read_res[i].md, blocks[i].md);
+        }
+        assert.strictEqual(read_res[20].code, 'ENOENT');
+
+        const delete_res = await nb_native().fs.delete_blocks(DEFAULT_FS_CONFIG, [block(0), block(1), block(99)]);
+        assert.strictEqual(delete_res[0].size, blocks[0].data.length + blocks[0].md.length);
+        assert.strictEqual(delete_res[1].size, blocks[1].data.length + blocks[1].md.length);
+        assert.strictEqual(delete_res[2].size, -1);
+        assert.strictEqual(delete_res[2].code, undefined);
+        assert.strictEqual(fs.existsSync(blocks[0].path), false);
+        assert.strictEqual(fs.existsSync(blocks[0].meta_path), false);
+    });
+
+    mocha.it('returns the replaced size on overwrite', async function() {
+        const b = { ...block(100), data: Buffer.from('first data'), md: 'md1' };
+        await nb_native().fs.write_blocks(DEFAULT_FS_CONFIG, [b]);
+        const [res] = await nb_native().fs.write_blocks(DEFAULT_FS_CONFIG, [{ ...b, data: Buffer.from('second'), md: 'md2' }]);
+        assert.strictEqual(res.replaced_size, 'first data'.length + 'md1'.length);
+        const [read_res] = await nb_native().fs.read_blocks(DEFAULT_FS_CONFIG, [block(100)]);
+        assert.strictEqual(read_res.data.toString(), 'second');
+        assert.strictEqual(read_res.md, 'md2');
+    });
+
+    mocha.it('deletes the meta file of a missing block', async function() {
+        fs.writeFileSync(block(200).meta_path, 'orphan md');
+        const [res] = await nb_native().fs.delete_blocks(DEFAULT_FS_CONFIG, [block(200)]);
+        assert.strictEqual(res.size, -1);
+        assert.strictEqual(res.code, undefined);
+        assert.strictEqual(fs.existsSync(block(200).meta_path), false);
+    });
+});
+
+mocha.describe('nb_native fs readdir_versions', function() {
+    const PATH = `/tmp/nb_native_fs_readdir_versions_${Date.now()}`;
+    const version_name = (key, sec, ino) => `${key}_mtime-${(BigInt(sec) * 1000000000n).toString(36)}-ino-${ino}`;
+    const names = entries => entries.map(e => e.name);
+
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH + '/versioned/.versions');
+        await fs_utils.create_fresh_path(PATH + '/plain');
+        for (const name of ['c', 'a', 'b']) {
+            fs.writeFileSync(`${PATH}/versioned/${name}`, name);
+            fs.writeFileSync(`${PATH}/plain/${name}`, name);
+        }
+        for (const name of [version_name('a', 1000, 2), version_name('b', 500, 3), version_name('a', 3000, 1)]) {
+            fs.writeFileSync(`${PATH}/versioned/.versions/${name}`, name);
+        }
+        fs.writeFileSync(`${PATH}/versioned/.versions/a_null`, 'null');
+        fs.utimesSync(`${PATH}/versioned/.versions/a_null`, 2000, 2000);
+    });
+    mocha.after(async function() {
+        await fs_utils.folder_delete(PATH);
+    });
+
+    const EXPECTED = [
+        '.versions',
+        'a',
+        version_name('a', 3000, 1),
+        'a_null',
+        version_name('a', 1000, 2),
+        'b',
+        version_name('b', 500, 3),
+        'c',
+    ];
+
+    mocha.it('merges the versions by key and then from the latest to the oldest', async function() {
+        const entries = await nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, PATH + '/versioned');
+        assert.deepStrictEqual(names(entries), EXPECTED);
+        assert(entries.every(e => typeof e.ino === 'number' && typeof e.type === 'number'));
+    });
+
+    mocha.it('pages after a marker', async function() {
+        const dir = PATH + '/versioned';
+        let entries = await nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, dir, { start_after: 'a_null', limit: 2 });
+        assert.deepStrictEqual(names(entries), EXPECTED.slice(4, 6));
+        // a marker that no longer exists continues from its sort position
+        entries = await nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, dir, { start_after: version_name('a', 2500, 9) });
+        assert.deepStrictEqual(names(entries), EXPECTED.slice(3));
+        entries = await nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, dir, { start_after: 'c', limit: 10 });
+        assert.deepStrictEqual(entries, []);
+    });
+
+    mocha.it('pages with a cursor', async function() {
+        const dir = PATH + '/versioned';
+        const cursor = await nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, dir, { start_after: 'a', cursor: true });
+        try {
+            assert.deepStrictEqual(names(cursor.read(2)), EXPECTED.slice(2, 4));
+            assert.deepStrictEqual(names(cursor.read(100)), EXPECTED.slice(4));
+            assert.deepStrictEqual(cursor.read(2), []);
+        } finally {
+            cursor.close();
+        }
+        assert.deepStrictEqual(cursor.read(2), []);
+    });
+
+    mocha.it('orders by name without a versions dir', async function() {
+        const entries = await nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, PATH + '/plain');
+        assert.deepStrictEqual(names(entries), ['a', 'b', 'c']);
+        await assert.rejects(nb_native().fs.readdir_versions(DEFAULT_FS_CONFIG, PATH + '/missing'), { code: 'ENOENT' });
+    });
+});
+
+mocha.describe('nb_native fs config cache', function() {
+    const PATH = `/tmp/nb_native_fs_config_cache_${Date.now()}`;
+    const ID_PATH = PATH + '/identities/1/identity.json';
+    const LINK_PATH = PATH + '/accounts_by_name/alice.symlink';
+
+    mocha.before(async function() {
+        await fs_utils.create_fresh_path(PATH + '/identities/1');
+        await fs_utils.create_fresh_path(PATH + '/accounts_by_name');
+    });
+    // every test starts from the same identity, so it does not depend on the tests that ran before it
+    mocha.beforeEach(function() {
+        write_identity('alice');
+        if (!fs.existsSync(LINK_PATH)) fs.symlinkSync('../identities/1/identity.json', LINK_PATH);
+    });
+    mocha.afterEach(function() {
+        nb_native().fs.config_cache_config({ max_entries: 0 });
+    });
+    mocha.after(async function() {
+        nb_native().fs.config_cache_config({
+            max_entries: config.NSFS_CONFIG_CACHE_SIZE,
+            max_bytes: config.NSFS_CONFIG_CACHE_MAX_BYTES,
+            max_file_size: config.NSFS_CONFIG_CACHE_MAX_FILE_SIZE,
+            validate_ms: config.NSFS_CONFIG_CACHE_VALIDATE_MS,
+            watch: config.NSFS_CONFIG_CACHE_WATCH,
+        });
+        await fs_utils.folder_delete(PATH);
+    });
+
+    function write_identity(name) {
+        fs.writeFileSync(PATH + '/tmp.json', JSON.stringify({ name }));
+        fs.renameSync(PATH + '/tmp.json', ID_PATH);
+    }
+
+    async function read_config(file_path) {
+        const cached = nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, file_path);
+        if (cached) return cached.toString();
+        const { data } = await nb_native().fs.read_config_file(DEFAULT_FS_CONFIG, file_path);
+        return data.toString();
+    }
+
+    async function wait_invalidated(file_path) {
+        for (let i = 0; i < 100; ++i) {
+            if (!nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, file_path)) return;
+            await new Promise(resolve => setTimeout(resolve, 10));
+        }
+        assert.fail(`expected ${file_path} to be invalidated`);
+    }
+
+    mocha.it('serves watched files synchronously until changed', async function() {
+        if (!os_utils.IS_LINUX) this.skip(); // eslint-disable-line no-invalid-this
+        nb_native().fs.config_cache_config({ max_entries: 100, validate_ms: 60000, watch: true });
+        assert.strictEqual(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, ID_PATH), undefined);
+        assert.strictEqual(await read_config(ID_PATH), '{"name":"alice"}');
+        assert.strictEqual(await read_config(LINK_PATH), '{"name":"alice"}');
+        assert.strictEqual(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, LINK_PATH).toString(), '{"name":"alice"}');
+        let stats = nb_native().fs.config_cache_stats({ reset: true });
+        assert.strictEqual(stats.entries, 2);
+        assert.strictEqual(stats.watched_entries, 2);
+
+        // an external update of the symlink target invalidates both paths
+        write_identity('alice2');
+        await wait_invalidated(ID_PATH);
+        await wait_invalidated(LINK_PATH);
+        assert.strictEqual(await read_config(LINK_PATH), '{"name":"alice2"}');
+        stats = nb_native().fs.config_cache_stats({ reset: true });
+        assert(stats.watch_events > 0);
+        assert.strictEqual(stats.invalidations, 2);
+
+        fs.unlinkSync(LINK_PATH);
+        await wait_invalidated(LINK_PATH);
+        await assert.rejects(nb_native().fs.read_config_file(DEFAULT_FS_CONFIG, LINK_PATH), { code: 'ENOENT' });
+    });
+
+    mocha.it('validates unwatched files by stat', async function() {
+        nb_native().fs.config_cache_config({ max_entries: 100, validate_ms: 0, watch: false });
+        assert.strictEqual(await read_config(ID_PATH), '{"name":"alice"}');
+        // with validate_ms 0 every read is validated, and an unchanged file costs a stat
+        assert.strictEqual(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, ID_PATH), undefined);
+        const res = await nb_native().fs.read_config_file(DEFAULT_FS_CONFIG, ID_PATH);
+        assert.strictEqual(res.cache_hit, true);
+        write_identity('alice2');
+        assert.strictEqual(await read_config(ID_PATH), '{"name":"alice2"}');
+        const stats = nb_native().fs.config_cache_stats({ reset: true });
+        assert.strictEqual(stats.watched_entries, 0);
+        assert.strictEqual(stats.validations, 1);
+    });
+
+    mocha.it('invalidates on our own rename and unlink', async function() {
+        nb_native().fs.config_cache_config({ max_entries: 100, validate_ms: 60000, watch: false });
+        assert.strictEqual(await read_config(ID_PATH), '{"name":"alice"}');
+        assert(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, ID_PATH));
+        fs.writeFileSync(PATH + '/tmp.json', '{"name":"alice2"}');
+        await nb_native().fs.rename(DEFAULT_FS_CONFIG, PATH + '/tmp.json', ID_PATH);
+        assert.strictEqual(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, ID_PATH), undefined);
+        assert.strictEqual(await read_config(ID_PATH), '{"name":"alice2"}');
+        // the symlink entry resolved to the renamed target is dropped too
+        assert.strictEqual(await read_config(LINK_PATH), '{"name":"alice2"}');
+        fs.writeFileSync(PATH + '/tmp.json', '{"name":"alice3"}');
+        await nb_native().fs.rename(DEFAULT_FS_CONFIG, PATH + '/tmp.json', ID_PATH);
+        assert.strictEqual(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, LINK_PATH), undefined);
+        assert.strictEqual(await read_config(LINK_PATH), '{"name":"alice3"}');
+    });
+
+    mocha.it('does not cache files larger than max_file_size', async function() {
+        nb_native().fs.config_cache_config({ max_entries: 100, max_file_size: 4, watch: false });
+        assert.strictEqual(await read_config(ID_PATH), '{"name":"alice"}');
+        assert.strictEqual(nb_native().fs.config_cache_get(DEFAULT_FS_CONFIG, ID_PATH), undefined);
+        assert.strictEqual(nb_native().fs.config_cache_stats().entries, 0);
+    });
+});
+
+mocha.describe('nb_native fs latency stats', function() {
+    mocha.after(function() {
+        nb_native().fs.latency_stats_config({ enabled: config.NSFS_FS_NATIVE_STATS });
+    });
+
+    mocha.it('counts ops and errors natively', async function() {
+        const PATH = '/tmp';
+        nb_native().fs.latency_stats_config({ enabled: true });
+        nb_native().fs.get_stats({ reset: true });
+        await Promise.all(_.times(5, () => nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH)));
+        await assert.rejects(nb_native().fs.stat(DEFAULT_FS_CONFIG, PATH + '/nb_native_missing_file'), { code: 'ENOENT' });
+        const stats = nb_native().fs.get_stats({ reset: true });
+        assert.strictEqual(stats.Stat.count, 6);
+        assert.strictEqual(stats.Stat.error_count, 1);
+        assert.strictEqual(stats.Stat.run.count, 5);
+        assert.strictEqual(stats.Stat.wait.count, 6);
+        assert(stats.Stat.run.min_us <= stats.Stat.run.p50_us);
+        assert(stats.Stat.run.p50_us <= stats.Stat.run.p99_us);
+        assert(stats.Stat.run.p99_us <= stats.Stat.run.max_us);
+        assert.deepStrictEqual(nb_native().fs.get_stats(), {});
+    });
+});
+
+mocha.describe('nb_native fs dio slab', function() {
+
+    mocha.it('alloc and release buffers', function() {
+        const native_fs = nb_native().fs;
+        native_fs.dio_slab_config({ sizes: [config.NSFS_BUF_SIZE_XS, config.NSFS_BUF_SIZE_S] });
+        const before = native_fs.dio_slab_stats();
+        assert.strictEqual(before.enabled, true);
+        const buf = native_fs.dio_buffer_alloc(config.NSFS_BUF_SIZE_S);
+        assert.strictEqual(buf.length, config.NSFS_BUF_SIZE_S);
+        assert.strictEqual(buf.byteOffset % 4096, 0);
+        buf.fill(7);
+        const after_alloc = native_fs.dio_slab_stats();
+        const cls = after_alloc.classes.find(c => c.size === config.NSFS_BUF_SIZE_S);
+        assert(cls.total > 0);
+        assert.strictEqual(native_fs.dio_buffer_release(buf), true);
+        // a second release of the same buffer is ignored
+        assert.strictEqual(native_fs.dio_buffer_release(buf), false);
+        const after_release = native_fs.dio_slab_stats();
+        assert(after_release.ignored_frees > before.ignored_frees);
+    });
 });
 
 async function create_file(file_path) {
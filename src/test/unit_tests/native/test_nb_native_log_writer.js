@@ -0,0 +1,95 @@
+/* Copyright (C) 2016 NooBaa */
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const mocha = require('mocha');
+const assert = require('assert');
+const fs_utils = require('../../../util/fs_utils');
+const nb_native = require('../../../util/nb_native');
+const { PersistentLogger } = require('../../../util/persistent_logger');
+
+mocha.describe('nb_native log writer', function() {
+
+    const dir = path.join(os.tmpdir(), `test_nb_native_log_writer_${process.pid}`);
+    const active_path = path.join(dir, 'test.log');
+
+    mocha.beforeEach(async function() {
+        await fs_utils.create_fresh_path(dir);
+    });
+
+    mocha.after(async function() {
+        await fs_utils.folder_delete(dir);
+    });
+
+    function read_lines(file_path) {
+        return fs.readFileSync(file_path, 'utf8').split('\n').filter(Boolean);
+    }
+
+    mocha.it('appends and flushes records in order', async function() {
+        const writer = new (nb_native().LogWriter)({ dir, namespace: 'test', lock: 'SHARED' });
+        await writer.open();
+        let seq = 0;
+        for (let i = 0; i < 1000; ++i) {
+            const next = writer.append(`record ${i}\n`);
+            assert(next > seq);
+            seq = next;
+        }
+        const flushed = await writer.flush();
+        assert(flushed >= seq);
+        const lines = read_lines(active_path);
+        assert.strictEqual(lines.length, 1000);
+        assert.strictEqual(lines[999], 'record 999');
+        const stats = writer.stats();
+        assert.strictEqual(stats.appended_records, 1000);
+        assert.strictEqual(stats.backlog_bytes, 0);
+        assert(stats.flushes < 1000, 'expected records to be batched');
+        await writer.close();
+    });
+
+    mocha.it('throws ENOBUFS when the buffer is full', async function() {
+        const writer = new (nb_native().LogWriter)({ dir, namespace: 'test', buffer_size: 4096, flush_interval_ms: 1000 });
+        await writer.open();
+        const record = 'x'.repeat(1000) + '\n';
+        let full = false;
+        for (let i = 0; i < 10 && !full; ++i) {
+            try {
+                writer.append(record);
+            } catch (err) {
+                assert.strictEqual(err.code, 'ENOBUFS');
+                full = true;
+            }
+        }
+        assert(full, 'expected the buffer to fill up');
+        await writer.flush();
+        writer.append(record);
+        await writer.close();
+    });
+
+    mocha.it('rotates the active file by size', async function() {
+        const writer = new (nb_native().LogWriter)({ dir, namespace: 'test', rotate_size: 1000, fsync: false });
+        await writer.open();
+        for (let i = 0; i < 10; ++i) {
+            writer.append('y'.repeat(299) + '\n');
+            await writer.flush();
+        }
+        await writer.close();
+        const files = fs.readdirSync(dir);
+        const inactive = files.filter(f => /^test[.]\d+[.]log$/.test(f));
+        assert(inactive.length >= 2, `expected rotated files: ${files}`);
+        assert.strictEqual(writer.stats().rotations, inactive.length);
+        const total = files.reduce((sum, f) => sum + read_lines(path.join(dir, f)).length, 0);
+        assert.strictEqual(total, 10);
+    });
+
+    mocha.it('PersistentLogger appends through the native writer', async function() {
+        const logger = new PersistentLogger(dir, 'test', { locking: 'SHARED', native_writer: true });
+        await Promise.all(Array.from({ length: 100 }, (v, i) => logger.append(`entry ${i}`)));
+        const lines = read_lines(active_path);
+        assert.strictEqual(lines.length, 100);
+        assert.deepStrictEqual(new Set(lines).size, 100);
+        await logger.close();
+    });
+
+});
@@ -63,6 +63,9 @@ require('../../unit_tests/nsfs/test_namespace_fs');
 require('../../unit_tests/api/s3/test_ns_list_objects');
 require('../../unit_tests/nsfs/test_namespace_fs_mpu');
 require('../../unit_tests/native/test_nb_native_fs');
+require('../../unit_tests/native/test_nb_native_block_log');
+require('../../unit_tests/native/test_nb_native_log_writer');
+require('../../unit_tests/native/test_nb_native_bucket_index');
 require('../../unit_tests/api/s3/test_s3select');
 require('../../unit_tests/nsfs/test_nsfs_glacier_backend');
 
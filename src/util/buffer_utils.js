@@ -186,9 +186,10 @@ class BuffersPool {
      *      warning_timeout: number;
      *      release_unused_interval?: number;
      *      buffer_alloc?: (size: number) => Buffer;
+     *      buffer_release?: (buf: Buffer) => void;
      * }} params
      */
-    constructor({ buf_size, sem, warning_timeout, release_unused_interval, buffer_alloc }) {
+    constructor({ buf_size, sem, warning_timeout, release_unused_interval, buffer_alloc, buffer_release }) {
         const MIN_BUFFERS = 8;
         if (sem.value < MIN_BUFFERS * buf_size) {
             dbg.error(`BuffersPool: buffer size ${buf_size} pool size ${sem.value}`,
@@ -199,6 +200,7 @@ class BuffersPool {
         this.sem = sem;
         this.warning_timeout = warning_timeout;
         this.buffer_alloc = buffer_alloc || Buffer.allocUnsafeSlow;
+        this.buffer_release = buffer_release;
         this.lowest_buffers_length = 0;
         if (release_unused_interval > 0) {
             this.release_interval = setInterval(() => this._release_unused(), release_unused_interval).unref();
@@ -216,8 +218,11 @@ class BuffersPool {
                     'lowest_buffers_length', this.lowest_buffers_length,
                     'release_count', release_count);
                 // decreasing the buffers array length will unref the last buffers of the array
-                // and allow them to be garbage collected
-                this.buffers.length -= release_count;
+                // and allow them to be garbage collected, or released right away if buffer_release was provided
+                const released = this.buffers.splice(this.buffers.length - release_count, release_count);
+                if (this.buffer_release) {
+                    for (const buf of released) this.buffer_release(buf);
+                }
             }
         }
         // start a new interval of tracking the lowest buffers length
@@ -300,9 +305,13 @@ class MultiSizeBuffersPool {
      *      sem_timeout_error_code?: string;
      *      sem_warning_timeout?: number;
      *      buffer_alloc?: (size: number) => Buffer;
+     *      buffer_release?: (buf: Buffer) => void;
      * }} params
      */
-    constructor({ sorted_buf_sizes, warning_timeout, sem_timeout, sem_timeout_error_code, sem_warning_timeout, buffer_alloc }) {
+    constructor({
+        sorted_buf_sizes, warning_timeout, sem_timeout, sem_timeout_error_code, sem_warning_timeout,
+        buffer_alloc, buffer_release,
+    }) {
         /** @type {BuffersPool} */
         this.default_pool = null;
         this.pools = sorted_buf_sizes.map(({ size, sem_size, is_default, release_unused_interval }) => {
@@ -315,7 +324,8 @@ class MultiSizeBuffersPool {
                 }),
                 warning_timeout: warning_timeout,
                 release_unused_interval,
-                buffer_alloc
+                buffer_alloc,
+                buffer_release,
             });
             if (is_default) {
                 this.default_pool ||= pool;
@@ -1,12 +1,14 @@
 /* Copyright (C) 2024 NooBaa */
 'use strict';
 
+const http = require('http');
 const stream = require('stream');
 const assert = require('assert');
 const config = require('../../config');
 const nb_native = require('./nb_native');
 const stream_utils = require('./stream_utils');
 const native_fs_utils = require('./native_fs_utils');
+const dbg = require('./debug_module')(__filename);
 
 /** @typedef {import('./buffer_utils').MultiSizeBuffersPool} MultiSizeBuffersPool */
 
@@ -40,6 +42,8 @@ class FileReader extends stream.Readable {
      *      bucket?: string,
      *      namespace_resource_id?: string,
      *      highWaterMark?: number,
+     *      readahead_size?: number,
+     *      drop_behind?: boolean,
      * }} params
      */
     constructor({ fs_context,
@@ -54,6 +58,8 @@ class FileReader extends stream.Readable {
         bucket,
         namespace_resource_id,
         highWaterMark = config.NSFS_DOWNLOAD_STREAM_MEM_THRESHOLD,
+        readahead_size = config.NSFS_READAHEAD_SIZE,
+        drop_behind = false,
     }) {
         super({ highWaterMark });
         this.fs_context = fs_context;
@@ -75,6 +81,12 @@ class FileReader extends stream.Readable {
         this.num_bytes = 0;
         this.num_buffers = 0;
         this.log2_size_histogram = {};
+        // page cache hints - prefetch a window ahead of the reader, and drop the pages behind it for scans
+        this.readahead_size = readahead_size;
+        this.readahead_pos = this.start;
+        this.drop_behind = drop_behind;
+        this.drop_behind_pos = this.start;
+        this.hint_promise = null;
     }
 
     /**
@@ -113,6 +125,7 @@ class FileReader extends stream.Readable {
     async read_into_buffer(buf, offset, length) {
         await this._warmup_sparse_file(this.pos);
         this.signal.throwIfAborted();
+        this._send_cache_hints();
         const nread = await this.file.read(this.fs_context, buf, offset, length, this.pos);
         if (nread) {
             this.pos += nread;
@@ -139,6 +152,11 @@ class FileReader extends stream.Readable {
         // cheap fast-fail if target_stream is destroyed to stop earlier
         if (target_stream.destroyed) this.signal.throwIfAborted();
 
+        if (this._can_sendfile(target_stream)) {
+            await this.sendfile_into_response(/** @type {http.ServerResponse} */ (target_stream));
+            return;
+        }
+
         let buffer_pool_cleanup = null;
         let drain_promise = null;
 
@@ -197,6 +215,72 @@ class FileReader extends stream.Readable {
         }
     }
 
+    /**
+     * Zero-copy alternative to read_into_stream for plain http responses.
+     * The data is sent from the file to the response socket inside the kernel using sendfile(2),
+     * so it does not cross user space and does not use the buffer pool.
+     * The native call returns partial counts with again=true when the socket is full,
+     * and we wait for the socket in the event loop and resume.
+     *
+     * @param {http.ServerResponse} res
+     */
+    async sendfile_into_response(res) {
+        // send the headers and wait for all pending socket writes to complete
+        // before the kernel starts writing the body directly to the socket fd.
+        res.flushHeaders();
+        const socket = res.socket;
+        await new Promise((resolve, reject) => socket.write(Buffer.alloc(0), err => (err ? reject(err) : resolve())));
+        // @ts-ignore
+        const socket_fd = socket._handle.fd;
+        while (this.pos < this.end) {
+            await this._warmup_sparse_file(this.pos);
+            this.signal.throwIfAborted();
+            const len = Math.min(this.end - this.pos, config.NSFS_SENDFILE_CHUNK_SIZE);
+            this._send_cache_hints();
+            const { bytes, again } = await this.file.sendfile(this.fs_context, socket_fd, this.pos, len);
+            if (bytes) {
+                this.pos += bytes;
+                this._update_stats(bytes);
+            } else if (!again) {
+                throw new Error(`FileReader sendfile reached EOF at ${this.pos} before the end ${this.end} of ${this.file_path}`);
+            }
+            if (again) await this._wait_for_socket(socket, socket_fd);
+        }
+    }
+
+    /**
+     * Waits for a full socket to become writable before resuming sendfile.
+     * sendfile writes to the fd behind the back of the node socket, so node does not emit drain for it,
+     * and the native wait polls the fd in the event loop. The wait returns every NSFS_SENDFILE_WRITABLE_TIMEOUT_MS
+     * to check if the request was aborted or the socket was closed while the peer is not reading.
+     * @param {import('net').Socket} socket
+     * @param {number} socket_fd
+     */
+    async _wait_for_socket(socket, socket_fd) {
+        for (;;) {
+            // checked before every native wait, which dups the fd, so the fd cannot belong to another socket
+            if (socket.destroyed) throw new Error(`FileReader sendfile socket closed at ${this.pos} of ${this.file_path}`);
+            this.signal.throwIfAborted();
+            if (await nb_native().fs.wait_writable(socket_fd, config.NSFS_SENDFILE_WRITABLE_TIMEOUT_MS)) return;
+        }
+    }
+
+    /**
+     * sendfile can be used only when writing directly to an unencrypted socket of an http response.
+     * @param {stream.Writable} target_stream
+     * @returns {boolean}
+     */
+    _can_sendfile(target_stream) {
+        if (!config.NSFS_SENDFILE_ENABLED) return false;
+        if (!(target_stream instanceof http.ServerResponse)) return false;
+        if (!target_stream.hasHeader('content-length')) return false;
+        const socket = target_stream.socket;
+        // @ts-ignore
+        const fd = socket?._handle?.fd;
+        // @ts-ignore
+        return Boolean(socket && !socket.encrypted && fd >= 0 && this.file.sendfile);
+    }
+
     /**
      * @param {number} size 
      */
@@ -217,6 +301,39 @@ class FileReader extends stream.Readable {
         });
     }
 
+    /**
+     * Sends page cache hints for the current position without waiting for them -
+     * readahead keeps the next readahead_size bytes loading while the current read is consumed,
+     * and drop_behind releases the pages that were already read so that scans do not evict hot objects.
+     * Only one hint is in flight at a time, and hint errors are ignored since they do not affect the data.
+     * The caller must call wait_for_hints() before closing the file so that no hint runs on a closed fd.
+     */
+    _send_cache_hints() {
+        if (this.hint_promise) return;
+        let hint;
+        if (this.drop_behind && this.pos - this.drop_behind_pos >= config.NSFS_DROP_BEHIND_SIZE) {
+            hint = this.file.advise(this.fs_context, this.drop_behind_pos, this.pos - this.drop_behind_pos, 'dontneed');
+            this.drop_behind_pos = this.pos;
+        } else if (this.readahead_size > 0 && this.readahead_pos < this.end &&
+            this.readahead_pos - this.pos < this.readahead_size / 2) {
+            const pos = Math.max(this.readahead_pos, this.pos);
+            const len = Math.min(this.readahead_size, this.end - pos);
+            hint = this.file.readahead(this.fs_context, pos, len);
+            this.readahead_pos = pos + len;
+        }
+        if (!hint) return;
+        this.hint_promise = hint
+            .catch(err => dbg.warn('FileReader: cache hint failed', this.file_path, err.code || err))
+            .finally(() => { this.hint_promise = null; });
+    }
+
+    /**
+     * Waits for the cache hint in flight (if any) to finish. Never throws.
+     */
+    async wait_for_hints() {
+        if (this.hint_promise) await this.hint_promise;
+    }
+
     /**
      * @param {number} pos
      */
@@ -259,6 +376,7 @@ class NewlineReader {
      *  skip_leftover_line?: boolean;
      *  skip_overflow_lines?: boolean;
      *  read_file_offset?: number;
+     *  drop_behind?: boolean;
      * }} [cfg]
      **/
     constructor(fs_context, filepath, cfg) {
@@ -277,6 +395,9 @@ class NewlineReader {
         this.end = 0;
         this.overflow_state = false;
         this.next_line_file_offset = cfg?.read_file_offset || 0;
+        // drop the pages that were read from the page cache, for one pass scans of large files
+        this.drop_behind = Boolean(cfg?.drop_behind);
+        this.drop_behind_pos = this.read_file_offset;
     }
 
     info() {
@@ -340,6 +461,7 @@ class NewlineReader {
             const read = await this.fh.read(this.fs_context, this.buf, this.end, avail, this.read_file_offset);
             if (!read) {
                 this.eof = true;
+                await this._drop_behind(0);
 
                 // what to do with the leftover in the buffer on eof
                 if (this.end > this.start) {
@@ -358,6 +480,7 @@ class NewlineReader {
                 return null;
             }
             this.read_file_offset += read;
+            await this._drop_behind(config.NSFS_DROP_BEHIND_SIZE);
             this.end += read;
         }
 
@@ -397,12 +520,26 @@ class NewlineReader {
         return this.forEach(entry => cb(new NewlineReaderFilePathEntry(this.fs_context, entry)));
     }
 
+    /**
+     * @param {number} min_size drop only when at least this many bytes were read since the last drop
+     */
+    async _drop_behind(min_size) {
+        if (!this.drop_behind || this.read_file_offset - this.drop_behind_pos < Math.max(min_size, 1)) return;
+        try {
+            await this.fh.advise(this.fs_context, this.drop_behind_pos, this.read_file_offset - this.drop_behind_pos, 'dontneed');
+        } catch (err) {
+            dbg.warn('NewlineReader: drop behind failed', this.path, err.code || err);
+        }
+        this.drop_behind_pos = this.read_file_offset;
+    }
+
     // reset will reset the reader and will allow reading the file from
     // the beginning again, this does not reopens the file so if the file
     // was moved, this will still keep on reading from the previous FD.
     reset() {
         this.eof = false;
         this.read_file_offset = 0;
+        this.drop_behind_pos = 0;
         this.start = 0;
         this.end = 0;
         this.overflow_state = false;
@@ -35,8 +35,7 @@ class FileWriter extends stream.Writable {
         this.bucket = bucket;
         this.namespace_resource_id = namespace_resource_id;
         this.MD5Async = md5_enabled ? new (nb_native().crypto.MD5Async)() : undefined;
-        const platform_iov_max = nb_native().fs.PLATFORM_IOV_MAX;
-        this.iov_max = platform_iov_max ? Math.min(platform_iov_max, config.NSFS_DEFAULT_IOV_MAX) : config.NSFS_DEFAULT_IOV_MAX;
+        this.iov_max = config.NSFS_DEFAULT_IOV_MAX || Infinity;
     }
 
     /**
@@ -104,7 +103,8 @@ class FileWriter extends stream.Writable {
 
     /**
      * Writes an array of buffers to the target file,
-     * splitting them into batches if it exceeds the platform's IOV_MAX.
+     * splitting them into batches of config.NSFS_DEFAULT_IOV_MAX buffers when it is set.
+     * The native writev splits by the platform IOV_MAX and resumes partial writes by itself.
      * @param {Buffer[]} buffers 
      * @param {number} size 
      */
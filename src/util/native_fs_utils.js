@@ -66,6 +66,8 @@ async function _generate_unique_path(fs_context, tmp_dir_path) {
  * @param {string} bucket_path
  * @param {string} open_path 
  * @param {string} open_mode 
+ * @param {number} [file_permissions]
+ * @param {{ preallocate?: number, keep_size?: boolean }} [open_options] preallocate reserves the expected size on open
  */
 // opens open_path on POSIX, and on GPFS it will open open_path parent folder
 async function open_file(
@@ -74,6 +76,7 @@ async function open_file(
     open_path,
     open_mode = config.NSFS_OPEN_READ_MODE,
     file_permissions = config.BASE_MODE_FILE,
+    open_options = undefined,
 ) {
     let retries = config.NSFS_MKDIR_PATH_RETRIES;
 
@@ -88,7 +91,7 @@ async function open_file(
             }
             dbg.log1(`native_fs_utils: open_file mode=${open_mode}`, open_path);
             // for 'wt' open the tmpfile with the parent dir path
-            const fd = await nb_native().fs.open(fs_context, actual_open_path, open_mode, get_umasked_mode(file_permissions));
+            const fd = await nb_native().fs.open(fs_context, actual_open_path, open_mode, get_umasked_mode(file_permissions), open_options);
             return fd;
         } catch (err) {
             dbg.warn(`native_fs_utils: open_file error retries=${retries} mode=${open_mode} open_path=${open_path} dir_path=${dir_path} actual_open_path=${actual_open_path}`, err);
@@ -161,6 +164,27 @@ async function use_file({
  */
 async function copy_bytes(multi_buffers_pool, fs_context, src_file, dst_file, size, write_offset, read_offset) {
     dbg.log1(`Native_fs_utils.copy_bytes size=${size} read_offset=${read_offset} write_offset=${write_offset}`);
+    if (config.NSFS_COPY_FILE_RANGE_ENABLED && src_file.copy_range) {
+        // copy inside the kernel (reflink/copy_file_range) instead of reading into pool buffers,
+        // on failure the buffers copy below rewrites the whole range from the start
+        let res;
+        try {
+            res = await src_file.copy_range(fs_context, dst_file, Number(size), Number(read_offset || 0),
+                write_offset >= 0 ? write_offset : 0, config.NSFS_COPY_FILE_REFLINK);
+            dbg.log1('Native_fs_utils.copy_bytes: copy_range', res);
+        } catch (err) {
+            dbg.warn('Native_fs_utils.copy_bytes: copy_range failed, fallback to buffers copy', err);
+        }
+        if (res) {
+            // copy_range stops at the end of the source, a shorter source must not become a truncated object
+            if (res.bytes < Number(size)) {
+                const err = new Error(`copy_bytes: source is shorter than expected copied ${res.bytes} of ${size}`);
+                err.code = 'EIO';
+                throw err;
+            }
+            return;
+        }
+    }
     let buffer_pool_cleanup = null;
     try {
         let read_pos = Number(read_offset || 0);
@@ -390,6 +414,19 @@ async function stat_if_exists(fs_context, entry_path, use_lstat, should_ignore_e
 /// NON CONTAINERIZED //
 ////////////////////////
 
+/**
+ * clone_stat returns a shallow copy of a stat result with the given xattr.
+ * unlike a plain spread it keeps the prototype, where the accessors of compact stat results live.
+ * @param {nb.NativeFSStats} stat
+ * @param {nb.NativeFSXattr} xattr
+ * @returns {nb.NativeFSStats}
+ */
+function clone_stat(stat, xattr) {
+    const clone = Object.assign(Object.create(Object.getPrototypeOf(stat)), stat);
+    clone.xattr = xattr;
+    return clone;
+}
+
 function get_config_files_tmpdir() {
     return config.NSFS_TEMP_CONF_DIR_NAME;
 }
@@ -752,6 +789,18 @@ async function folder_delete(dir, fs_context, is_temp, silent_if_missing) {
     if (!exists && is_temp) {
         return;
     }
+    if (config.NSFS_NATIVE_RMTREE) {
+        try {
+            await rmtree(fs_context, dir);
+        } catch (err) {
+            if (err.code === 'ENOENT' && silent_if_missing) {
+                dbg.warn(`native_fs_utils.folder_delete already deleted, skipping`);
+                return;
+            }
+            throw err;
+        }
+        return;
+    }
     const entries = await nb_native().fs.readdir(fs_context, dir);
     const results = await Promise.all(entries.map(entry => {
         const fullPath = path.join(dir, entry.name);
@@ -774,6 +823,72 @@ async function folder_delete(dir, fs_context, is_temp, silent_if_missing) {
     }
 }
 
+// indexes of the progress array shared with the native rmtree (see RmtreeProgress in fs_napi.cpp)
+const RMTREE_CANCEL = 0;
+const RMTREE_FILES = 1;
+const RMTREE_DIRS = 2;
+const RMTREE_ERRORS = 3;
+const RMTREE_PROGRESS_LEN = 4;
+
+/**
+ * rmtree deletes a directory tree in native code, walking it with a bounded number of threads.
+ * Symlinks are unlinked and never followed, and entries that are already missing are ignored.
+ * Other errors do not stop the walk - the first of them is thrown when it completes,
+ * with the list of reported errors on err.errors.
+ * @param {nb.NativeFSContext} fs_context
+ * @param {string} dir
+ * @param {{
+ *      concurrency?: number,
+ *      signal?: AbortSignal,
+ *      on_progress?: (progress: { files: number, dirs: number, errors: number }) => void,
+ *      progress_interval_ms?: number,
+ * }} [options]
+ * @returns {Promise<{ files: number, dirs: number, error_count: number }>}
+ */
+async function rmtree(fs_context, dir, options = {}) {
+    const {
+        concurrency = config.NSFS_RMTREE_CONCURRENCY,
+        signal,
+        on_progress,
+        progress_interval_ms = 1000,
+    } = options;
+    signal?.throwIfAborted();
+    const progress = new Float64Array(RMTREE_PROGRESS_LEN);
+    const on_abort = () => {
+        progress[RMTREE_CANCEL] = 1;
+    };
+    const report_progress = () => on_progress({
+        files: progress[RMTREE_FILES],
+        dirs: progress[RMTREE_DIRS],
+        errors: progress[RMTREE_ERRORS],
+    });
+    signal?.addEventListener('abort', on_abort);
+    const progress_interval = on_progress && setInterval(report_progress, progress_interval_ms);
+    try {
+        const res = await nb_native().fs.rmtree(fs_context, dir, { concurrency, progress });
+        if (on_progress) report_progress();
+        if (res.cancelled) {
+            signal?.throwIfAborted();
+            // the native op stopped before deleting the tree, which must not look like success
+            const err = new Error(`native_fs_utils.rmtree cancelled before deleting ${dir}`);
+            err.name = 'AbortError';
+            err.code = 'ABORT_ERR';
+            throw err;
+        }
+        if (res.errors.length) {
+            const { path: err_path, code } = res.errors[0];
+            const err = new Error(`native_fs_utils.rmtree failed to delete ${err_path} (${res.error_count} errors)`);
+            err.code = code;
+            err.errors = res.errors;
+            throw err;
+        }
+        return res;
+    } finally {
+        clearInterval(progress_interval);
+        signal?.removeEventListener('abort', on_abort);
+    }
+}
+
 /**
  * read_file reads file and returns the parsed file data as object
  * @param {nb.NativeFSContext} fs_context
@@ -965,6 +1080,7 @@ async function warmup_sparse_file(fs_context, file, file_path, stat, pos) {
     await file.read(fs_context, warmup_buffer, 0, 1, pos);
 }
 
+exports.clone_stat = clone_stat;
 exports.get_umasked_mode = get_umasked_mode;
 exports._make_path_dirs = _make_path_dirs;
 exports._create_path = _create_path;
@@ -1006,6 +1122,7 @@ exports.validate_bucket_creation = validate_bucket_creation;
 exports.is_path_exists = is_path_exists;
 exports.is_dir_accessible = is_dir_accessible;
 exports.folder_delete = folder_delete;
+exports.rmtree = rmtree;
 exports.unlink_ignore_enoent = unlink_ignore_enoent;
 exports.get_bucket_tmpdir_full_path = get_bucket_tmpdir_full_path;
 exports.get_bucket_tmpdir_name = get_bucket_tmpdir_name;
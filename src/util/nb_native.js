@@ -28,6 +28,8 @@ function nb_native() {
     inherits(nb_native_nan.Ntcp, events.EventEmitter);
     _.defaults(nb_native_napi, nb_native_nan);
 
+    init_fs_config();
+
     if (process.env.DISABLE_INIT_RANDOM_SEED !== 'true') {
         init_rand_seed();
     }
@@ -35,6 +37,101 @@ function nb_native() {
     return nb_native_napi;
 }
 
+/**
+ * apply the native fs module settings from config
+ */
+function init_fs_config() {
+    nb_native_napi.fs.dir_cache_config({
+        max_entries: config.NSFS_DIR_FD_CACHE_SIZE,
+        validate_ms: config.NSFS_DIR_FD_CACHE_VALIDATE_MS,
+    });
+    nb_native_napi.fs.object_cache_config({
+        max_entries: config.NSFS_OBJECT_CACHE_SIZE,
+        max_bytes: config.NSFS_OBJECT_CACHE_MAX_BYTES,
+        max_object_size: config.NSFS_OBJECT_CACHE_MAX_OBJECT_SIZE,
+    });
+    nb_native_napi.fs.fd_cache_config({
+        max_entries: config.NSFS_FD_CACHE_SIZE,
+        idle_ttl_ms: config.NSFS_FD_CACHE_IDLE_TTL_MS,
+        validate_ms: config.NSFS_FD_CACHE_VALIDATE_MS,
+    });
+    nb_native_napi.fs.config_cache_config({
+        max_entries: config.NSFS_CONFIG_CACHE_SIZE,
+        max_bytes: config.NSFS_CONFIG_CACHE_MAX_BYTES,
+        max_file_size: config.NSFS_CONFIG_CACHE_MAX_FILE_SIZE,
+        validate_ms: config.NSFS_CONFIG_CACHE_VALIDATE_MS,
+        watch: config.NSFS_CONFIG_CACHE_WATCH,
+    });
+    nb_native_napi.fs.xattr_config({
+        buf_size: config.NSFS_XATTR_BUF_SIZE,
+        packed: config.NSFS_XATTR_PACKED,
+    });
+    nb_native_napi.fs.latency_stats_config({
+        enabled: config.NSFS_FS_NATIVE_STATS,
+    });
+    nb_native_napi.fs.stat_config({
+        compact_class: config.NSFS_STAT_COMPACT ? make_compact_stat_class(nb_native_napi.fs.STAT_COMPACT_FIELDS) : undefined,
+    });
+    if (config.NSFS_FS_POOL_META_THREADS > 0 || config.NSFS_FS_POOL_DATA_THREADS > 0 || config.NSFS_FS_POOL_LOCK_THREADS > 0) {
+        nb_native_napi.fs.fs_pool_config({
+            meta_threads: config.NSFS_FS_POOL_META_THREADS,
+            data_threads: config.NSFS_FS_POOL_DATA_THREADS,
+            lock_threads: config.NSFS_FS_POOL_LOCK_THREADS,
+        });
+    }
+    if (config.NSFS_FSYNC_GROUP_ENABLED) {
+        nb_native_napi.fs.fsync_group_config({
+            enabled: true,
+            window_us: config.NSFS_FSYNC_GROUP_WINDOW_US,
+            max_batch: config.NSFS_FSYNC_GROUP_MAX_BATCH,
+            syncfs: config.NSFS_FSYNC_GROUP_SYNCFS,
+        });
+    }
+    if (config.NSFS_DIO_SLAB_ENABLED) {
+        nb_native_napi.fs.dio_slab_config({
+            sizes: [
+                config.NSFS_BUF_SIZE_XS,
+                config.NSFS_BUF_SIZE_S,
+                config.NSFS_BUF_SIZE_M,
+                config.NSFS_BUF_SIZE_L,
+                config.NSFS_BUF_SIZE_XL,
+            ],
+            max_bytes: config.NSFS_DIO_SLAB_MAX_BYTES,
+            thread_cache: config.NSFS_DIO_SLAB_THREAD_CACHE,
+            hugepages: config.NSFS_DIO_SLAB_HUGEPAGES,
+        });
+    }
+}
+
+/**
+ * Creates the class of compact stat results - the native code passes a Float64Array
+ * of the stat fields (ordered by STAT_COMPACT_FIELDS) and the accessors decode them,
+ * so Dates and BigInts are created only when a caller actually reads them.
+ * @param {string[]} fields
+ */
+function make_compact_stat_class(fields) {
+    class CompactStat {
+        /** @param {Float64Array} f */
+        constructor(f) {
+            this._f = f;
+        }
+    }
+    const index = _.invert(fields);
+    const define = (name, get) => Object.defineProperty(CompactStat.prototype, name, { get, enumerable: true });
+    for (const [i, name] of fields.entries()) {
+        if (!name.endsWith('Ns')) define(name, function() { return this._f[i]; });
+    }
+    for (const t of ['atime', 'mtime', 'ctime', 'birthtime']) {
+        const i = Number(index[t + 'Ms']);
+        define(t, function() { return new Date(Math.round(this._f[i])); });
+    }
+    for (const t of ['atime', 'mtime', 'ctime']) {
+        const i = Number(index[t + 'Ns']);
+        define(t + 'NsBigint', function() { return BigInt(this._f[i]); });
+    }
+    return CompactStat;
+}
+
 // extend prototype
 function inherits(target, source) {
     _.forIn(source.prototype, function(v, k) {
@@ -106,3 +203,4 @@ async function read_rand_seed(seed_bytes) {
 }
 
 module.exports = nb_native;
+module.exports.make_compact_stat_class = make_compact_stat_class;
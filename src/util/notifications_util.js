@@ -585,8 +585,9 @@ function check_notif_relevant(notif, req) {
 /**
  *
  * @param {"SHARED" | "EXCLUSIVE"} locking counterintuitively, either 'SHARED' for writing or 'EXCLUSIVE' for reading
+ * @param {boolean} [native_writer] append through the native batched writer (see config.NSFS_LOGGER_NATIVE_WRITER)
  */
-function get_notification_logger(locking, namespace, poll_interval) {
+function get_notification_logger(locking, namespace, poll_interval, native_writer) {
     if (!namespace) {
         const node_name = process.env.NODE_NAME || os.hostname();
         namespace = node_name + '_' + config.NOTIFICATION_LOG_NS;
@@ -595,6 +596,7 @@ function get_notification_logger(locking, namespace, poll_interval) {
     const logger = new PersistentLogger(config.NOTIFICATION_LOG_DIR, namespace, {
         locking,
         poll_interval,
+        native_writer,
     });
 
     //initialize writes_counter, used in check_free_space
@@ -10,6 +10,10 @@ const dbg = require('./debug_module')(__filename);
 const P = require('../util/promise');
 const config = require('../../config');
 
+// the open native writers of this process, for the nsfs stats (see endpoint_stats_collector)
+/** @type {Set<nb.LogWriter>} */
+const native_writers = new Set();
+
 /**
  * PersistentLogger is a logger that is used to record data onto disk separated by newlines.
  * 
@@ -25,6 +29,7 @@ class PersistentLogger {
      * @param {{
      *  poll_interval?: Number,
      *  locking?: "SHARED" | "EXCLUSIVE",
+     *  native_writer?: boolean,
      * }} cfg 
      */
     constructor(dir, namespace, cfg) {
@@ -44,10 +49,20 @@ class PersistentLogger {
 
         this.init_lock = new semaphore.Semaphore(1);
 
-        if (cfg.poll_interval) this._poll_active_file_change(cfg.poll_interval);
+        // with native_writer the records are appended to a native ring buffer and written in batches,
+        // and the native writer also reopens the active file when it is replaced (instead of polling here).
+        /** @type {nb.LogWriter} */
+        this.writer = null;
+        this.native_writer = Boolean(cfg.native_writer);
+        this.flushed_seq = 0;
+        this.flush_waiters = [];
+        this.flushing = false;
+
+        if (cfg.poll_interval && !this.native_writer) this._poll_active_file_change(cfg.poll_interval);
     }
 
     async init() {
+        if (this.native_writer) return this._init_writer();
         if (this.fh) return this.fh;
 
         return this.init_lock.surround(async () => {
@@ -73,6 +88,7 @@ class PersistentLogger {
      * @param {string} data 
      */
     async append(data) {
+        if (this.native_writer) return this._append_native(data);
         const fh = await this.init();
 
         const buf = Buffer.from(data + '\n', 'utf8');
@@ -81,6 +97,13 @@ class PersistentLogger {
     }
 
     async close() {
+        if (this.writer) {
+            const writer = this.writer;
+            this.writer = null;
+            native_writers.delete(writer);
+            await writer.close();
+            return;
+        }
         const fh = this.fh;
 
         this.fh = null;
@@ -90,6 +113,86 @@ class PersistentLogger {
         if (fh) await fh.close(this.fs_context);
     }
 
+    async _init_writer() {
+        if (this.writer) return this.writer;
+
+        return this.init_lock.surround(async () => {
+            if (this.writer) return this.writer;
+
+            await native_fs_utils._create_path(this.dir, this.fs_context);
+            const writer = new (nb_native().LogWriter)({
+                dir: this.dir,
+                namespace: this.namespace,
+                lock: this.locking || undefined,
+                buffer_size: config.NSFS_LOGGER_NATIVE_BUFFER_SIZE,
+                flush_size: config.NSFS_LOGGER_NATIVE_FLUSH_SIZE,
+                flush_interval_ms: config.NSFS_LOGGER_NATIVE_FLUSH_INTERVAL_MS,
+                fsync: config.NSFS_LOGGER_NATIVE_FSYNC,
+                rotate_size: config.NSFS_LOGGER_NATIVE_ROTATE_SIZE,
+                rotate_age_ms: config.NSFS_LOGGER_NATIVE_ROTATE_AGE_MS,
+                reopen_check_ms: this.cfg.poll_interval || 0,
+            });
+            await writer.open();
+            this.writer = writer;
+            native_writers.add(writer);
+            this.flushed_seq = 0;
+            return writer;
+        });
+    }
+
+    /**
+     * appends the record to the native ring buffer, and waits for a flush that covers it.
+     * concurrent appends share the same flush, so a batch of records costs a single write and sync.
+     * @param {string} data
+     */
+    async _append_native(data) {
+        const writer = await this._init_writer();
+        const buf = Buffer.from(data + '\n', 'utf8');
+        let seq;
+        for (;;) {
+            try {
+                seq = writer.append(buf);
+                break;
+            } catch (err) {
+                if (err.code !== 'ENOBUFS') throw err;
+                // the buffer is full - wait for the flusher to make room
+                await this._wait_flushed(Infinity);
+            }
+        }
+        await this._wait_flushed(seq);
+        this.local_size += buf.length;
+    }
+
+    /**
+     * @param {number} seq
+     */
+    async _wait_flushed(seq) {
+        if (seq <= this.flushed_seq) return;
+        return new Promise((resolve, reject) => {
+            this.flush_waiters.push({ resolve, reject });
+            if (!this.flushing) this._flush_loop();
+        });
+    }
+
+    async _flush_loop() {
+        this.flushing = true;
+        try {
+            while (this.flush_waiters.length) {
+                // every waiter appended before this flush started, so it covers all of them
+                const waiters = this.flush_waiters;
+                this.flush_waiters = [];
+                try {
+                    this.flushed_seq = await this.writer.flush();
+                    for (const w of waiters) w.resolve();
+                } catch (err) {
+                    for (const w of waiters) w.reject(err);
+                }
+            }
+        } finally {
+            this.flushing = false;
+        }
+    }
+
     async remove() {
         try {
             await nb_native().fs.unlink(this.fs_context, this.active_path);
@@ -404,4 +507,5 @@ class LogFile {
 }
 
 exports.PersistentLogger = PersistentLogger;
+exports.native_writers = native_writers;
 exports.LogFile = LogFile;
@@ -30,7 +30,11 @@ const iam_op_names = [
     `list_access_keys`,
 ];
 
+// the fields of the reported op stats (see OpStats in endpoint_stats_collector), other numeric fields are extra counters
+const op_stats_fields = ['count', 'error_count', 'min_time', 'max_time', 'sum_time'];
+
 function update_nsfs_stats(op_name, stats, new_data) {
+    const prev = stats[op_name];
     //In the event of all of the same ops are failing (count = error_count) we will not masseur the op times
     // As this is intended as a timing masseur and not a counter.
     if (stats[op_name]) {
@@ -60,6 +64,13 @@ function update_nsfs_stats(op_name, stats, new_data) {
             error_count: new_data.error_count,
         };
     }
+    // extra counters of an op (e.g fsync_group requests) are summed, or kept at the max for max_*
+    if (!stats[op_name]) return;
+    for (const [key, value] of Object.entries(new_data)) {
+        if (op_stats_fields.includes(key) || typeof value !== 'number') continue;
+        const old = prev?.[key];
+        stats[op_name][key] = key.startsWith('max') ? Math.max(old ?? value, value) : (old ?? 0) + value;
+    }
 }
 
 exports.op_names = op_names;